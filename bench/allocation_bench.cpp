@@ -0,0 +1,386 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Microbenchmark of the agent's device memory allocation tracking.  Each
+   thread keeps a working set of allocations, and repeatedly frees the oldest
+   and allocates a new one through a stand-in for the runtime.  The cost of
+   an allocate and free pair is measured with 1 to 64 threads without
+   tracking, with tracking, and with tracking and backtraces, and the
+   tracking overhead of a single thread is checked against its budget.  */
+
+#include "allocation_tracker.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace amd::debug_agent;
+
+namespace
+{
+
+/* The overhead budget of the tracking, per allocate and free pair, above
+   the cost of the runtime functions.  Allocating device memory takes tens
+   of microseconds in the runtime and the kernel driver.  Unwinding the stack
+   costs a few hundred nanoseconds per frame, the backtraces have their own
+   budget.  */
+constexpr double budget_ns = 500;
+constexpr double backtrace_budget_ns = 8000;
+
+/* The backtrace depth recorded by default by --track-allocations.  */
+constexpr size_t backtrace_depth = 16;
+
+/* The number of frames above the allocating functions, an application
+   allocates through the language runtime.  */
+constexpr size_t stack_depth = 16;
+
+constexpr uint64_t block_size = 64 * 1024;
+
+/* Free and allocate blocks this many times before the measurement, so that
+   the tracker reuses the nodes of the allocations it forgets as in a long
+   running application.  */
+constexpr size_t warmup_iterations = 10000;
+
+/* The addresses handed out by the runtime, a thread only allocates its
+   own.  */
+thread_local uint64_t next_thread_address;
+
+/* Stand-ins for the runtime functions.  */
+__attribute__ ((noinline)) int
+runtime_allocate (size_t size, void **ptr)
+{
+  *ptr = reinterpret_cast<void *> (next_thread_address);
+  next_thread_address += size;
+  return 0;
+}
+
+__attribute__ ((noinline)) int
+runtime_free (void *ptr)
+{
+  return ptr ? 0 : 1;
+}
+
+/* The interception without any bookkeeping.  */
+struct direct_t
+{
+  static constexpr const char *name = "direct";
+
+  int
+  allocate (size_t size, void **ptr)
+  {
+    return runtime_allocate (size, ptr);
+  }
+
+  int
+  free (void *ptr)
+  {
+    return runtime_free (ptr);
+  }
+};
+
+/* The agent's interception, with backtraces of DEPTH frames.  */
+template <size_t Depth> struct tracked_t
+{
+  static constexpr const char *name
+      = Depth ? "tracked_backtrace" : "tracked";
+
+  tracked_t () { m_tracker->set_backtrace_depth (Depth); }
+
+  __attribute__ ((noinline)) int
+  allocate (size_t size, void **ptr)
+  {
+    int status = runtime_allocate (size, ptr);
+    if (!status)
+      m_tracker->allocated (*ptr, size, 0);
+    return status;
+  }
+
+  __attribute__ ((noinline)) int
+  free (void *ptr)
+  {
+    m_tracker->freed (ptr);
+    return runtime_free (ptr);
+  }
+
+  std::unique_ptr<allocation_tracker_t> m_tracker{
+    std::make_unique<allocation_tracker_t> ()
+  };
+};
+
+/* Call FUNCTION from DEPTH nested frames.  */
+__attribute__ ((noinline)) void
+call_at_depth (size_t depth, const std::function<void ()> &function)
+{
+  if (depth)
+    call_at_depth (depth - 1, function);
+  else
+    function ();
+
+  /* Prevent the tail call.  */
+  asm volatile ("" ::: "memory");
+}
+
+struct result_t
+{
+  std::string name;
+  size_t thread_count;
+  /* Average time a thread spends freeing and allocating a block.  */
+  double ns_per_pair;
+};
+
+template <typename Interceptor>
+result_t
+run (size_t thread_count, size_t iterations, size_t live_per_thread)
+{
+  Interceptor interceptor;
+  std::atomic<size_t> ready{ 0 };
+  std::atomic<bool> go{ false };
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < thread_count; ++i)
+    threads.emplace_back ([&, i] () {
+      next_thread_address = (0x7f00ull + i) << 32;
+      std::vector<void *> blocks (live_per_thread);
+
+      call_at_depth (stack_depth, [&] () {
+        auto free_and_allocate = [&] (size_t count) {
+          for (size_t iteration = 0; iteration < count; ++iteration)
+            {
+              void *&block = blocks[iteration % blocks.size ()];
+              if (interceptor.free (block)
+                  || interceptor.allocate (block_size, &block))
+                abort ();
+            }
+        };
+
+        for (auto &block : blocks)
+          if (interceptor.allocate (block_size, &block))
+            abort ();
+        free_and_allocate (warmup_iterations);
+
+        ready.fetch_add (1);
+        while (!go.load ())
+          std::this_thread::yield ();
+
+        free_and_allocate (iterations);
+      });
+    });
+
+  while (ready.load () != thread_count)
+    std::this_thread::yield ();
+
+  const auto start = std::chrono::steady_clock::now ();
+  go.store (true);
+  for (auto &thread : threads)
+    thread.join ();
+  const std::chrono::duration<double, std::nano> elapsed
+      = std::chrono::steady_clock::now () - start;
+
+  return { Interceptor::name, thread_count, elapsed.count () / iterations };
+}
+
+void
+write_json (std::ostream &os, size_t iterations, size_t live_per_thread,
+            const std::vector<result_t> &results)
+{
+  os << "{\n"
+     << "  \"benchmark\": \"allocation\",\n"
+     << "  \"iterations\": " << iterations << ",\n"
+     << "  \"live_per_thread\": " << live_per_thread << ",\n"
+     << "  \"backtrace_depth\": " << backtrace_depth << ",\n"
+     << std::fixed << std::setprecision (1)
+     << "  \"budget_ns\": " << budget_ns << ",\n"
+     << "  \"backtrace_budget_ns\": " << backtrace_budget_ns << ",\n"
+     << "  \"results\": [";
+
+  for (size_t i = 0; i < results.size (); ++i)
+    os << (i ? ",\n" : "\n") << "    { \"interceptor\": \""
+       << results[i].name << "\", \"threads\": " << results[i].thread_count
+       << ", \"ns_per_pair\": " << results[i].ns_per_pair << " }";
+
+  os << "\n  ]\n}\n";
+}
+
+void
+print_usage ()
+{
+  std::cerr
+      << "Usage: rocm-debug-agent-allocation-bench [options]" << std::endl
+      << std::endl
+      << "  -o, --output=FILE       Write the results as JSON to FILE"
+      << std::endl
+      << "  -t, --max-threads=N     Largest number of threads (default 64)"
+      << std::endl
+      << "  -n, --iterations=N      Free and allocate a block N times per"
+      << std::endl
+      << "                          thread (default 100000)" << std::endl
+      << "  -p, --live=N            Blocks allocated by each thread at a time"
+      << std::endl
+      << "                          (default 256)" << std::endl
+      << "  -q, --quick             Run fewer iterations" << std::endl
+      << "  -h, --help              Display a usage message and exit"
+      << std::endl;
+}
+
+} /* namespace */
+
+int
+main (int argc, char **argv)
+{
+  std::string output_file;
+  size_t max_threads = 64;
+  size_t iterations = 100000;
+  size_t live_per_thread = 256;
+
+  static const struct option long_options[]
+      = { { "output", required_argument, 0, 'o' },
+          { "max-threads", required_argument, 0, 't' },
+          { "iterations", required_argument, 0, 'n' },
+          { "live", required_argument, 0, 'p' },
+          { "quick", no_argument, 0, 'q' },
+          { "help", no_argument, 0, 'h' },
+          { 0, 0, 0, 0 } };
+
+  int c;
+  while ((c = getopt_long (argc, argv, "o:t:n:p:qh", long_options, nullptr))
+         != -1)
+    {
+      try
+        {
+          switch (c)
+            {
+            case 'o':
+              output_file = optarg;
+              break;
+            case 't':
+              max_threads = std::stoul (optarg);
+              break;
+            case 'n':
+              iterations = std::stoul (optarg);
+              break;
+            case 'p':
+              live_per_thread = std::stoul (optarg);
+              break;
+            case 'q':
+              iterations = 1000;
+              break;
+            case 'h':
+              print_usage ();
+              return EXIT_SUCCESS;
+            default:
+              print_usage ();
+              return EXIT_FAILURE;
+            }
+        }
+      catch (...)
+        {
+          print_usage ();
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (!iterations || !live_per_thread)
+    {
+      print_usage ();
+      return EXIT_FAILURE;
+    }
+
+  std::cout << "   threads    direct   tracked  tracked_backtrace  (ns/pair)"
+            << std::endl;
+
+  std::vector<result_t> results;
+  std::optional<double> overhead, backtrace_overhead;
+  for (size_t thread_count = 1; thread_count <= max_threads;
+       thread_count *= 2)
+    {
+      results.emplace_back (
+          run<direct_t> (thread_count, iterations, live_per_thread));
+      results.emplace_back (
+          run<tracked_t<0>> (thread_count, iterations, live_per_thread));
+      results.emplace_back (run<tracked_t<backtrace_depth>> (
+          thread_count, iterations, live_per_thread));
+
+      auto row = results.end () - 3;
+      std::cout << std::fixed << std::setprecision (1) << std::setw (10)
+                << thread_count << std::setw (10) << row[0].ns_per_pair
+                << std::setw (10) << row[1].ns_per_pair << std::setw (19)
+                << row[2].ns_per_pair << std::endl;
+
+      if (thread_count == 1)
+        {
+          overhead = row[1].ns_per_pair - row[0].ns_per_pair;
+          backtrace_overhead = row[2].ns_per_pair - row[0].ns_per_pair;
+        }
+    }
+
+  if (!output_file.empty ())
+    {
+      std::ofstream os (output_file);
+      write_json (os, iterations, live_per_thread, results);
+      if (!os)
+        {
+          std::cerr << "could not write `" << output_file << "'" << std::endl;
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    write_json (std::cout, iterations, live_per_thread, results);
+
+  if (overhead && *overhead > budget_ns)
+    {
+      std::cerr << "tracking overhead of " << *overhead
+                << " ns per allocation exceeds the budget of " << budget_ns
+                << " ns" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (backtrace_overhead && *backtrace_overhead > backtrace_budget_ns)
+    {
+      std::cerr << "tracking overhead with backtraces of "
+                << *backtrace_overhead
+                << " ns per allocation exceeds the budget of "
+                << backtrace_budget_ns << " ns" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,527 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* CPU-only microbenchmark for code_object_t.  Synthetic AMDGPU code objects
+   of increasing size are generated with libelf, and the time to open them,
+   to load their symbol and line number tables, and to look up addresses is
+   written as JSON so that regressions can be tracked.  A working set of many
+   small code objects, as loaded by a JIT compiler, is then looked up with
+   and without a code object memory limit.  */
+
+#include "code_object.h"
+#include "elf_fixture.h"
+
+#include <getopt.h>
+#include <libelf.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace amd::debug_agent;
+using namespace amd::debug_agent::bench;
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+/* Stop timing a lookup after this long, so that the slow paths of the
+   largest fixtures do not dominate the run.  */
+constexpr auto lookup_time_limit = std::chrono::milliseconds (200);
+
+/* Same context as code_object_t::disassemble.  */
+constexpr amd_dbgapi_size_t context_byte_size = 24;
+
+struct result_t
+{
+  elf_fixture_params_t params;
+  size_t file_size;
+  double open_ns;
+  double load_symbol_map_ns;
+  double load_debug_info_ns;
+  double find_symbol_ns;
+  double find_line_ns;
+  double disassembly_range_ns;
+  double first_source_line_ns;
+};
+
+/* Lookups in many code objects with a memory limit.  */
+struct working_set_result_t
+{
+  size_t code_object_count;
+  size_t memory_limit;
+  double lookup_ns;
+  code_object_memory_stats_t memory;
+};
+
+double
+median (std::vector<double> values)
+{
+  std::sort (values.begin (), values.end ());
+  size_t middle = values.size () / 2;
+  return values.size () % 2
+             ? values[middle]
+             : (values[middle - 1] + values[middle]) / 2;
+}
+
+template <typename Function>
+double
+elapsed_ns (Function &&function)
+{
+  auto start = clock_type::now ();
+  function ();
+  return std::chrono::duration<double, std::nano> (clock_type::now () - start)
+      .count ();
+}
+
+/* Return the average time of `function (address)` for up to `max_lookups`
+   addresses, or until `lookup_time_limit` has elapsed.  */
+template <typename Function>
+double
+ns_per_lookup (const std::vector<amd_dbgapi_global_address_t> &addresses,
+               size_t max_lookups, Function &&function)
+{
+  constexpr size_t batch_size = 64;
+  size_t lookups = 0;
+
+  auto start = clock_type::now ();
+  while (lookups < max_lookups
+         && clock_type::now () - start < lookup_time_limit)
+    for (size_t i = 0; i < batch_size && lookups < max_lookups; ++i)
+      function (addresses[lookups++ % addresses.size ()]);
+
+  return std::chrono::duration<double, std::nano> (clock_type::now () - start)
+             .count ()
+         / lookups;
+}
+
+result_t
+run_fixture (const std::string &directory, const elf_fixture_params_t &params,
+             size_t repetitions, size_t max_lookups)
+{
+  elf_fixture_t fixture
+      = write_elf_fixture (directory + "/fixture.so", params);
+  std::string uri = "file://" + fixture.path;
+
+  result_t result{ params, fixture.file_size };
+
+  /* Pseudo-random, but reproducible, instruction addresses in .text.  */
+  std::vector<amd_dbgapi_global_address_t> addresses (4096);
+  uint64_t state = 0x9e3779b97f4a7c15;
+  for (auto &&address : addresses)
+    {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      address = fixture.text_address
+                + (state % fixture.text_size & ~uint64_t{ 3 });
+    }
+
+  /* The symbol and line number tables are loaded by the first lookup, so
+     time the first lookup of a freshly opened code object.  */
+  std::vector<double> open_ns, load_symbol_map_ns, load_debug_info_ns;
+  for (size_t i = 0; i < repetitions; ++i)
+    {
+      code_object_t code_object (uri, 0);
+
+      open_ns.emplace_back (elapsed_ns ([&] () { code_object.open (); }));
+      if (!code_object.is_open ())
+        throw std::runtime_error ("could not open `" + uri + "'");
+
+      load_symbol_map_ns.emplace_back (elapsed_ns (
+          [&] () { code_object.find_symbol (fixture.text_address); }));
+      load_debug_info_ns.emplace_back (elapsed_ns (
+          [&] () { code_object.find_line (fixture.text_address); }));
+    }
+
+  result.open_ns = median (open_ns);
+  result.load_symbol_map_ns = median (load_symbol_map_ns);
+  result.load_debug_info_ns = median (load_debug_info_ns);
+
+  code_object_t code_object (uri, 0);
+  code_object.open ();
+
+  result.find_symbol_ns = ns_per_lookup (
+      addresses, max_lookups,
+      [&] (auto address) { code_object.find_symbol (address); });
+  result.find_line_ns = ns_per_lookup (
+      addresses, max_lookups,
+      [&] (auto address) { code_object.find_line (address); });
+  result.disassembly_range_ns
+      = ns_per_lookup (addresses, max_lookups, [&] (auto address) {
+          code_object.disassembly_range (address, context_byte_size);
+        });
+
+  /* The disassembly prints the source lines between two consecutive line
+     table rows.  Rows are 2 lines apart, so each lookup has a line that is
+     not in the table.  */
+  result.first_source_line_ns
+      = ns_per_lookup (addresses, max_lookups, [&] (auto address) {
+          if (auto line = code_object.find_line (address); line)
+            code_object.first_source_line (line->first, line->second,
+                                           line->first, line->second - 4);
+        });
+
+  ::unlink (fixture.path.c_str ());
+  return result;
+}
+
+/* Open `code_object_count` copies of a small code object, each from a
+   distinct range of one file, and look up symbols and lines in them: 90% of
+   the lookups are in the first 10% of the code objects, the rest are spread
+   over all of them.  */
+working_set_result_t
+run_working_set (const std::string &directory, size_t code_object_count,
+                 size_t memory_limit, size_t max_lookups)
+{
+  elf_fixture_t fixture = write_elf_fixture (
+      directory + "/fixture.so", elf_fixture_params_t{ 64, 4, 64 });
+
+  std::vector<char> image (fixture.file_size);
+  {
+    std::ifstream file (fixture.path, std::ios::binary);
+    file.read (image.data (), image.size ());
+  }
+
+  const std::string path = directory + "/working_set.so";
+  {
+    std::ofstream file (path, std::ios::binary);
+    for (size_t i = 0; i < code_object_count; ++i)
+      file.write (image.data (), image.size ());
+    if (!file)
+      throw std::runtime_error ("could not write `" + path + "'");
+  }
+  ::unlink (fixture.path.c_str ());
+
+  set_code_object_memory_limit (memory_limit);
+  code_object_memory_stats ();
+
+  working_set_result_t result{ code_object_count, memory_limit };
+  {
+    std::vector<std::unique_ptr<code_object_t>> code_objects;
+    for (size_t i = 0; i < code_object_count; ++i)
+      {
+        code_objects.emplace_back (std::make_unique<code_object_t> (
+            "file://" + path + "#offset=" + std::to_string (i * image.size ())
+                + "&size=" + std::to_string (image.size ()),
+            0));
+        code_objects.back ()->open ();
+        if (!code_objects.back ()->is_open ())
+          throw std::runtime_error ("could not open `" + path + "'");
+      }
+
+    uint64_t state = 0x9e3779b97f4a7c15;
+    auto next = [&] () {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      return state;
+    };
+
+    const size_t hot_count = std::max<size_t> (1, code_object_count / 10);
+    auto start = clock_type::now ();
+    size_t lookups = 0;
+    for (; lookups < max_lookups
+           && clock_type::now () - start < 10 * lookup_time_limit;
+         ++lookups)
+      {
+        code_object_t &code_object
+            = *code_objects[next () % 10 ? next () % hot_count
+                                         : next () % code_object_count];
+        amd_dbgapi_global_address_t address
+            = fixture.text_address
+              + (next () % fixture.text_size & ~uint64_t{ 3 });
+        code_object.find_symbol (address);
+        code_object.find_line (address);
+      }
+
+    result.lookup_ns = std::chrono::duration<double, std::nano> (
+                           clock_type::now () - start)
+                           .count ()
+                       / lookups;
+    result.memory = code_object_memory_stats ();
+  }
+
+  set_code_object_memory_limit (0);
+  ::unlink (path.c_str ());
+  return result;
+}
+
+void
+write_json (std::ostream &os, const std::vector<result_t> &results,
+            const std::vector<working_set_result_t> &working_set_results,
+            size_t repetitions, size_t max_lookups)
+{
+  os << "{\n"
+     << "  \"benchmark\": \"code_object\",\n"
+     << "  \"repetitions\": " << repetitions << ",\n"
+     << "  \"max_lookups\": " << max_lookups << ",\n"
+     << "  \"results\": [";
+
+  os << std::fixed << std::setprecision (1);
+  for (size_t i = 0; i < results.size (); ++i)
+    {
+      const result_t &result = results[i];
+      os << (i ? ",\n" : "\n") << "    { "
+         << "\"symbols\": " << result.params.symbol_count
+         << ", \"cus\": " << result.params.cu_count
+         << ", \"lines_per_cu\": " << result.params.lines_per_cu
+         << ", \"file_bytes\": " << result.file_size
+         << ", \"open_ns\": " << result.open_ns
+         << ", \"load_symbol_map_ns\": " << result.load_symbol_map_ns
+         << ", \"load_debug_info_ns\": " << result.load_debug_info_ns
+         << ", \"find_symbol_ns\": " << result.find_symbol_ns
+         << ", \"find_line_ns\": " << result.find_line_ns
+         << ", \"disassembly_range_ns\": " << result.disassembly_range_ns
+         << ", \"first_source_line_ns\": " << result.first_source_line_ns
+         << " }";
+    }
+
+  os << "\n  ],\n  \"working_set\": [";
+  for (size_t i = 0; i < working_set_results.size (); ++i)
+    {
+      const working_set_result_t &result = working_set_results[i];
+      os << (i ? ",\n" : "\n") << "    { "
+         << "\"code_objects\": " << result.code_object_count
+         << ", \"memory_limit\": " << result.memory_limit
+         << ", \"lookup_ns\": " << result.lookup_ns
+         << ", \"file_bytes\": " << result.memory.peak_image_bytes
+         << ", \"peak_index_bytes\": " << result.memory.peak_index_bytes
+         << ", \"indices_built\": " << result.memory.index_build_count
+         << ", \"evictions\": " << result.memory.eviction_count << " }";
+    }
+
+  os << "\n  ]\n}\n";
+}
+
+void
+print_result (std::ostream &os, const result_t &result)
+{
+  auto us = [] (double ns) { return ns / 1000; };
+
+  os << std::fixed << std::setprecision (1) << std::setw (8)
+     << result.params.symbol_count << std::setw (6) << result.params.cu_count
+     << std::setw (8) << result.params.lines_per_cu << std::setw (11)
+     << result.file_size << std::setw (10) << us (result.open_ns)
+     << std::setw (10) << us (result.load_symbol_map_ns) << std::setw (10)
+     << us (result.load_debug_info_ns) << std::setw (10)
+     << result.find_symbol_ns << std::setw (10) << result.find_line_ns
+     << std::setw (10) << result.disassembly_range_ns << std::setw (12)
+     << result.first_source_line_ns << std::endl;
+}
+
+void
+print_working_set_result (std::ostream &os,
+                          const working_set_result_t &result)
+{
+  os << std::fixed << std::setprecision (1) << std::setw (8)
+     << result.code_object_count << std::setw (12) << result.memory_limit
+     << std::setw (12) << result.memory.peak_image_bytes << std::setw (12)
+     << result.memory.peak_index_bytes << std::setw (10)
+     << result.memory.index_build_count << std::setw (10)
+     << result.memory.eviction_count << std::setw (12) << result.lookup_ns
+     << std::endl;
+}
+
+void
+print_usage ()
+{
+  std::cerr
+      << "Usage: rocm-debug-agent-code-object-bench [options]" << std::endl
+      << std::endl
+      << "  -o, --output=FILE       Write the results as JSON to FILE"
+      << std::endl
+      << "  -r, --repetitions=N     Open each code object N times (default 5)"
+      << std::endl
+      << "  -l, --lookups=N         Time at most N lookups of each kind"
+      << std::endl
+      << "                          (default 100000)" << std::endl
+      << "  -n, --code-objects=N    Code objects of the working set (default"
+      << std::endl
+      << "                          4096)" << std::endl
+      << "  -q, --quick             Only run the smaller fixtures" << std::endl
+      << "  -h, --help              Display a usage message and exit"
+      << std::endl;
+}
+
+} /* namespace */
+
+int
+main (int argc, char **argv)
+{
+  std::string output_file;
+  size_t repetitions = 5, max_lookups = 100000, code_object_count = 4096;
+  bool quick = false;
+
+  static const struct option long_options[]
+      = { { "output", required_argument, 0, 'o' },
+          { "repetitions", required_argument, 0, 'r' },
+          { "lookups", required_argument, 0, 'l' },
+          { "code-objects", required_argument, 0, 'n' },
+          { "quick", no_argument, 0, 'q' },
+          { "help", no_argument, 0, 'h' },
+          { 0, 0, 0, 0 } };
+
+  int c;
+  while ((c = getopt_long (argc, argv, "o:r:l:n:qh", long_options, nullptr))
+         != -1)
+    {
+      switch (c)
+        {
+        case 'o':
+          output_file = optarg;
+          break;
+        case 'r':
+          repetitions = std::max (1ul, std::stoul (optarg));
+          break;
+        case 'l':
+          max_lookups = std::max (1ul, std::stoul (optarg));
+          break;
+        case 'n':
+          code_object_count = std::max (1ul, std::stoul (optarg));
+          break;
+        case 'q':
+          quick = true;
+          break;
+        case 'h':
+          print_usage ();
+          return EXIT_SUCCESS;
+        default:
+          print_usage ();
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (elf_version (EV_CURRENT) == EV_NONE)
+    {
+      std::cerr << "libelf initialization failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  /* Each sweep varies one dimension of the code object.  */
+  std::vector<elf_fixture_params_t> fixtures;
+  auto sweep = [&] (std::vector<size_t> values, auto &&make_params) {
+    if (quick)
+      values.resize (2);
+    for (size_t value : values)
+      fixtures.emplace_back (make_params (value));
+  };
+
+  sweep ({ 100, 1000, 10000, 100000 }, [] (size_t symbols) {
+    return elf_fixture_params_t{ symbols, 16, 256 };
+  });
+  sweep ({ 1, 16, 256, 4096 }, [] (size_t cus) {
+    return elf_fixture_params_t{ 1000, cus, 64 };
+  });
+  sweep ({ 256, 4096, 65536, 262144 }, [] (size_t lines) {
+    return elf_fixture_params_t{ 1000, 1, lines };
+  });
+
+  char directory_template[] = "/tmp/rocm-debug-agent-bench-XXXXXX";
+  const char *directory = ::mkdtemp (directory_template);
+  if (!directory)
+    {
+      std::cerr << "could not create a temporary directory" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  std::cout << " symbols   cus   lines      bytes   open_us  symtab_us"
+               "  dwarf_us  symbol_ns  line_ns  range_ns  srcline_ns"
+            << std::endl;
+
+  std::vector<result_t> results;
+  std::vector<working_set_result_t> working_set_results;
+  try
+    {
+      for (auto &&params : fixtures)
+        {
+          results.emplace_back (
+              run_fixture (directory, params, repetitions, max_lookups));
+          print_result (std::cout, results.back ());
+        }
+
+      std::cout << std::endl
+                << "    objs       limit  file_bytes index_bytes     built"
+                   "   evicted   lookup_ns"
+                << std::endl;
+
+      /* Without a limit, then with a quarter and a twentieth of the memory
+         the indices of the whole working set need.  */
+      working_set_results.emplace_back (
+          run_working_set (directory, code_object_count, 0, max_lookups));
+      print_working_set_result (std::cout, working_set_results.back ());
+
+      const size_t index_bytes
+          = working_set_results.back ().memory.peak_index_bytes;
+      for (size_t divisor : { 4, 20 })
+        {
+          working_set_results.emplace_back (
+              run_working_set (directory, code_object_count,
+                               index_bytes / divisor, max_lookups));
+          print_working_set_result (std::cout, working_set_results.back ());
+        }
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "error: " << e.what () << std::endl;
+      ::unlink ((std::string (directory) + "/fixture.so").c_str ());
+      ::unlink ((std::string (directory) + "/working_set.so").c_str ());
+      ::rmdir (directory);
+      return EXIT_FAILURE;
+    }
+
+  ::rmdir (directory);
+
+  if (!output_file.empty ())
+    {
+      std::ofstream os (output_file);
+      write_json (os, results, working_set_results, repetitions,
+                  max_lookups);
+      if (!os)
+        {
+          std::cerr << "could not write `" << output_file << "'" << std::endl;
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    write_json (std::cout, results, working_set_results, repetitions,
+                max_lookups);
+
+  return EXIT_SUCCESS;
+}
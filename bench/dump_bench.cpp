@@ -0,0 +1,411 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* End-to-end benchmark of the wavefront dump.  The agent's dump pipeline is
+   linked with the mock debugger API library, which simulates processes with
+   up to millions of waves, and the time, output size, and number of debugger
+   API calls per wave are written as JSON.  */
+
+#include "code_object.h"
+#include "dump.h"
+#include "logging.h"
+#include "mock_dbgapi.h"
+#include "queue_registry.h"
+#include "stats.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace amd::debug_agent;
+using namespace amd::debug_agent::bench;
+
+namespace
+{
+
+struct result_t
+{
+  size_t wave_count;
+  double seconds;
+  size_t bytes;
+  std::vector<std::pair<std::string, uint64_t>> call_counts;
+
+  uint64_t
+  call_count () const
+  {
+    uint64_t count = 0;
+    for (auto &&[name, calls] : call_counts)
+      count += calls;
+    return count;
+  }
+};
+
+result_t
+run_dump (const mock_process_config_t &config,
+          const dump_options_t &options)
+{
+  mock_dbgapi_configure (config);
+  mock_dbgapi_reset_call_counts ();
+
+  const size_t start_bytes = agent_out_bytes ();
+  const auto start = std::chrono::steady_clock::now ();
+
+  /* Same as a dump requested with SIGQUIT: stop all the waves and print
+     them.  */
+  dump_wavefronts (true, options);
+  agent_out.flush ();
+
+  result_t result;
+  result.seconds = std::chrono::duration<double> (
+                       std::chrono::steady_clock::now () - start)
+                       .count ();
+  result.bytes = agent_out_bytes () - start_bytes;
+  result.wave_count = config.agent_count * config.queues_per_agent
+                      * config.dispatches_per_queue
+                      * config.workgroups_per_dispatch
+                      * config.waves_per_workgroup;
+  result.call_counts = mock_dbgapi_call_counts ();
+  return result;
+}
+
+void
+write_json (std::ostream &os, const mock_process_config_t &config,
+            const std::vector<result_t> &results)
+{
+  os << "{\n"
+     << "  \"benchmark\": \"dump\",\n"
+     << "  \"agents\": " << config.agent_count << ",\n"
+     << "  \"queues_per_agent\": " << config.queues_per_agent << ",\n"
+     << "  \"dispatches_per_queue\": " << config.dispatches_per_queue
+     << ",\n"
+     << "  \"waves_per_workgroup\": " << config.waves_per_workgroup << ",\n"
+     << "  \"sgprs\": " << config.sgpr_count << ",\n"
+     << "  \"vgprs\": " << config.vgpr_count << ",\n"
+     << "  \"lds_size\": " << config.lds_size << ",\n"
+     << "  \"exec_lanes\": " << config.active_lane_count << ",\n"
+     << "  \"results\": [";
+
+  for (size_t i = 0; i < results.size (); ++i)
+    {
+      const result_t &result = results[i];
+      os << (i ? ",\n" : "\n") << std::fixed << std::setprecision (1)
+         << "    { \"waves\": " << result.wave_count
+         << ", \"seconds\": " << std::setprecision (3) << result.seconds
+         << std::setprecision (1) << ", \"ns_per_wave\": "
+         << result.seconds * 1e9 / result.wave_count
+         << ", \"bytes\": " << result.bytes << ", \"bytes_per_wave\": "
+         << static_cast<double> (result.bytes) / result.wave_count
+         << ", \"calls_per_wave\": "
+         << static_cast<double> (result.call_count ()) / result.wave_count
+         << ", \"calls\": {";
+
+      for (size_t j = 0; j < result.call_counts.size (); ++j)
+        os << (j ? ", " : " ") << "\"" << result.call_counts[j].first
+           << "\": " << result.call_counts[j].second;
+
+      os << " } }";
+    }
+
+  os << "\n  ]\n}\n";
+}
+
+void
+print_usage ()
+{
+  std::cerr
+      << "Usage: rocm-debug-agent-dump-bench [options]" << std::endl
+      << std::endl
+      << "  -o, --output=FILE       Write the results as JSON to FILE"
+      << std::endl
+      << "  -d, --dump-output=FILE  Write the dumps to FILE (default "
+         "/dev/null)"
+      << std::endl
+      << "  -w, --max-waves=N       Largest process to dump (default 1000000)"
+      << std::endl
+      << "  -L, --latency=CALL=NS   Add NS nanoseconds to each call to"
+      << std::endl
+      << "                          amd_dbgapi_CALL, or to all calls if CALL"
+      << std::endl
+      << "                          is `*'" << std::endl
+      << "      --sgprs=N           Scalar registers per wave (default 16)"
+      << std::endl
+      << "      --vgprs=N           Vector registers per wave (default 4)"
+      << std::endl
+      << "      --lds-size=N        Bytes of local memory per wave (default 0)"
+      << std::endl
+      << "      --exec-lanes=N      Active lanes per wave (default 64)"
+      << std::endl
+      << "      --active-lanes[=matrix]" << std::endl
+      << "                          Only print the active lanes of the"
+      << std::endl
+      << "                          vector registers" << std::endl
+      << "  -b, --buffer-size=N     Size of the dump output buffer, 0 for"
+      << std::endl
+      << "                          unbuffered (default 1048576)" << std::endl
+      << "  -a, --async-output=N    Write the dumps from a separate thread"
+      << std::endl
+      << "                          through an N bytes ring buffer"
+      << std::endl
+      << "  -z, --compress=LEVEL    Compress the dumps with gzip" << std::endl
+      << "  -c, --core-file=FILE    Also write the dumps to a GPU core file"
+      << std::endl
+      << "  -r, --raw-dump          Do not symbolize the dumps (requires -c)"
+      << std::endl
+      << "  -q, --quick             Only dump the smallest process"
+      << std::endl
+      << "  -s, --stats             Print the agent's stage timings to stderr"
+      << std::endl
+      << "  -h, --help              Display a usage message and exit"
+      << std::endl;
+}
+
+} /* namespace */
+
+int
+main (int argc, char **argv)
+{
+  std::string output_file, dump_output = "/dev/null";
+  size_t max_waves = 1000000;
+  agent_out_options_t output_options;
+  dump_options_t dump_options;
+  bool quick = false;
+
+  /* 2 agents with 4 queues of 4 dispatches, the number of workgroups per
+     dispatch is set from the number of waves.  */
+  mock_process_config_t config;
+  config.agent_count = 2;
+  config.queues_per_agent = 4;
+  config.dispatches_per_queue = 4;
+  config.waves_per_workgroup = 4;
+  config.faulting_wave_count = 16;
+
+  static const struct option long_options[]
+      = { { "output", required_argument, 0, 'o' },
+          { "dump-output", required_argument, 0, 'd' },
+          { "max-waves", required_argument, 0, 'w' },
+          { "latency", required_argument, 0, 'L' },
+          { "sgprs", required_argument, 0, 'G' },
+          { "vgprs", required_argument, 0, 'V' },
+          { "lds-size", required_argument, 0, 'M' },
+          { "exec-lanes", required_argument, 0, 'E' },
+          { "active-lanes", optional_argument, 0, 'A' },
+          { "buffer-size", required_argument, 0, 'b' },
+          { "async-output", required_argument, 0, 'a' },
+          { "compress", required_argument, 0, 'z' },
+          { "core-file", required_argument, 0, 'c' },
+          { "raw-dump", no_argument, 0, 'r' },
+          { "quick", no_argument, 0, 'q' },
+          { "stats", no_argument, 0, 's' },
+          { "help", no_argument, 0, 'h' },
+          { 0, 0, 0, 0 } };
+
+  int c;
+  while ((c = getopt_long (argc, argv, "o:d:w:L:b:a:z:c:rqsh", long_options,
+                          nullptr))
+         != -1)
+    {
+      try
+        {
+          switch (c)
+            {
+            case 'o':
+              output_file = optarg;
+              break;
+            case 'd':
+              dump_output = optarg;
+              break;
+            case 'w':
+              max_waves = std::stoul (optarg);
+              break;
+            case 'L':
+              {
+                std::string argument (optarg);
+                size_t equal = argument.find ('=');
+                if (equal == std::string::npos
+                    || !mock_dbgapi_set_latency (
+                        argument.substr (0, equal),
+                        std::chrono::nanoseconds (
+                            std::stol (argument.substr (equal + 1)))))
+                  {
+                    print_usage ();
+                    return EXIT_FAILURE;
+                  }
+                break;
+              }
+            case 'G':
+              config.sgpr_count = std::stoul (optarg);
+              break;
+            case 'V':
+              config.vgpr_count = std::stoul (optarg);
+              break;
+            case 'M':
+              config.lds_size = std::stoul (optarg);
+              break;
+            case 'E':
+              config.active_lane_count = std::stoul (optarg);
+              break;
+            case 'A':
+              if (!optarg)
+                dump_options.vector_lanes = vector_lanes_t::active;
+              else if (optarg == std::string ("matrix"))
+                dump_options.vector_lanes = vector_lanes_t::matrix;
+              else
+                {
+                  print_usage ();
+                  return EXIT_FAILURE;
+                }
+              break;
+            case 'b':
+              output_options.buffer_size = std::stoul (optarg);
+              break;
+            case 'a':
+              output_options.ring_size = std::stoul (optarg);
+              break;
+            case 'z':
+              output_options.compression_level = std::stoi (optarg);
+              break;
+            case 'c':
+              dump_options.core_file = optarg;
+              break;
+            case 'r':
+              dump_options.raw = true;
+              break;
+            case 'q':
+              quick = true;
+              break;
+            case 's':
+              stats_enabled = true;
+              break;
+            case 'h':
+              print_usage ();
+              return EXIT_SUCCESS;
+            default:
+              print_usage ();
+              return EXIT_FAILURE;
+            }
+        }
+      catch (...)
+        {
+          print_usage ();
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (dump_options.raw && !dump_options.core_file)
+    {
+      print_usage ();
+      return EXIT_FAILURE;
+    }
+
+  output_options.path_template = dump_output;
+  open_agent_out (output_options);
+
+  /* Register the simulated queues as if the application had created them,
+     so that their headers are printed as in the agent.  */
+  std::vector<hsa_queue_t> queues (config.agent_count
+                                   * config.queues_per_agent);
+  for (size_t i = 0; i < queues.size (); ++i)
+    {
+      callback_and_data_t *record
+          = queue_callback_registry_t::allocate (nullptr, nullptr);
+      record->info.size = 4096;
+      record->info.type = HSA_QUEUE_TYPE_MULTI;
+      record->info.id = i;
+      record->info.address = mock_queue_address (i);
+      clock_gettime (CLOCK_REALTIME, &record->info.creation_time);
+      record->info.creation_tid = gettid ();
+      queue_registry.insert (&queues[i], record);
+    }
+
+  const size_t waves_per_dispatch_group
+      = config.agent_count * config.queues_per_agent
+        * config.dispatches_per_queue * config.waves_per_workgroup;
+
+  std::cout << "     waves   seconds   ns/wave  bytes/wave  calls/wave"
+            << std::endl;
+
+  std::vector<result_t> results;
+  for (size_t wave_count : { 10000, 100000, 1000000 })
+    {
+      if (wave_count > max_waves || (quick && !results.empty ()))
+        break;
+
+      config.workgroups_per_dispatch
+          = std::max<size_t> (1, wave_count / waves_per_dispatch_group);
+      results.emplace_back (run_dump (config, dump_options));
+
+      const result_t &result = results.back ();
+      std::cout << std::fixed << std::setprecision (1) << std::setw (10)
+                << result.wave_count << std::setw (10)
+                << std::setprecision (3) << result.seconds
+                << std::setprecision (1) << std::setw (10)
+                << result.seconds * 1e9 / result.wave_count << std::setw (12)
+                << static_cast<double> (result.bytes) / result.wave_count
+                << std::setw (12)
+                << static_cast<double> (result.call_count ())
+                       / result.wave_count
+                << std::endl;
+
+      if (stats_enabled)
+        {
+          print_stats (std::cerr);
+          print_code_object_memory (std::cerr);
+        }
+    }
+
+  drain_agent_out ();
+
+  if (!output_file.empty ())
+    {
+      std::ofstream os (output_file);
+      write_json (os, config, results);
+      if (!os)
+        {
+          std::cerr << "could not write `" << output_file << "'" << std::endl;
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    write_json (std::cout, config, results);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,423 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "elf_fixture.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <gelf.h>
+#include <libelf.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef EM_AMDGPU
+#define EM_AMDGPU 224
+#endif
+
+#ifndef ELFOSABI_AMDGPU_HSA
+#define ELFOSABI_AMDGPU_HSA 64
+#endif
+
+#ifndef ELFABIVERSION_AMDGPU_HSA_V4
+#define ELFABIVERSION_AMDGPU_HSA_V4 2
+#endif
+
+namespace amd::debug_agent::bench
+{
+
+namespace
+{
+
+/* DWARF constants used by the generated debug information.  */
+constexpr uint8_t DW_TAG_compile_unit = 0x11;
+constexpr uint8_t DW_CHILDREN_no = 0x00;
+constexpr uint8_t DW_AT_name = 0x03;
+constexpr uint8_t DW_AT_stmt_list = 0x10;
+constexpr uint8_t DW_AT_low_pc = 0x11;
+constexpr uint8_t DW_AT_high_pc = 0x12;
+constexpr uint8_t DW_FORM_addr = 0x01;
+constexpr uint8_t DW_FORM_data8 = 0x07;
+constexpr uint8_t DW_FORM_string = 0x08;
+constexpr uint8_t DW_FORM_sec_offset = 0x17;
+constexpr uint8_t DW_LNS_copy = 0x01;
+constexpr uint8_t DW_LNS_advance_pc = 0x02;
+constexpr uint8_t DW_LNS_advance_line = 0x03;
+constexpr uint8_t DW_LNE_end_sequence = 0x01;
+constexpr uint8_t DW_LNE_set_address = 0x02;
+
+/* AMDGPU instructions are a multiple of 4 bytes.  */
+constexpr uint8_t minimum_instruction_length = 4;
+/* s_nop 0  */
+constexpr uint32_t s_nop = 0xbf800000;
+
+constexpr uint64_t text_address = 0x1000;
+constexpr uint64_t min_line_stride = 8;
+
+/* Little-endian byte buffer with the DWARF encodings we need.  */
+class byte_buffer_t
+{
+public:
+  std::vector<unsigned char> m_bytes;
+
+  size_t size () const { return m_bytes.size (); }
+
+  void u8 (uint8_t value) { m_bytes.push_back (value); }
+
+  void
+  unsigned_value (uint64_t value, size_t byte_size)
+  {
+    for (size_t i = 0; i < byte_size; ++i)
+      m_bytes.push_back (value >> (i * 8));
+  }
+
+  void u16 (uint16_t value) { unsigned_value (value, sizeof (value)); }
+  void u32 (uint32_t value) { unsigned_value (value, sizeof (value)); }
+  void u64 (uint64_t value) { unsigned_value (value, sizeof (value)); }
+
+  void
+  uleb128 (uint64_t value)
+  {
+    do
+      {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        m_bytes.push_back (value ? byte | 0x80 : byte);
+      }
+    while (value);
+  }
+
+  void
+  sleb128 (int64_t value)
+  {
+    bool more;
+    do
+      {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        more = !((value == 0 && !(byte & 0x40))
+                 || (value == -1 && (byte & 0x40)));
+        m_bytes.push_back (more ? byte | 0x80 : byte);
+      }
+    while (more);
+  }
+
+  void
+  string (const std::string &value)
+  {
+    m_bytes.insert (m_bytes.end (), value.begin (), value.end ());
+    m_bytes.push_back ('\0');
+  }
+
+  void
+  raw (const void *data, size_t size)
+  {
+    auto *bytes = static_cast<const unsigned char *> (data);
+    m_bytes.insert (m_bytes.end (), bytes, bytes + size);
+  }
+
+  void
+  patch_u32 (size_t offset, uint32_t value)
+  {
+    for (size_t i = 0; i < sizeof (value); ++i)
+      m_bytes[offset + i] = value >> (i * 8);
+  }
+};
+
+std::string
+mangled_name (size_t index)
+{
+  std::string name = "kernel_" + std::to_string (index);
+  /* kernel_N(float*, float*)  */
+  return "_Z" + std::to_string (name.length ()) + name + "PfS_";
+}
+
+[[noreturn]] void
+elf_failure (const char *what)
+{
+  throw std::runtime_error (std::string (what) + ": " + elf_errmsg (-1));
+}
+
+} /* namespace */
+
+elf_fixture_t
+write_elf_fixture (const std::string &path, const elf_fixture_params_t &params)
+{
+  if (!params.symbol_count || !params.cu_count || !params.lines_per_cu)
+    throw std::invalid_argument ("fixture counts must be != 0");
+
+  elf_fixture_t fixture{};
+  fixture.path = path;
+  fixture.text_address = text_address;
+
+  /* Give each CU room for its line rows, and for its share of the symbols.  */
+  size_t symbols_per_cu
+      = (params.symbol_count + params.cu_count - 1) / params.cu_count;
+  fixture.cu_size = std::max (params.lines_per_cu, symbols_per_cu)
+                    * min_line_stride;
+  fixture.text_size = fixture.cu_size * params.cu_count;
+  fixture.line_stride = (fixture.cu_size / params.lines_per_cu)
+                        & ~uint64_t{ minimum_instruction_length - 1 };
+  fixture.symbol_size = (fixture.text_size / params.symbol_count)
+                        & ~uint64_t{ minimum_instruction_length - 1 };
+
+  /* .text  */
+  byte_buffer_t text;
+  text.m_bytes.reserve (fixture.text_size);
+  for (uint64_t i = 0; i < fixture.text_size; i += sizeof (s_nop))
+    text.u32 (s_nop);
+
+  /* .symtab and .strtab  */
+  constexpr size_t text_index = 1, strtab_index = 3;
+  byte_buffer_t strtab;
+  strtab.u8 (0);
+  byte_buffer_t symtab;
+  Elf64_Sym null_sym{};
+  symtab.raw (&null_sym, sizeof (null_sym));
+  for (size_t i = 0; i < params.symbol_count; ++i)
+    {
+      Elf64_Sym sym{};
+      sym.st_name = strtab.size ();
+      sym.st_info = ELF64_ST_INFO (STB_GLOBAL, STT_FUNC);
+      sym.st_other = STV_PROTECTED;
+      sym.st_shndx = text_index;
+      sym.st_value = text_address + i * fixture.symbol_size;
+      sym.st_size = fixture.symbol_size;
+      symtab.raw (&sym, sizeof (sym));
+      strtab.string (mangled_name (i));
+    }
+
+  /* .debug_abbrev: a single childless DW_TAG_compile_unit.  */
+  byte_buffer_t debug_abbrev;
+  debug_abbrev.uleb128 (1);
+  debug_abbrev.uleb128 (DW_TAG_compile_unit);
+  debug_abbrev.u8 (DW_CHILDREN_no);
+  for (auto [attribute, form] :
+       { std::make_pair (DW_AT_name, DW_FORM_string),
+         std::make_pair (DW_AT_stmt_list, DW_FORM_sec_offset),
+         std::make_pair (DW_AT_low_pc, DW_FORM_addr),
+         std::make_pair (DW_AT_high_pc, DW_FORM_data8) })
+    {
+      debug_abbrev.uleb128 (attribute);
+      debug_abbrev.uleb128 (form);
+    }
+  debug_abbrev.uleb128 (0);
+  debug_abbrev.uleb128 (0);
+  debug_abbrev.uleb128 (0);
+
+  /* .debug_info and .debug_line, one unit per CU.  */
+  byte_buffer_t debug_info, debug_line;
+  for (size_t cu = 0; cu < params.cu_count; ++cu)
+    {
+      std::string file_name = "cu_" + std::to_string (cu) + ".cpp";
+      uint64_t low_pc = text_address + cu * fixture.cu_size;
+
+      size_t info_start = debug_info.size ();
+      debug_info.u32 (0); /* unit_length  */
+      debug_info.u16 (4); /* version  */
+      debug_info.u32 (0); /* debug_abbrev_offset  */
+      debug_info.u8 (8);  /* address_size  */
+      debug_info.uleb128 (1);
+      debug_info.string (file_name);
+      debug_info.u32 (debug_line.size ());
+      debug_info.u64 (low_pc);
+      debug_info.u64 (fixture.cu_size);
+      debug_info.patch_u32 (info_start,
+                            debug_info.size () - info_start - 4);
+
+      size_t line_start = debug_line.size ();
+      debug_line.u32 (0); /* unit_length  */
+      debug_line.u16 (4); /* version  */
+      size_t header_length_offset = debug_line.size ();
+      debug_line.u32 (0); /* header_length  */
+      debug_line.u8 (minimum_instruction_length);
+      debug_line.u8 (1);  /* maximum_operations_per_instruction  */
+      debug_line.u8 (1);  /* default_is_stmt  */
+      debug_line.u8 (-5); /* line_base  */
+      debug_line.u8 (14); /* line_range  */
+      debug_line.u8 (13); /* opcode_base  */
+      for (uint8_t length : { 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 })
+        debug_line.u8 (length);
+      debug_line.string ("/bench/src"); /* include_directories  */
+      debug_line.u8 (0);
+      debug_line.string (file_name); /* file_names  */
+      debug_line.uleb128 (1);
+      debug_line.uleb128 (0);
+      debug_line.uleb128 (0);
+      debug_line.u8 (0);
+      debug_line.patch_u32 (header_length_offset,
+                            debug_line.size () - header_length_offset - 4);
+
+      debug_line.u8 (0);
+      debug_line.uleb128 (9);
+      debug_line.u8 (DW_LNE_set_address);
+      debug_line.u64 (low_pc);
+      debug_line.u8 (DW_LNS_copy);
+      for (size_t row = 1; row < params.lines_per_cu; ++row)
+        {
+          debug_line.u8 (DW_LNS_advance_pc);
+          debug_line.uleb128 (fixture.line_stride
+                              / minimum_instruction_length);
+          debug_line.u8 (DW_LNS_advance_line);
+          debug_line.sleb128 (2);
+          debug_line.u8 (DW_LNS_copy);
+        }
+      debug_line.u8 (DW_LNS_advance_pc);
+      debug_line.uleb128 ((fixture.cu_size
+                           - (params.lines_per_cu - 1) * fixture.line_stride)
+                          / minimum_instruction_length);
+      debug_line.u8 (0);
+      debug_line.uleb128 (1);
+      debug_line.u8 (DW_LNE_end_sequence);
+      debug_line.patch_u32 (line_start, debug_line.size () - line_start - 4);
+    }
+
+  /* Write the object.  */
+  int fd = ::open (path.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    throw std::runtime_error ("could not create `" + path + "'");
+
+  /* Close the file after elf_end, including when throwing.  */
+  struct fd_closer_t
+  {
+    int fd;
+    ~fd_closer_t () { ::close (fd); }
+  } fd_closer{ fd };
+
+  std::unique_ptr<Elf, void (*) (Elf *)> elf (
+      elf_begin (fd, ELF_C_WRITE, nullptr), [] (Elf *elf) { elf_end (elf); });
+  if (!elf)
+    elf_failure ("elf_begin");
+
+  if (!gelf_newehdr (elf.get (), ELFCLASS64)
+      || !gelf_newphdr (elf.get (), 1))
+    elf_failure ("gelf_newehdr");
+
+  byte_buffer_t shstrtab;
+  shstrtab.u8 (0);
+
+  /* The Elf_Data buffers must outlive elf_update.  The section name is added
+     before the bytes are taken so that .shstrtab can name itself.  */
+  std::list<std::vector<unsigned char>> buffers;
+  auto add_section = [&] (const char *name, Elf64_Word type,
+                          Elf64_Xword flags, byte_buffer_t &bytes,
+                          uint64_t alignment) {
+    Elf_Scn *scn = elf_newscn (elf.get ());
+    Elf_Data *data = scn ? elf_newdata (scn) : nullptr;
+    if (!data)
+      elf_failure ("elf_newscn");
+
+    GElf_Shdr shdr_mem;
+    GElf_Shdr *shdr = gelf_getshdr (scn, &shdr_mem);
+    shdr->sh_name = shstrtab.size ();
+    shdr->sh_type = type;
+    shdr->sh_flags = flags;
+    shdr->sh_addralign = alignment;
+    gelf_update_shdr (scn, shdr);
+    shstrtab.string (name);
+
+    buffers.emplace_back (std::move (bytes.m_bytes));
+    data->d_buf = buffers.back ().data ();
+    data->d_size = buffers.back ().size ();
+    data->d_type = ELF_T_BYTE;
+    data->d_align = alignment;
+    data->d_version = EV_CURRENT;
+
+    return scn;
+  };
+
+  Elf_Scn *text_scn = add_section (".text", SHT_PROGBITS,
+                                   SHF_ALLOC | SHF_EXECINSTR, text,
+                                   text_address);
+  Elf_Scn *symtab_scn = add_section (".symtab", SHT_SYMTAB, 0, symtab, 8);
+  add_section (".strtab", SHT_STRTAB, 0, strtab, 1);
+  add_section (".debug_abbrev", SHT_PROGBITS, 0, debug_abbrev, 1);
+  add_section (".debug_info", SHT_PROGBITS, 0, debug_info, 1);
+  add_section (".debug_line", SHT_PROGBITS, 0, debug_line, 1);
+  Elf_Scn *shstrtab_scn
+      = add_section (".shstrtab", SHT_STRTAB, 0, shstrtab, 1);
+
+  GElf_Shdr shdr_mem;
+  GElf_Shdr *shdr;
+
+  shdr = gelf_getshdr (text_scn, &shdr_mem);
+  shdr->sh_addr = text_address;
+  gelf_update_shdr (text_scn, shdr);
+
+  shdr = gelf_getshdr (symtab_scn, &shdr_mem);
+  shdr->sh_link = strtab_index;
+  shdr->sh_info = 1; /* One local symbol, the null symbol.  */
+  shdr->sh_entsize = sizeof (Elf64_Sym);
+  gelf_update_shdr (symtab_scn, shdr);
+
+  GElf_Ehdr ehdr_mem;
+  GElf_Ehdr *ehdr = gelf_getehdr (elf.get (), &ehdr_mem);
+  ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr->e_ident[EI_OSABI] = ELFOSABI_AMDGPU_HSA;
+  ehdr->e_ident[EI_ABIVERSION] = ELFABIVERSION_AMDGPU_HSA_V4;
+  ehdr->e_type = ET_DYN;
+  ehdr->e_machine = EM_AMDGPU;
+  ehdr->e_version = EV_CURRENT;
+  ehdr->e_shstrndx = elf_ndxscn (shstrtab_scn);
+  gelf_update_ehdr (elf.get (), ehdr);
+
+  /* Lay out the file so that the .text file offset is known, then map it
+     with a PT_LOAD segment.  .text is aligned to its load address, so libelf
+     places it right after the headers at the same offset.  */
+  if (elf_update (elf.get (), ELF_C_NULL) < 0)
+    elf_failure ("elf_update");
+
+  shdr = gelf_getshdr (text_scn, &shdr_mem);
+  if (shdr->sh_offset != text_address)
+    throw std::runtime_error ("unexpected .text offset");
+
+  GElf_Phdr phdr{};
+  phdr.p_type = PT_LOAD;
+  phdr.p_flags = PF_R | PF_X;
+  phdr.p_offset = shdr->sh_offset;
+  phdr.p_vaddr = phdr.p_paddr = text_address;
+  phdr.p_filesz = phdr.p_memsz = fixture.text_size;
+  phdr.p_align = text_address;
+  gelf_update_phdr (elf.get (), 0, &phdr);
+
+  off_t file_size = elf_update (elf.get (), ELF_C_WRITE);
+  if (file_size < 0)
+    elf_failure ("elf_update");
+
+  fixture.file_size = file_size;
+  return fixture;
+}
+
+} /* namespace amd::debug_agent::bench */
@@ -0,0 +1,74 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_BENCH_ELF_FIXTURE_H
+#define _ROCM_DEBUG_AGENT_BENCH_ELF_FIXTURE_H 1
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace amd::debug_agent::bench
+{
+
+/* Shape of a synthetic AMDGPU code object.  The .text section is split evenly
+   between `cu_count` compilation units, each with a line number program of
+   `lines_per_cu` rows, and between `symbol_count` function symbols.  */
+struct elf_fixture_params_t
+{
+  size_t symbol_count;
+  size_t cu_count;
+  size_t lines_per_cu;
+};
+
+/* Layout of a generated code object, used to pick lookup addresses.  */
+struct elf_fixture_t
+{
+  std::string path;
+  size_t file_size;
+  uint64_t text_address;
+  uint64_t text_size;
+  uint64_t symbol_size;
+  uint64_t cu_size;
+  uint64_t line_stride;
+};
+
+/* Write an ELF64 EM_AMDGPU shared object described by `params` to `path`.
+   The object has a single PT_LOAD segment covering .text, a .symtab with
+   mangled STT_FUNC symbols, and DWARF 4 .debug_abbrev, .debug_info and
+   .debug_line sections.  Source lines advance by 2 per row so that every
+   other line has no code associated with it.  Throws std::runtime_error on
+   failure.  */
+elf_fixture_t write_elf_fixture (const std::string &path,
+                                 const elf_fixture_params_t &params);
+
+} /* namespace amd::debug_agent::bench */
+
+#endif /* _ROCM_DEBUG_AGENT_BENCH_ELF_FIXTURE_H */
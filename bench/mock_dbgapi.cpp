@@ -0,0 +1,1257 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* A stand-in for the ROCdbgapi library that simulates a process with any
+   number of agents, queues, dispatches and waves, so that the dump pipeline
+   can be benchmarked without a GPU.  It implements the subset of the API used
+   by the agent with the same signatures, and can inject a latency in each
+   call.  Like the real library, it is not thread-safe.  */
+
+#include "mock_dbgapi.h"
+#include "elf_fixture.h"
+
+#include <amd-dbgapi.h>
+#include <libelf.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace amd::debug_agent::bench
+{
+
+namespace
+{
+
+/* The API functions implemented by the mock.  */
+#define MOCK_DBGAPI_CALLS(CALL)                                               \
+  CALL (initialize)                                                           \
+  CALL (finalize)                                                             \
+  CALL (set_log_level)                                                        \
+  CALL (process_attach)                                                       \
+  CALL (process_detach)                                                       \
+  CALL (process_set_progress)                                                 \
+  CALL (process_set_wave_creation)                                            \
+  CALL (next_pending_event)                                                   \
+  CALL (event_get_info)                                                       \
+  CALL (event_processed)                                                      \
+  CALL (code_object_list)                                                     \
+  CALL (code_object_get_info)                                                 \
+  CALL (agent_list)                                                           \
+  CALL (agent_get_info)                                                       \
+  CALL (queue_get_info)                                                       \
+  CALL (dispatch_get_info)                                                    \
+  CALL (wave_list)                                                            \
+  CALL (wave_get_info)                                                        \
+  CALL (wave_stop)                                                            \
+  CALL (wave_resume)                                                          \
+  CALL (architecture_get_info)                                                \
+  CALL (architecture_register_class_list)                                     \
+  CALL (architecture_register_class_get_info)                                 \
+  CALL (wave_register_list)                                                   \
+  CALL (wave_register_get_info)                                               \
+  CALL (register_is_in_register_class)                                        \
+  CALL (read_register)                                                        \
+  CALL (dwarf_address_space_to_address_space)                                 \
+  CALL (read_memory)                                                          \
+  CALL (disassemble_instruction)
+
+enum class call_t : size_t
+{
+#define CALL(name) name,
+  MOCK_DBGAPI_CALLS (CALL)
+#undef CALL
+      count
+};
+
+constexpr const char *call_names[] = {
+#define CALL(name) #name,
+  MOCK_DBGAPI_CALLS (CALL)
+#undef CALL
+};
+
+struct call_stats_t
+{
+  std::atomic<uint64_t> count{ 0 };
+  std::atomic<int64_t> latency_ns{ 0 };
+};
+
+std::array<call_stats_t, static_cast<size_t> (call_t::count)> call_stats;
+
+/* Count a call, and spin for its injected latency.  Sleeping would add the
+   scheduler's wake-up latency, which is larger than most of the latencies
+   being simulated.  */
+void
+enter (call_t call)
+{
+  call_stats_t &stats = call_stats[static_cast<size_t> (call)];
+  stats.count.fetch_add (1, std::memory_order_relaxed);
+
+  if (int64_t latency_ns = stats.latency_ns.load (std::memory_order_relaxed))
+    {
+      auto end = std::chrono::steady_clock::now ()
+                 + std::chrono::nanoseconds (latency_ns);
+      while (std::chrono::steady_clock::now () < end)
+        ;
+    }
+}
+
+constexpr uint64_t process_handle = 1;
+constexpr uint64_t architecture_handle = 1;
+constexpr uint64_t code_object_handle = 1;
+constexpr uint64_t local_address_space_handle = 3;
+constexpr uint64_t dwarf_local_address_space = 0x3;
+constexpr amd_dbgapi_global_address_t load_address = 0x7f0000000000;
+constexpr amd_dbgapi_size_t instruction_size = 4;
+/* s_nop 0  */
+constexpr uint32_t s_nop = 0xbf800000;
+
+/* Register classes, in handle order starting from 1.  */
+enum class register_class_t : uint64_t
+{
+  general = 1,
+  scalar,
+  vector,
+  system
+};
+
+constexpr const char *register_class_names[] = { "general", "scalar",
+                                                 "vector", "system" };
+
+/* Registers, in handle order starting from 1: pc, exec, s0..sN, v0..vN.  */
+enum class register_kind_t
+{
+  pc,
+  exec,
+  sgpr,
+  vgpr
+};
+
+struct event_t
+{
+  amd_dbgapi_event_kind_t kind;
+  size_t wave;
+};
+
+struct process_t
+{
+  mock_process_config_t config;
+  elf_fixture_t code_object;
+  std::string code_object_uri;
+
+  size_t queue_count;
+  size_t dispatch_count;
+  size_t wave_count;
+
+  std::vector<bool> stopped;
+  std::vector<amd_dbgapi_wave_stop_reason_t> stop_reason;
+
+  /* Indexed by event handle - 1.  */
+  std::vector<event_t> events;
+  std::deque<uint64_t> pending_events;
+
+  bool attached{ false };
+  bool code_objects_reported{ false };
+
+  size_t
+  waves_per_dispatch () const
+  {
+    return config.workgroups_per_dispatch * config.waves_per_workgroup;
+  }
+
+  size_t dispatch_index (size_t wave) const
+  {
+    return wave / waves_per_dispatch ();
+  }
+
+  size_t queue_index (size_t dispatch) const
+  {
+    return dispatch / config.dispatches_per_queue;
+  }
+
+  size_t agent_index (size_t queue) const
+  {
+    return queue / config.queues_per_agent;
+  }
+
+  amd_dbgapi_global_address_t
+  kernel_entry (size_t dispatch) const
+  {
+    return load_address + code_object.text_address
+           + (dispatch % config.kernel_count) * code_object.symbol_size;
+  }
+
+  amd_dbgapi_global_address_t
+  wave_pc (size_t wave) const
+  {
+    return kernel_entry (dispatch_index (wave))
+           + ((wave % config.waves_per_workgroup + 2) * instruction_size)
+                 % code_object.symbol_size;
+  }
+
+  uint64_t
+  exec_mask () const
+  {
+    const size_t lane_count = std::min<size_t> (config.lane_count, 64);
+    const size_t active_lane_count
+        = std::min (config.active_lane_count, lane_count);
+
+    uint64_t exec{ 0 };
+    for (size_t i = 0; i < active_lane_count; ++i)
+      exec |= uint64_t{ 1 } << (i * lane_count / active_lane_count);
+    return exec;
+  }
+
+  size_t register_count () const
+  {
+    return 2 + config.sgpr_count + config.vgpr_count;
+  }
+
+  std::optional<std::pair<register_kind_t, size_t>>
+  register_kind (amd_dbgapi_register_id_t register_id) const
+  {
+    if (!register_id.handle || register_id.handle > register_count ())
+      return {};
+
+    size_t index = register_id.handle - 1;
+    if (index == 0)
+      return std::make_pair (register_kind_t::pc, 0);
+    if (index == 1)
+      return std::make_pair (register_kind_t::exec, 0);
+    if ((index -= 2) < config.sgpr_count)
+      return std::make_pair (register_kind_t::sgpr, index);
+    return std::make_pair (register_kind_t::vgpr, index - config.sgpr_count);
+  }
+
+  amd_dbgapi_size_t
+  register_size (register_kind_t kind) const
+  {
+    switch (kind)
+      {
+      case register_kind_t::pc:
+      case register_kind_t::exec:
+        return sizeof (uint64_t);
+      case register_kind_t::sgpr:
+        return sizeof (uint32_t);
+      case register_kind_t::vgpr:
+        return sizeof (uint32_t) * config.lane_count;
+      }
+    return 0;
+  }
+
+  void
+  queue_event (amd_dbgapi_event_kind_t kind, size_t wave)
+  {
+    events.emplace_back (event_t{ kind, wave });
+    pending_events.emplace_back (events.size ());
+  }
+};
+
+std::optional<process_t> process;
+std::optional<amd_dbgapi_callbacks_t> callbacks;
+
+/* Remove the generated code object when the program exits.  */
+struct code_object_file_t
+{
+  std::string path;
+  ~code_object_file_t ()
+  {
+    if (!path.empty ())
+      ::unlink (path.c_str ());
+  }
+} code_object_file;
+
+void *
+allocate (size_t size)
+{
+  return callbacks->allocate_memory (size);
+}
+
+template <typename Id>
+Id *
+allocate_list (size_t count)
+{
+  return static_cast<Id *> (allocate (count * sizeof (Id)));
+}
+
+template <typename T>
+amd_dbgapi_status_t
+get_info (size_t value_size, void *value, const T &info)
+{
+  if (!value)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+  if (value_size != sizeof (T))
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT_COMPATIBILITY;
+
+  memcpy (value, &info, sizeof (T));
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+get_string_info (size_t value_size, void *value, const std::string &info)
+{
+  if (value_size != sizeof (char *))
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT_COMPATIBILITY;
+
+  char *copy = static_cast<char *> (allocate (info.length () + 1));
+  memcpy (copy, info.c_str (), info.length () + 1);
+  return get_info (value_size, value, copy);
+}
+
+amd_dbgapi_status_t
+check_process (amd_dbgapi_process_id_t process_id)
+{
+  if (!callbacks)
+    return AMD_DBGAPI_STATUS_ERROR_NOT_INITIALIZED;
+  if (!process || !process->attached || process_id.handle != process_handle)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_PROCESS_ID;
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+check_architecture (amd_dbgapi_architecture_id_t architecture_id)
+{
+  if (!callbacks)
+    return AMD_DBGAPI_STATUS_ERROR_NOT_INITIALIZED;
+  if (architecture_id.handle != architecture_handle)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARCHITECTURE_ID;
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+/* Return the index of `wave_id` in the process, or an error status.  */
+std::pair<amd_dbgapi_status_t, size_t>
+find_wave (amd_dbgapi_process_id_t process_id, amd_dbgapi_wave_id_t wave_id)
+{
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return { status, 0 };
+  if (!wave_id.handle || wave_id.handle > process->wave_count)
+    return { AMD_DBGAPI_STATUS_ERROR_INVALID_WAVE_ID, 0 };
+  return { AMD_DBGAPI_STATUS_SUCCESS, wave_id.handle - 1 };
+}
+
+} /* namespace */
+
+uint64_t
+mock_queue_address (size_t queue_index)
+{
+  return 0x7f0000000000 + queue_index * 0x100000;
+}
+
+void
+mock_dbgapi_configure (const mock_process_config_t &config)
+{
+  if (!config.agent_count || !config.queues_per_agent
+      || !config.dispatches_per_queue || !config.workgroups_per_dispatch
+      || !config.waves_per_workgroup || !config.kernel_count
+      || !config.lane_count)
+    throw std::invalid_argument ("mock process counts must be != 0");
+
+  bool attached = process && process->attached;
+  process.emplace ();
+  process->config = config;
+  process->attached = attached;
+
+  process->queue_count = config.agent_count * config.queues_per_agent;
+  process->dispatch_count = process->queue_count * config.dispatches_per_queue;
+  process->wave_count
+    = process->dispatch_count * process->waves_per_dispatch ();
+
+  /* One code object with a symbol, and a few lines of debug information, for
+     each kernel.  */
+  if (elf_version (EV_CURRENT) == EV_NONE)
+    throw std::runtime_error ("libelf initialization failed");
+
+  if (code_object_file.path.empty ())
+    code_object_file.path = "/tmp/rocm-debug-agent-mock-"
+                            + std::to_string (getpid ()) + ".so";
+  process->code_object = write_elf_fixture (
+      code_object_file.path, { config.kernel_count, 1, 16 });
+  process->code_object_uri = "file://" + code_object_file.path;
+
+  process->stopped.assign (process->wave_count, false);
+  process->stop_reason.assign (process->wave_count,
+                               AMD_DBGAPI_WAVE_STOP_REASON_NONE);
+  for (size_t i = 0;
+       i < std::min (config.faulting_wave_count, process->wave_count); ++i)
+    {
+      process->stopped[i] = true;
+      process->stop_reason[i] = AMD_DBGAPI_WAVE_STOP_REASON_MEMORY_VIOLATION;
+    }
+}
+
+bool
+mock_dbgapi_set_latency (const std::string &call_name,
+                         std::chrono::nanoseconds latency)
+{
+  bool found = false;
+  for (size_t i = 0; i < call_stats.size (); ++i)
+    if (call_name == "*" || call_name == call_names[i])
+      {
+        call_stats[i].latency_ns.store (latency.count ());
+        found = true;
+      }
+  return found;
+}
+
+std::vector<std::pair<std::string, uint64_t>>
+mock_dbgapi_call_counts ()
+{
+  std::vector<std::pair<std::string, uint64_t>> counts;
+  for (size_t i = 0; i < call_stats.size (); ++i)
+    if (uint64_t count = call_stats[i].count.load ())
+      counts.emplace_back (call_names[i], count);
+  return counts;
+}
+
+void
+mock_dbgapi_reset_call_counts ()
+{
+  for (auto &&stats : call_stats)
+    stats.count.store (0);
+}
+
+} /* namespace amd::debug_agent::bench */
+
+using namespace amd::debug_agent::bench;
+
+amd_dbgapi_status_t
+amd_dbgapi_initialize (amd_dbgapi_callbacks_t *callbacks_)
+{
+  enter (call_t::initialize);
+
+  if (callbacks)
+    return AMD_DBGAPI_STATUS_ERROR_ALREADY_INITIALIZED;
+  if (!callbacks_)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  callbacks.emplace (*callbacks_);
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_finalize ()
+{
+  enter (call_t::finalize);
+
+  if (!callbacks)
+    return AMD_DBGAPI_STATUS_ERROR_NOT_INITIALIZED;
+
+  if (process)
+    process->attached = false;
+  callbacks.reset ();
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+void
+amd_dbgapi_set_log_level (amd_dbgapi_log_level_t level)
+{
+  enter (call_t::set_log_level);
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_process_attach (amd_dbgapi_client_process_id_t client_process_id,
+                           amd_dbgapi_process_id_t *process_id)
+{
+  enter (call_t::process_attach);
+
+  if (!callbacks)
+    return AMD_DBGAPI_STATUS_ERROR_NOT_INITIALIZED;
+  if (!process_id)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  if (!process)
+    mock_dbgapi_configure ({});
+  if (process->attached)
+    return AMD_DBGAPI_STATUS_ERROR_ALREADY_ATTACHED;
+
+  process->attached = true;
+  process->code_objects_reported = false;
+  process->queue_event (AMD_DBGAPI_EVENT_KIND_RUNTIME, 0);
+
+  *process_id = { process_handle };
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_process_detach (amd_dbgapi_process_id_t process_id)
+{
+  enter (call_t::process_detach);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+
+  process->attached = false;
+  process->events.clear ();
+  process->pending_events.clear ();
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_process_set_progress (amd_dbgapi_process_id_t process_id,
+                                 amd_dbgapi_progress_t progress)
+{
+  enter (call_t::process_set_progress);
+  return check_process (process_id);
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_process_set_wave_creation (amd_dbgapi_process_id_t process_id,
+                                      amd_dbgapi_wave_creation_t creation)
+{
+  enter (call_t::process_set_wave_creation);
+  return check_process (process_id);
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_next_pending_event (amd_dbgapi_process_id_t process_id,
+                               amd_dbgapi_event_id_t *event_id,
+                               amd_dbgapi_event_kind_t *kind)
+{
+  enter (call_t::next_pending_event);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!event_id || !kind)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  if (process->pending_events.empty ())
+    {
+      *event_id = AMD_DBGAPI_EVENT_NONE;
+      *kind = AMD_DBGAPI_EVENT_KIND_NONE;
+      return AMD_DBGAPI_STATUS_SUCCESS;
+    }
+
+  *event_id = { process->pending_events.front () };
+  *kind = process->events[event_id->handle - 1].kind;
+  process->pending_events.pop_front ();
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_event_get_info (amd_dbgapi_process_id_t process_id,
+                           amd_dbgapi_event_id_t event_id,
+                           amd_dbgapi_event_info_t query, size_t value_size,
+                           void *value)
+{
+  enter (call_t::event_get_info);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!event_id.handle || event_id.handle > process->events.size ())
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_EVENT_ID;
+
+  const event_t &event = process->events[event_id.handle - 1];
+  switch (query)
+    {
+    case AMD_DBGAPI_EVENT_INFO_WAVE:
+      if (event.kind != AMD_DBGAPI_EVENT_KIND_WAVE_STOP)
+        break;
+      return get_info (value_size, value,
+                       amd_dbgapi_wave_id_t{ event.wave + 1 });
+
+    case AMD_DBGAPI_EVENT_INFO_RUNTIME_STATE:
+      if (event.kind != AMD_DBGAPI_EVENT_KIND_RUNTIME)
+        break;
+      return get_info (value_size, value,
+                       AMD_DBGAPI_RUNTIME_STATE_LOADED_SUCCESS);
+
+    default:
+      break;
+    }
+
+  return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_event_processed (amd_dbgapi_process_id_t process_id,
+                            amd_dbgapi_event_id_t event_id)
+{
+  enter (call_t::event_processed);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!event_id.handle || event_id.handle > process->events.size ())
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_EVENT_ID;
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_code_object_list (amd_dbgapi_process_id_t process_id,
+                             size_t *code_object_count,
+                             amd_dbgapi_code_object_id_t **code_objects,
+                             amd_dbgapi_changed_t *changed)
+{
+  enter (call_t::code_object_list);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!code_object_count || !code_objects)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  /* The code object list never changes after it was first reported.  */
+  if (changed)
+    {
+      *changed = process->code_objects_reported ? AMD_DBGAPI_CHANGED_NO
+                                                : AMD_DBGAPI_CHANGED_YES;
+      if (process->code_objects_reported)
+        return AMD_DBGAPI_STATUS_SUCCESS;
+    }
+  process->code_objects_reported = true;
+
+  *code_object_count = 1;
+  *code_objects = allocate_list<amd_dbgapi_code_object_id_t> (1);
+  (*code_objects)[0] = { code_object_handle };
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_code_object_get_info (amd_dbgapi_process_id_t process_id,
+                                 amd_dbgapi_code_object_id_t code_object_id,
+                                 amd_dbgapi_code_object_info_t query,
+                                 size_t value_size, void *value)
+{
+  enter (call_t::code_object_get_info);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (code_object_id.handle != code_object_handle)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_CODE_OBJECT_ID;
+
+  switch (query)
+    {
+    case AMD_DBGAPI_CODE_OBJECT_INFO_LOAD_ADDRESS:
+      return get_info (value_size, value, load_address);
+    case AMD_DBGAPI_CODE_OBJECT_INFO_URI_NAME:
+      return get_string_info (value_size, value, process->code_object_uri);
+    default:
+      return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_agent_list (amd_dbgapi_process_id_t process_id, size_t *agent_count,
+                       amd_dbgapi_agent_id_t **agents,
+                       amd_dbgapi_changed_t *changed)
+{
+  enter (call_t::agent_list);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!agent_count || !agents)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  if (changed)
+    *changed = AMD_DBGAPI_CHANGED_YES;
+
+  *agent_count = process->config.agent_count;
+  *agents = allocate_list<amd_dbgapi_agent_id_t> (*agent_count);
+  for (size_t i = 0; i < *agent_count; ++i)
+    (*agents)[i] = { i + 1 };
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_agent_get_info (amd_dbgapi_process_id_t process_id,
+                           amd_dbgapi_agent_id_t agent_id,
+                           amd_dbgapi_agent_info_t query, size_t value_size,
+                           void *value)
+{
+  enter (call_t::agent_get_info);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!agent_id.handle || agent_id.handle > process->config.agent_count)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_AGENT_ID;
+
+  switch (query)
+    {
+    case AMD_DBGAPI_AGENT_INFO_NAME:
+      return get_string_info (value_size, value, "Mock GPU");
+    case AMD_DBGAPI_AGENT_INFO_ARCHITECTURE:
+      return get_info (value_size, value,
+                       amd_dbgapi_architecture_id_t{ architecture_handle });
+    default:
+      return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_queue_get_info (amd_dbgapi_process_id_t process_id,
+                           amd_dbgapi_queue_id_t queue_id,
+                           amd_dbgapi_queue_info_t query, size_t value_size,
+                           void *value)
+{
+  enter (call_t::queue_get_info);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!queue_id.handle || queue_id.handle > process->queue_count)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_QUEUE_ID;
+
+  switch (query)
+    {
+    case AMD_DBGAPI_QUEUE_INFO_AGENT:
+      return get_info (
+          value_size, value,
+          amd_dbgapi_agent_id_t{ process->agent_index (queue_id.handle - 1)
+                                 + 1 });
+    case AMD_DBGAPI_QUEUE_INFO_ARCHITECTURE:
+      return get_info (value_size, value,
+                       amd_dbgapi_architecture_id_t{ architecture_handle });
+    case AMD_DBGAPI_QUEUE_INFO_ADDRESS:
+      return get_info (value_size, value,
+                       mock_queue_address (queue_id.handle - 1));
+    default:
+      return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_dispatch_get_info (amd_dbgapi_process_id_t process_id,
+                              amd_dbgapi_dispatch_id_t dispatch_id,
+                              amd_dbgapi_dispatch_info_t query,
+                              size_t value_size, void *value)
+{
+  enter (call_t::dispatch_get_info);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!dispatch_id.handle || dispatch_id.handle > process->dispatch_count)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_DISPATCH_ID;
+
+  size_t dispatch = dispatch_id.handle - 1;
+  size_t queue = process->queue_index (dispatch);
+
+  switch (query)
+    {
+    case AMD_DBGAPI_DISPATCH_INFO_QUEUE:
+      return get_info (value_size, value, amd_dbgapi_queue_id_t{ queue + 1 });
+    case AMD_DBGAPI_DISPATCH_INFO_AGENT:
+      return get_info (
+          value_size, value,
+          amd_dbgapi_agent_id_t{ process->agent_index (queue) + 1 });
+    case AMD_DBGAPI_DISPATCH_INFO_ARCHITECTURE:
+      return get_info (value_size, value,
+                       amd_dbgapi_architecture_id_t{ architecture_handle });
+    case AMD_DBGAPI_DISPATCH_INFO_KERNEL_CODE_ENTRY_ADDRESS:
+      return get_info (value_size, value, process->kernel_entry (dispatch));
+    default:
+      return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_wave_list (amd_dbgapi_process_id_t process_id, size_t *wave_count,
+                      amd_dbgapi_wave_id_t **waves,
+                      amd_dbgapi_changed_t *changed)
+{
+  enter (call_t::wave_list);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!wave_count || !waves)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  if (changed)
+    *changed = AMD_DBGAPI_CHANGED_YES;
+
+  *wave_count = process->wave_count;
+  *waves = allocate_list<amd_dbgapi_wave_id_t> (*wave_count);
+  for (size_t i = 0; i < *wave_count; ++i)
+    (*waves)[i] = { i + 1 };
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_wave_get_info (amd_dbgapi_process_id_t process_id,
+                          amd_dbgapi_wave_id_t wave_id,
+                          amd_dbgapi_wave_info_t query, size_t value_size,
+                          void *value)
+{
+  enter (call_t::wave_get_info);
+
+  auto [status, wave] = find_wave (process_id, wave_id);
+  if (status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+
+  const mock_process_config_t &config = process->config;
+  size_t dispatch = process->dispatch_index (wave);
+  size_t queue = process->queue_index (dispatch);
+  size_t workgroup
+      = wave % process->waves_per_dispatch () / config.waves_per_workgroup;
+
+  switch (query)
+    {
+    case AMD_DBGAPI_WAVE_INFO_STATE:
+      return get_info (value_size, value,
+                       process->stopped[wave] ? AMD_DBGAPI_WAVE_STATE_STOP
+                                              : AMD_DBGAPI_WAVE_STATE_RUN);
+    case AMD_DBGAPI_WAVE_INFO_STOP_REASON:
+      if (!process->stopped[wave])
+        return AMD_DBGAPI_STATUS_ERROR_WAVE_NOT_STOPPED;
+      return get_info (value_size, value, process->stop_reason[wave]);
+    case AMD_DBGAPI_WAVE_INFO_PC:
+      if (!process->stopped[wave])
+        return AMD_DBGAPI_STATUS_ERROR_WAVE_NOT_STOPPED;
+      return get_info (value_size, value, process->wave_pc (wave));
+    case AMD_DBGAPI_WAVE_INFO_ARCHITECTURE:
+      return get_info (value_size, value,
+                       amd_dbgapi_architecture_id_t{ architecture_handle });
+    case AMD_DBGAPI_WAVE_INFO_AGENT:
+      return get_info (
+          value_size, value,
+          amd_dbgapi_agent_id_t{ process->agent_index (queue) + 1 });
+    case AMD_DBGAPI_WAVE_INFO_QUEUE:
+      return get_info (value_size, value, amd_dbgapi_queue_id_t{ queue + 1 });
+    case AMD_DBGAPI_WAVE_INFO_DISPATCH:
+      return get_info (value_size, value,
+                       amd_dbgapi_dispatch_id_t{ dispatch + 1 });
+    case AMD_DBGAPI_WAVE_INFO_WORK_GROUP_COORD:
+      return get_info (value_size, value,
+                       std::array<uint32_t, 3>{
+                           static_cast<uint32_t> (workgroup % 256),
+                           static_cast<uint32_t> (workgroup / 256), 0 });
+    case AMD_DBGAPI_WAVE_INFO_WAVE_NUMBER_IN_WORK_GROUP:
+      return get_info (
+          value_size, value,
+          static_cast<uint32_t> (wave % config.waves_per_workgroup));
+    case AMD_DBGAPI_WAVE_INFO_LANE_COUNT:
+      return get_info (value_size, value, config.lane_count);
+    case AMD_DBGAPI_WAVE_INFO_EXEC_MASK:
+      return get_info (value_size, value, process->exec_mask ());
+    default:
+      return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_wave_stop (amd_dbgapi_process_id_t process_id,
+                      amd_dbgapi_wave_id_t wave_id)
+{
+  enter (call_t::wave_stop);
+
+  auto [status, wave] = find_wave (process_id, wave_id);
+  if (status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+
+  /* Like the debugger API, stopping a wave that is already stopped is an
+     error.  Otherwise the wave stops immediately, and reports it with an
+     event.  */
+  if (process->stopped[wave])
+    return AMD_DBGAPI_STATUS_ERROR_WAVE_STOPPED;
+
+  process->stopped[wave] = true;
+  process->stop_reason[wave] = AMD_DBGAPI_WAVE_STOP_REASON_NONE;
+  process->queue_event (AMD_DBGAPI_EVENT_KIND_WAVE_STOP, wave);
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_wave_resume (amd_dbgapi_process_id_t process_id,
+                        amd_dbgapi_wave_id_t wave_id,
+                        amd_dbgapi_resume_mode_t resume_mode)
+{
+  enter (call_t::wave_resume);
+
+  auto [status, wave] = find_wave (process_id, wave_id);
+  if (status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!process->stopped[wave])
+    return AMD_DBGAPI_STATUS_ERROR_WAVE_NOT_STOPPED;
+
+  process->stopped[wave] = false;
+  process->stop_reason[wave] = AMD_DBGAPI_WAVE_STOP_REASON_NONE;
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_architecture_get_info (amd_dbgapi_architecture_id_t architecture_id,
+                                  amd_dbgapi_architecture_info_t query,
+                                  size_t value_size, void *value)
+{
+  enter (call_t::architecture_get_info);
+
+  if (amd_dbgapi_status_t status = check_architecture (architecture_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+
+  switch (query)
+    {
+    case AMD_DBGAPI_ARCHITECTURE_INFO_NAME:
+      return get_string_info (value_size, value, "amdgcn-amd-amdhsa--gfx90a");
+    case AMD_DBGAPI_ARCHITECTURE_INFO_LARGEST_INSTRUCTION_SIZE:
+      return get_info (value_size, value, amd_dbgapi_size_t{ 8 });
+    default:
+      return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+    }
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_architecture_register_class_list (
+    amd_dbgapi_architecture_id_t architecture_id,
+    size_t *register_class_count,
+    amd_dbgapi_register_class_id_t **register_classes)
+{
+  enter (call_t::architecture_register_class_list);
+
+  if (amd_dbgapi_status_t status = check_architecture (architecture_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!register_class_count || !register_classes)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  *register_class_count = std::size (register_class_names);
+  *register_classes
+      = allocate_list<amd_dbgapi_register_class_id_t> (*register_class_count);
+  for (size_t i = 0; i < *register_class_count; ++i)
+    (*register_classes)[i] = { i + 1 };
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_architecture_register_class_get_info (
+    amd_dbgapi_architecture_id_t architecture_id,
+    amd_dbgapi_register_class_id_t register_class_id,
+    amd_dbgapi_register_class_info_t query, size_t value_size, void *value)
+{
+  enter (call_t::architecture_register_class_get_info);
+
+  if (amd_dbgapi_status_t status = check_architecture (architecture_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!register_class_id.handle
+      || register_class_id.handle > std::size (register_class_names))
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_REGISTER_CLASS_ID;
+
+  if (query != AMD_DBGAPI_REGISTER_CLASS_INFO_NAME)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  return get_string_info (value_size, value,
+                          register_class_names[register_class_id.handle - 1]);
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_wave_register_list (amd_dbgapi_process_id_t process_id,
+                               amd_dbgapi_wave_id_t wave_id,
+                               size_t *register_count,
+                               amd_dbgapi_register_id_t **registers)
+{
+  enter (call_t::wave_register_list);
+
+  auto [status, wave] = find_wave (process_id, wave_id);
+  if (status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!register_count || !registers)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  *register_count = process->register_count ();
+  *registers = allocate_list<amd_dbgapi_register_id_t> (*register_count);
+  for (size_t i = 0; i < *register_count; ++i)
+    (*registers)[i] = { i + 1 };
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_wave_register_get_info (amd_dbgapi_process_id_t process_id,
+                                   amd_dbgapi_wave_id_t wave_id,
+                                   amd_dbgapi_register_id_t register_id,
+                                   amd_dbgapi_register_info_t query,
+                                   size_t value_size, void *value)
+{
+  enter (call_t::wave_register_get_info);
+
+  auto [status, wave] = find_wave (process_id, wave_id);
+  if (status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+
+  auto kind = process->register_kind (register_id);
+  if (!kind)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_REGISTER_ID;
+
+  auto [register_kind, index] = *kind;
+  switch (query)
+    {
+    case AMD_DBGAPI_REGISTER_INFO_NAME:
+      switch (register_kind)
+        {
+        case register_kind_t::pc:
+          return get_string_info (value_size, value, "pc");
+        case register_kind_t::exec:
+          return get_string_info (value_size, value, "exec");
+        case register_kind_t::sgpr:
+          return get_string_info (value_size, value,
+                                  "s" + std::to_string (index));
+        case register_kind_t::vgpr:
+          return get_string_info (value_size, value,
+                                  "v" + std::to_string (index));
+        }
+      break;
+
+    case AMD_DBGAPI_REGISTER_INFO_TYPE:
+      switch (register_kind)
+        {
+        case register_kind_t::pc:
+          return get_string_info (value_size, value, "code_ptr");
+        case register_kind_t::exec:
+          return get_string_info (value_size, value, "uint64_t");
+        case register_kind_t::sgpr:
+          return get_string_info (value_size, value, "uint32_t");
+        case register_kind_t::vgpr:
+          return get_string_info (
+              value_size, value,
+              "int32_t[" + std::to_string (process->config.lane_count) + "]");
+        }
+      break;
+
+    case AMD_DBGAPI_REGISTER_INFO_SIZE:
+      return get_info (value_size, value,
+                       process->register_size (register_kind));
+
+    default:
+      break;
+    }
+
+  return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_register_is_in_register_class (
+    amd_dbgapi_architecture_id_t architecture_id,
+    amd_dbgapi_register_id_t register_id,
+    amd_dbgapi_register_class_id_t register_class_id,
+    amd_dbgapi_register_class_state_t *register_class_state)
+{
+  enter (call_t::register_is_in_register_class);
+
+  if (amd_dbgapi_status_t status = check_architecture (architecture_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!process)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_REGISTER_ID;
+
+  auto kind = process->register_kind (register_id);
+  if (!kind)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_REGISTER_ID;
+  if (!register_class_state)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  bool member;
+  switch (static_cast<register_class_t> (register_class_id.handle))
+    {
+    case register_class_t::general:
+      member = true;
+      break;
+    case register_class_t::scalar:
+      member = kind->first == register_kind_t::sgpr;
+      break;
+    case register_class_t::vector:
+      member = kind->first == register_kind_t::vgpr;
+      break;
+    case register_class_t::system:
+      member = kind->first == register_kind_t::pc
+               || kind->first == register_kind_t::exec;
+      break;
+    default:
+      return AMD_DBGAPI_STATUS_ERROR_INVALID_REGISTER_CLASS_ID;
+    }
+
+  *register_class_state = member ? AMD_DBGAPI_REGISTER_CLASS_STATE_MEMBER
+                                 : AMD_DBGAPI_REGISTER_CLASS_STATE_NOT_MEMBER;
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_read_register (amd_dbgapi_process_id_t process_id,
+                          amd_dbgapi_wave_id_t wave_id,
+                          amd_dbgapi_register_id_t register_id,
+                          amd_dbgapi_size_t offset,
+                          amd_dbgapi_size_t value_size, void *value)
+{
+  enter (call_t::read_register);
+
+  auto [status, wave] = find_wave (process_id, wave_id);
+  if (status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!process->stopped[wave])
+    return AMD_DBGAPI_STATUS_ERROR_WAVE_NOT_STOPPED;
+
+  auto kind = process->register_kind (register_id);
+  if (!kind)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_REGISTER_ID;
+  if (!value || offset + value_size > process->register_size (kind->first))
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  auto *bytes = static_cast<uint8_t *> (value);
+  switch (kind->first)
+    {
+    case register_kind_t::pc:
+      {
+        amd_dbgapi_global_address_t pc = process->wave_pc (wave);
+        memcpy (bytes, reinterpret_cast<uint8_t *> (&pc) + offset,
+                value_size);
+        break;
+      }
+
+    case register_kind_t::exec:
+      {
+        uint64_t exec = process->exec_mask ();
+        memcpy (bytes, reinterpret_cast<uint8_t *> (&exec) + offset,
+                value_size);
+        break;
+      }
+
+    default:
+      /* A pattern unique to the wave and register.  */
+      for (size_t i = 0; i < value_size; ++i)
+        bytes[i] = wave * 31 + register_id.handle * 7 + offset + i;
+      break;
+    }
+
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_dwarf_address_space_to_address_space (
+    amd_dbgapi_architecture_id_t architecture_id, uint64_t dwarf_address_space,
+    amd_dbgapi_address_space_id_t *address_space_id)
+{
+  enter (call_t::dwarf_address_space_to_address_space);
+
+  if (amd_dbgapi_status_t status = check_architecture (architecture_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!address_space_id || dwarf_address_space != dwarf_local_address_space)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  *address_space_id = { local_address_space_handle };
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_read_memory (amd_dbgapi_process_id_t process_id,
+                        amd_dbgapi_wave_id_t wave_id,
+                        amd_dbgapi_lane_id_t lane_id,
+                        amd_dbgapi_address_space_id_t address_space_id,
+                        amd_dbgapi_segment_address_t segment_address,
+                        amd_dbgapi_size_t *value_size, void *value)
+{
+  enter (call_t::read_memory);
+
+  if (amd_dbgapi_status_t status = check_process (process_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!value_size || !value)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  auto *bytes = static_cast<uint8_t *> (value);
+
+  /* The global memory is filled with s_nop instructions.  */
+  if (address_space_id.handle == AMD_DBGAPI_ADDRESS_SPACE_GLOBAL.handle)
+    {
+      for (size_t i = 0; i < *value_size; ++i)
+        bytes[i] = s_nop >> ((segment_address + i) % sizeof (s_nop) * 8);
+      return AMD_DBGAPI_STATUS_SUCCESS;
+    }
+
+  if (address_space_id.handle != local_address_space_handle)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ADDRESS_SPACE_ID;
+
+  auto [status, wave] = find_wave (process_id, wave_id);
+  if (status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!process->stopped[wave])
+    return AMD_DBGAPI_STATUS_ERROR_WAVE_NOT_STOPPED;
+  if (segment_address >= process->config.lds_size)
+    return AMD_DBGAPI_STATUS_ERROR_MEMORY_ACCESS;
+
+  *value_size = std::min<amd_dbgapi_size_t> (
+      *value_size, process->config.lds_size - segment_address);
+  for (size_t i = 0; i < *value_size; ++i)
+    bytes[i] = wave * 131 + segment_address + i;
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
+
+amd_dbgapi_status_t
+amd_dbgapi_disassemble_instruction (
+    amd_dbgapi_architecture_id_t architecture_id,
+    amd_dbgapi_global_address_t address, amd_dbgapi_size_t *size,
+    const void *memory, char **instruction_text,
+    amd_dbgapi_symbolizer_id_t symbolizer_id,
+    amd_dbgapi_status_t (*symbolizer) (
+        amd_dbgapi_symbolizer_id_t symbolizer_id,
+        amd_dbgapi_global_address_t address, char **symbol_text))
+{
+  enter (call_t::disassemble_instruction);
+
+  if (amd_dbgapi_status_t status = check_architecture (architecture_id);
+      status != AMD_DBGAPI_STATUS_SUCCESS)
+    return status;
+  if (!size || !memory || *size < instruction_size)
+    return AMD_DBGAPI_STATUS_ERROR_INVALID_ARGUMENT;
+
+  *size = instruction_size;
+  if (!instruction_text)
+    return AMD_DBGAPI_STATUS_SUCCESS;
+
+  uint32_t instruction;
+  memcpy (&instruction, memory, sizeof (instruction));
+
+  std::string text = "s_nop 0";
+  if (instruction != s_nop)
+    {
+      char buffer[32];
+      snprintf (buffer, sizeof (buffer), ".long 0x%08x", instruction);
+      text = buffer;
+    }
+
+  *instruction_text = static_cast<char *> (allocate (text.length () + 1));
+  memcpy (*instruction_text, text.c_str (), text.length () + 1);
+  return AMD_DBGAPI_STATUS_SUCCESS;
+}
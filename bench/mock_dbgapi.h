@@ -0,0 +1,89 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_BENCH_MOCK_DBGAPI_H
+#define _ROCM_DEBUG_AGENT_BENCH_MOCK_DBGAPI_H 1
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace amd::debug_agent::bench
+{
+
+/* Shape of the process simulated by the mock debugger API library.  Waves
+   are numbered in agent, queue, dispatch, workgroup order, and each dispatch
+   executes one of `kernel_count` kernels of a single code object.  */
+struct mock_process_config_t
+{
+  size_t agent_count{ 1 };
+  size_t queues_per_agent{ 1 };
+  size_t dispatches_per_queue{ 1 };
+  size_t workgroups_per_dispatch{ 1 };
+  size_t waves_per_workgroup{ 1 };
+  /* The first `faulting_wave_count` waves are stopped by a memory violation,
+     the other waves are running.  */
+  size_t faulting_wave_count{ 1 };
+  size_t kernel_count{ 16 };
+  size_t sgpr_count{ 16 };
+  size_t vgpr_count{ 4 };
+  size_t lane_count{ 64 };
+  /* Number of lanes set in the exec mask of each wave, evenly spread over
+     the `lane_count` lanes, as in a divergent branch.  */
+  size_t active_lane_count{ 64 };
+  /* Size of the local memory readable by each wave.  */
+  size_t lds_size{ 0 };
+};
+
+/* Replace the simulated process, and reset the state of all its waves.  */
+void mock_dbgapi_configure (const mock_process_config_t &config);
+
+/* Make each call to `call_name` busy-wait for `latency` before returning.
+   `call_name` is the API function name without its amd_dbgapi_ prefix, or
+   "*" for all the functions.  Return false if `call_name` is unknown.  */
+bool mock_dbgapi_set_latency (const std::string &call_name,
+                              std::chrono::nanoseconds latency);
+
+/* Return the number of calls made to each API function since the last
+   reset, in API declaration order, omitting the functions never called.  */
+std::vector<std::pair<std::string, uint64_t>> mock_dbgapi_call_counts ();
+
+void mock_dbgapi_reset_call_counts ();
+
+/* Return the address of the packets of the simulated queue `queue_index`,
+   as reported by AMD_DBGAPI_QUEUE_INFO_ADDRESS.  */
+uint64_t mock_queue_address (size_t queue_index);
+
+} /* namespace amd::debug_agent::bench */
+
+#endif /* _ROCM_DEBUG_AGENT_BENCH_MOCK_DBGAPI_H */
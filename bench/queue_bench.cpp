@@ -0,0 +1,368 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Microbenchmark of the agent's hsa_queue_create and hsa_queue_destroy
+   interception.  Each thread repeatedly creates and destroys a few queues
+   through a stand-in for the runtime, and the cost of recording the
+   original error callbacks is measured with 1 to 64 threads for no
+   bookkeeping, a map guarded by a lock, and the queue callback registry.  */
+
+#include "queue_registry.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace amd::debug_agent;
+
+namespace
+{
+
+using error_callback_t = void (*) (hsa_status_t, hsa_queue_t *, void *);
+
+/* The runtime's queues, a thread only creates its own.  */
+thread_local std::vector<hsa_queue_t> thread_queues;
+thread_local size_t next_thread_queue;
+
+/* Stand-ins for the runtime functions, which only hand out the thread's
+   preallocated queues.  */
+hsa_status_t
+runtime_queue_create (error_callback_t callback, void *data,
+                      hsa_queue_t **queue)
+{
+  *queue = &thread_queues[next_thread_queue++ % thread_queues.size ()];
+  return callback ? HSA_STATUS_SUCCESS : HSA_STATUS_ERROR;
+}
+
+hsa_status_t
+runtime_queue_destroy (hsa_queue_t *queue)
+{
+  return queue ? HSA_STATUS_SUCCESS : HSA_STATUS_ERROR;
+}
+
+void
+application_callback (hsa_status_t, hsa_queue_t *, void *)
+{
+}
+
+void
+agent_callback (hsa_status_t, hsa_queue_t *, void *)
+{
+}
+
+/* The interception without any bookkeeping.  */
+struct direct_t
+{
+  static constexpr const char *name = "direct";
+
+  hsa_status_t
+  create (error_callback_t, void *, hsa_queue_t **queue)
+  {
+    return runtime_queue_create (agent_callback, nullptr, queue);
+  }
+
+  hsa_status_t
+  destroy (hsa_queue_t *queue)
+  {
+    return runtime_queue_destroy (queue);
+  }
+};
+
+/* The agent's previous bookkeeping, a heap allocated record per queue in a
+   map, with the lock it was missing.  */
+struct locked_map_t
+{
+  static constexpr const char *name = "locked_map";
+
+  hsa_status_t
+  create (error_callback_t callback, void *data, hsa_queue_t **queue)
+  {
+    auto record = std::make_unique<callback_and_data_t> (
+        callback_and_data_t{ callback, data });
+
+    hsa_status_t status
+        = runtime_queue_create (agent_callback, record.get (), queue);
+
+    if (status == HSA_STATUS_SUCCESS)
+      {
+        std::scoped_lock lock (m_lock);
+        m_records.emplace (*queue, std::move (record));
+      }
+    return status;
+  }
+
+  hsa_status_t
+  destroy (hsa_queue_t *queue)
+  {
+    {
+      std::scoped_lock lock (m_lock);
+      m_records.erase (queue);
+    }
+    return runtime_queue_destroy (queue);
+  }
+
+  std::mutex m_lock;
+  std::unordered_map<hsa_queue_t *, std::unique_ptr<callback_and_data_t>>
+      m_records;
+};
+
+/* The agent's current bookkeeping.  */
+struct registry_t
+{
+  static constexpr const char *name = "registry";
+
+  hsa_status_t
+  create (error_callback_t callback, void *data, hsa_queue_t **queue)
+  {
+    callback_and_data_t *record = m_registry.allocate (callback, data);
+
+    hsa_status_t status = runtime_queue_create (agent_callback, record, queue);
+
+    if (status == HSA_STATUS_SUCCESS)
+      m_registry.insert (*queue, record);
+    else
+      m_registry.deallocate (record);
+    return status;
+  }
+
+  hsa_status_t
+  destroy (hsa_queue_t *queue)
+  {
+    m_registry.erase (queue);
+    return runtime_queue_destroy (queue);
+  }
+
+  queue_callback_registry_t m_registry;
+};
+
+struct result_t
+{
+  std::string name;
+  size_t thread_count;
+  /* Average time a thread spends creating and destroying a queue.  */
+  double ns_per_pair;
+};
+
+template <typename Interceptor>
+result_t
+run (size_t thread_count, size_t iterations, size_t queues_per_thread)
+{
+  Interceptor interceptor;
+  std::atomic<size_t> ready{ 0 };
+  std::atomic<bool> go{ false };
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < thread_count; ++i)
+    threads.emplace_back ([&] () {
+      thread_queues.resize (queues_per_thread);
+      next_thread_queue = 0;
+      std::vector<hsa_queue_t *> queues (queues_per_thread);
+
+      ready.fetch_add (1);
+      while (!go.load ())
+        std::this_thread::yield ();
+
+      for (size_t iteration = 0; iteration < iterations; ++iteration)
+        {
+          for (auto &queue : queues)
+            if (interceptor.create (application_callback, &queue, &queue)
+                != HSA_STATUS_SUCCESS)
+              abort ();
+          for (auto queue : queues)
+            if (interceptor.destroy (queue) != HSA_STATUS_SUCCESS)
+              abort ();
+        }
+    });
+
+  while (ready.load () != thread_count)
+    std::this_thread::yield ();
+
+  const auto start = std::chrono::steady_clock::now ();
+  go.store (true);
+  for (auto &thread : threads)
+    thread.join ();
+  const std::chrono::duration<double, std::nano> elapsed
+      = std::chrono::steady_clock::now () - start;
+
+  return { Interceptor::name, thread_count,
+           elapsed.count () / (iterations * queues_per_thread) };
+}
+
+void
+write_json (std::ostream &os, size_t iterations, size_t queues_per_thread,
+            const std::vector<result_t> &results)
+{
+  os << "{\n"
+     << "  \"benchmark\": \"queue\",\n"
+     << "  \"iterations\": " << iterations << ",\n"
+     << "  \"queues_per_thread\": " << queues_per_thread << ",\n"
+     << "  \"results\": [";
+
+  for (size_t i = 0; i < results.size (); ++i)
+    os << (i ? ",\n" : "\n") << std::fixed << std::setprecision (1)
+       << "    { \"interceptor\": \"" << results[i].name
+       << "\", \"threads\": " << results[i].thread_count
+       << ", \"ns_per_pair\": " << results[i].ns_per_pair << " }";
+
+  os << "\n  ]\n}\n";
+}
+
+void
+print_usage ()
+{
+  std::cerr
+      << "Usage: rocm-debug-agent-queue-bench [options]" << std::endl
+      << std::endl
+      << "  -o, --output=FILE       Write the results as JSON to FILE"
+      << std::endl
+      << "  -t, --max-threads=N     Largest number of threads (default 64)"
+      << std::endl
+      << "  -n, --iterations=N      Create and destroy the queues N times per"
+      << std::endl
+      << "                          thread (default 100000)" << std::endl
+      << "  -p, --queues=N          Queues created by each thread at a time"
+      << std::endl
+      << "                          (default 4)" << std::endl
+      << "  -q, --quick             Run fewer iterations" << std::endl
+      << "  -h, --help              Display a usage message and exit"
+      << std::endl;
+}
+
+} /* namespace */
+
+int
+main (int argc, char **argv)
+{
+  std::string output_file;
+  size_t max_threads = 64;
+  size_t iterations = 100000;
+  size_t queues_per_thread = 4;
+
+  static const struct option long_options[]
+      = { { "output", required_argument, 0, 'o' },
+          { "max-threads", required_argument, 0, 't' },
+          { "iterations", required_argument, 0, 'n' },
+          { "queues", required_argument, 0, 'p' },
+          { "quick", no_argument, 0, 'q' },
+          { "help", no_argument, 0, 'h' },
+          { 0, 0, 0, 0 } };
+
+  int c;
+  while ((c = getopt_long (argc, argv, "o:t:n:p:qh", long_options, nullptr))
+         != -1)
+    {
+      try
+        {
+          switch (c)
+            {
+            case 'o':
+              output_file = optarg;
+              break;
+            case 't':
+              max_threads = std::stoul (optarg);
+              break;
+            case 'n':
+              iterations = std::stoul (optarg);
+              break;
+            case 'p':
+              queues_per_thread = std::stoul (optarg);
+              break;
+            case 'q':
+              iterations = 1000;
+              break;
+            case 'h':
+              print_usage ();
+              return EXIT_SUCCESS;
+            default:
+              print_usage ();
+              return EXIT_FAILURE;
+            }
+        }
+      catch (...)
+        {
+          print_usage ();
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (!iterations || !queues_per_thread)
+    {
+      print_usage ();
+      return EXIT_FAILURE;
+    }
+
+  std::cout << "   threads    direct  locked_map  registry  (ns/pair)"
+            << std::endl;
+
+  std::vector<result_t> results;
+  for (size_t thread_count = 1; thread_count <= max_threads;
+       thread_count *= 2)
+    {
+      results.emplace_back (
+          run<direct_t> (thread_count, iterations, queues_per_thread));
+      results.emplace_back (
+          run<locked_map_t> (thread_count, iterations, queues_per_thread));
+      results.emplace_back (
+          run<registry_t> (thread_count, iterations, queues_per_thread));
+
+      auto row = results.end () - 3;
+      std::cout << std::fixed << std::setprecision (1) << std::setw (10)
+                << thread_count << std::setw (10) << row[0].ns_per_pair
+                << std::setw (12) << row[1].ns_per_pair << std::setw (10)
+                << row[2].ns_per_pair << std::endl;
+    }
+
+  if (!output_file.empty ())
+    {
+      std::ofstream os (output_file);
+      write_json (os, iterations, queues_per_thread, results);
+      if (!os)
+        {
+          std::cerr << "could not write `" << output_file << "'" << std::endl;
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    write_json (std::cout, iterations, queues_per_thread, results);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,488 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Benchmark of the cost of loading the agent in a process that never
+   faults.  Each measurement runs in a new process: a minimal program that
+   only loads the runtime, and the same program that also loads the agent
+   and calls its OnLoad with a stand-in for the runtime's API table, as the
+   runtime's tools loader does.  The time to load and initialize the agent,
+   the resident memory it adds, and the libraries it loads are reported.
+   With --hsa, the program initializes the runtime instead, which loads the
+   agent from HSA_TOOLS_LIB, and needs a GPU.  */
+
+#include <hsa/hsa.h>
+#include <hsa/hsa_api_trace.h>
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <link.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std::string_literals;
+
+namespace
+{
+
+/* The libraries the agent must only load when a dump starts.  */
+const char *const lazy_libraries[]
+    = { "libamd_dbgapi.so", "libelf.so", "libdw.so" };
+
+enum class run_mode_t
+{
+  /* The minimal program, without the agent.  */
+  none,
+  /* The minimal program with the agent.  */
+  agent
+};
+
+const char *
+mode_name (run_mode_t mode)
+{
+  return mode == run_mode_t::none ? "none" : "agent";
+}
+
+/* A measurement made in a new process.  */
+struct sample_t
+{
+  /* The time to load and initialize the agent, or the runtime with
+     --hsa.  */
+  double startup_ns{ 0 };
+  /* The time spent in OnLoad, not measured with --hsa.  */
+  double onload_ns{ 0 };
+  /* The resident memory of the process once started.  */
+  uint64_t rss_kb{ 0 };
+  /* The lazy libraries loaded in the process, as a bit mask indexed like
+     lazy_libraries.  */
+  unsigned loaded{ 0 };
+};
+
+struct result_t
+{
+  run_mode_t mode;
+  sample_t median;
+};
+
+/* Return the VmRSS of this process in KiB.  */
+uint64_t
+resident_kb ()
+{
+  std::ifstream status ("/proc/self/status");
+  std::string line;
+  while (std::getline (status, line))
+    if (line.compare (0, 6, "VmRSS:") == 0)
+      return std::stoull (line.substr (6));
+  return 0;
+}
+
+/* Return the lazy libraries loaded in this process.  */
+unsigned
+loaded_lazy_libraries ()
+{
+  unsigned loaded{ 0 };
+  dl_iterate_phdr (
+      [] (struct dl_phdr_info *info, size_t, void *data) {
+        for (size_t i = 0; i < std::size (lazy_libraries); ++i)
+          if (strstr (info->dlpi_name, lazy_libraries[i]))
+            *static_cast<unsigned *> (data) |= 1u << i;
+        return 0;
+      },
+      &loaded);
+  return loaded;
+}
+
+/* Run one measurement in this process, and print it on the standard
+   output for the parent.  */
+int
+run_child (run_mode_t mode, const std::string &agent_path, bool hsa)
+{
+  using clock = std::chrono::steady_clock;
+  sample_t sample;
+
+  if (hsa)
+    {
+      /* The runtime loads the agent from HSA_TOOLS_LIB.  */
+      const auto start = clock::now ();
+      if (hsa_init () != HSA_STATUS_SUCCESS)
+        {
+          std::cerr << "hsa_init failed" << std::endl;
+          return EXIT_FAILURE;
+        }
+      sample.startup_ns
+          = std::chrono::duration<double, std::nano> (clock::now () - start)
+                .count ();
+    }
+  else if (mode == run_mode_t::agent)
+    {
+      /* A stand-in for the runtime's API table, the agent only replaces
+         some of its functions.  */
+      static CoreApiTable core_table;
+      static AmdExtTable amd_ext_table;
+      static HsaApiTable table;
+      table.core_ = &core_table;
+      table.amd_ext_ = &amd_ext_table;
+
+      const auto start = clock::now ();
+
+      void *handle = dlopen (agent_path.c_str (), RTLD_NOW | RTLD_LOCAL);
+      if (!handle)
+        {
+          std::cerr << "cannot load the agent: " << dlerror () << std::endl;
+          return EXIT_FAILURE;
+        }
+
+      auto *on_load = reinterpret_cast<bool (*) (
+          void *, uint64_t, uint64_t, const char *const *)> (
+          dlsym (handle, "OnLoad"));
+      if (!on_load)
+        {
+          std::cerr << "OnLoad not found in `" << agent_path << "'"
+                    << std::endl;
+          return EXIT_FAILURE;
+        }
+
+      const auto loaded = clock::now ();
+
+      /* OnLoad fails to register its system event handler since the
+         runtime is not initialized, everything else is done.  */
+      on_load (&table, 0, 0, nullptr);
+
+      const auto end = clock::now ();
+      sample.startup_ns
+          = std::chrono::duration<double, std::nano> (end - start).count ();
+      sample.onload_ns
+          = std::chrono::duration<double, std::nano> (end - loaded).count ();
+    }
+
+  sample.rss_kb = resident_kb ();
+  sample.loaded = loaded_lazy_libraries ();
+
+  std::cout << sample.startup_ns << ' ' << sample.onload_ns << ' '
+            << sample.rss_kb << ' ' << sample.loaded << std::endl;
+
+  if (hsa)
+    hsa_shut_down ();
+
+  return EXIT_SUCCESS;
+}
+
+/* Run one measurement of MODE in a new process.  */
+std::optional<sample_t>
+run_process (run_mode_t mode, const std::string &agent_path, bool hsa)
+{
+  int pipe_fds[2];
+  if (pipe (pipe_fds) == -1)
+    return std::nullopt;
+
+  pid_t pid = fork ();
+  if (pid == -1)
+    return std::nullopt;
+
+  if (!pid)
+    {
+      dup2 (pipe_fds[1], STDOUT_FILENO);
+      close (pipe_fds[0]);
+      close (pipe_fds[1]);
+
+      if (hsa && mode == run_mode_t::agent)
+        setenv ("HSA_TOOLS_LIB", agent_path.c_str (), 1);
+      else
+        unsetenv ("HSA_TOOLS_LIB");
+
+      std::string child = "--child="s + mode_name (mode);
+      std::vector<const char *> args
+          = { "rocm-debug-agent-startup-bench", child.c_str (), "--agent",
+              agent_path.c_str () };
+      if (hsa)
+        args.emplace_back ("--hsa");
+      args.emplace_back (nullptr);
+
+      execv ("/proc/self/exe", const_cast<char *const *> (args.data ()));
+      _exit (127);
+    }
+
+  close (pipe_fds[1]);
+
+  std::string output;
+  char buffer[256];
+  ssize_t count;
+  while ((count = read (pipe_fds[0], buffer, sizeof (buffer))) > 0)
+    output.append (buffer, count);
+  close (pipe_fds[0]);
+
+  int status;
+  if (waitpid (pid, &status, 0) != pid || !WIFEXITED (status)
+      || WEXITSTATUS (status) != EXIT_SUCCESS)
+    return std::nullopt;
+
+  sample_t sample;
+  std::istringstream is (output);
+  if (!(is >> sample.startup_ns >> sample.onload_ns >> sample.rss_kb
+        >> sample.loaded))
+    return std::nullopt;
+
+  return sample;
+}
+
+template <typename T>
+T
+median (std::vector<sample_t> &samples, T sample_t::*field)
+{
+  auto middle = samples.begin () + samples.size () / 2;
+  std::nth_element (samples.begin (), middle, samples.end (),
+                    [field] (const sample_t &a, const sample_t &b) {
+                      return a.*field < b.*field;
+                    });
+  return (*middle).*field;
+}
+
+/* Measure MODE REPETITIONS times, and return the medians.  */
+std::optional<result_t>
+run (run_mode_t mode, const std::string &agent_path, bool hsa,
+     size_t repetitions)
+{
+  std::vector<sample_t> samples;
+  for (size_t i = 0; i < repetitions; ++i)
+    {
+      auto sample = run_process (mode, agent_path, hsa);
+      if (!sample)
+        return std::nullopt;
+      samples.emplace_back (*sample);
+    }
+
+  result_t result{ mode, {} };
+  result.median.startup_ns = median (samples, &sample_t::startup_ns);
+  result.median.onload_ns = median (samples, &sample_t::onload_ns);
+  result.median.rss_kb = median (samples, &sample_t::rss_kb);
+  for (auto &&sample : samples)
+    result.median.loaded |= sample.loaded;
+  return result;
+}
+
+void
+write_loaded (std::ostream &os, unsigned loaded)
+{
+  os << "[";
+  const char *separator = "";
+  for (size_t i = 0; i < std::size (lazy_libraries); ++i)
+    if (loaded & (1u << i))
+      {
+        os << separator << '"' << lazy_libraries[i] << '"';
+        separator = ", ";
+      }
+  os << "]";
+}
+
+void
+write_json (std::ostream &os, const std::string &agent_path, bool hsa,
+            size_t repetitions, const std::vector<result_t> &results)
+{
+  os << "{\n"
+     << "  \"benchmark\": \"startup\",\n"
+     << "  \"agent\": \"" << agent_path << "\",\n"
+     << "  \"hsa\": " << (hsa ? "true" : "false") << ",\n"
+     << "  \"repetitions\": " << repetitions << ",\n"
+     << std::fixed << std::setprecision (1) << "  \"results\": [";
+
+  for (size_t i = 0; i < results.size (); ++i)
+    {
+      const sample_t &median = results[i].median;
+      os << (i ? ",\n" : "\n") << "    { \"mode\": \""
+         << mode_name (results[i].mode)
+         << "\", \"startup_ns\": " << median.startup_ns
+         << ", \"onload_ns\": " << median.onload_ns
+         << ", \"rss_kb\": " << median.rss_kb << ", \"lazy_loaded\": ";
+      write_loaded (os, median.loaded);
+      os << " }";
+    }
+
+  const sample_t &none = results[0].median, &agent = results[1].median;
+  os << "\n  ],\n"
+     << "  \"added_startup_ns\": " << agent.startup_ns - none.startup_ns
+     << ",\n"
+     << "  \"added_rss_kb\": "
+     << static_cast<int64_t> (agent.rss_kb - none.rss_kb) << "\n}\n";
+}
+
+void
+print_usage ()
+{
+  std::cerr
+      << "Usage: rocm-debug-agent-startup-bench [options]" << std::endl
+      << std::endl
+      << "  -a, --agent=PATH        The agent library to load (default"
+      << std::endl
+      << "                          librocm-debug-agent.so.2)" << std::endl
+      << "  -o, --output=FILE       Write the results as JSON to FILE"
+      << std::endl
+      << "  -r, --repetitions=N     Start N processes with and without the"
+      << std::endl
+      << "                          agent (default 20)" << std::endl
+      << "      --hsa               Initialize the runtime, which loads the"
+      << std::endl
+      << "                          agent from HSA_TOOLS_LIB (needs a GPU)"
+      << std::endl
+      << "  -q, --quick             Run fewer repetitions" << std::endl
+      << "  -h, --help              Display a usage message and exit"
+      << std::endl;
+}
+
+} /* namespace */
+
+int
+main (int argc, char **argv)
+{
+  std::string output_file;
+  std::string agent_path = "librocm-debug-agent.so.2";
+  std::optional<run_mode_t> child;
+  size_t repetitions = 20;
+  bool hsa = false;
+
+  static const struct option long_options[]
+      = { { "agent", required_argument, 0, 'a' },
+          { "output", required_argument, 0, 'o' },
+          { "repetitions", required_argument, 0, 'r' },
+          { "hsa", no_argument, 0, 'H' },
+          { "child", required_argument, 0, 'C' },
+          { "quick", no_argument, 0, 'q' },
+          { "help", no_argument, 0, 'h' },
+          { 0, 0, 0, 0 } };
+
+  int c;
+  while ((c = getopt_long (argc, argv, "a:o:r:qh", long_options, nullptr))
+         != -1)
+    {
+      try
+        {
+          switch (c)
+            {
+            case 'a':
+              agent_path = optarg;
+              break;
+            case 'o':
+              output_file = optarg;
+              break;
+            case 'r':
+              repetitions = std::stoul (optarg);
+              break;
+            case 'H':
+              hsa = true;
+              break;
+            case 'C': /* Internal, run one measurement.  */
+              child = optarg == "agent"s ? run_mode_t::agent
+                                         : run_mode_t::none;
+              break;
+            case 'q':
+              repetitions = 5;
+              break;
+            case 'h':
+              print_usage ();
+              return EXIT_SUCCESS;
+            default:
+              print_usage ();
+              return EXIT_FAILURE;
+            }
+        }
+      catch (...)
+        {
+          print_usage ();
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (child)
+    return run_child (*child, agent_path, hsa);
+
+  if (!repetitions)
+    {
+      print_usage ();
+      return EXIT_FAILURE;
+    }
+
+  std::vector<result_t> results;
+  for (run_mode_t mode : { run_mode_t::none, run_mode_t::agent })
+    {
+      auto result = run (mode, agent_path, hsa, repetitions);
+      if (!result)
+        {
+          std::cerr << "the " << mode_name (mode) << " process failed"
+                    << std::endl;
+          return EXIT_FAILURE;
+        }
+      results.emplace_back (*result);
+    }
+
+  const sample_t &none = results[0].median, &agent = results[1].median;
+  std::cout << std::fixed << std::setprecision (1)
+            << "startup added by the agent: "
+            << (agent.startup_ns - none.startup_ns) / 1000 << " us (OnLoad "
+            << agent.onload_ns / 1000 << " us)" << std::endl
+            << "resident memory added by the agent: "
+            << static_cast<int64_t> (agent.rss_kb - none.rss_kb) << " KiB"
+            << std::endl;
+
+  if (!output_file.empty ())
+    {
+      std::ofstream os (output_file);
+      write_json (os, agent_path, hsa, repetitions, results);
+      if (!os)
+        {
+          std::cerr << "could not write `" << output_file << "'" << std::endl;
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    write_json (std::cout, agent_path, hsa, repetitions, results);
+
+  /* The libraries only needed to dump must not be loaded at startup.  */
+  if (unsigned added = agent.loaded & ~none.loaded)
+    {
+      std::cerr << "the agent loaded ";
+      write_loaded (std::cerr, added);
+      std::cerr << " at startup" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
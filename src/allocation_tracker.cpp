@@ -0,0 +1,279 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "allocation_tracker.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+namespace amd::debug_agent
+{
+
+namespace
+{
+
+/* gettid is a system call, only make it once per thread.  */
+thread_local const pid_t this_thread_id = gettid ();
+
+/* Print TIME as "HH:MM:SS.uuuuuu", in local time.  */
+void
+print_time (std::ostream &os, const struct timespec &time)
+{
+  struct tm tm;
+  localtime_r (&time.tv_sec, &tm);
+
+  os << std::dec << std::right << std::setfill ('0') << std::setw (2)
+     << tm.tm_hour << ':' << std::setw (2) << tm.tm_min << ':'
+     << std::setw (2) << tm.tm_sec << '.' << std::setw (6)
+     << time.tv_nsec / 1000 << std::setfill (' ');
+}
+
+/* Print "0xPC in SYMBOL+0xOFFSET (LIBRARY)" for the return address PC.  */
+void
+print_frame (std::ostream &os, void *pc)
+{
+  os << "0x" << std::hex << std::setfill ('0') << std::setw (16)
+     << reinterpret_cast<uintptr_t> (pc) << std::setfill (' ');
+
+  /* Look up the call instruction rather than the return address, which may
+     be the first instruction of the next function.  */
+  Dl_info info;
+  if (!dladdr (static_cast<char *> (pc) - 1, &info) || !info.dli_fname)
+    return;
+
+  if (info.dli_sname)
+    {
+      int status;
+      char *demangled
+          = abi::__cxa_demangle (info.dli_sname, nullptr, nullptr, &status);
+
+      os << " in " << (demangled ? demangled : info.dli_sname) << "+0x"
+         << (static_cast<char *> (pc) - static_cast<char *> (info.dli_saddr));
+      free (demangled);
+    }
+
+  os << " (" << info.dli_fname << ")";
+}
+
+bool
+overlaps (const allocation_t &allocation, uint64_t address, std::size_t size)
+{
+  return allocation.address < address + size
+         && address < allocation.address
+                          + std::max<std::size_t> (allocation.size, 1);
+}
+
+} /* namespace */
+
+/* Never destroyed, so that the allocations made and freed while the runtime
+   shuts down are still recorded.  */
+allocation_tracker_t &allocation_tracker = *new allocation_tracker_t;
+
+std::ostream &
+operator<< (std::ostream &os, const allocation_t &allocation)
+{
+  const std::ios_base::fmtflags flags = os.flags ();
+  const char fill = os.fill ();
+
+  os << std::dec << allocation.size << " bytes at 0x" << std::hex
+     << allocation.address << " from pool 0x" << allocation.pool
+     << ", allocated at ";
+  print_time (os, allocation.time);
+  os << " by thread " << std::dec << allocation.tid;
+
+  if (allocation.freed)
+    {
+      os << ", freed at ";
+      print_time (os, allocation.free_time);
+      os << " by thread " << std::dec << allocation.free_tid;
+    }
+
+  os << '\n';
+
+  for (std::size_t i = 0; i < allocation.frame_count; ++i)
+    {
+      os << "    #" << std::dec << std::left << std::setw (2) << i << ' '
+         << std::right;
+      print_frame (os, allocation.frames[i]);
+      os << '\n';
+    }
+
+  os.fill (fill);
+  os.flags (flags);
+  return os;
+}
+
+void
+allocation_tracker_t::set_backtrace_depth (std::size_t depth)
+{
+  m_backtrace_depth = std::min (depth, allocation_t::max_backtrace_depth);
+}
+
+allocation_tracker_t::shard_t &
+allocation_tracker_t::address_shard (uint64_t address)
+{
+  /* Device allocations are page aligned, multiply by the golden ratio to mix
+     the page number into the high bits.  */
+  uint64_t hash = (address >> 12) * 0x9e3779b97f4a7c15ull;
+  return m_shards[(hash >> 32) % shard_count];
+}
+
+void
+allocation_tracker_t::allocated (void *address, std::size_t size,
+                                 uint64_t pool)
+{
+  struct timespec time;
+  clock_gettime (CLOCK_REALTIME, &time);
+
+  /* Only the return addresses are recorded, unwinding the stack is the bulk
+     of the cost, and most allocations are never printed.  Skip this
+     function and the runtime function's interceptor.  */
+  constexpr std::size_t skipped_frames = 2;
+  void *frames[allocation_t::max_backtrace_depth + skipped_frames];
+  std::size_t frame_count{ 0 };
+
+  if (m_backtrace_depth)
+    frame_count = std::max (
+        backtrace (frames, m_backtrace_depth + skipped_frames),
+        static_cast<int> (skipped_frames)) - skipped_frames;
+
+  const uint64_t key = reinterpret_cast<uintptr_t> (address);
+  shard_t &shard = address_shard (key);
+  std::scoped_lock lock (shard.lock);
+
+  allocation_map_t::iterator it;
+  if (shard.spare)
+    {
+      allocation_map_t::node_type node = std::move (shard.spare);
+      node.key () = key;
+
+      /* The runtime does not return an address that is still allocated,
+         but the application may have freed it directly.  */
+      auto result = shard.live.insert (std::move (node));
+      if (!result.inserted)
+        shard.spare = std::move (result.node);
+      it = result.position;
+    }
+  else
+    it = shard.live.try_emplace (key).first;
+
+  /* The node was most likely evicted from the freed ring long ago, only
+     write the part of it that is used.  */
+  allocation_t &allocation = it->second;
+  allocation.address = key;
+  allocation.size = size;
+  allocation.pool = pool;
+  allocation.time = time;
+  allocation.tid = this_thread_id;
+  allocation.freed = false;
+  allocation.frame_count = frame_count;
+  std::copy_n (&frames[skipped_frames], frame_count,
+               allocation.frames.begin ());
+}
+
+void
+allocation_tracker_t::freed (void *address)
+{
+  struct timespec time;
+  clock_gettime (CLOCK_REALTIME, &time);
+
+  shard_t &shard = address_shard (reinterpret_cast<uintptr_t> (address));
+  std::scoped_lock lock (shard.lock);
+
+  allocation_map_t::node_type node
+      = shard.live.extract (reinterpret_cast<uintptr_t> (address));
+  if (!node)
+    return;
+
+  allocation_t &allocation = node.mapped ();
+  allocation.freed = true;
+  allocation.free_time = time;
+  allocation.free_tid = this_thread_id;
+
+  /* Replace the oldest freed allocation, and keep its node for the next
+     allocation.  */
+  allocation_map_t::node_type &oldest = shard.freed[shard.freed_next];
+  if (oldest)
+    shard.spare = std::move (oldest);
+  oldest = std::move (node);
+  shard.freed_next = (shard.freed_next + 1) % freed_per_shard;
+}
+
+std::vector<allocation_t>
+allocation_tracker_t::find (uint64_t address, std::size_t size)
+{
+  std::vector<allocation_t> live;
+  std::optional<allocation_t> freed;
+
+  for (shard_t &shard : m_shards)
+    {
+      std::scoped_lock lock (shard.lock);
+
+      /* Live allocations do not overlap, only the last one starting before
+         ADDRESS may contain it.  */
+      auto it = shard.live.upper_bound (address);
+      if (it != shard.live.begin ()
+          && overlaps (std::prev (it)->second, address, size))
+        live.emplace_back (std::prev (it)->second);
+
+      for (; it != shard.live.end () && it->first < address + size; ++it)
+        live.emplace_back (it->second);
+
+      for (auto &&node : shard.freed)
+        if (node && overlaps (node.mapped (), address, size)
+            && (!freed
+                || std::make_pair (node.mapped ().free_time.tv_sec,
+                                   node.mapped ().free_time.tv_nsec)
+                       > std::make_pair (freed->free_time.tv_sec,
+                                         freed->free_time.tv_nsec)))
+          freed = node.mapped ();
+    }
+
+  if (live.empty () && freed)
+    live.emplace_back (*freed);
+
+  std::sort (live.begin (), live.end (),
+             [] (const allocation_t &lhs, const allocation_t &rhs) {
+               return lhs.address < rhs.address;
+             });
+
+  return live;
+}
+
+} /* namespace amd::debug_agent */
@@ -0,0 +1,136 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_ALLOCATION_TRACKER_H
+#define _ROCM_DEBUG_AGENT_ALLOCATION_TRACKER_H 1
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace amd::debug_agent
+{
+
+/* A block of device memory allocated by the application.  */
+struct allocation_t
+{
+  static constexpr std::size_t max_backtrace_depth = 32;
+
+  uint64_t address;
+  std::size_t size;
+  /* The handle of the memory pool, or of the region, it was allocated
+     from.  */
+  uint64_t pool;
+  struct timespec time;
+  pid_t tid;
+
+  /* Set once the application freed the allocation.  */
+  bool freed;
+  struct timespec free_time;
+  pid_t free_tid;
+
+  /* The return addresses of the allocating thread, innermost first.  They
+     are only resolved to symbols when the allocation is printed.  */
+  std::size_t frame_count;
+  std::array<void *, max_backtrace_depth> frames;
+};
+
+/* Print "SIZE bytes at 0xADDRESS from pool 0xPOOL, allocated at TIME by
+   thread TID", and when it was freed, followed by the allocation backtrace,
+   one frame per line.  */
+std::ostream &operator<< (std::ostream &os, const allocation_t &allocation);
+
+/* The live and the recently freed allocations of the application, safe to
+   update from concurrent threads.  Live allocations do not overlap, so each
+   shard keeps them in a map ordered by address, and an address is looked up
+   in every shard.  The allocations are spread across the shards by address
+   so that threads allocating and freeing different blocks rarely contend.
+   Freed allocations are kept in a ring per shard, and their nodes are reused
+   for the next allocations, so that tracking does not allocate host memory
+   once the tracker is warm.  */
+class allocation_tracker_t
+{
+public:
+  /* Record the allocations' backtraces up to DEPTH frames, 0 disables the
+     backtraces.  Must be set before the first allocation.  */
+  void set_backtrace_depth (std::size_t depth);
+
+  /* Record that ADDRESS was allocated from POOL.  */
+  void allocated (void *address, std::size_t size, uint64_t pool);
+
+  /* Record that ADDRESS, returned by a previous allocation, is being freed.
+     Must be called before the memory is returned to the runtime, so that
+     the address is not reused by another thread before it is recorded.  */
+  void freed (void *address);
+
+  /* Return the live allocations overlapping [ADDRESS, ADDRESS + SIZE), or
+     if there are none, the most recently freed allocation overlapping it,
+     if any.  */
+  std::vector<allocation_t> find (uint64_t address, std::size_t size);
+
+private:
+  /* The number of freed allocations remembered by each shard.  */
+  static constexpr std::size_t freed_per_shard = 64;
+  static constexpr std::size_t shard_count = 64;
+
+  using allocation_map_t = std::map<uint64_t, allocation_t>;
+
+  struct alignas (64) shard_t
+  {
+    std::mutex lock;
+    allocation_map_t live;
+    /* The freed allocations, the oldest at `freed_next` once the ring is
+       full.  */
+    std::array<allocation_map_t::node_type, freed_per_shard> freed;
+    std::size_t freed_next{ 0 };
+    /* A node evicted from the ring, reused by the next allocation.  */
+    allocation_map_t::node_type spare;
+  };
+
+  shard_t &address_shard (uint64_t address);
+
+  std::size_t m_backtrace_depth{ 0 };
+  std::array<shard_t, shard_count> m_shards;
+};
+
+/* The device memory allocations of the application, only updated if
+   --track-allocations is used.  */
+extern allocation_tracker_t &allocation_tracker;
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_ALLOCATION_TRACKER_H */
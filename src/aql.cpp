@@ -0,0 +1,205 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "aql.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace amd::debug_agent
+{
+
+namespace
+{
+
+const char *
+signal_condition_string (hsa_signal_condition32_t condition)
+{
+  switch (condition)
+    {
+    case HSA_SIGNAL_CONDITION_EQ:
+      return "EQ";
+    case HSA_SIGNAL_CONDITION_NE:
+      return "NE";
+    case HSA_SIGNAL_CONDITION_LT:
+      return "LT";
+    case HSA_SIGNAL_CONDITION_GTE:
+      return "GTE";
+    }
+  return "unknown";
+}
+
+void
+print_dependent_signals (std::ostream &os, const hsa_signal_t (&signals)[5])
+{
+  os << "dep_signal=[";
+
+  const char *separator = "";
+  for (const hsa_signal_t &signal : signals)
+    if (signal.handle)
+      {
+        os << separator << "0x" << signal.handle;
+        separator = ", ";
+      }
+
+  os << "]";
+}
+
+} /* namespace */
+
+std::vector<aql_packet_t>
+read_aql_packets (const void *ring, uint32_t size, uint64_t read_index,
+                  uint64_t write_index, std::size_t max_count)
+{
+  std::vector<aql_packet_t> packets;
+
+  if (!ring || !size || write_index <= read_index)
+    return packets;
+
+  /* All the packet types have the same size.  */
+  constexpr std::size_t packet_size = sizeof (hsa_kernel_dispatch_packet_t);
+  static_assert (sizeof (aql_packet_t) == sizeof (uint64_t) + packet_size);
+
+  const std::size_t count
+      = std::min<uint64_t> ({ write_index - read_index, size, max_count });
+  packets.resize (count);
+
+  for (std::size_t i = 0; i < count; ++i)
+    {
+      const uint64_t index = read_index + i;
+      packets[i].index = index;
+
+      /* The size of a queue is a power of 2.  */
+      memcpy (&packets[i].kernel_dispatch,
+              static_cast<const char *> (ring)
+                  + (index & (size - 1)) * packet_size,
+              packet_size);
+    }
+
+  return packets;
+}
+
+void
+print_aql_packet (std::ostream &os, const aql_packet_t &packet,
+                  const std::string &kernel_name)
+{
+  const std::ios_base::fmtflags flags = os.flags ();
+
+  os << "  packet " << std::dec << packet.index << ": ";
+
+  const bool barrier = (packet.header >> HSA_PACKET_HEADER_BARRIER) & 1;
+
+  switch (packet.type ())
+    {
+    case HSA_PACKET_TYPE_KERNEL_DISPATCH:
+      {
+        const hsa_kernel_dispatch_packet_t &dispatch = packet.kernel_dispatch;
+
+        os << "kernel_dispatch";
+        if (!kernel_name.empty ())
+          os << " (" << kernel_name << ")";
+        if (barrier)
+          os << ", barrier";
+
+        os << "\n    kernel_object=0x" << std::hex << dispatch.kernel_object
+           << std::dec << ", grid=(" << dispatch.grid_size_x << ", "
+           << dispatch.grid_size_y << ", " << dispatch.grid_size_z
+           << "), workgroup=(" << dispatch.workgroup_size_x << ", "
+           << dispatch.workgroup_size_y << ", " << dispatch.workgroup_size_z
+           << "), private_segment_size=" << dispatch.private_segment_size
+           << ", group_segment_size=" << dispatch.group_segment_size
+           << ", kernarg_address=" << dispatch.kernarg_address
+           << ", completion_signal=0x" << std::hex
+           << dispatch.completion_signal.handle << '\n';
+        break;
+      }
+
+    case HSA_PACKET_TYPE_BARRIER_AND:
+    case HSA_PACKET_TYPE_BARRIER_OR:
+      {
+        /* Both barrier packets have the same layout.  */
+        const hsa_barrier_and_packet_t &barrier_packet = packet.barrier_and;
+
+        os << (packet.type () == HSA_PACKET_TYPE_BARRIER_AND ? "barrier_and"
+                                                             : "barrier_or")
+           << std::hex << "\n    ";
+        print_dependent_signals (os, barrier_packet.dep_signal);
+        os << ", completion_signal=0x"
+           << barrier_packet.completion_signal.handle << '\n';
+        break;
+      }
+
+    case HSA_PACKET_TYPE_AGENT_DISPATCH:
+      {
+        const hsa_agent_dispatch_packet_t &dispatch = packet.agent_dispatch;
+
+        os << "agent_dispatch, type=" << dispatch.type << std::hex
+           << "\n    arg=[0x" << dispatch.arg[0] << ", 0x" << dispatch.arg[1]
+           << ", 0x" << dispatch.arg[2] << ", 0x" << dispatch.arg[3]
+           << "], return_address=" << dispatch.return_address
+           << ", completion_signal=0x" << dispatch.completion_signal.handle
+           << '\n';
+        break;
+      }
+
+    case HSA_PACKET_TYPE_VENDOR_SPECIFIC:
+      if (const hsa_amd_barrier_value_packet_t &barrier_value
+          = packet.barrier_value;
+          barrier_value.header.AmdFormat == HSA_AMD_PACKET_TYPE_BARRIER_VALUE)
+        {
+          os << "barrier_value" << std::hex << "\n    signal=0x"
+             << barrier_value.signal.handle
+             << ", condition=" << signal_condition_string (barrier_value.cond)
+             << ", value=0x" << barrier_value.value << ", mask=0x"
+             << barrier_value.mask << ", completion_signal=0x"
+             << barrier_value.completion_signal.handle << '\n';
+        }
+      else
+        {
+          os << "vendor_specific, format=" << std::dec
+             << static_cast<unsigned> (barrier_value.header.AmdFormat)
+             << '\n';
+        }
+      break;
+
+    case HSA_PACKET_TYPE_INVALID:
+      os << "invalid\n";
+      break;
+
+    default:
+      os << "unknown type " << std::dec << packet.type () << '\n';
+      break;
+    }
+
+  os.flags (flags);
+}
+
+} /* namespace amd::debug_agent */
@@ -0,0 +1,87 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_AQL_H
+#define _ROCM_DEBUG_AGENT_AQL_H 1
+
+#include <hsa/hsa.h>
+#include <hsa/hsa_ext_amd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace amd::debug_agent
+{
+
+/* A copy of an AQL packet read from a queue's ring buffer.  */
+struct aql_packet_t
+{
+  /* The packet's index in the queue.  */
+  uint64_t index;
+
+  union
+  {
+    uint16_t header;
+    hsa_kernel_dispatch_packet_t kernel_dispatch;
+    hsa_agent_dispatch_packet_t agent_dispatch;
+    hsa_barrier_and_packet_t barrier_and;
+    hsa_barrier_or_packet_t barrier_or;
+    hsa_amd_barrier_value_packet_t barrier_value;
+  };
+
+  hsa_packet_type_t
+  type () const
+  {
+    return static_cast<hsa_packet_type_t> (
+        (header >> HSA_PACKET_HEADER_TYPE)
+        & ((1 << HSA_PACKET_HEADER_WIDTH_TYPE) - 1));
+  }
+};
+
+/* Copy the packets in [read_index, write_index) from `ring`, which holds
+   `size` packets, but no more than `max_count` of them.  The packets are
+   copied as they are, the ones not yet written by the producer are
+   invalid.  */
+std::vector<aql_packet_t> read_aql_packets (const void *ring, uint32_t size,
+                                            uint64_t read_index,
+                                            uint64_t write_index,
+                                            std::size_t max_count);
+
+/* Print `packet`, indented by 2 spaces.  `kernel_name` is the name of the
+   kernel a kernel dispatch packet launches, if known.  */
+void print_aql_packet (std::ostream &os, const aql_packet_t &packet,
+                       const std::string &kernel_name = {});
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_AQL_H */
@@ -31,17 +31,16 @@
 #include "code_object.h"
 #include "debug.h"
 #include "logging.h"
+#include "stats.h"
 
 #include <ctype.h>
 #include <cxxabi.h>
 #include <elf.h>
 #include <elfutils/libdw.h>
-#include <fcntl.h>
 #include <gelf.h>
 #include <libelf.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include <algorithm>
 #include <cstdint>
@@ -50,14 +49,320 @@
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace amd::debug_agent
 {
 
+namespace
+{
+
+std::string
+demangle (const std::string &symbol_name)
+{
+  if (int status; auto *demangled_name = abi::__cxa_demangle (
+                      symbol_name.c_str (), nullptr, nullptr, &status))
+    {
+      std::string str (demangled_name);
+      free (demangled_name);
+      return str;
+    }
+
+  return symbol_name;
+}
+
+/* Return the protocol of `uri`, in lower case.  */
+std::string
+uri_protocol (const std::string &uri)
+{
+  std::string protocol = uri.substr (0, uri.find ("://"));
+  std::transform (protocol.begin (), protocol.end (), protocol.begin (),
+                  [] (unsigned char c) { return std::tolower (c); });
+  return protocol;
+}
+
+/* Estimate the heap memory used by `value`, and by the nodes of `map`.  */
+size_t
+heap_bytes (const std::string &value)
+{
+  /* Short strings are stored in the string object.  */
+  return value.capacity () > 15 ? value.capacity () + 1 : 0;
+}
+
+template <typename T>
+size_t
+heap_bytes (const T &)
+{
+  return 0;
+}
+
+template <typename T, typename U>
+size_t
+heap_bytes (const std::pair<T, U> &value)
+{
+  return heap_bytes (value.first) + heap_bytes (value.second);
+}
+
+template <typename Key, typename T>
+size_t
+heap_bytes (const std::map<Key, T> &map)
+{
+  /* A red-black tree node has 3 pointers and a color.  */
+  size_t bytes = map.size ()
+                 * (4 * sizeof (void *)
+                    + sizeof (typename std::map<Key, T>::value_type));
+
+  for (auto &&value : map)
+    bytes += heap_bytes (value);
+
+  return bytes;
+}
+
+} /* namespace */
+
+class code_object_t::memory_manager_t
+{
+public:
+  static memory_manager_t &
+  instance ()
+  {
+    /* Never destroyed, the code objects of other static objects may be
+       destroyed after it.  */
+    static memory_manager_t *manager = new memory_manager_t;
+    return *manager;
+  }
+
+  void
+  set_limit (std::size_t limit)
+  {
+    std::scoped_lock lock (m_lock);
+    m_limit = limit;
+  }
+
+  void
+  add (code_object_t *code_object)
+  {
+    std::scoped_lock lock (m_lock);
+    m_code_objects.emplace (code_object);
+    m_peak.code_object_count
+        = std::max (m_peak.code_object_count, m_code_objects.size ());
+  }
+
+  void
+  remove (code_object_t *code_object)
+  {
+    std::scoped_lock lock (m_lock);
+    m_code_objects.erase (code_object);
+    m_index_bytes -= code_object->m_index_bytes;
+    code_object->m_index_bytes = 0;
+  }
+
+  /* Make `to` take the place of `from`, which is being moved into it.  */
+  void
+  replace (code_object_t *from, code_object_t *to)
+  {
+    std::scoped_lock lock (m_lock);
+    if (m_code_objects.erase (from))
+      m_code_objects.emplace (to);
+    to->m_index_bytes = std::exchange (from->m_index_bytes, 0);
+  }
+
+  /* Return the ELF file of the code objects sharing `key` if one of them
+     holds it.  */
+  std::shared_ptr<const std::vector<char>>
+  find_image (const std::string &key)
+  {
+    std::scoped_lock lock (m_lock);
+    if (auto it = m_images.find (key); it != m_images.end ())
+      return it->second.lock ();
+    return {};
+  }
+
+  /* Return a shared ELF file with the contents of `buffer`, which
+     find_image returns for `key` until it is released.  It is accounted for
+     until then.  */
+  std::shared_ptr<const std::vector<char>>
+  make_image (const std::string &key, std::vector<char> buffer)
+  {
+    const std::size_t size = buffer.size ();
+    std::shared_ptr<const std::vector<char>> image (
+        new std::vector<char> (std::move (buffer)),
+        [this, key] (const std::vector<char> *image) {
+          {
+            std::scoped_lock lock (m_lock);
+            m_image_bytes -= image->size ();
+            if (auto it = m_images.find (key);
+                it != m_images.end () && it->second.expired ())
+              m_images.erase (it);
+          }
+          delete image;
+        });
+
+    std::scoped_lock lock (m_lock);
+    m_image_bytes += size;
+    m_peak.image_bytes = std::max (m_peak.image_bytes, m_image_bytes);
+    m_images[key] = image;
+
+    return image;
+  }
+
+  void
+  touch (code_object_t *code_object)
+  {
+    code_object->m_last_use.store (
+        m_clock.fetch_add (1, std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+
+  /* Account for a new index of `bytes` built by `code_object`, whose
+     m_load_lock is held, and evict as needed.  */
+  void
+  charge (code_object_t *code_object, std::size_t bytes)
+  {
+    std::scoped_lock lock (m_lock);
+
+    if (!m_code_objects.count (code_object))
+      return;
+
+    code_object->m_index_bytes += bytes;
+    m_index_bytes += bytes;
+    ++m_index_build_count;
+
+    evict (code_object);
+    m_peak.index_bytes = std::max (m_peak.index_bytes, m_index_bytes);
+  }
+
+  /* Release the ELF files and indices of the least recently used code
+     objects other than `current` until the limit is met.  The code objects
+     in use by another thread are skipped, so that the load locks are only
+     ever acquired in one order.  An ELF file is only released once none of
+     the code objects sharing it hold it.  The pinned ELF files are never
+     released.  */
+  void
+  evict (const code_object_t *current)
+  {
+    std::scoped_lock lock (m_lock);
+
+    if (!m_limit || m_index_bytes + m_image_bytes <= m_limit)
+      return;
+
+    std::vector<std::pair<uint64_t, code_object_t *>> candidates;
+    for (code_object_t *candidate : m_code_objects)
+      if (candidate != current)
+        candidates.emplace_back (
+            candidate->m_last_use.load (std::memory_order_relaxed),
+            candidate);
+
+    std::sort (candidates.begin (), candidates.end ());
+
+    for (auto it = candidates.begin ();
+         it != candidates.end () && m_index_bytes + m_image_bytes > m_limit;
+         ++it)
+      {
+        code_object_t *victim = it->second;
+
+        std::unique_lock victim_lock (victim->m_load_lock, std::try_to_lock);
+        if (!victim_lock
+            || ((!victim->m_image || victim->m_image_pinned)
+                && !victim->m_symbol_index && !victim->m_debug_index))
+          continue;
+
+        /* Releasing the last reference to an ELF file calls its deleter,
+           which updates m_image_bytes with m_lock held again.  */
+        if (!victim->m_image_pinned)
+          victim->m_image.reset ();
+        victim->m_symbol_index.reset ();
+        victim->m_debug_index.reset ();
+        m_index_bytes -= std::exchange (victim->m_index_bytes, 0);
+        ++m_eviction_count;
+      }
+  }
+
+  code_object_memory_stats_t
+  stats (bool reset)
+  {
+    std::scoped_lock lock (m_lock);
+
+    code_object_memory_stats_t stats;
+    stats.code_object_count = m_code_objects.size ();
+    stats.image_bytes = m_image_bytes;
+    stats.index_bytes = m_index_bytes;
+    stats.peak_code_object_count = m_peak.code_object_count;
+    stats.peak_image_bytes = m_peak.image_bytes;
+    stats.peak_index_bytes = m_peak.index_bytes;
+    stats.index_build_count = m_index_build_count;
+    stats.eviction_count = m_eviction_count;
+
+    if (reset)
+      {
+        m_index_build_count = 0;
+        m_eviction_count = 0;
+        m_peak.code_object_count = m_code_objects.size ();
+        m_peak.image_bytes = m_image_bytes;
+        m_peak.index_bytes = m_index_bytes;
+      }
+    return stats;
+  }
+
+private:
+  /* Recursive, the deleter of an ELF file released by evict takes it.  */
+  std::recursive_mutex m_lock;
+  std::size_t m_limit{ 0 };
+  std::unordered_set<code_object_t *> m_code_objects;
+  std::unordered_map<std::string, std::weak_ptr<const std::vector<char>>>
+      m_images;
+  std::size_t m_image_bytes{ 0 };
+  std::size_t m_index_bytes{ 0 };
+  /* The largest counts since the last call to stats.  */
+  struct
+  {
+    std::size_t code_object_count{ 0 };
+    std::size_t image_bytes{ 0 };
+    std::size_t index_bytes{ 0 };
+  } m_peak;
+  std::size_t m_index_build_count{ 0 };
+  std::size_t m_eviction_count{ 0 };
+  std::atomic<uint64_t> m_clock{ 0 };
+};
+
+void
+set_code_object_memory_limit (std::size_t limit)
+{
+  code_object_t::memory_manager_t::instance ().set_limit (limit);
+}
+
+code_object_memory_stats_t
+code_object_memory_stats (bool reset)
+{
+  return code_object_t::memory_manager_t::instance ().stats (reset);
+}
+
+void
+print_code_object_memory (std::ostream &os, bool reset)
+{
+  const code_object_memory_stats_t stats = code_object_memory_stats (reset);
+  const std::ios_base::fmtflags flags = os.flags ();
+
+  os << "\nCode object memory:" << std::dec << std::left << std::setfill (' ')
+     << '\n'
+     << std::setw (24) << "  code objects:" << stats.code_object_count
+     << " (peak " << stats.peak_code_object_count << ")\n"
+     << std::setw (24) << "  ELF files (bytes):" << stats.image_bytes
+     << " (peak " << stats.peak_image_bytes << ")\n"
+     << std::setw (24) << "  indices (bytes):" << stats.index_bytes
+     << " (peak " << stats.peak_index_bytes << ")\n"
+     << std::setw (24) << "  indices built:" << stats.index_build_count
+     << '\n'
+     << std::setw (24) << "  evictions:" << stats.eviction_count << '\n';
+
+  os.flags (flags);
+}
+
 code_object_t::code_object_t (amd_dbgapi_process_id_t process_id,
                               amd_dbgapi_code_object_id_t code_object_id)
     : m_code_object_id (code_object_id), m_process_id (process_id)
@@ -85,43 +390,46 @@ code_object_t::code_object_t (amd_dbgapi_process_id_t process_id,
   free (value);
 }
 
+code_object_t::code_object_t (std::string uri,
+                              amd_dbgapi_global_address_t load_address)
+    : m_load_address (load_address), m_uri (std::move (uri)),
+      m_code_object_id (AMD_DBGAPI_CODE_OBJECT_NONE),
+      m_process_id (AMD_DBGAPI_PROCESS_NONE)
+{
+}
+
 code_object_t::code_object_t (code_object_t &&rhs)
     : m_load_address (rhs.m_load_address), m_mem_size (rhs.m_mem_size),
-      m_uri (std::move (rhs.m_uri)), m_code_object_id (rhs.m_code_object_id),
-      m_process_id (rhs.m_process_id)
+      m_open (rhs.m_open), m_file_size (rhs.m_file_size),
+      m_image (std::move (rhs.m_image)), m_image_pinned (rhs.m_image_pinned),
+      m_symbol_index (std::move (rhs.m_symbol_index)),
+      m_debug_index (std::move (rhs.m_debug_index)),
+      m_last_use (rhs.m_last_use.load ()),
+      m_load_segments (std::move (rhs.m_load_segments)),
+      m_content_hash (rhs.m_content_hash), m_uri (std::move (rhs.m_uri)),
+      m_code_object_id (rhs.m_code_object_id), m_process_id (rhs.m_process_id)
 {
-  m_fd = rhs.m_fd;
-  rhs.m_fd.reset ();
+  memory_manager_t::instance ().replace (&rhs, this);
 }
 
 code_object_t::~code_object_t ()
 {
-  if (m_fd)
-    ::close (*m_fd);
+  memory_manager_t::instance ().remove (this);
 }
 
 std::optional<code_object_t::symbol_info_t>
 code_object_t::find_symbol (amd_dbgapi_global_address_t address)
 {
   /* Load the symbol table.  */
-  load_symbol_map ();
+  auto index = symbol_index ();
 
-  if (auto it = m_symbol_map->upper_bound (address);
-      it != m_symbol_map->begin ())
+  if (auto it = index->symbol_map.upper_bound (address);
+      it != index->symbol_map.begin ())
     {
       if (auto &&[symbol_value, symbol] = *std::prev (it);
           address < (symbol_value + symbol.second))
         {
-          std::string symbol_name = symbol.first;
-
-          if (int status; auto *demangled_name = abi::__cxa_demangle (
-                              symbol_name.c_str (), nullptr, nullptr, &status))
-            {
-              symbol_name = demangled_name;
-              free (demangled_name);
-            }
-
-          return symbol_info_t{ std::move (symbol_name), symbol_value,
+          return symbol_info_t{ demangle (symbol.first), symbol_value,
                                 symbol.second };
         }
     }
@@ -129,17 +437,60 @@ code_object_t::find_symbol (amd_dbgapi_global_address_t address)
   return {};
 }
 
-void
-code_object_t::open ()
+std::optional<std::string>
+code_object_t::find_kernel_descriptor (amd_dbgapi_global_address_t address)
 {
-  const std::string protocol_delim{ "://" };
+  /* The kernel descriptors are loaded with the symbol table.  */
+  auto index = symbol_index ();
 
-  size_t protocol_end = m_uri.find (protocol_delim);
-  std::string protocol = m_uri.substr (0, protocol_end);
-  protocol_end += protocol_delim.length ();
+  if (auto it = index->kernel_descriptor_map.find (address);
+      it != index->kernel_descriptor_map.end ())
+    return demangle (it->second);
 
-  std::transform (protocol.begin (), protocol.end (), protocol.begin (),
-                  [] (unsigned char c) { return std::tolower (c); });
+  return {};
+}
+
+std::optional<std::pair<std::string, size_t>>
+code_object_t::find_line (amd_dbgapi_global_address_t address)
+{
+  /* Load the line number table, and low/high pc for all CUs.  */
+  auto index = debug_index ();
+
+  /* Only addresses covered by a compilation unit have line information.  */
+  if (auto it = index->pc_ranges_map.upper_bound (address);
+      it == index->pc_ranges_map.begin ()
+      || address >= std::prev (it)->second)
+    return {};
+
+  if (auto it = index->line_number_map.upper_bound (address);
+      it != index->line_number_map.begin ())
+    return std::prev (it)->second;
+
+  return {};
+}
+
+std::shared_ptr<const std::vector<char>>
+code_object_t::load_image () const
+{
+  memory_manager_t &memory_manager = memory_manager_t::instance ();
+  const std::string protocol = uri_protocol (m_uri);
+
+  /* The code objects loaded from the same URI share their ELF file.  A
+     memory URI only names a range of the process's memory, which may hold
+     another code object once this one is unloaded, so its ELF file is only
+     shared by the code objects with the same id.  */
+  const std::string image_key
+      = protocol == "memory" ? m_uri + "#code_object_"
+                                   + std::to_string (m_code_object_id.handle)
+                             : m_uri;
+  if (auto image = memory_manager.find_image (image_key))
+    return image;
+
+  static stat_site_t timer_site ("code_object_read");
+  scoped_timer_t timer (timer_site);
+
+  const std::string protocol_delim{ "://" };
+  size_t protocol_end = m_uri.find (protocol_delim) + protocol_delim.length ();
 
   std::string path;
   size_t path_end = m_uri.find_first_of ("#?", protocol_end);
@@ -190,7 +541,7 @@ code_object_t::open ()
 
       if (auto size_it = params.find ("size"); size_it != params.end ())
         if (!(size = std::stoul (size_it->second, nullptr, 0)))
-          return;
+          return {};
 
       if (protocol == "file")
         {
@@ -198,7 +549,7 @@ code_object_t::open ()
           if (!file)
             {
               agent_warning ("could not open `%s'", decoded_path.c_str ());
-              return;
+              return {};
             }
 
           if (!size)
@@ -211,7 +562,7 @@ code_object_t::open ()
                 {
                   agent_warning ("invalid uri `%s' (file size < offset)",
                                  decoded_path.c_str ());
-                  return;
+                  return {};
                 }
               size = bytes - offset;
             }
@@ -226,52 +577,52 @@ code_object_t::open ()
             {
               agent_warning ("invalid uri `%s' (offset and size must be != 0",
                              m_uri.c_str ());
-              return;
+              return {};
             }
 
           buffer.resize (size);
-          if (amd_dbgapi_read_memory (m_process_id, AMD_DBGAPI_WAVE_NONE, 0,
-                                      AMD_DBGAPI_ADDRESS_SPACE_GLOBAL, offset,
-                                      &size, buffer.data ())
+          if (DBGAPI_TIMED (amd_dbgapi_read_memory (
+                  m_process_id, AMD_DBGAPI_WAVE_NONE, 0,
+                  AMD_DBGAPI_ADDRESS_SPACE_GLOBAL, offset, &size,
+                  buffer.data ()))
               != AMD_DBGAPI_STATUS_SUCCESS)
             {
               agent_warning ("could not read memory at 0x%lx", offset);
-              return;
+              return {};
             }
         }
       else
         {
           agent_warning ("\"%s\" protocol not supported", protocol.c_str ());
-          return;
+          return {};
         }
     }
   catch (...)
     {
     }
 
-  int fd = ::open ("/tmp", O_TMPFILE | O_RDWR, 0666);
-  if (fd == -1)
-    {
-      agent_warning ("could not create a temporary file for code object");
-      return;
-    }
+  timer.add_bytes (buffer.size ());
+  return memory_manager.make_image (image_key, std::move (buffer));
+}
 
-  if (size_t size = ::write (fd, buffer.data (), buffer.size ());
-      size != buffer.size ())
-    {
-      agent_warning ("could not write to the temporary file");
-      return;
-    }
+void
+code_object_t::open ()
+{
+  static stat_site_t timer_site ("code_object_open");
+  scoped_timer_t timer (timer_site);
 
-  ::lseek (fd, 0, SEEK_SET);
+  std::shared_ptr<const std::vector<char>> image = load_image ();
+  if (!image)
+    return;
 
   /* Calculate the size of the code object as loaded in memory.  Its size is
      the distance of the end of the highest segment from the load address.  */
   std::unique_ptr<Elf, void (*) (Elf *)> elf (
-      elf_begin (fd, ELF_C_READ, nullptr), [] (Elf *elf) { elf_end (elf); });
+      elf_memory (const_cast<char *> (image->data ()), image->size ()),
+      [] (Elf *elf) { elf_end (elf); });
   if (!elf)
     {
-      agent_warning ("elf_begin failed for `%s'", m_uri.c_str ());
+      agent_warning ("elf_memory failed for `%s'", m_uri.c_str ());
       return;
     }
 
@@ -292,11 +643,46 @@ code_object_t::open ()
           return;
         }
 
-      if (phdr->p_type == PT_LOAD)
-        m_mem_size = std::max (m_mem_size, phdr->p_vaddr + phdr->p_memsz);
+      if (phdr->p_type != PT_LOAD)
+        continue;
+
+      m_mem_size = std::max (m_mem_size, phdr->p_vaddr + phdr->p_memsz);
+      m_load_segments.push_back (
+          { phdr->p_vaddr, phdr->p_filesz, phdr->p_offset });
     }
 
-  m_fd.emplace (fd);
+  m_file_size = image->size ();
+  m_image = std::move (image);
+  m_image_pinned = uri_protocol (m_uri) == "memory";
+  m_open = true;
+
+  memory_manager_t &memory_manager = memory_manager_t::instance ();
+  memory_manager.add (this);
+  memory_manager.evict (this);
+}
+
+std::shared_ptr<const std::vector<char>>
+code_object_t::image_locked () const
+{
+  if (!m_image)
+    {
+      /* Reading a pinned ELF file again would call the debugger API,
+         which the caller may not hold the lock of.  */
+      agent_assert (!m_image_pinned && "a pinned ELF file is never released");
+      m_image = load_image ();
+      if (!m_image)
+        agent_warning ("could not load `%s' again", m_uri.c_str ());
+      memory_manager_t::instance ().evict (this);
+    }
+
+  return m_image;
+}
+
+std::shared_ptr<const std::vector<char>>
+code_object_t::image () const
+{
+  std::scoped_lock lock (m_load_lock);
+  return image_locked ();
 }
 
 namespace
@@ -329,22 +715,32 @@ get_source_file_index (const std::string &file_name)
 
 } /* namespace */
 
-void
-code_object_t::load_symbol_map ()
+std::shared_ptr<const code_object_t::symbol_index_t>
+code_object_t::symbol_index ()
 {
   agent_assert (is_open () && "code object is not opened");
 
-  if (m_symbol_map)
-    return;
+  memory_manager_t &memory_manager = memory_manager_t::instance ();
+  memory_manager.touch (this);
+
+  std::scoped_lock lock (m_load_lock);
+  if (m_symbol_index)
+    return m_symbol_index;
 
+  static stat_site_t timer_site ("load_symbol_map");
+  scoped_timer_t timer (timer_site);
+
+  auto index = std::make_shared<symbol_index_t> ();
+  m_symbol_index = index;
+
+  const std::shared_ptr<const std::vector<char>> image = image_locked ();
   std::unique_ptr<Elf, void (*) (Elf *)> elf (
-      elf_begin (*m_fd, ELF_C_READ, nullptr),
+      image ? elf_memory (const_cast<char *> (image->data ()), image->size ())
+            : nullptr,
       [] (Elf *elf) { elf_end (elf); });
 
   if (!elf)
-    return;
-
-  m_symbol_map.emplace ();
+    return index;
 
   /* Slurp the symbol table.  */
   Elf_Scn *scn = nullptr;
@@ -366,14 +762,31 @@ code_object_t::load_symbol_map ()
           GElf_Sym sym_mem;
           GElf_Sym *sym = gelf_getsym (data, j, &sym_mem);
 
-          if (GELF_ST_TYPE (sym->st_info) != STT_FUNC
-              || sym->st_shndx == SHN_UNDEF)
+          if (sym->st_shndx == SHN_UNDEF)
             continue;
 
           std::string symbol_name{ elf_strptr (elf.get (), shdr->sh_link,
                                                sym->st_name) };
 
-          auto [it, success] = m_symbol_map->emplace (
+          /* A kernel's descriptor is an object named after the kernel, with
+             a ".kd" suffix.  */
+          if (static const std::string kd_suffix{ ".kd" };
+              GELF_ST_TYPE (sym->st_info) == STT_OBJECT
+              && symbol_name.size () > kd_suffix.size ()
+              && symbol_name.compare (symbol_name.size () - kd_suffix.size (),
+                                      kd_suffix.size (), kd_suffix)
+                     == 0)
+            {
+              symbol_name.resize (symbol_name.size () - kd_suffix.size ());
+              index->kernel_descriptor_map.emplace (
+                  m_load_address + sym->st_value, std::move (symbol_name));
+              continue;
+            }
+
+          if (GELF_ST_TYPE (sym->st_info) != STT_FUNC)
+            continue;
+
+          auto [it, success] = index->symbol_map.emplace (
               m_load_address + sym->st_value,
               std::make_pair (symbol_name, sym->st_size));
 
@@ -386,24 +799,44 @@ code_object_t::load_symbol_map ()
     }
 
   /* TODO: If we did not see a symbtab, check the dynamic segment.  */
+
+  memory_manager.charge (this,
+                         heap_bytes (index->symbol_map)
+                             + heap_bytes (index->kernel_descriptor_map));
+  return index;
 }
 
-void
-code_object_t::load_debug_info ()
+std::shared_ptr<const code_object_t::debug_index_t>
+code_object_t::debug_index ()
 {
   agent_assert (is_open () && "code object is not opened");
 
-  if (m_line_number_map && m_pc_ranges_map)
-    return;
+  memory_manager_t &memory_manager = memory_manager_t::instance ();
+  memory_manager.touch (this);
+
+  std::scoped_lock lock (m_load_lock);
+  if (m_debug_index)
+    return m_debug_index;
+
+  static stat_site_t timer_site ("load_debug_info");
+  scoped_timer_t timer (timer_site);
+
+  /* Code objects without debug information have empty maps.  */
+  auto index = std::make_shared<debug_index_t> ();
+  m_debug_index = index;
+
+  const std::shared_ptr<const std::vector<char>> image = image_locked ();
+  std::unique_ptr<Elf, void (*) (Elf *)> elf (
+      image ? elf_memory (const_cast<char *> (image->data ()), image->size ())
+            : nullptr,
+      [] (Elf *elf) { elf_end (elf); });
 
   std::unique_ptr<Dwarf, void (*) (Dwarf *)> dbg (
-      dwarf_begin (*m_fd, DWARF_C_READ), [] (Dwarf *dbg) { dwarf_end (dbg); });
+      elf ? dwarf_begin_elf (elf.get (), DWARF_C_READ, nullptr) : nullptr,
+      [] (Dwarf *dbg) { dwarf_end (dbg); });
 
   if (!dbg)
-    return;
-
-  m_line_number_map.emplace ();
-  m_pc_ranges_map.emplace ();
+    return index;
 
   Dwarf_Off cu_offset{ 0 }, next_offset;
   size_t header_size;
@@ -422,8 +855,8 @@ code_object_t::load_debug_info ()
          (DW_AT_low_pc/DW_AT_high_pc), or a series of non-contiguous ranges
          (DW_AT_ranges). */
       while ((offset = dwarf_ranges (&die, offset, &base, &start, &end) > 0))
-        m_pc_ranges_map->emplace (m_load_address + start,
-                                  m_load_address + end);
+        index->pc_ranges_map.emplace (m_load_address + start,
+                                      m_load_address + end);
 
       Dwarf_Lines *lines;
       size_t line_count;
@@ -439,7 +872,7 @@ code_object_t::load_debug_info ()
               line && !dwarf_lineaddr (line, &addr)
               && !dwarf_lineno (line, &line_number) && line_number)
             {
-              m_line_number_map->emplace (
+              index->line_number_map.emplace (
                   m_load_address + addr,
                   std::make_pair (dwarf_linesrc (line, nullptr, nullptr),
                                   line_number));
@@ -448,32 +881,27 @@ code_object_t::load_debug_info ()
 
       cu_offset = next_offset;
     }
+
+  memory_manager.charge (this, heap_bytes (index->line_number_map)
+                                   + heap_bytes (index->pc_ranges_map));
+  return index;
 }
 
-void
-code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
-                            amd_dbgapi_global_address_t pc)
+std::pair<amd_dbgapi_global_address_t, amd_dbgapi_global_address_t>
+code_object_t::disassembly_range (amd_dbgapi_global_address_t pc,
+                                  amd_dbgapi_size_t context_byte_size)
 {
-  amd_dbgapi_size_t largest_instruction_size;
-  if (amd_dbgapi_architecture_get_info (
-          architecture_id,
-          AMD_DBGAPI_ARCHITECTURE_INFO_LARGEST_INSTRUCTION_SIZE,
-          sizeof (largest_instruction_size), &largest_instruction_size)
-      != AMD_DBGAPI_STATUS_SUCCESS)
-    agent_error ("could not get the instruction size from the architecture");
-
   /* Load the line number table, and low/high pc for all CUs.  */
-  load_debug_info ();
+  auto index = debug_index ();
 
-  constexpr int context_byte_size = 24;
   amd_dbgapi_global_address_t start_pc;
 
   /* Try to find a line number that precedes `pc` by `context_byte_size` bytes.
      If we don't have a line number map, simply start the disassembly from the
      current pc.  */
 
-  if (auto it = m_line_number_map->upper_bound (pc);
-      it != m_line_number_map->begin ())
+  if (auto it = index->line_number_map.upper_bound (pc);
+      it != index->line_number_map.begin ())
     {
       do
         {
@@ -481,7 +909,7 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
           if ((pc - it->first) >= context_byte_size)
             break;
         }
-      while (it != m_line_number_map->begin ());
+      while (it != index->line_number_map.begin ());
 
       start_pc = it->first;
     }
@@ -498,8 +926,8 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
   /* If pc is included in a [lowpc,highpc] interval, clamp start_pc and
      end_pc.  */
 
-  if (auto it = m_pc_ranges_map->upper_bound (pc);
-      it != m_pc_ranges_map->begin ())
+  if (auto it = index->pc_ranges_map.upper_bound (pc);
+      it != index->pc_ranges_map.begin ())
     {
       if (auto [low_pc, high_pc] = *std::prev (it); pc < high_pc)
         {
@@ -508,18 +936,80 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
         }
     }
 
+  return { start_pc, end_pc };
+}
+
+size_t
+code_object_t::first_source_line (const std::string &file_name,
+                                  size_t line_number,
+                                  const std::string &prev_file_name,
+                                  size_t prev_line_number)
+{
+  /* Load the line number table, and low/high pc for all CUs.  */
+  auto index = debug_index ();
+
+  size_t first_line = line_number;
+
+  /* Find the first line to print between prev_line_number and line_number
+     that does not appear in the line number table.  */
+  if (file_name == prev_file_name && (line_number + 1) > prev_line_number)
+    {
+      while (--first_line > prev_line_number)
+        {
+          if (std::find_if (
+                  index->line_number_map.begin (),
+                  index->line_number_map.end (),
+                  [first_line, &file_name] (
+                      const decltype (
+                          index->line_number_map)::value_type &value) {
+                    return file_name == value.second.first
+                           && first_line == value.second.second;
+                  })
+              != index->line_number_map.end ())
+            break;
+        }
+      /* First is either prev_line_number, or a line associated with another
+         address, so start at the next line.  */
+      ++first_line;
+    }
+
+  return first_line;
+}
+
+void
+code_object_t::disassemble (std::ostream &out,
+                            amd_dbgapi_architecture_id_t architecture_id,
+                            amd_dbgapi_global_address_t pc)
+{
+  static stat_site_t timer_site ("disassemble");
+  scoped_timer_t timer (timer_site);
+
+  amd_dbgapi_size_t largest_instruction_size;
+  if (DBGAPI_TIMED (amd_dbgapi_architecture_get_info (
+          architecture_id,
+          AMD_DBGAPI_ARCHITECTURE_INFO_LARGEST_INSTRUCTION_SIZE,
+          sizeof (largest_instruction_size), &largest_instruction_size))
+      != AMD_DBGAPI_STATUS_SUCCESS)
+    agent_error ("could not get the instruction size from the architecture");
+
+  /* Load the line number table, and low/high pc for all CUs.  */
+  auto index = debug_index ();
+
+  constexpr int context_byte_size = 24;
+  auto [start_pc, end_pc] = disassembly_range (pc, context_byte_size);
+
   auto symbol = find_symbol (pc);
 
-  agent_out << std::endl << "Disassembly";
+  out << "\nDisassembly";
   if (symbol)
-    agent_out << " for function " << symbol->m_name;
-  agent_out << ":" << std::endl;
+    out << " for function " << symbol->m_name;
+  out << ":\n";
 
-  agent_out << "    code object: " << m_uri << std::endl;
-  agent_out << "    loaded at: "
-            << "[0x" << std::hex << m_load_address << "-"
-            << "0x" << std::hex << (m_load_address + m_mem_size) << "]"
-            << std::endl;
+  out << "    code object: " << m_uri << '\n';
+  out << "    loaded at: "
+      << "[0x" << std::hex << m_load_address << "-"
+      << "0x" << std::hex << (m_load_address + m_mem_size) << "]"
+      << '\n';
 
   /* Remember the start_pc address to print the first source line.  */
   amd_dbgapi_global_address_t saved_start_pc{ start_pc };
@@ -530,16 +1020,15 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
     {
       std::vector<uint8_t> buffer (largest_instruction_size);
 
-      amd_dbgapi_size_t size = buffer.size ();
-      if (amd_dbgapi_read_memory (
-              m_process_id, AMD_DBGAPI_WAVE_NONE, AMD_DBGAPI_LANE_NONE,
-              AMD_DBGAPI_ADDRESS_SPACE_GLOBAL, start_pc, &size, buffer.data ())
-          != AMD_DBGAPI_STATUS_SUCCESS)
+      amd_dbgapi_size_t size
+          = read_instructions (start_pc, buffer.data (), buffer.size ());
+      if (!size)
         break;
+      timer.add_bytes (size);
 
-      if (amd_dbgapi_disassemble_instruction (
+      if (DBGAPI_TIMED (amd_dbgapi_disassemble_instruction (
               architecture_id, start_pc, &size, buffer.data (), nullptr,
-              amd_dbgapi_symbolizer_id_t{}, nullptr)
+              amd_dbgapi_symbolizer_id_t{}, nullptr))
           != AMD_DBGAPI_STATUS_SUCCESS)
         break;
 
@@ -555,18 +1044,18 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
 
   while (addr < end_pc)
     {
-      if (auto it
-          = m_line_number_map->find (addr == start_pc ? saved_start_pc : addr);
-          it != m_line_number_map->end ())
+      if (auto it = index->line_number_map.find (
+              addr == start_pc ? saved_start_pc : addr);
+          it != index->line_number_map.end ())
         {
           const std::string &file_name = it->second.first;
           size_t line_number = it->second.second;
 
           if (file_name != prev_file_name || line_number != prev_line_number)
-            agent_out << std::endl;
+            out << '\n';
 
           if (file_name != prev_file_name)
-            agent_out << file_name << ":" << std::endl;
+            out << file_name << ":\n";
 
           /* If the source line for `addr` is a different line than the
              previous one printed, then print it.  If the previous line printed
@@ -579,46 +1068,21 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
            */
           if (file_name != prev_file_name || line_number != prev_line_number)
             {
-              size_t first_line = line_number;
+              size_t first_line = first_source_line (
+                  file_name, line_number, prev_file_name, prev_line_number);
               size_t last_line = line_number;
 
-              /* Find the first line to print between prev_line_number and
-                 line_number that does not appear in the line number table.
-               */
-              if (file_name == prev_file_name
-                  && (line_number + 1) > prev_line_number)
-                {
-                  while (--first_line > prev_line_number)
-                    {
-                      if (std::find_if (
-                              m_line_number_map->begin (),
-                              m_line_number_map->end (),
-                              [first_line, &file_name] (
-                                  const std::remove_reference_t<decltype (
-                                      *m_line_number_map)>::value_type
-                                      &value) {
-                                return file_name == value.second.first
-                                       && first_line == value.second.second;
-                              })
-                          != m_line_number_map->end ())
-                        break;
-                    }
-                  /* First is either prev_line_number, or a line associated
-                     with another address, so start at the next line.  */
-                  ++first_line;
-                }
-
               for (size_t line = first_line; line <= last_line; ++line)
                 {
-                  agent_out << std::setfill (' ') << std::setw (8) << std::left
-                            << std::dec << line;
+                  out << std::setfill (' ') << std::setw (8) << std::left
+                      << std::dec << line;
 
                   if (auto lines = get_source_file_index (file_name); !lines)
-                    agent_out << file_name << ": No such file or directory.";
+                    out << file_name << ": No such file or directory.";
                   else if (line && line <= lines->get ().size ())
-                    agent_out << lines->get ()[line - 1];
+                    out << lines->get ()[line - 1];
 
-                  agent_out << std::endl;
+                  out << '\n';
                 }
             }
 
@@ -629,21 +1093,20 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
              block, then print ... to show that the following instruction is
              not the first in the block.  */
           if (addr == start_pc && start_pc != saved_start_pc)
-            agent_out << "    ..." << std::endl;
+            out << "    ...\n";
         }
 
       std::vector<uint8_t> buffer (largest_instruction_size);
 
-      amd_dbgapi_size_t size = buffer.size ();
-      if (amd_dbgapi_read_memory (
-              m_process_id, AMD_DBGAPI_WAVE_NONE, AMD_DBGAPI_LANE_NONE,
-              AMD_DBGAPI_ADDRESS_SPACE_GLOBAL, addr, &size, buffer.data ())
-          != AMD_DBGAPI_STATUS_SUCCESS)
+      amd_dbgapi_size_t size
+          = read_instructions (addr, buffer.data (), buffer.size ());
+      if (!size)
         {
-          agent_out << "Cannot access memory at address 0x" << std::hex << addr
-                    << std::endl;
+          out << "Cannot access memory at address 0x" << std::hex << addr
+              << '\n';
           break;
         }
+      timer.add_bytes (size);
 
       auto symbolizer = [] (amd_dbgapi_symbolizer_id_t symbolizer_id,
                             amd_dbgapi_global_address_t address,
@@ -665,29 +1128,30 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
       };
 
       char *value;
-      if (amd_dbgapi_disassemble_instruction (
+      if (DBGAPI_TIMED (amd_dbgapi_disassemble_instruction (
               architecture_id, addr, &size, buffer.data (), &value,
-              reinterpret_cast<amd_dbgapi_symbolizer_id_t> (this), symbolizer)
+              reinterpret_cast<amd_dbgapi_symbolizer_id_t> (this),
+              symbolizer))
           != AMD_DBGAPI_STATUS_SUCCESS)
         agent_error ("amd_dbgapi_disassemble_instruction failed");
 
       std::string instruction (value);
       free (value);
 
-      agent_out << ((addr == pc) ? " => " : "    ");
+      out << ((addr == pc) ? " => " : "    ");
 
-      agent_out << "0x" << std::hex << addr;
+      out << "0x" << std::hex << addr;
       if (symbol)
         {
-          agent_out << " <";
+          out << " <";
           if (addr >= symbol->m_value)
-            agent_out << "+" << std::dec << (addr - symbol->m_value);
+            out << "+" << std::dec << (addr - symbol->m_value);
           else
-            agent_out << "-" << std::dec << (symbol->m_value - addr);
-          agent_out << ">";
+            out << "-" << std::dec << (symbol->m_value - addr);
+          out << ">";
         }
 
-      agent_out << ":    " << instruction << std::endl;
+      out << ":    " << instruction << '\n';
 
       addr += size;
     }
@@ -696,11 +1160,83 @@ code_object_t::disassemble (amd_dbgapi_architecture_id_t architecture_id,
      block, then print ... to show that the previous instruction was
      not the last of the instructions associated with the previous source ine
      printed.  */
-  if (auto it = m_line_number_map->find (addr);
-      it == m_line_number_map->end ())
-    agent_out << "    ..." << std::endl;
+  if (auto it = index->line_number_map.find (addr);
+      it == index->line_number_map.end ())
+    out << "    ...\n";
+
+  out << "\nEnd of disassembly.\n";
+}
+
+std::size_t
+code_object_t::read_instructions (amd_dbgapi_global_address_t address,
+                                  void *buffer, std::size_t size)
+{
+  if (m_process_id.handle != AMD_DBGAPI_PROCESS_NONE.handle)
+    {
+      if (DBGAPI_TIMED (amd_dbgapi_read_memory (
+              m_process_id, AMD_DBGAPI_WAVE_NONE, AMD_DBGAPI_LANE_NONE,
+              AMD_DBGAPI_ADDRESS_SPACE_GLOBAL, address, &size, buffer))
+          != AMD_DBGAPI_STATUS_SUCCESS)
+        return 0;
+
+      return size;
+    }
+
+  const amd_dbgapi_global_address_t vaddr = address - m_load_address;
+  for (auto &&segment : m_load_segments)
+    if (vaddr >= segment.vaddr && vaddr - segment.vaddr < segment.filesz)
+      return read (buffer,
+                   std::min (size, segment.filesz - (vaddr - segment.vaddr)),
+                   segment.offset + (vaddr - segment.vaddr));
 
-  agent_out << std::endl << "End of disassembly." << std::endl;
+  return 0;
+}
+
+std::size_t
+code_object_t::file_size () const
+{
+  agent_assert (is_open () && "code object is not opened");
+
+  return m_file_size;
+}
+
+std::size_t
+code_object_t::read (void *buffer, std::size_t size, std::size_t offset) const
+{
+  agent_assert (is_open () && "code object is not opened");
+
+  const std::shared_ptr<const std::vector<char>> image = this->image ();
+  if (!image || offset >= image->size ())
+    return 0;
+
+  size = std::min (size, image->size () - offset);
+  memcpy (buffer, image->data () + offset, size);
+  return size;
+}
+
+uint64_t
+code_object_t::content_hash ()
+{
+  agent_assert (is_open () && "code object is not opened");
+
+  std::scoped_lock lock (m_load_lock);
+  if (m_content_hash)
+    return *m_content_hash;
+
+  static stat_site_t timer_site ("code_object_hash");
+  scoped_timer_t timer (timer_site);
+
+  uint64_t hash = 0xcbf29ce484222325;
+  if (const std::shared_ptr<const std::vector<char>> image = image_locked ())
+    {
+      for (char byte : *image)
+        hash = (hash ^ static_cast<uint8_t> (byte)) * 0x100000001b3;
+
+      timer.add_bytes (image->size ());
+    }
+
+  m_content_hash.emplace (hash);
+  return hash;
 }
 
 bool
@@ -714,16 +1250,14 @@ code_object_t::save (const std::string &directory) const
   while ((pos = name.find_first_of (":/#?&="), pos) != std::string::npos)
     name[pos] = '_';
 
+  const std::shared_ptr<const std::vector<char>> image = this->image ();
+  if (!image)
+    return false;
+
   std::string file_path = directory + '/' + name;
   std::ofstream file (file_path, std::ios::out | std::ios::binary);
-  std::vector<char> buffer (lseek (*m_fd, 0, SEEK_END));
-
-  ::lseek (*m_fd, 0, SEEK_SET);
-  if (size_t size = ::read (*m_fd, buffer.data (), buffer.size ());
-      size != buffer.size ())
-    return false;
 
-  file.write (buffer.data (), buffer.size ());
+  file.write (image->data (), image->size ());
   file.close ();
 
   return file.good ();
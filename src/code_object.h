@@ -33,18 +33,42 @@
 
 #include <amd-dbgapi.h>
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <ostream>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace amd::debug_agent
 {
 
+/* The memory used by the open code objects.  */
+struct code_object_memory_stats_t
+{
+  std::size_t code_object_count{ 0 };
+  /* The ELF files, each counted once however many code objects share it.  */
+  std::size_t image_bytes{ 0 };
+  /* The parsed symbol tables and debug information.  */
+  std::size_t index_bytes{ 0 };
+  /* The largest values of the above, the number of indices built, and the
+     number of code objects whose indices were evicted since the last call
+     to code_object_memory_stats.  */
+  std::size_t peak_code_object_count{ 0 };
+  std::size_t peak_image_bytes{ 0 };
+  std::size_t peak_index_bytes{ 0 };
+  std::size_t index_build_count{ 0 };
+  std::size_t eviction_count{ 0 };
+};
+
 class code_object_t
 {
-private:
+public:
   struct symbol_info_t
   {
     const std::string m_name;
@@ -52,52 +76,179 @@ private:
     amd_dbgapi_size_t m_size;
   };
 
-  void load_symbol_map ();
-  void load_debug_info ();
+private:
+  /* The function symbols and kernel descriptors, parsed from the symbol
+     table.  */
+  struct symbol_index_t
+  {
+    std::map<amd_dbgapi_global_address_t,
+             std::pair<std::string, amd_dbgapi_size_t>>
+        symbol_map;
+    std::map<amd_dbgapi_global_address_t, std::string> kernel_descriptor_map;
+  };
 
-  std::optional<symbol_info_t>
-  find_symbol (amd_dbgapi_global_address_t address);
+  /* The line number table and the pc ranges of the compilation units,
+     parsed from the debug information.  Empty if there is none.  */
+  struct debug_index_t
+  {
+    std::map<amd_dbgapi_global_address_t, std::pair<std::string, size_t>>
+        line_number_map;
+    std::map<amd_dbgapi_global_address_t, amd_dbgapi_global_address_t>
+        pc_ranges_map;
+  };
+
+  /* Accounts for the memory used by the code objects, and evicts the ELF
+     files and indices of the least recently used ones.  */
+  class memory_manager_t;
+  friend void set_code_object_memory_limit (std::size_t limit);
+  friend code_object_memory_stats_t code_object_memory_stats (bool reset);
+
+  /* Read the ELF file from the URI, or return the one already read by
+     another code object with the same URI, and the same id for a memory
+     URI.  Return nullptr if it cannot be read.  */
+  std::shared_ptr<const std::vector<char>> load_image () const;
+
+  /* Return the ELF file, loaded again if it was evicted.  m_load_lock must
+     be held by image_locked.  The file remains valid as long as the
+     returned pointer is held.  */
+  std::shared_ptr<const std::vector<char>> image () const;
+  std::shared_ptr<const std::vector<char>> image_locked () const;
+
+  /* Return the symbol or debug index, parsed on first use, or again if it
+     was evicted.  The index remains valid as long as the returned pointer
+     is held, even if it is evicted meanwhile.  */
+  std::shared_ptr<const symbol_index_t> symbol_index ();
+  std::shared_ptr<const debug_index_t> debug_index ();
+
+  /* Read up to `size` bytes of the code object's instructions at `address`
+     into `buffer`, from the process's memory, or from the ELF file if the
+     code object is not associated with a process.  Return the number of
+     bytes read.  */
+  std::size_t read_instructions (amd_dbgapi_global_address_t address,
+                                 void *buffer, std::size_t size);
 
 public:
   code_object_t (amd_dbgapi_process_id_t process_id,
                  amd_dbgapi_code_object_id_t code_object_id);
+  /* Create a code object that is not associated with a process, such as a
+     code object saved in a file.  Only code objects with a file:// URI can be
+     opened.  */
+  code_object_t (std::string uri, amd_dbgapi_global_address_t load_address);
   code_object_t (code_object_t &&rhs);
 
   ~code_object_t ();
 
   void open ();
-  bool is_open () const { return m_fd.has_value (); }
+  bool is_open () const { return m_open; }
 
   amd_dbgapi_global_address_t load_address () const { return m_load_address; }
   amd_dbgapi_size_t mem_size () const { return m_mem_size; }
 
-  void disassemble (amd_dbgapi_architecture_id_t architecture_id,
+  void disassemble (std::ostream &out,
+                    amd_dbgapi_architecture_id_t architecture_id,
                     amd_dbgapi_global_address_t pc);
 
   bool save (const std::string &directory) const;
 
+  /* The URI the code object was loaded from.  */
+  const std::string &uri () const { return m_uri; }
+
+  /* Return the size of the code object's ELF file.  */
+  std::size_t file_size () const;
+
+  /* Read up to `size` bytes of the code object's ELF file at `offset` into
+     `buffer`, and return the number of bytes read.  */
+  std::size_t read (void *buffer, std::size_t size, std::size_t offset) const;
+
+  /* Return a 64-bit FNV-1a hash of the code object's ELF file, to identify
+     its content independently of its URI.  Computed on the first call.  */
+  uint64_t content_hash ();
+
+  /* Return the function symbol that contains `address`.  */
+  std::optional<symbol_info_t>
+  find_symbol (amd_dbgapi_global_address_t address);
+
+  /* Return the name of the kernel whose descriptor is at `address`, such as
+     the `kernel_object` of a kernel dispatch packet.  */
+  std::optional<std::string>
+  find_kernel_descriptor (amd_dbgapi_global_address_t address);
+
+  /* Return the source file name and line number of the instruction at
+     `address`.  */
+  std::optional<std::pair<std::string, size_t>>
+  find_line (amd_dbgapi_global_address_t address);
+
+  /* Return the [start, end) range of instructions to disassemble around `pc`.
+     The range starts at a line number table entry at least
+     `context_byte_size` bytes before `pc` and ends `context_byte_size` bytes
+     after `pc`, both clamped to the compilation unit containing `pc`.  */
+  std::pair<amd_dbgapi_global_address_t, amd_dbgapi_global_address_t>
+  disassembly_range (amd_dbgapi_global_address_t pc,
+                     amd_dbgapi_size_t context_byte_size);
+
+  /* Return the first source line to print with `line_number`.  The lines
+     between the previously printed line and `line_number` that have no code
+     associated with them are printed as a single block.  */
+  size_t first_source_line (const std::string &file_name, size_t line_number,
+                            const std::string &prev_file_name,
+                            size_t prev_line_number);
+
 private:
   amd_dbgapi_global_address_t m_load_address{ 0 };
   amd_dbgapi_size_t m_mem_size{ 0 };
-  std::optional<int> m_fd;
-
-  std::optional<
-      std::map<amd_dbgapi_global_address_t, std::pair<std::string, size_t>>>
-      m_line_number_map;
-
-  std::optional<
-      std::map<amd_dbgapi_global_address_t, amd_dbgapi_global_address_t>>
-      m_pc_ranges_map;
+  bool m_open{ false };
+  std::size_t m_file_size{ 0 };
+
+  /* The ELF file, shared by the code objects loaded from the same URI, and
+     the indices, loaded on first use.  They may be evicted by any thread,
+     the ELF file is then loaded again from its URI when needed.  An ELF file
+     read from the process's memory is pinned: reading it again would take
+     debugger API calls, which the thread using the code object may not be
+     allowed to make.  */
+  mutable std::mutex m_load_lock;
+  mutable std::shared_ptr<const std::vector<char>> m_image;
+  bool m_image_pinned{ false };
+  std::shared_ptr<const symbol_index_t> m_symbol_index;
+  std::shared_ptr<const debug_index_t> m_debug_index;
+
+  /* The number of bytes of indices accounted for by the memory manager,
+     protected by its lock, and when this code object was last used.  */
+  std::size_t m_index_bytes{ 0 };
+  std::atomic<uint64_t> m_last_use{ 0 };
+
+  /* The [vaddr, vaddr + filesz) range and file offset of each PT_LOAD
+     segment, to read the instructions from the ELF file.  */
+  struct load_segment_t
+  {
+    amd_dbgapi_global_address_t vaddr;
+    std::size_t filesz;
+    std::size_t offset;
+  };
+  std::vector<load_segment_t> m_load_segments;
 
-  std::optional<std::map<amd_dbgapi_global_address_t,
-                         std::pair<std::string, amd_dbgapi_size_t>>>
-      m_symbol_map;
+  std::optional<uint64_t> m_content_hash;
 
   std::string m_uri;
   amd_dbgapi_code_object_id_t const m_code_object_id;
   amd_dbgapi_process_id_t const m_process_id;
 };
 
+/* Limit the memory used by the ELF files and indices of all the code
+   objects to about `limit` bytes, 0 for no limit.  When an ELF file is read
+   or an index is built past the limit, the ELF files and indices of the least
+   recently used code objects are evicted, and are read or rebuilt if used
+   again.  Those of the code object being used are never evicted, so a single
+   code object may exceed the limit.  The ELF files read from the process's
+   memory are accounted for, but only released with their code objects.  */
+void set_code_object_memory_limit (std::size_t limit);
+
+/* Return the memory currently used by the code objects, and reset the peak
+   and counts if `reset` is set.  */
+code_object_memory_stats_t code_object_memory_stats (bool reset = true);
+
+/* Print code_object_memory_stats (reset) to `os`.  */
+void print_code_object_memory (std::ostream &os, bool reset = true);
+
 } /* namespace amd::debug_agent */
 
 #endif /* _ROCM_DEBUG_AGENT_CODE_OBJECT_H */
\ No newline at end of file
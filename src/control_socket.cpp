@@ -0,0 +1,252 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "control_socket.h"
+#include "debug.h"
+#include "logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace amd::debug_agent
+{
+
+namespace
+{
+
+/* The longest command accepted from a client.  */
+constexpr std::size_t max_command_length = 4096;
+
+class control_socket_t
+{
+public:
+  control_socket_t (std::string path, control_handler_t handler)
+      : m_path (std::move (path)), m_handler (std::move (handler))
+  {
+  }
+
+  bool start ();
+  void stop ();
+
+private:
+  void run ();
+  void serve (int client_fd);
+
+  const std::string m_path;
+  const control_handler_t m_handler;
+
+  int m_listen_fd{ -1 };
+  /* Written to by stop to wake up the thread.  */
+  int m_stop_pipe[2]{ -1, -1 };
+  std::thread m_thread;
+};
+
+bool
+control_socket_t::start ()
+{
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (m_path.size () >= sizeof (address.sun_path))
+    {
+      agent_warning ("control socket path `%s' is too long", m_path.c_str ());
+      return false;
+    }
+  m_path.copy (address.sun_path, m_path.size ());
+
+  m_listen_fd = ::socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_listen_fd == -1)
+    return false;
+
+  /* A socket left by an earlier process with the same pid.  */
+  struct stat path_stat;
+  if (::lstat (m_path.c_str (), &path_stat) == 0
+      && S_ISSOCK (path_stat.st_mode))
+    ::unlink (m_path.c_str ());
+
+  /* Connections are refused until listen is called, so no other user can
+     connect before the permissions are restricted.  */
+  if (::bind (m_listen_fd, reinterpret_cast<struct sockaddr *> (&address),
+              sizeof (address))
+          == -1
+      || ::chmod (m_path.c_str (), S_IRUSR | S_IWUSR) == -1
+      || ::listen (m_listen_fd, 4) == -1
+      || ::pipe2 (m_stop_pipe, O_CLOEXEC) == -1)
+    {
+      agent_warning ("could not create the control socket `%s' (%s)",
+                     m_path.c_str (), strerror (errno));
+      ::close (m_listen_fd);
+      ::unlink (m_path.c_str ());
+      return false;
+    }
+
+  m_thread = std::thread ([this] () { run (); });
+  agent_log (log_level_t::info, "control socket listening on `%s'",
+             m_path.c_str ());
+  return true;
+}
+
+void
+control_socket_t::stop ()
+{
+  char c = 0;
+  [[maybe_unused]] ssize_t ignored = ::write (m_stop_pipe[1], &c, 1);
+  m_thread.join ();
+
+  ::close (m_stop_pipe[0]);
+  ::close (m_stop_pipe[1]);
+  ::close (m_listen_fd);
+  ::unlink (m_path.c_str ());
+}
+
+void
+control_socket_t::run ()
+{
+  /* Signals are handled by the application threads, a SIGQUIT dump must not
+     be started from this thread while it is dumping.  A client that closes
+     its connection early must not kill the process, the threads started
+     by the dump inherit this mask.  */
+  sigset_t signal_set;
+  sigemptyset (&signal_set);
+  sigaddset (&signal_set, SIGQUIT);
+  sigaddset (&signal_set, SIGPIPE);
+  pthread_sigmask (SIG_BLOCK, &signal_set, nullptr);
+
+  while (true)
+    {
+      struct pollfd fds[2]
+          = { { m_listen_fd, POLLIN, 0 }, { m_stop_pipe[0], POLLIN, 0 } };
+
+      if (::poll (fds, 2, -1) == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          return;
+        }
+
+      if (fds[1].revents)
+        return;
+
+      int client_fd = ::accept4 (m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client_fd == -1)
+        continue;
+
+      serve (client_fd);
+      ::close (client_fd);
+    }
+}
+
+void
+control_socket_t::serve (int client_fd)
+{
+  /* The socket file is only accessible by the user, but root and processes
+     that inherited an open descriptor could still connect.  */
+  struct ucred credentials = {};
+  socklen_t length = sizeof (credentials);
+  if (::getsockopt (client_fd, SOL_SOCKET, SO_PEERCRED, &credentials,
+                    &length)
+          == -1
+      || (credentials.uid != ::geteuid () && credentials.uid != 0))
+    {
+      agent_warning ("rejected a control connection from uid %d",
+                     static_cast<int> (credentials.uid));
+      return;
+    }
+
+  /* Do not let a client that never sends its command, or stops reading the
+     output, block the thread.  The waves stay stopped, and the other dumps
+     wait, while the output is written.  */
+  struct timeval timeout = { 5, 0 };
+  ::setsockopt (client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                sizeof (timeout));
+  ::setsockopt (client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                sizeof (timeout));
+
+  std::string command;
+  char buffer[256];
+  while (command.size () < max_command_length
+         && command.find ('\n') == std::string::npos)
+    {
+      ssize_t count = ::recv (client_fd, buffer, sizeof (buffer), 0);
+      if (count == -1 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        break;
+      command.append (buffer, count);
+    }
+
+  command.erase (std::min (command.find_first_of ("\r\n"),
+                           std::min (command.size (), max_command_length)));
+
+  agent_log (log_level_t::info, "control command: %s", command.c_str ());
+  m_handler (client_fd, command);
+}
+
+std::unique_ptr<control_socket_t> control_socket;
+
+} /* namespace */
+
+bool
+start_control_socket (const std::string &path, control_handler_t handler)
+{
+  agent_assert (!control_socket && "the control socket is already started");
+
+  auto socket = std::make_unique<control_socket_t> (path, std::move (handler));
+  if (!socket->start ())
+    return false;
+
+  control_socket = std::move (socket);
+  return true;
+}
+
+void
+stop_control_socket ()
+{
+  if (!control_socket)
+    return;
+
+  control_socket->stop ();
+  control_socket.reset ();
+}
+
+} /* namespace amd::debug_agent */
@@ -0,0 +1,58 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_CONTROL_SOCKET_H
+#define _ROCM_DEBUG_AGENT_CONTROL_SOCKET_H 1
+
+#include <functional>
+#include <string>
+
+namespace amd::debug_agent
+{
+
+/* Called with the connected socket of a client, and the command it sent.
+   The reply is written to the socket, which is closed on return.  */
+using control_handler_t
+    = std::function<void (int socket_fd, const std::string &command)>;
+
+/* Create a Unix domain socket at `path`, only accessible by the user, and
+   start a background thread that accepts one connection at a time, reads a
+   single line command from it, and passes it to `handler`.  Connections from
+   other users are rejected.  Return false if the socket could not be
+   created.  */
+bool start_control_socket (const std::string &path,
+                           control_handler_t handler);
+
+/* Stop the thread, and remove the socket.  */
+void stop_control_socket ();
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_CONTROL_SOCKET_H */
@@ -0,0 +1,803 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "core_file.h"
+#include "code_object.h"
+#include "debug.h"
+#include "logging.h"
+#include "stats.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#ifndef EM_AMDGPU
+#define EM_AMDGPU 224
+#endif /* EM_AMDGPU */
+
+namespace amd::debug_agent
+{
+
+namespace
+{
+
+constexpr unsigned char elfosabi_amdgpu_hsa = 64;
+
+constexpr char note_name[] = "AMDGPU";
+
+/* The notes are written as is, they must not have padding.  */
+static_assert (sizeof (core_process_note_t) == 40);
+static_assert (sizeof (core_agent_note_t) == 8);
+static_assert (sizeof (core_dispatch_note_t) == 80);
+static_assert (sizeof (core_wave_note_t) == 80);
+static_assert (sizeof (core_register_t) == 8);
+static_assert (sizeof (core_code_object_note_t) == 32);
+
+/* The size of the output buffer, and of the largest read of memory.  */
+constexpr std::size_t buffer_size = 1 << 20;
+
+/* The most bytes saved from a kernel argument segment.  */
+constexpr std::size_t kernarg_window_size = 4096;
+
+constexpr std::size_t
+align_up (std::size_t value, std::size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+/* A sequential writer to a file, through a fixed size buffer.  */
+class core_writer_t
+{
+public:
+  explicit core_writer_t (int fd) : m_fd (fd)
+  {
+    m_buffer.reserve (buffer_size);
+  }
+
+  bool ok () const { return m_ok; }
+  uint64_t offset () const { return m_offset; }
+
+  void
+  write (const void *data, std::size_t size)
+  {
+    if (m_buffer.size () + size > buffer_size)
+      flush ();
+
+    if (size >= buffer_size)
+      write_fully (data, size);
+    else
+      m_buffer.insert (m_buffer.end (), static_cast<const char *> (data),
+                       static_cast<const char *> (data) + size);
+
+    m_offset += size;
+  }
+
+  template <typename T>
+  void
+  write (const T &value)
+  {
+    static_assert (std::is_trivially_copyable_v<T>);
+    write (&value, sizeof (value));
+  }
+
+  void
+  write_string (const std::string &str)
+  {
+    write (str.c_str (), str.size () + 1);
+  }
+
+  /* Write zeros up to the next multiple of ALIGNMENT.  */
+  void
+  pad (std::size_t alignment)
+  {
+    static constexpr std::array<char, 8> zeros{};
+    agent_assert (alignment <= zeros.size ());
+    write (zeros.data (), align_up (m_offset, alignment) - m_offset);
+  }
+
+  void
+  flush ()
+  {
+    write_fully (m_buffer.data (), m_buffer.size ());
+    m_buffer.clear ();
+  }
+
+  /* Overwrite the bytes already written at OFFSET.  */
+  void
+  rewrite (const void *data, std::size_t size, uint64_t offset)
+  {
+    flush ();
+    if (m_ok && ::pwrite (m_fd, data, size, offset) != ssize_t (size))
+      m_ok = false;
+  }
+
+private:
+  void
+  write_fully (const void *data, std::size_t size)
+  {
+    const char *ptr = static_cast<const char *> (data);
+    while (m_ok && size)
+      {
+        ssize_t count = ::write (m_fd, ptr, size);
+        if (count < 0 && errno == EINTR)
+          continue;
+        if (count <= 0)
+          {
+            m_ok = false;
+            break;
+          }
+        ptr += count;
+        size -= count;
+      }
+  }
+
+  const int m_fd;
+  std::vector<char> m_buffer;
+  uint64_t m_offset{ 0 };
+  bool m_ok{ true };
+};
+
+/* Write the header of a note whose description is DESC_SIZE bytes.  */
+void
+write_note_header (core_writer_t &out, core_note_type_t type,
+                   std::size_t desc_size)
+{
+  Elf64_Nhdr header{};
+  header.n_namesz = sizeof (note_name);
+  header.n_descsz = desc_size;
+  header.n_type = type;
+
+  out.write (header);
+  out.write (note_name, sizeof (note_name));
+  out.pad (4);
+}
+
+/* Return the string returned by a debugger API query, or an empty string if
+   the query failed.  */
+template <typename Query>
+std::string
+string_info (Query &&query)
+{
+  char *value;
+  if (query (sizeof (value), &value) != AMD_DBGAPI_STATUS_SUCCESS)
+    return {};
+
+  std::string str (value);
+  free (value);
+  return str;
+}
+
+/* A workgroup whose local memory is saved, and a wave to read it from.  */
+struct workgroup_t
+{
+  amd_dbgapi_wave_id_t wave_id;
+  amd_dbgapi_architecture_id_t architecture_id;
+};
+
+/* A dispatch whose kernel arguments are saved, and a wave to read them
+   from.  */
+struct dispatch_t
+{
+  amd_dbgapi_wave_id_t wave_id;
+  amd_dbgapi_global_address_t kernel_argument_segment_address;
+};
+
+class core_file_t
+{
+public:
+  core_file_t (int fd, amd_dbgapi_process_id_t process_id,
+               const std::vector<code_object_t *> &code_objects,
+               const core_file_options_t &options)
+      : m_out (fd), m_process_id (process_id), m_options (options)
+  {
+    for (code_object_t *code_object : code_objects)
+      m_code_object_map.emplace (code_object->load_address (), code_object);
+  }
+
+  /* Write the file, and return the number of bytes written, or nothing on
+     error.  */
+  std::optional<std::size_t>
+  write (const std::vector<amd_dbgapi_wave_id_t> &wave_ids);
+
+private:
+  void write_agent_note (amd_dbgapi_agent_id_t agent_id);
+  void write_dispatch_note (amd_dbgapi_dispatch_id_t dispatch_id,
+                            amd_dbgapi_wave_id_t wave_id);
+  void write_wave_note (amd_dbgapi_wave_id_t wave_id);
+  void write_code_object_notes ();
+  void write_register_names_note ();
+
+  void write_local_memory (const workgroup_t &workgroup);
+  void write_code_objects ();
+  void write_kernel_arguments (const dispatch_t &dispatch);
+  std::size_t write_global_memory (amd_dbgapi_wave_id_t wave_id,
+                                   amd_dbgapi_global_address_t address,
+                                   std::size_t size);
+
+  /* Add a program header for the segment written since START_OFFSET.  */
+  void
+  add_segment (uint32_t type, uint64_t start_offset, uint64_t address)
+  {
+    Elf64_Phdr phdr{};
+    phdr.p_type = type;
+    phdr.p_flags = PF_R;
+    phdr.p_offset = start_offset;
+    phdr.p_vaddr = address;
+    phdr.p_filesz = phdr.p_memsz = m_out.offset () - start_offset;
+    phdr.p_align = 1;
+    m_program_headers.emplace_back (phdr);
+  }
+
+  /* Return true if `code_object` is saved in the core file, false if it is
+     only referenced by URI.  */
+  bool
+  is_embedded (const code_object_t &code_object) const
+  {
+    /* Code objects loaded from files are only referenced, unless they are
+       to be symbolized offline, the others would not be available when the
+       core file is opened.  */
+    return m_options.raw || code_object.uri ().rfind ("file://", 0) != 0;
+  }
+
+  /* Return the offset of NAME in the register names note.  */
+  uint32_t register_name_offset (amd_dbgapi_wave_id_t wave_id,
+                                 amd_dbgapi_register_id_t register_id);
+
+  core_writer_t m_out;
+  const amd_dbgapi_process_id_t m_process_id;
+  const core_file_options_t &m_options;
+  std::map<amd_dbgapi_global_address_t, code_object_t *> m_code_object_map;
+
+  std::vector<Elf64_Phdr> m_program_headers;
+
+  std::unordered_set<decltype (amd_dbgapi_agent_id_t::handle)> m_agents;
+  std::unordered_map<decltype (amd_dbgapi_dispatch_id_t::handle), dispatch_t>
+      m_dispatches;
+  std::map<std::tuple<decltype (amd_dbgapi_dispatch_id_t::handle), uint32_t,
+                      uint32_t, uint32_t>,
+           int32_t>
+      m_workgroup_segments;
+  std::vector<workgroup_t> m_workgroups;
+
+  std::unordered_map<decltype (amd_dbgapi_register_id_t::handle), uint32_t>
+      m_register_name_offsets;
+  std::string m_register_names;
+
+  /* Reused for the registers of each wave, and for memory.  */
+  std::vector<std::pair<amd_dbgapi_register_id_t, core_register_t>>
+      m_registers;
+  std::vector<uint8_t> m_scratch;
+};
+
+void
+core_file_t::write_agent_note (amd_dbgapi_agent_id_t agent_id)
+{
+  const std::string name = string_info ([&] (size_t size, void *value) {
+    return DBGAPI_TIMED (amd_dbgapi_agent_get_info (
+        m_process_id, agent_id, AMD_DBGAPI_AGENT_INFO_NAME, size, value));
+  });
+
+  std::string architecture;
+  if (amd_dbgapi_architecture_id_t architecture_id;
+      DBGAPI_TIMED (amd_dbgapi_agent_get_info (
+          m_process_id, agent_id, AMD_DBGAPI_AGENT_INFO_ARCHITECTURE,
+          sizeof (architecture_id), &architecture_id))
+      == AMD_DBGAPI_STATUS_SUCCESS)
+    architecture = string_info ([&] (size_t size, void *value) {
+      return DBGAPI_TIMED (amd_dbgapi_architecture_get_info (
+          architecture_id, AMD_DBGAPI_ARCHITECTURE_INFO_NAME, size, value));
+    });
+
+  core_agent_note_t note{ agent_id.handle };
+
+  write_note_header (m_out, core_nt_amdgpu_agent,
+                     sizeof (note) + name.size () + 1
+                         + architecture.size () + 1);
+  m_out.write (note);
+  m_out.write_string (name);
+  m_out.write_string (architecture);
+  m_out.pad (4);
+}
+
+void
+core_file_t::write_dispatch_note (amd_dbgapi_dispatch_id_t dispatch_id,
+                                  amd_dbgapi_wave_id_t wave_id)
+{
+  core_dispatch_note_t note{};
+  note.dispatch_id = dispatch_id.handle;
+
+  auto get_info = [&] (amd_dbgapi_dispatch_info_t query, auto &value) {
+    DBGAPI_TIMED (amd_dbgapi_dispatch_get_info (
+        m_process_id, dispatch_id, query, sizeof (value), &value));
+  };
+
+  amd_dbgapi_queue_id_t queue_id{};
+  get_info (AMD_DBGAPI_DISPATCH_INFO_QUEUE, queue_id);
+  note.queue_id = queue_id.handle;
+
+  amd_dbgapi_agent_id_t agent_id{};
+  get_info (AMD_DBGAPI_DISPATCH_INFO_AGENT, agent_id);
+  note.agent_id = agent_id.handle;
+
+  get_info (AMD_DBGAPI_DISPATCH_INFO_OS_QUEUE_PACKET_ID,
+            note.os_queue_packet_id);
+  get_info (AMD_DBGAPI_DISPATCH_INFO_KERNEL_DESCRIPTOR_ADDRESS,
+            note.kernel_descriptor_address);
+  get_info (AMD_DBGAPI_DISPATCH_INFO_KERNEL_CODE_ENTRY_ADDRESS,
+            note.kernel_code_entry_address);
+  get_info (AMD_DBGAPI_DISPATCH_INFO_KERNEL_ARGUMENT_SEGMENT_ADDRESS,
+            note.kernel_argument_segment_address);
+  get_info (AMD_DBGAPI_DISPATCH_INFO_GRID_SIZES, note.grid_sizes);
+
+  uint16_t work_group_sizes[3]{};
+  get_info (AMD_DBGAPI_DISPATCH_INFO_WORK_GROUP_SIZES, work_group_sizes);
+  std::copy_n (work_group_sizes, 3, note.work_group_sizes);
+
+  std::string kernel_name;
+  if (auto it = m_code_object_map.upper_bound (note.kernel_code_entry_address);
+      !m_options.raw && note.kernel_code_entry_address
+      && it != m_code_object_map.begin ())
+    if (auto &&[load_address, code_object] = *std::prev (it);
+        note.kernel_code_entry_address - load_address
+        <= code_object->mem_size ())
+      if (auto symbol
+          = code_object->find_symbol (note.kernel_code_entry_address))
+        kernel_name = symbol->m_name;
+
+  write_note_header (m_out, core_nt_amdgpu_dispatch,
+                     sizeof (note) + kernel_name.size () + 1);
+  m_out.write (note);
+  m_out.write_string (kernel_name);
+  m_out.pad (4);
+
+  m_dispatches.emplace (dispatch_id.handle,
+                        dispatch_t{ wave_id,
+                                    note.kernel_argument_segment_address });
+}
+
+uint32_t
+core_file_t::register_name_offset (amd_dbgapi_wave_id_t wave_id,
+                                   amd_dbgapi_register_id_t register_id)
+{
+  auto [it, inserted] = m_register_name_offsets.try_emplace (
+      register_id.handle, m_register_names.size ());
+
+  if (inserted)
+    {
+      m_register_names += string_info ([&] (size_t size, void *value) {
+        return DBGAPI_TIMED (amd_dbgapi_wave_register_get_info (
+            m_process_id, wave_id, register_id, AMD_DBGAPI_REGISTER_INFO_NAME,
+            size, value));
+      });
+      m_register_names += '\0';
+    }
+
+  return it->second;
+}
+
+void
+core_file_t::write_wave_note (amd_dbgapi_wave_id_t wave_id)
+{
+  core_wave_note_t note{};
+  note.wave_id = wave_id.handle;
+  note.lds_segment = -1;
+
+  auto get_info = [&] (amd_dbgapi_wave_info_t query, auto &value) {
+    return DBGAPI_TIMED (amd_dbgapi_wave_get_info (
+               m_process_id, wave_id, query, sizeof (value), &value))
+           == AMD_DBGAPI_STATUS_SUCCESS;
+  };
+
+  amd_dbgapi_agent_id_t agent_id{};
+  get_info (AMD_DBGAPI_WAVE_INFO_AGENT, agent_id);
+  note.agent_id = agent_id.handle;
+
+  amd_dbgapi_queue_id_t queue_id{};
+  get_info (AMD_DBGAPI_WAVE_INFO_QUEUE, queue_id);
+  note.queue_id = queue_id.handle;
+
+  amd_dbgapi_architecture_id_t architecture_id{};
+  get_info (AMD_DBGAPI_WAVE_INFO_ARCHITECTURE, architecture_id);
+
+  amd_dbgapi_wave_stop_reason_t stop_reason{};
+  get_info (AMD_DBGAPI_WAVE_INFO_STOP_REASON, stop_reason);
+  note.stop_reason = stop_reason;
+
+  get_info (AMD_DBGAPI_WAVE_INFO_PC, note.pc);
+  get_info (AMD_DBGAPI_WAVE_INFO_EXEC_MASK, note.exec_mask);
+  get_info (AMD_DBGAPI_WAVE_INFO_LANE_COUNT, note.lane_count);
+
+  if (m_agents.insert (agent_id.handle).second)
+    write_agent_note (agent_id);
+
+  /* Not all queue types provide dispatch and workgroup information.  */
+  if (amd_dbgapi_dispatch_id_t dispatch_id;
+      get_info (AMD_DBGAPI_WAVE_INFO_DISPATCH, dispatch_id))
+    {
+      note.dispatch_id = dispatch_id.handle;
+
+      if (m_dispatches.find (dispatch_id.handle) == m_dispatches.end ())
+        write_dispatch_note (dispatch_id, wave_id);
+
+      if (get_info (AMD_DBGAPI_WAVE_INFO_WORK_GROUP_COORD,
+                    note.work_group_coord))
+        {
+          get_info (AMD_DBGAPI_WAVE_INFO_WAVE_NUMBER_IN_WORK_GROUP,
+                    note.wave_number_in_work_group);
+
+          /* The local memory segments follow the notes segment, in the order
+             their workgroups are first seen.  */
+          auto [it, inserted] = m_workgroup_segments.try_emplace (
+              { dispatch_id.handle, note.work_group_coord[0],
+                note.work_group_coord[1], note.work_group_coord[2] },
+              1 + m_workgroups.size ());
+          if (inserted)
+            m_workgroups.emplace_back (
+                workgroup_t{ wave_id, architecture_id });
+          note.lds_segment = it->second;
+        }
+    }
+
+  /* Query the size of all the registers first, the note's size is written
+     before the registers' values.  */
+  size_t register_count{ 0 };
+  amd_dbgapi_register_id_t *register_ids{ nullptr };
+  if (DBGAPI_TIMED (amd_dbgapi_wave_register_list (
+          m_process_id, wave_id, &register_count, &register_ids))
+      != AMD_DBGAPI_STATUS_SUCCESS)
+    register_count = 0;
+
+  m_registers.clear ();
+  size_t desc_size = sizeof (note);
+
+  for (size_t i = 0; i < register_count; ++i)
+    {
+      size_t register_size;
+      if (DBGAPI_TIMED (amd_dbgapi_wave_register_get_info (
+              m_process_id, wave_id, register_ids[i],
+              AMD_DBGAPI_REGISTER_INFO_SIZE, sizeof (register_size),
+              &register_size))
+          != AMD_DBGAPI_STATUS_SUCCESS)
+        continue;
+
+      m_registers.emplace_back (
+          register_ids[i],
+          core_register_t{ register_name_offset (wave_id, register_ids[i]),
+                           static_cast<uint32_t> (register_size) });
+      desc_size += sizeof (core_register_t) + align_up (register_size, 4);
+    }
+  free (register_ids);
+
+  note.register_count = m_registers.size ();
+
+  write_note_header (m_out, core_nt_amdgpu_wave, desc_size);
+  m_out.write (note);
+
+  for (auto &&[register_id, record] : m_registers)
+    {
+      m_scratch.assign (record.size, 0);
+
+      /* A register that cannot be read is saved as 0.  */
+      DBGAPI_TIMED (amd_dbgapi_read_register (m_process_id, wave_id,
+                                              register_id, 0, record.size,
+                                              m_scratch.data ()));
+
+      m_out.write (record);
+      m_out.write (m_scratch.data (), m_scratch.size ());
+      m_out.pad (4);
+    }
+}
+
+void
+core_file_t::write_code_object_notes ()
+{
+  int32_t segment = 1 + m_workgroups.size ();
+
+  for (auto &&[load_address, code_object] : m_code_object_map)
+    {
+      core_code_object_note_t note{};
+      note.load_address = load_address;
+      note.mem_size = code_object->mem_size ();
+      note.content_hash = code_object->content_hash ();
+      note.segment = is_embedded (*code_object) ? segment++ : -1;
+
+      write_note_header (m_out, core_nt_amdgpu_code_object,
+                         sizeof (note) + code_object->uri ().size () + 1);
+      m_out.write (note);
+      m_out.write_string (code_object->uri ());
+      m_out.pad (4);
+    }
+}
+
+void
+core_file_t::write_register_names_note ()
+{
+  write_note_header (m_out, core_nt_amdgpu_register_names,
+                     m_register_names.size ());
+  m_out.write (m_register_names.data (), m_register_names.size ());
+  m_out.pad (4);
+}
+
+void
+core_file_t::write_local_memory (const workgroup_t &workgroup)
+{
+  const uint64_t start_offset = m_out.offset ();
+
+  amd_dbgapi_address_space_id_t local_address_space_id;
+  if (DBGAPI_TIMED (amd_dbgapi_dwarf_address_space_to_address_space (
+          workgroup.architecture_id, 0x3 /* DW_ASPACE_AMDGPU_local */,
+          &local_address_space_id))
+      == AMD_DBGAPI_STATUS_SUCCESS)
+    {
+      m_scratch.resize (64 * 1024);
+      amd_dbgapi_segment_address_t address{ 0 };
+
+      while (true)
+        {
+          size_t size = m_scratch.size ();
+          if (DBGAPI_TIMED (amd_dbgapi_read_memory (
+                  m_process_id, workgroup.wave_id, 0, local_address_space_id,
+                  address, &size, m_scratch.data ()))
+              != AMD_DBGAPI_STATUS_SUCCESS)
+            break;
+
+          m_out.write (m_scratch.data (), size);
+          address += size;
+
+          if (size != m_scratch.size ())
+            break;
+        }
+    }
+
+  /* A workgroup without local memory still has its, empty, segment.  */
+  add_segment (core_pt_amdgpu_lds, start_offset, 0);
+}
+
+void
+core_file_t::write_code_objects ()
+{
+  for (auto &&[load_address, code_object] : m_code_object_map)
+    {
+      if (!is_embedded (*code_object))
+        continue;
+
+      const uint64_t start_offset = m_out.offset ();
+      const size_t file_size = code_object->file_size ();
+
+      m_scratch.resize (buffer_size);
+      for (size_t offset = 0; offset < file_size;)
+        {
+          size_t size = code_object->read (
+              m_scratch.data (),
+              std::min (m_scratch.size (), file_size - offset), offset);
+          if (!size)
+            break;
+
+          m_out.write (m_scratch.data (), size);
+          offset += size;
+        }
+
+      add_segment (core_pt_amdgpu_code_object, start_offset, load_address);
+    }
+}
+
+std::size_t
+core_file_t::write_global_memory (amd_dbgapi_wave_id_t wave_id,
+                                  amd_dbgapi_global_address_t address,
+                                  std::size_t size)
+{
+  const uint64_t start_offset = m_out.offset ();
+  m_scratch.resize (std::min (size, buffer_size));
+
+  std::size_t total{ 0 };
+  while (total < size)
+    {
+      size_t chunk_size = std::min (size - total, m_scratch.size ());
+      const size_t requested_size = chunk_size;
+
+      if (DBGAPI_TIMED (amd_dbgapi_read_memory (
+              m_process_id, wave_id, AMD_DBGAPI_LANE_NONE,
+              AMD_DBGAPI_ADDRESS_SPACE_GLOBAL, address + total, &chunk_size,
+              m_scratch.data ()))
+          != AMD_DBGAPI_STATUS_SUCCESS)
+        break;
+
+      m_out.write (m_scratch.data (), chunk_size);
+      total += chunk_size;
+
+      if (chunk_size != requested_size)
+        break;
+    }
+
+  if (total)
+    add_segment (PT_LOAD, start_offset, address);
+
+  return total;
+}
+
+void
+core_file_t::write_kernel_arguments (const dispatch_t &dispatch)
+{
+  if (!dispatch.kernel_argument_segment_address)
+    return;
+
+  const std::size_t size
+      = write_global_memory (dispatch.wave_id,
+                             dispatch.kernel_argument_segment_address,
+                             kernarg_window_size);
+
+  if (!m_options.memory_window_size || !size)
+    return;
+
+  /* Save the memory at the arguments that are addresses of global memory.
+     The arguments are in the scratch buffer, copy them before it is
+     reused.  */
+  std::vector<uint64_t> arguments (size / sizeof (uint64_t));
+  memcpy (arguments.data (), m_scratch.data (),
+          arguments.size () * sizeof (uint64_t));
+
+  for (uint64_t argument : arguments)
+    {
+      if (!argument)
+        continue;
+
+      /* Skip the addresses already saved by another window.  */
+      if (std::any_of (m_program_headers.begin (), m_program_headers.end (),
+                       [&] (const Elf64_Phdr &phdr) {
+                         return phdr.p_type == PT_LOAD
+                                && argument >= phdr.p_vaddr
+                                && argument - phdr.p_vaddr < phdr.p_memsz;
+                       }))
+        continue;
+
+      write_global_memory (dispatch.wave_id, argument,
+                           m_options.memory_window_size);
+    }
+}
+
+std::optional<std::size_t>
+core_file_t::write (const std::vector<amd_dbgapi_wave_id_t> &wave_ids)
+{
+  /* The ELF header is written last, once the program headers are.  */
+  m_out.write (Elf64_Ehdr{});
+
+  const uint64_t notes_offset = m_out.offset ();
+
+  core_process_note_t process_note{};
+  process_note.version = core_format_version;
+  process_note.pid = getpid ();
+  process_note.wave_count = wave_ids.size ();
+  process_note.code_object_count = m_code_object_map.size ();
+
+  write_note_header (m_out, core_nt_amdgpu_process, sizeof (process_note));
+  m_out.write (process_note);
+
+  for (auto wave_id : wave_ids)
+    write_wave_note (wave_id);
+
+  write_code_object_notes ();
+  write_register_names_note ();
+
+  add_segment (PT_NOTE, notes_offset, 0);
+  m_program_headers.back ().p_align = 4;
+
+  for (auto &&workgroup : m_workgroups)
+    write_local_memory (workgroup);
+
+  write_code_objects ();
+
+  for (auto &&[handle, dispatch] : m_dispatches)
+    write_kernel_arguments (dispatch);
+
+  m_out.pad (8);
+
+  Elf64_Ehdr ehdr{};
+  memcpy (ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_ident[EI_OSABI] = elfosabi_amdgpu_hsa;
+  ehdr.e_type = ET_CORE;
+  ehdr.e_machine = EM_AMDGPU;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_phoff = m_out.offset ();
+  ehdr.e_ehsize = sizeof (Elf64_Ehdr);
+  ehdr.e_phentsize = sizeof (Elf64_Phdr);
+  ehdr.e_shentsize = sizeof (Elf64_Shdr);
+
+  for (auto &&phdr : m_program_headers)
+    m_out.write (phdr);
+
+  if (m_program_headers.size () < PN_XNUM)
+    ehdr.e_phnum = m_program_headers.size ();
+  else
+    {
+      Elf64_Shdr shdr{};
+      shdr.sh_info = m_program_headers.size ();
+
+      ehdr.e_phnum = PN_XNUM;
+      ehdr.e_shoff = m_out.offset ();
+      ehdr.e_shnum = 1;
+      m_out.write (shdr);
+    }
+
+  m_out.flush ();
+  m_out.rewrite (&ehdr, sizeof (ehdr), 0);
+
+  if (!m_out.ok ())
+    return {};
+
+  return m_out.offset ();
+}
+
+} /* namespace */
+
+bool
+write_core_file (const std::string &path, amd_dbgapi_process_id_t process_id,
+                 const std::vector<amd_dbgapi_wave_id_t> &wave_ids,
+                 const std::vector<code_object_t *> &code_objects,
+                 const core_file_options_t &options)
+{
+  static stat_site_t timer_site ("core_file");
+  scoped_timer_t timer (timer_site);
+
+  int fd = ::open (path.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+  if (fd == -1)
+    return false;
+
+  core_file_t core_file (fd, process_id, code_objects, options);
+  std::optional<std::size_t> size = core_file.write (wave_ids);
+
+  if (::close (fd) || !size)
+    {
+      ::unlink (path.c_str ());
+      return false;
+    }
+
+  timer.add_bytes (*size);
+  return true;
+}
+
+} /* namespace amd::debug_agent */
@@ -0,0 +1,185 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_CORE_FILE_H
+#define _ROCM_DEBUG_AGENT_CORE_FILE_H 1
+
+#include <amd-dbgapi.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace amd::debug_agent
+{
+
+class code_object_t;
+
+/* The layout of a GPU core file.  It is an ELF64 ET_CORE file for the
+   EM_AMDGPU machine and the ELFOSABI_AMDGPU_HSA ABI, with the following
+   segments:
+
+     PT_NOTE                The notes described below, all named "AMDGPU".
+     PT_AMDGPU_LDS          The local memory of a workgroup, at its address
+                            in the local address space.
+     PT_AMDGPU_CODE_OBJECT  The ELF file of a code object that was loaded
+                            from memory, at its load address.  Code objects
+                            loaded from a file are only referenced by URI,
+                            unless the core file is written for offline
+                            symbolization.
+     PT_LOAD                A window of global memory, at its address.
+
+   The program headers follow the segments, at the end of the file, so that
+   the file is written sequentially.  If there are more than PN_XNUM - 1
+   segments, e_phnum is PN_XNUM and the number of segments is in the sh_info
+   of the only section header.
+
+   All the integers are little-endian, strings are NUL-terminated, and each
+   note description is padded to a multiple of 4 bytes.  */
+
+constexpr uint32_t core_pt_amdgpu_lds = 0x60000000 + 0x1000;
+constexpr uint32_t core_pt_amdgpu_code_object = 0x60000000 + 0x1001;
+
+constexpr uint32_t core_format_version = 2;
+
+enum core_note_type_t : uint32_t
+{
+  /* core_process_note_t.  */
+  core_nt_amdgpu_process = 1,
+  /* core_agent_note_t, followed by the agent name and architecture
+     name.  */
+  core_nt_amdgpu_agent = 2,
+  /* core_dispatch_note_t, followed by the kernel name, empty if unknown or
+     if the core file is written for offline symbolization.  */
+  core_nt_amdgpu_dispatch = 3,
+  /* core_wave_note_t, followed by `register_count` core_register_t each
+     followed by `size` bytes of value padded to a multiple of 4 bytes.  */
+  core_nt_amdgpu_wave = 4,
+  /* core_code_object_note_t, followed by the URI.  */
+  core_nt_amdgpu_code_object = 5,
+  /* The names of the registers, referenced by their offset in this note.  */
+  core_nt_amdgpu_register_names = 6,
+};
+
+struct core_process_note_t
+{
+  uint32_t version;
+  uint32_t pid;
+  uint64_t agent_count;
+  uint64_t dispatch_count;
+  uint64_t wave_count;
+  uint64_t code_object_count;
+};
+
+struct core_agent_note_t
+{
+  uint64_t agent_id;
+};
+
+struct core_dispatch_note_t
+{
+  uint64_t dispatch_id;
+  uint64_t queue_id;
+  uint64_t agent_id;
+  uint64_t os_queue_packet_id;
+  uint64_t kernel_descriptor_address;
+  uint64_t kernel_code_entry_address;
+  uint64_t kernel_argument_segment_address;
+  uint32_t grid_sizes[3];
+  uint32_t work_group_sizes[3];
+};
+
+struct core_wave_note_t
+{
+  uint64_t wave_id;
+  uint64_t agent_id;
+  uint64_t queue_id;
+  /* 0 if the wave's queue does not report dispatches.  */
+  uint64_t dispatch_id;
+  uint64_t pc;
+  uint64_t exec_mask;
+  uint32_t stop_reason;
+  uint32_t work_group_coord[3];
+  uint32_t wave_number_in_work_group;
+  uint32_t lane_count;
+  /* The index of the program header of the workgroup's local memory, or -1
+     if the wave is not part of a workgroup.  */
+  int32_t lds_segment;
+  uint32_t register_count;
+};
+
+struct core_register_t
+{
+  /* The offset of the register's name in the register names note.  */
+  uint32_t name_offset;
+  uint32_t size;
+};
+
+struct core_code_object_note_t
+{
+  uint64_t load_address;
+  uint64_t mem_size;
+  /* code_object_t::content_hash of the ELF file.  */
+  uint64_t content_hash;
+  /* The index of the program header of the code object's ELF file, or -1
+     if it is only referenced by URI.  */
+  int32_t segment;
+  uint32_t reserved;
+};
+
+struct core_file_options_t
+{
+  /* If not 0, also save this many bytes of global memory at each kernel
+     argument that is the address of readable memory.  */
+  std::size_t memory_window_size{ 0 };
+  /* Write a core file to be symbolized offline: embed all the code objects,
+     and do not look up the kernel names.  */
+  bool raw{ false };
+};
+
+/* Write the state of the stopped waves `wave_ids` of `process_id`, and of
+   their agents and dispatches, to a new GPU core file at `path`.  The
+   `code_objects` loaded in the process are embedded or referenced, and the
+   kernel argument segment of each dispatch is saved.
+
+   The registers and memory are streamed to the file through a fixed size
+   buffer, only a few bytes per workgroup and dispatch are kept until the
+   end.  Return false and remove the file if it could not be written.
+   dbgapi_lock must be held.  */
+bool write_core_file (const std::string &path,
+                      amd_dbgapi_process_id_t process_id,
+                      const std::vector<amd_dbgapi_wave_id_t> &wave_ids,
+                      const std::vector<code_object_t *> &code_objects,
+                      const core_file_options_t &options);
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_CORE_FILE_H */
@@ -32,6 +32,7 @@
 #define _ROCM_DEBUG_AGENT_DEBUG_H 1
 
 #include "logging.h"
+#include "stats.h"
 
 namespace amd::debug_agent
 {
@@ -45,10 +46,31 @@ namespace amd::debug_agent
   do                                                                          \
     {                                                                         \
       agent_log (log_level_t::error, format, ##__VA_ARGS__);                  \
+      amd::debug_agent::drain_agent_out ();                                   \
       abort ();                                                               \
     }                                                                         \
   while (false)
 
+/* Evaluate the debugger API call `expr` and return its status.  The call is
+   accounted in the agent statistics under the function's name.  */
+#define DBGAPI_TIMED(expr)                                                    \
+  ([&] () {                                                                   \
+    static amd::debug_agent::stat_site_t dbgapi_site (#expr);                 \
+    amd::debug_agent::scoped_timer_t dbgapi_timer (dbgapi_site);              \
+    return (expr);                                                            \
+  }())
+
+/* Abort if the debugger API call `expr` does not succeed.  */
+#define DBGAPI_CHECK(expr)                                                    \
+  do                                                                          \
+    {                                                                         \
+      if (amd_dbgapi_status_t status = DBGAPI_TIMED (expr);                   \
+          status != AMD_DBGAPI_STATUS_SUCCESS)                                \
+        agent_error ("%s:%d: %s failed (rc=%d)", __FILE__, __LINE__, #expr,   \
+                     status);                                                 \
+    }                                                                         \
+  while (false)
+
 #define agent_assert_fail(assertion, file, line)                              \
   [] () {                                                                     \
     agent_error ("%s:%d: Assertion `%s' failed.", file, line, assertion);     \
@@ -28,645 +28,493 @@
    ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
    DEALINGS WITH THE SOFTWARE.  */
 
+#include "allocation_tracker.h"
+#include "aql.h"
 #include "code_object.h"
+#include "control_socket.h"
 #include "debug.h"
+#include "dump.h"
 #include "logging.h"
+#include "pc_sampler.h"
+#include "queue_registry.h"
+#include "session.h"
+#include "stats.h"
 
-#include <amd-dbgapi.h>
 #include <hsa/hsa.h>
 #include <hsa/hsa_api_trace.h>
 #include <hsa/hsa_ext_amd.h>
 
-#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <iterator>
-#include <map>
-#include <memory>
 #include <mutex>
 #include <optional>
+#include <sstream>
 #include <string>
-#include <type_traits>
-#include <unordered_map>
-#include <unordered_set>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
-#define DBGAPI_CHECK(expr)                                                    \
-  do                                                                          \
-    {                                                                         \
-      if (amd_dbgapi_status_t status = (expr);                                \
-          status != AMD_DBGAPI_STATUS_SUCCESS)                                \
-        agent_error ("%s:%d: %s failed (rc=%d)", __FILE__, __LINE__, #expr,   \
-                     status);                                                 \
-    }                                                                         \
-  while (false)
-
 using namespace amd::debug_agent;
-using namespace std::string_literals;
 
 namespace
 {
-std::optional<std::string> g_code_objects_dir;
 bool g_all_wavefronts{ false };
-
-static amd_dbgapi_callbacks_t dbgapi_callbacks = {
-  /* allocate_memory.  */
-  .allocate_memory = malloc,
-
-  /* deallocate_memory.  */
-  .deallocate_memory = free,
-
-  /* get_os_pid.  */
-  .get_os_pid =
-      [] (amd_dbgapi_client_process_id_t client_process_id, pid_t *pid) {
-        *pid = getpid ();
-        return AMD_DBGAPI_STATUS_SUCCESS;
-      },
-
-  /* enable_notify_shared_library callback.  */
-  .enable_notify_shared_library =
-      [] (amd_dbgapi_client_process_id_t client_process_id,
-          const char *library_name, amd_dbgapi_shared_library_id_t library_id,
-          amd_dbgapi_shared_library_state_t *library_state) {
-        /* If the debug agent is loaded, then the ROCR is already loaded.   */
-        *library_state = (library_name == "libhsa-runtime64.so.1"s)
-                             ? AMD_DBGAPI_SHARED_LIBRARY_STATE_LOADED
-                             : AMD_DBGAPI_SHARED_LIBRARY_STATE_UNLOADED;
-        return AMD_DBGAPI_STATUS_SUCCESS;
-      },
-
-  /* disable_notify_shared_library callback.  */
-  .disable_notify_shared_library =
-      [] (amd_dbgapi_client_process_id_t client_process_id,
-          amd_dbgapi_shared_library_id_t library_id) {
-        return AMD_DBGAPI_STATUS_SUCCESS;
-      },
-
-  /* get_symbol_address callback.  */
-  .get_symbol_address =
-      [] (amd_dbgapi_client_process_id_t client_process_id,
-          amd_dbgapi_shared_library_id_t library_id, const char *symbol_name,
-          amd_dbgapi_global_address_t *address) {
-        *address = reinterpret_cast<amd_dbgapi_global_address_t> (
-            dlsym (RTLD_DEFAULT, symbol_name));
-        return AMD_DBGAPI_STATUS_SUCCESS;
-      },
-
-  /* set_breakpoint callback.  */
-  .insert_breakpoint =
-      [] (amd_dbgapi_client_process_id_t client_process_id,
-          amd_dbgapi_shared_library_id_t shared_library_id,
-          amd_dbgapi_global_address_t address,
-          amd_dbgapi_breakpoint_id_t breakpoint_id) {
-        return AMD_DBGAPI_STATUS_SUCCESS;
-      },
-
-  /* remove_breakpoint callback.  */
-  .remove_breakpoint =
-      [] (amd_dbgapi_client_process_id_t client_process_id,
-          amd_dbgapi_breakpoint_id_t breakpoint_id) {
-        return AMD_DBGAPI_STATUS_SUCCESS;
-      },
-
-  /* log_message callback.  */
-  .log_message =
-      [] (amd_dbgapi_log_level_t level, const char *message) {
-        agent_out << "rocm-dbgapi: " << message << std::endl;
-      }
+dump_options_t g_dump_options;
+agent_out_options_t g_output_options;
+std::optional<std::string> g_pc_sampling_output;
+std::chrono::microseconds g_pc_sampling_interval{ 10000 };
+std::optional<std::string> g_stats_file;
+std::optional<std::string> g_control_socket_path;
+bool g_track_allocations{ false };
+
+/* When to attach a debugger API session that remains attached until the
+   agent is unloaded.  */
+enum class persistent_session_t
+{
+  /* Attach and detach the process for each dump.  */
+  none,
+  /* Attach the process at the first dump.  */
+  first_dump,
+  /* Attach the process when the first queue is created.  */
+  startup
 };
 
-std::string
-hex_string (const std::vector<uint8_t> &value)
-{
-  std::string value_string;
-  value_string.reserve (2 * value.size ());
+persistent_session_t g_persistent_session{ persistent_session_t::none };
+bool g_session_held{ false };
 
-  for (size_t pos = value.size (); pos > 0; --pos)
-    {
-      static constexpr char hex_digits[] = "0123456789abcdef";
-      value_string.push_back (hex_digits[value[pos - 1] >> 4]);
-      value_string.push_back (hex_digits[value[pos - 1] & 0xF]);
-    }
-
-  return value_string;
+/* Take a reference to the debugger API session, released in OnUnload, so
+   that the process is not detached after each dump.  */
+void
+hold_session ()
+{
+  static std::once_flag session_held;
+  std::call_once (session_held, [] () {
+    std::scoped_lock lock (dbgapi_lock);
+    attach_process ();
+    g_session_held = true;
+  });
 }
 
-std::string
-register_value_string (const std::string &register_type,
-                       const std::vector<uint8_t> &register_value)
-{
-  /* handle vector types..  */
-  if (size_t pos = register_type.find_last_of ('['); pos != std::string::npos)
-    {
-      const std::string element_type = register_type.substr (0, pos);
-      const size_t element_count = std::stoi (register_type.substr (pos + 1));
-      const size_t element_size = register_value.size () / element_count;
+/* Serializes the dumps, and the changes to g_dump_options made by the
+   control socket.  A control command received while a dump is in progress
+   is rejected, the dumps requested by SIGQUIT or by faults wait for it to
+   complete.  Taken before the agent_out_lock_t.  */
+std::mutex g_dump_lock;
 
-      agent_assert ((register_value.size () % element_size) == 0);
+/* Print the wavefronts, and the statistics if enabled.  g_dump_lock must be
+   held.  */
+void
+dump (bool all_wavefronts, const dump_options_t &options)
+{
+  agent_out_lock_t out_lock;
 
-      std::stringstream ss;
-      for (size_t i = 0; i < element_count; ++i)
-        {
-          if (i != 0)
-            ss << " ";
-          ss << "[" << i << "] ";
+  if (g_persistent_session != persistent_session_t::none)
+    hold_session ();
 
-          std::vector<uint8_t> element_value (
-              &register_value[element_size * i],
-              &register_value[element_size * (i + 1)]);
+  dump_wavefronts (all_wavefronts, options);
 
-          ss << register_value_string (element_type, element_value);
-        }
-      return ss.str ();
+  if (stats_enabled && g_stats_file)
+    {
+      std::ofstream stats_file (*g_stats_file, std::ios::app);
+      if (!stats_file)
+        agent_warning ("could not open `%s'", g_stats_file->c_str ());
+      print_stats (stats_file);
+      print_code_object_memory (stats_file);
+    }
+  else if (stats_enabled)
+    {
+      print_stats (agent_out);
+      print_code_object_memory (agent_out);
     }
 
-  return hex_string (register_value);
+  /* agent_out is buffered, write the complete dump now.  */
+  agent_out.flush ();
 }
 
-void
-print_registers (amd_dbgapi_process_id_t process_id,
-                 amd_dbgapi_wave_id_t wave_id)
+/* Parse a wave, queue or dispatch id, as printed in a dump with the `PREFIX_'
+   or in a control command without it.  */
+std::optional<uint64_t>
+parse_id (std::string_view str, std::string_view prefix)
 {
-  amd_dbgapi_architecture_id_t architecture_id;
-  DBGAPI_CHECK (amd_dbgapi_wave_get_info (
-      process_id, wave_id, AMD_DBGAPI_WAVE_INFO_ARCHITECTURE,
-      sizeof (architecture_id), &architecture_id));
-
-  size_t class_count;
-  amd_dbgapi_register_class_id_t *register_class_ids;
-  DBGAPI_CHECK (amd_dbgapi_architecture_register_class_list (
-      architecture_id, &class_count, &register_class_ids));
-
-  size_t register_count;
-  amd_dbgapi_register_id_t *register_ids;
-  DBGAPI_CHECK (amd_dbgapi_wave_register_list (
-      process_id, wave_id, &register_count, &register_ids));
-
-  for (size_t i = 0; i < class_count; ++i)
-    {
-      amd_dbgapi_register_class_id_t register_class_id = register_class_ids[i];
-
-      char *class_name_;
-      DBGAPI_CHECK (amd_dbgapi_architecture_register_class_get_info (
-          architecture_id, register_class_id,
-          AMD_DBGAPI_REGISTER_CLASS_INFO_NAME, sizeof (class_name_),
-          &class_name_));
-      std::string class_name (class_name_);
-      free (class_name_);
-
-      if (class_name == "general" || class_name == "all")
-        continue;
-
-      agent_out << std::endl << class_name << " registers:";
+  if (str.substr (0, prefix.size ()) == prefix)
+    str.remove_prefix (prefix.size ());
 
-      size_t last_register_size = 0;
-      for (size_t j = 0, column = 0; j < register_count; ++j)
-        {
-          amd_dbgapi_register_id_t register_id = register_ids[j];
-
-          amd_dbgapi_register_class_state_t state;
-          DBGAPI_CHECK (amd_dbgapi_register_is_in_register_class (
-              architecture_id, register_id, register_class_id, &state));
-
-          if (state != AMD_DBGAPI_REGISTER_CLASS_STATE_MEMBER)
-            continue;
-
-          char *register_name_;
-          DBGAPI_CHECK (amd_dbgapi_wave_register_get_info (
-              process_id, wave_id, register_id, AMD_DBGAPI_REGISTER_INFO_NAME,
-              sizeof (register_name_), &register_name_));
-          std::string register_name (register_name_);
-          free (register_name_);
-
-          char *register_type_;
-          DBGAPI_CHECK (amd_dbgapi_wave_register_get_info (
-              process_id, wave_id, register_id, AMD_DBGAPI_REGISTER_INFO_TYPE,
-              sizeof (register_type_), &register_type_));
-          std::string register_type (register_type_);
-          free (register_type_);
-
-          size_t register_size;
-          DBGAPI_CHECK (amd_dbgapi_wave_register_get_info (
-              process_id, wave_id, register_id, AMD_DBGAPI_REGISTER_INFO_SIZE,
-              sizeof (register_size), &register_size));
-
-          std::vector<uint8_t> buffer (register_size);
-          DBGAPI_CHECK (
-              amd_dbgapi_read_register (process_id, wave_id, register_id, 0,
-                                        register_size, buffer.data ()));
-
-          const size_t num_register_per_line = 16 / register_size;
-
-          if (register_size > sizeof (uint64_t) /* Registers larger than a
-                                                   uint64_t are printed each
-                                                   on a separate line.  */
-              || register_size != last_register_size
-              || (column++ % num_register_per_line) == 0)
-            {
-              agent_out << std::endl;
-              column = 1;
-            }
+  if (str.empty ()
+      || str.find_first_not_of ("0123456789") != std::string_view::npos)
+    return std::nullopt;
 
-          last_register_size = register_size;
-
-          agent_out << std::right << std::setfill (' ') << std::setw (16)
-                    << (register_name + ": ")
-                    << register_value_string (register_type, buffer);
-        }
-
-      agent_out << std::endl;
+  try
+    {
+      return std::stoull (std::string (str));
+    }
+  catch (...)
+    {
+      return std::nullopt;
     }
-
-  free (register_ids);
-  free (register_class_ids);
 }
 
-void
-print_local_memory (amd_dbgapi_process_id_t process_id,
-                    amd_dbgapi_wave_id_t wave_id)
+/* Parse a size in bytes, optionally followed by a K, M, or G suffix.  */
+std::optional<size_t>
+parse_size (const std::string &str)
 {
-  amd_dbgapi_architecture_id_t architecture_id;
-  DBGAPI_CHECK (amd_dbgapi_wave_get_info (
-      process_id, wave_id, AMD_DBGAPI_WAVE_INFO_ARCHITECTURE,
-      sizeof (architecture_id), &architecture_id));
-
-  amd_dbgapi_address_space_id_t local_address_space_id;
-  DBGAPI_CHECK (amd_dbgapi_dwarf_address_space_to_address_space (
-      architecture_id, 0x3 /* DW_ASPACE_AMDGPU_local */,
-      &local_address_space_id));
-
-  std::vector<uint32_t> buffer (1024);
-  amd_dbgapi_segment_address_t base_address{ 0 };
-
-  while (true)
+  size_t pos;
+  size_t value;
+  try
     {
-      size_t requested_size = buffer.size () * sizeof (buffer[0]);
-      size_t size = requested_size;
-      if (amd_dbgapi_read_memory (process_id, wave_id, 0,
-                                  local_address_space_id, base_address, &size,
-                                  buffer.data ())
-          != AMD_DBGAPI_STATUS_SUCCESS)
-        break;
-
-      agent_assert ((size % sizeof (buffer[0])) == 0);
-      buffer.resize (size / sizeof (buffer[0]));
-
-      if (!base_address)
-        agent_out << std::endl << "Local memory content:";
-
-      for (size_t i = 0, column = 0; i < buffer.size (); ++i)
-        {
-          if ((column++ % 8) == 0)
-            {
-              agent_out << std::endl
-                        << "    0x" << std::setfill ('0') << std::setw (4)
-                        << (base_address + i * sizeof (buffer[0])) << ":";
-              column = 1;
-            }
-
-          agent_out << " " << std::hex << std::setfill ('0') << std::setw (8)
-                    << buffer[i];
-        }
-
-      base_address += size;
-
-      if (size != requested_size)
-        break;
+      value = std::stoul (str, &pos, 0);
+    }
+  catch (...)
+    {
+      return std::nullopt;
     }
 
-  if (base_address)
-    agent_out << std::endl;
+  const std::string suffix = str.substr (pos);
+  if (suffix == "K" || suffix == "k")
+    value <<= 10;
+  else if (suffix == "M" || suffix == "m")
+    value <<= 20;
+  else if (suffix == "G" || suffix == "g")
+    value <<= 30;
+  else if (!suffix.empty ())
+    return std::nullopt;
+
+  return value;
 }
 
-void
-stop_all_wavefronts (amd_dbgapi_process_id_t process_id)
+/* Apply the `NAME=VALUE' change of a dump option sent to the control socket
+   to OPTIONS.  Return an error message, or an empty string on success.  */
+std::string
+set_dump_option (const std::string &name, const std::string &value,
+                 dump_options_t &options)
 {
-  using wave_handle_type_t = decltype (amd_dbgapi_wave_id_t::handle);
-  std::unordered_set<wave_handle_type_t> already_stopped;
-  std::unordered_set<wave_handle_type_t> waiting_to_stop;
-
-  agent_log (log_level_t::info, "stopping all wavefronts");
-  for (size_t iter = 0;; ++iter)
+  if (name == "active-lanes")
     {
-      agent_log (log_level_t::info, "iteration %zu:", iter);
-
-      while (true)
+      if (value == "all")
+        options.vector_lanes = vector_lanes_t::all;
+      else if (value == "active")
+        options.vector_lanes = vector_lanes_t::active;
+      else if (value == "matrix")
+        options.vector_lanes = vector_lanes_t::matrix;
+      else
+        return "expected all, active or matrix";
+    }
+  else if (name == "dump-time-budget")
+    {
+      if (value == "none")
         {
-          amd_dbgapi_event_id_t event_id;
-          amd_dbgapi_event_kind_t kind;
-
-          DBGAPI_CHECK (
-              amd_dbgapi_next_pending_event (process_id, &event_id, &kind));
-
-          if (event_id.handle == AMD_DBGAPI_EVENT_NONE.handle)
-            break;
-
-          if (kind == AMD_DBGAPI_EVENT_KIND_WAVE_STOP)
-            {
-              amd_dbgapi_wave_id_t wave_id;
-              DBGAPI_CHECK (amd_dbgapi_event_get_info (
-                  process_id, event_id, AMD_DBGAPI_EVENT_INFO_WAVE,
-                  sizeof (wave_id), &wave_id));
-
-              waiting_to_stop.erase (wave_id.handle);
-              already_stopped.emplace (wave_id.handle);
-
-              agent_log (log_level_t::info, "wave_%ld is stopped",
-                         wave_id.handle);
-            }
+          options.time_budget.reset ();
+          return {};
         }
 
-      amd_dbgapi_wave_id_t *wave_ids;
-      size_t wave_count;
-      DBGAPI_CHECK (
-          amd_dbgapi_wave_list (process_id, &wave_count, &wave_ids, nullptr));
-
-      /* Stop all waves that are still running.  */
-      for (size_t i = 0; i < wave_count; ++i)
+      double seconds{ 0 };
+      try
         {
-          amd_dbgapi_wave_id_t wave_id = wave_ids[i];
-
-          if (already_stopped.find (wave_id.handle) != already_stopped.end ())
-            continue;
-
-          /* Already requested to stop.  */
-          if (waiting_to_stop.find (wave_id.handle) != waiting_to_stop.end ())
-            {
-              agent_log (log_level_t::info, "wave_%ld is still stopping",
-                         wave_id.handle);
-              continue;
-            }
-
-          agent_log (log_level_t::info,
-                     "wave_%ld is running, sending stop request",
-                     wave_id.handle);
+          seconds = std::stod (value);
+        }
+      catch (...)
+        {
+        }
 
-          /* FIXME: The wave could be single-stepping, how are we going to
-             restore the state?  */
-          DBGAPI_CHECK (amd_dbgapi_wave_stop (process_id, wave_id));
+      if (seconds <= 0)
+        return "expected a number of seconds or none";
 
-          waiting_to_stop.emplace (wave_id.handle);
+      options.time_budget
+          = std::chrono::duration_cast<std::chrono::steady_clock::duration> (
+              std::chrono::duration<double> (seconds));
+    }
+  else if (name == "dump-size-budget")
+    {
+      if (value == "none")
+        {
+          options.size_budget.reset ();
+          return {};
         }
 
-      free (wave_ids);
+      std::optional<size_t> size = parse_size (value);
+      if (!size || !*size)
+        return "expected a size or none";
 
-      if (!waiting_to_stop.size ())
-        break;
+      options.size_budget = size;
     }
+  else
+    return "unknown option `" + name + "'";
 
-  agent_log (log_level_t::info, "all wavefronts are stopped");
+  return {};
 }
 
+/* Write REPLY, which is short, to the control socket client SOCKET_FD.  */
 void
-print_wavefronts (bool all_wavefronts)
+control_reply (int socket_fd, const std::string &reply)
 {
-  /* This function is not thread-safe and not re-entrant.  */
-  static std::mutex lock;
-  if (!lock.try_lock ())
-    return;
-  /* Make sure the lock is released when this function returns.  */
-  std::scoped_lock sl (std::adopt_lock, lock);
-
-  DBGAPI_CHECK (amd_dbgapi_initialize (&dbgapi_callbacks));
-
-  amd_dbgapi_process_id_t process_id;
-  DBGAPI_CHECK (amd_dbgapi_process_attach (
-      reinterpret_cast<amd_dbgapi_client_process_id_t> (&process_id),
-      &process_id));
-
-  /* Check the runtime state.  */
-  while (true)
-    {
-      amd_dbgapi_event_id_t event_id;
-      amd_dbgapi_event_kind_t event_kind;
-
-      DBGAPI_CHECK (
-          amd_dbgapi_next_pending_event (process_id, &event_id, &event_kind));
+  [[maybe_unused]] ssize_t ignored
+      = ::send (socket_fd, reply.data (), reply.size (), MSG_NOSIGNAL);
+}
 
-      if (event_kind == AMD_DBGAPI_EVENT_KIND_RUNTIME)
+constexpr const char *control_help
+    = "Commands:\n"
+      "  summary               List the waves, stopping them only briefly.\n"
+      "  dump [FILTER...]      Print the waves matching all the filters:\n"
+      "                        queue=ID, dispatch=ID, wave=ID, kernel=NAME\n"
+      "                        (a part of the kernel name). Only these waves\n"
+      "                        are stopped.\n"
+      "  wave ID               Print all the lanes of the wave ID, without\n"
+      "                        budgets.\n"
+      "  set OPTION=VALUE      Change an option of the following dumps:\n"
+      "                        active-lanes=all|active|matrix,\n"
+      "                        dump-time-budget=SECONDS|none,\n"
+      "                        dump-size-budget=SIZE|none\n"
+      "  stats                 Print the agent statistics.\n"
+      "  help                  Print this message.\n";
+
+/* Run a COMMAND received on the control socket, and write its output to the
+   client's SOCKET_FD.  */
+void
+run_control_command (int socket_fd, const std::string &command)
+{
+  std::istringstream words (command);
+  std::string verb;
+  std::vector<std::string> arguments;
+  words >> verb;
+  for (std::string word; words >> word;)
+    arguments.emplace_back (std::move (word));
+
+  if (verb.empty () || verb == "help")
+    return control_reply (socket_fd, control_help);
+
+  /* Another dump, requested by a fault or SIGQUIT, is writing to
+     agent_out.  */
+  std::unique_lock lock (g_dump_lock, std::try_to_lock);
+  if (!lock)
+    return control_reply (socket_fd, "error: a dump is in progress\n");
+
+  dump_options_t options = g_dump_options;
+
+  if (verb == "summary" && arguments.empty ())
+    options.summary_only = true;
+  else if (verb == "dump")
+    {
+      for (auto &&argument : arguments)
         {
-          amd_dbgapi_runtime_state_t runtime_state;
-
-          DBGAPI_CHECK (amd_dbgapi_event_get_info (
-              process_id, event_id, AMD_DBGAPI_EVENT_INFO_RUNTIME_STATE,
-              sizeof (runtime_state), &runtime_state));
-
-          switch (runtime_state)
+          std::size_t equal = argument.find ('=');
+          std::string name = argument.substr (0, equal);
+          std::string value = equal == std::string::npos
+                                  ? std::string{}
+                                  : argument.substr (equal + 1);
+
+          wave_filter_t &filter = options.filter;
+          if (name == "queue"
+              && (filter.queue_id = parse_id (value, "queue_")))
+            continue;
+          if (name == "dispatch"
+              && (filter.dispatch_id = parse_id (value, "dispatch_")))
+            continue;
+          if (name == "wave" && (filter.wave_id = parse_id (value, "wave_")))
+            continue;
+          if (name == "kernel" && !value.empty ())
             {
-            case AMD_DBGAPI_RUNTIME_STATE_LOADED_SUCCESS:
-              break;
-
-            case AMD_DBGAPI_RUNTIME_STATE_UNLOADED:
-              agent_error ("invalid runtime state %d", runtime_state);
-
-            case AMD_DBGAPI_RUNTIME_STATE_LOADED_ERROR_RESTRICTION:
-              agent_error ("unable to enable GPU debugging due to a "
-                           "restriction error");
-              break;
+              filter.kernel = value;
+              continue;
             }
-        }
 
-      /* No more events.  */
-      if (event_kind == AMD_DBGAPI_EVENT_KIND_NONE)
-        break;
+          return control_reply (socket_fd, "error: invalid filter `" + argument
+                                               + "', see help\n");
+        }
     }
-
-  std::map<amd_dbgapi_global_address_t, code_object_t> code_object_map;
-
-  amd_dbgapi_code_object_id_t *code_objects_id;
-  size_t code_object_count;
-  DBGAPI_CHECK (amd_dbgapi_code_object_list (process_id, &code_object_count,
-                                             &code_objects_id, nullptr));
-
-  for (size_t i = 0; i < code_object_count; ++i)
+  else if (verb == "wave" && arguments.size () == 1)
     {
-      code_object_t code_object (process_id, code_objects_id[i]);
+      if (!(options.filter.wave_id = parse_id (arguments[0], "wave_")))
+        return control_reply (socket_fd, "error: invalid wave id\n");
 
-      code_object.open ();
-      if (!code_object.is_open ())
+      options.vector_lanes = vector_lanes_t::all;
+      options.time_budget.reset ();
+      options.size_budget.reset ();
+    }
+  else if (verb == "set" && !arguments.empty ())
+    {
+      dump_options_t changed = g_dump_options;
+      for (auto &&argument : arguments)
         {
-          agent_warning ("could not open code_object_%ld",
-                         code_objects_id[i].handle);
-          continue;
+          std::size_t equal = argument.find ('=');
+          std::string error
+              = equal == std::string::npos
+                    ? "expected OPTION=VALUE"
+                    : set_dump_option (argument.substr (0, equal),
+                                       argument.substr (equal + 1), changed);
+          if (!error.empty ())
+            return control_reply (socket_fd, "error: " + argument + ": "
+                                                 + error + "\n");
         }
 
-      if (g_code_objects_dir && !code_object.save (*g_code_objects_dir))
-        agent_warning ("could not save code object to %s",
-                       g_code_objects_dir->c_str ());
-
-      code_object_map.emplace (code_object.load_address (),
-                               std::move (code_object));
+      /* Only apply the changes if they are all valid.  */
+      g_dump_options = changed;
+      return control_reply (socket_fd, "ok\n");
     }
-  free (code_objects_id);
-
-  DBGAPI_CHECK (amd_dbgapi_process_set_progress (
-      process_id, AMD_DBGAPI_PROGRESS_NO_FORWARD));
-
-  DBGAPI_CHECK (amd_dbgapi_process_set_wave_creation (
-      process_id, AMD_DBGAPI_WAVE_CREATION_STOP));
-
-  if (all_wavefronts)
-    stop_all_wavefronts (process_id);
-
-  amd_dbgapi_wave_id_t *wave_ids;
-  size_t wave_count;
-  DBGAPI_CHECK (
-      amd_dbgapi_wave_list (process_id, &wave_count, &wave_ids, nullptr));
-
-  for (size_t i = 0; i < wave_count; ++i)
+  else if (verb == "stats" && arguments.empty ())
     {
-      amd_dbgapi_wave_id_t wave_id = wave_ids[i];
-
-      amd_dbgapi_wave_state_t state;
-      DBGAPI_CHECK (amd_dbgapi_wave_get_info (process_id, wave_id,
-                                              AMD_DBGAPI_WAVE_INFO_STATE,
-                                              sizeof (state), &state));
-
-      if (state != AMD_DBGAPI_WAVE_STATE_STOP)
-        continue;
-
-      std::underlying_type_t<amd_dbgapi_wave_stop_reason_t> stop_reason;
-      DBGAPI_CHECK (amd_dbgapi_wave_get_info (
-          process_id, wave_id, AMD_DBGAPI_WAVE_INFO_STOP_REASON,
-          sizeof (stop_reason), &stop_reason));
-
-      amd_dbgapi_global_address_t pc;
-      DBGAPI_CHECK (amd_dbgapi_wave_get_info (
-          process_id, wave_id, AMD_DBGAPI_WAVE_INFO_PC, sizeof (pc), &pc));
-
-      if (i)
-        agent_out << std::endl;
-
-      agent_out << "--------------------------------------------------------"
-                << std::endl;
-
-      agent_out << "wave_" << std::dec << wave_id.handle << ": pc=0x"
-                << std::hex << pc;
+      /* A query, the statistics printed with the next dump still cover
+         the whole period since the previous one.  */
+      std::ostringstream stats;
+      if (stats_enabled)
+        print_stats (stats, false);
+      else
+        stats << "Dump statistics are only recorded with --stats.\n";
+      print_code_object_memory (stats, false);
+      return control_reply (socket_fd, stats.str ());
+    }
+  else
+    return control_reply (socket_fd, "error: unknown command `" + command
+                                         + "', see help\n");
+
+  /* Keep the debugger API session attached, so that the ids printed by a
+     command remain valid in the next ones.  */
+  hold_session ();
+
+  agent_out_lock_t out_lock;
+  redirect_agent_out (socket_fd);
+  dump_wavefronts (true, options);
+  restore_agent_out ();
+}
 
-      std::string stop_reason_str;
-      auto stop_reason_bits{ stop_reason };
-      do
-        {
-          /* Consume one bit from the stop reason.  */
-          auto one_bit
-              = stop_reason_bits ^ (stop_reason_bits & (stop_reason_bits - 1));
-          stop_reason_bits ^= one_bit;
+/* Prints all the wavefronts when requested by a SIGQUIT signal.  The dump
+   cannot run in the signal handler: it allocates memory, and calls the
+   debugger API and libelf, so it could deadlock if the signal interrupted
+   the application in malloc.  Instead, the handler wakes up this service
+   thread by writing to a pipe.  */
+class dump_service_t
+{
+public:
+  /* Create the pipe.  Requests are accepted, and remain pending, until the
+     thread is started.  */
+  bool
+  initialize ()
+  {
+    if (pipe2 (m_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+      return false;
+
+    /* The service thread blocks reading the pipe.  */
+    int flags = fcntl (m_pipe[0], F_GETFL);
+    return fcntl (m_pipe[0], F_SETFL, flags & ~O_NONBLOCK) != -1;
+  }
+
+  void
+  start ()
+  {
+    m_thread = std::thread ([this] () { run (); });
+  }
+
+  void
+  stop ()
+  {
+    if (!m_thread.joinable ())
+      return;
+
+    m_stop_requested.store (true);
+    wake_up ();
+    m_thread.join ();
+  }
+
+  /* Called from the SIGQUIT handler, only uses async-signal-safe
+     operations.  Requests received while one is pending are coalesced.  */
+  void
+  request_dump ()
+  {
+    if (!m_dump_requested.exchange (true))
+      wake_up ();
+  }
+
+private:
+  void
+  wake_up ()
+  {
+    int saved_errno = errno;
+    char c = 0;
+    /* The pipe is only full if the thread has not consumed an earlier
+       wake up, which is enough.  */
+    [[maybe_unused]] ssize_t ignored = write (m_pipe[1], &c, 1);
+    errno = saved_errno;
+  }
+
+  void
+  run ()
+  {
+    /* The dumps are requested by the application threads.  */
+    sigset_t signal_set;
+    sigemptyset (&signal_set);
+    sigaddset (&signal_set, SIGQUIT);
+    pthread_sigmask (SIG_BLOCK, &signal_set, nullptr);
+
+    while (!m_stop_requested.load ())
+      {
+        char buffer[64];
+        ssize_t length = read (m_pipe[0], buffer, sizeof (buffer));
+        if (length == -1 && errno != EINTR)
+          return;
+
+        /* Clear the request before starting the dump, so that a signal
+           received during the dump requests another one.  */
+        if (!m_dump_requested.exchange (false))
+          continue;
 
-          if (!stop_reason_str.empty ())
-            stop_reason_str += "|";
+        /* Wait for a control command dump in progress instead of dropping
+           the request.  */
+        std::scoped_lock dump_lock (g_dump_lock);
 
-          stop_reason_str += [] (amd_dbgapi_wave_stop_reason_t reason) {
-            switch (reason)
-              {
-              case AMD_DBGAPI_WAVE_STOP_REASON_NONE:
-                return "NONE";
-              case AMD_DBGAPI_WAVE_STOP_REASON_BREAKPOINT:
-                return "BREAKPOINT";
-              case AMD_DBGAPI_WAVE_STOP_REASON_WATCHPOINT:
-                return "WATCHPOINT";
-              case AMD_DBGAPI_WAVE_STOP_REASON_SINGLE_STEP:
-                return "SINGLE_STEP";
-              case AMD_DBGAPI_WAVE_STOP_REASON_QUEUE_ERROR:
-                return "QUEUE_ERROR";
-              case AMD_DBGAPI_WAVE_STOP_REASON_FP_INPUT_DENORMAL:
-                return "FP_INPUT_DENORMAL";
-              case AMD_DBGAPI_WAVE_STOP_REASON_FP_DIVIDE_BY_0:
-                return "FP_DIVIDE_BY_0";
-              case AMD_DBGAPI_WAVE_STOP_REASON_FP_OVERFLOW:
-                return "FP_OVERFLOW";
-              case AMD_DBGAPI_WAVE_STOP_REASON_FP_UNDERFLOW:
-                return "FP_UNDERFLOW";
-              case AMD_DBGAPI_WAVE_STOP_REASON_FP_INEXACT:
-                return "FP_INEXACT";
-              case AMD_DBGAPI_WAVE_STOP_REASON_FP_INVALID_OPERATION:
-                return "FP_INVALID_OPERATION";
-              case AMD_DBGAPI_WAVE_STOP_REASON_INT_DIVIDE_BY_0:
-                return "INT_DIVIDE_BY_0";
-              case AMD_DBGAPI_WAVE_STOP_REASON_DEBUG_TRAP:
-                return "DEBUG_TRAP";
-              case AMD_DBGAPI_WAVE_STOP_REASON_ASSERT_TRAP:
-                return "ASSERT_TRAP";
-              case AMD_DBGAPI_WAVE_STOP_REASON_TRAP:
-                return "TRAP";
-              case AMD_DBGAPI_WAVE_STOP_REASON_MEMORY_VIOLATION:
-                return "MEMORY_VIOLATION";
-              case AMD_DBGAPI_WAVE_STOP_REASON_ILLEGAL_INSTRUCTION:
-                return "ILLEGAL_INSTRUCTION";
-              case AMD_DBGAPI_WAVE_STOP_REASON_ECC_ERROR:
-                return "ECC_ERROR";
-              case AMD_DBGAPI_WAVE_STOP_REASON_FATAL_HALT:
-                return "FATAL_HALT";
-              case AMD_DBGAPI_WAVE_STOP_REASON_XNACK_ERROR:
-                return "XNACK_ERROR";
-              case AMD_DBGAPI_WAVE_STOP_REASON_RESERVED:
-                return "RESERVED";
-              }
-            return "";
-          }(static_cast<amd_dbgapi_wave_stop_reason_t> (one_bit));
-        }
-      while (stop_reason_bits);
+        agent_out_lock_t out_lock;
+        next_agent_out_dump ();
+        agent_out << '\n';
+        dump (true, g_dump_options);
+      }
+  }
 
-      agent_out << " (";
-      if (stop_reason != AMD_DBGAPI_WAVE_STOP_REASON_NONE)
-        agent_out << "stopped, reason: " << stop_reason_str;
-      else
-        agent_out << "running";
-      agent_out << ")" << std::endl;
-
-      print_registers (process_id, wave_id);
-      print_local_memory (process_id, wave_id);
-
-      /* Find the code object that contains this pc, and disassemble
-         instructions around `pc`  */
-      code_object_t *code_object_found{ nullptr };
-      if (auto it = code_object_map.upper_bound (pc);
-          it != code_object_map.begin ())
-        if (auto &&[load_address, code_object] = *std::prev (it);
-            (pc - load_address) <= code_object.mem_size ())
-          code_object_found = &code_object;
-
-      if (code_object_found)
-        {
-          amd_dbgapi_architecture_id_t architecture_id;
-          DBGAPI_CHECK (amd_dbgapi_wave_get_info (
-              process_id, wave_id, AMD_DBGAPI_WAVE_INFO_ARCHITECTURE,
-              sizeof (architecture_id), &architecture_id));
+  int m_pipe[2]{ -1, -1 };
+  /* Lock-free, and therefore safe to use from a signal handler.  */
+  std::atomic<bool> m_dump_requested{ false };
+  std::atomic<bool> m_stop_requested{ false };
+  std::thread m_thread;
+};
 
-          code_object_found->disassemble (architecture_id, pc);
-        }
-      else
-        {
-          /* TODO: Add disassembly even if we did not find a code object  */
-        }
+static_assert (std::atomic<bool>::is_always_lock_free);
 
-      if (stop_reason == AMD_DBGAPI_WAVE_STOP_REASON_NONE)
-        {
-          /* FIXME: What if the wave was single-stepping?  */
-          DBGAPI_CHECK (amd_dbgapi_wave_resume (
-              process_id, wave_id, AMD_DBGAPI_RESUME_MODE_NORMAL));
-        }
-    }
+/* Set if the SIGQUIT handler is installed.  */
+std::optional<dump_service_t> g_dump_service;
 
-  free (wave_ids);
+/* Print the allocations the faulting page at ADDRESS belongs to, or the
+   allocation it was freed from.  */
+void
+print_fault_allocations (uint64_t address)
+{
+  /* The size of the pages reported by memory faults.  */
+  constexpr size_t gpu_page_size = 4096;
 
-  DBGAPI_CHECK (amd_dbgapi_process_set_wave_creation (
-      process_id, AMD_DBGAPI_WAVE_CREATION_NORMAL));
+  const std::vector<allocation_t> allocations
+      = allocation_tracker.find (address, gpu_page_size);
 
-  DBGAPI_CHECK (amd_dbgapi_process_set_progress (process_id,
-                                                 AMD_DBGAPI_PROGRESS_NORMAL));
+  if (allocations.empty ())
+    agent_out << "Faulting page is not in a device memory allocation\n\n";
 
-  DBGAPI_CHECK (amd_dbgapi_process_detach (process_id));
-  DBGAPI_CHECK (amd_dbgapi_finalize ());
+  for (auto &&allocation : allocations)
+    agent_out << (allocation.freed ? "Faulting page was freed (use after "
+                                     "free), allocation: "
+                                   : "Faulting page is in allocation: ")
+              << allocation << '\n';
 }
 
 hsa_status_t
@@ -675,6 +523,12 @@ handle_system_event (const hsa_amd_event_t *event, void *data)
   if (event->event_type != HSA_AMD_GPU_MEMORY_FAULT_EVENT)
     return HSA_STATUS_SUCCESS;
 
+  /* Wait for a dump in progress, which could be writing to a control socket
+     client, before printing the fault.  The process is aborted afterwards,
+     so the lock is never released.  */
+  std::scoped_lock dump_lock (g_dump_lock);
+  agent_out_lock_t out_lock;
+  next_agent_out_dump ();
   agent_out << "System event (HSA_AMD_GPU_MEMORY_FAULT_EVENT: ";
 
   uint32_t fault_reason = event->memory_fault.fault_reason_mask;
@@ -712,31 +566,81 @@ handle_system_event (const hsa_amd_event_t *event, void *data)
       }(static_cast<hsa_amd_memory_fault_reason_t> (one_bit));
     }
 
-  agent_out << fault_reason_str << ")" << std::endl;
+  agent_out << fault_reason_str << ")\n";
 
   agent_out << "Faulting page: 0x" << std::hex
-            << event->memory_fault.virtual_address << std::endl
-            << std::endl;
+            << event->memory_fault.virtual_address << "\n\n";
+
+  if (g_track_allocations)
+    print_fault_allocations (event->memory_fault.virtual_address);
 
-  print_wavefronts (g_all_wavefronts);
+  dump (g_all_wavefronts, g_dump_options);
 
   /* FIXME: We really should be returning to the ROCr and let it print more
      information then abort.  */
+  drain_agent_out ();
   abort ();
 }
 
-struct callback_and_data_t
+/* Print the packets of `queue` that the packet processor has not consumed
+   yet, and the last one it did, which is normally the dispatch that caused
+   the error.  */
+void
+print_queue_packets (const hsa_queue_t *queue)
 {
-  void (*callback) (hsa_status_t error_code, hsa_queue_t *source, void *data);
-  void *data;
-};
+  /* Bound the dump of a queue with a large backlog.  */
+  constexpr std::size_t max_printed_packets = 32;
+
+  const uint64_t read_index = hsa_queue_load_read_index_scacquire (queue);
+  const uint64_t write_index = hsa_queue_load_write_index_relaxed (queue);
+
+  std::vector<aql_packet_t> packets = read_aql_packets (
+      queue->base_address, queue->size, read_index ? read_index - 1 : 0,
+      write_index, max_printed_packets + 1);
 
-std::unordered_map<hsa_queue_t *, std::unique_ptr<callback_and_data_t>>
-    original_callbacks;
+  std::vector<uint64_t> kernel_objects;
+  for (auto &&packet : packets)
+    kernel_objects.emplace_back (
+        packet.type () == HSA_PACKET_TYPE_KERNEL_DISPATCH
+            ? packet.kernel_dispatch.kernel_object
+            : 0);
+
+  const std::vector<std::string> kernel_names
+      = kernel_object_names (kernel_objects, g_dump_options);
+
+  const uint64_t pending_count
+      = write_index > read_index ? write_index - read_index : 0;
+
+  /* The last processed packet is only printed if there is one, so count
+     the pending packets actually printed.  */
+  uint64_t printed_pending_count{ 0 };
+  for (size_t i = 0; i < packets.size (); ++i)
+    {
+      if (packets[i].index < read_index)
+        agent_out << "Last processed packet:\n";
+      else if (packets[i].index == read_index)
+        agent_out << "Pending packets: " << std::dec << pending_count << '\n';
+
+      if (packets[i].index >= read_index)
+        ++printed_pending_count;
+
+      print_aql_packet (agent_out, packets[i], kernel_names[i]);
+    }
+
+  if (!pending_count)
+    agent_out << "Pending packets: 0\n";
+  else if (pending_count > printed_pending_count)
+    agent_out << "  " << std::dec << (pending_count - printed_pending_count)
+              << " more packet(s) not printed\n";
+
+  agent_out << '\n';
+}
 
 void
 handle_queue_error (hsa_status_t error_code, hsa_queue_t *queue, void *data)
 {
+  auto *original_callback = reinterpret_cast<callback_and_data_t *> (data);
+
   if (error_code == hsa_status_t (HSA_STATUS_ERROR_MEMORY_APERTURE_VIOLATION)
       || error_code == hsa_status_t (HSA_STATUS_ERROR_ILLEGAL_INSTRUCTION)
       || error_code == HSA_STATUS_ERROR_EXCEPTION)
@@ -746,15 +650,19 @@ handle_queue_error (hsa_status_t error_code, hsa_queue_t *queue, void *data)
       hsa_status_t status = hsa_status_string (error_code, &queue_error_str);
       agent_assert (status == HSA_STATUS_SUCCESS);
 
-      agent_out << "Queue error (" << queue_error_str << ")" << std::endl
-                << std::endl;
+      /* Wait for a dump in progress instead of dropping this one.  */
+      std::scoped_lock dump_lock (g_dump_lock);
+      agent_out_lock_t out_lock;
+      next_agent_out_dump ();
+      agent_out << "Queue error (" << queue_error_str << ") on "
+                << original_callback->info << "\n\n";
 
-      print_wavefronts (g_all_wavefronts);
+      print_queue_packets (queue);
+      dump (g_all_wavefronts, g_dump_options);
     }
 
   /* Call the original callback.  */
-  if (auto *original_callback = reinterpret_cast<callback_and_data_t *> (data);
-      original_callback->callback)
+  if (original_callback->callback)
     (*original_callback->callback) (error_code, queue,
                                     original_callback->data);
 }
@@ -768,15 +676,62 @@ queue_create (hsa_agent_t agent, uint32_t size, hsa_queue_type32_t type,
               void *data, uint32_t private_segment_size,
               uint32_t group_segment_size, hsa_queue_t **queue)
 {
-  auto original_callback = std::make_unique<callback_and_data_t> (
-      callback_and_data_t{ callback, data });
+  /* The runtime is only fully initialized once the first queue is created,
+     so delay attaching the pc sampler until then.  */
+  if (g_pc_sampling_output)
+    {
+      static std::once_flag pc_sampling_started;
+      std::call_once (pc_sampling_started, [] () {
+        start_pc_sampling (g_pc_sampling_interval, *g_pc_sampling_output);
+      });
+    }
+
+  if (g_persistent_session == persistent_session_t::startup)
+    hold_session ();
+
+  /* Likewise, the dump service thread is only needed once there are
+     wavefronts to print.  */
+  if (g_dump_service)
+    {
+      static std::once_flag dump_service_started;
+      std::call_once (dump_service_started,
+                      [] () { g_dump_service->start (); });
+    }
+
+  if (g_control_socket_path)
+    {
+      static std::once_flag control_socket_started;
+      std::call_once (control_socket_started, [] () {
+        start_control_socket (
+            expand_path_template (*g_control_socket_path, 0),
+            run_control_command);
+      });
+    }
+
+  callback_and_data_t *original_callback
+      = queue_callback_registry_t::allocate (callback, data);
 
   hsa_status_t status = (*original_hsa_queue_create_fn) (
-      agent, size, type, handle_queue_error, original_callback.get (),
+      agent, size, type, handle_queue_error, original_callback,
       private_segment_size, group_segment_size, queue);
 
   if (status == HSA_STATUS_SUCCESS)
-    original_callbacks.emplace (*queue, std::move (original_callback));
+    {
+      queue_info_t &info = original_callback->info;
+      info.agent = agent;
+      info.size = size;
+      info.type = type;
+      info.private_segment_size = private_segment_size;
+      info.group_segment_size = group_segment_size;
+      info.id = (*queue)->id;
+      info.address = reinterpret_cast<uint64_t> ((*queue)->base_address);
+      clock_gettime (CLOCK_REALTIME, &info.creation_time);
+      info.creation_tid = gettid ();
+
+      queue_registry.insert (*queue, original_callback);
+    }
+  else
+    queue_callback_registry_t::deallocate (original_callback);
 
   return status;
 }
@@ -787,13 +742,62 @@ decltype (CoreApiTable::hsa_queue_destroy_fn) original_hsa_queue_destroy_fn
 hsa_status_t
 queue_destroy (hsa_queue_t *queue)
 {
-  if (auto it = original_callbacks.find (queue);
-      it != original_callbacks.end ())
-    original_callbacks.erase (it);
+  queue_registry.erase (queue);
 
   return (*original_hsa_queue_destroy_fn) (queue);
 }
 
+decltype (AmdExtTable::hsa_amd_memory_pool_allocate_fn)
+    original_hsa_amd_memory_pool_allocate_fn = {};
+
+hsa_status_t
+memory_pool_allocate (hsa_amd_memory_pool_t memory_pool, size_t size,
+                      uint32_t flags, void **ptr)
+{
+  hsa_status_t status = (*original_hsa_amd_memory_pool_allocate_fn) (
+      memory_pool, size, flags, ptr);
+
+  if (status == HSA_STATUS_SUCCESS)
+    allocation_tracker.allocated (*ptr, size, memory_pool.handle);
+
+  return status;
+}
+
+decltype (AmdExtTable::hsa_amd_memory_pool_free_fn)
+    original_hsa_amd_memory_pool_free_fn = {};
+
+hsa_status_t
+memory_pool_free (void *ptr)
+{
+  allocation_tracker.freed (ptr);
+
+  return (*original_hsa_amd_memory_pool_free_fn) (ptr);
+}
+
+decltype (CoreApiTable::hsa_memory_allocate_fn)
+    original_hsa_memory_allocate_fn = {};
+
+hsa_status_t
+memory_allocate (hsa_region_t region, size_t size, void **ptr)
+{
+  hsa_status_t status = (*original_hsa_memory_allocate_fn) (region, size, ptr);
+
+  if (status == HSA_STATUS_SUCCESS)
+    allocation_tracker.allocated (*ptr, size, region.handle);
+
+  return status;
+}
+
+decltype (CoreApiTable::hsa_memory_free_fn) original_hsa_memory_free_fn = {};
+
+hsa_status_t
+memory_free (void *ptr)
+{
+  allocation_tracker.freed (ptr);
+
+  return (*original_hsa_memory_free_fn) (ptr);
+}
+
 void
 print_usage ()
 {
@@ -814,7 +818,43 @@ print_usage ()
                "Save the output in FILE. By default, the output"
             << std::endl
             << "                              "
-               "is redirected to stderr."
+               "is redirected to stderr. FILE is created by the"
+            << std::endl
+            << "                              "
+               "first output, and %p, %h, %t, %r, and %n are"
+            << std::endl
+            << "                              "
+               "replaced with the pid, host name, time, MPI"
+            << std::endl
+            << "                              "
+               "rank, and dump number."
+            << std::endl;
+  std::cerr << "  --output-buffer-size=SIZE   "
+               "Size of the output buffer (K, M, or G suffixes"
+            << std::endl
+            << "                              "
+               "are accepted). The output is written at the end"
+            << std::endl
+            << "                              "
+               "of each dump, or when the buffer is full. The"
+            << std::endl
+            << "                              "
+               "default is 1M, 0 disables buffering."
+            << std::endl;
+  std::cerr << "  --async-output[=SIZE]       "
+               "Write the output from a separate thread, which"
+            << std::endl
+            << "                              "
+               "is handed the output through a SIZE bytes ring"
+            << std::endl
+            << "                              "
+               "buffer. The default size is 16M."
+            << std::endl;
+  std::cerr << "  --compress-output[=LEVEL]   "
+               "Compress the output with gzip. LEVEL is from 1"
+            << std::endl
+            << "                              "
+               "(fastest, the default) to 9 (smallest)."
             << std::endl;
   std::cerr << "  -d, --disable-linux-signals "
                "Disable installing a SIGQUIT signal handler, so"
@@ -832,6 +872,139 @@ print_usage ()
             << "                              "
                "level. The default log level is 'none'."
             << std ::endl;
+  std::cerr << "  --log-timestamps            "
+               "Prefix the log messages with the time and the"
+            << std::endl
+            << "                              "
+               "thread id."
+            << std::endl;
+  std::cerr << "  --dump-time-budget=SECONDS  "
+               "Stop printing wavefronts once a dump has taken"
+            << std::endl
+            << "                              "
+               "SECONDS. The remaining wavefronts are listed"
+            << std::endl
+            << "                              "
+               "in a one line per wavefront summary."
+            << std::endl;
+  std::cerr << "  --dump-size-budget=SIZE     "
+               "Stop printing wavefronts once a dump has"
+            << std::endl
+            << "                              "
+               "written SIZE bytes (K, M, or G suffixes are"
+            << std::endl
+            << "                              "
+               "accepted)."
+            << std::endl;
+  std::cerr << "  --core-file=FILE            "
+               "Also save the state of the wavefronts of each"
+            << std::endl
+            << "                              "
+               "dump in an ELF GPU core file. The same %"
+            << std::endl
+            << "                              "
+               "sequences as --output are replaced, %n by the"
+            << std::endl
+            << "                              "
+               "number of the core file."
+            << std::endl;
+  std::cerr << "  --core-memory-window=SIZE   "
+               "Save SIZE bytes of global memory at each kernel"
+            << std::endl
+            << "                              "
+               "argument that is an address in the core file."
+            << std::endl;
+  std::cerr << "  --raw-dump                  "
+               "Only print the pc and registers of the"
+            << std::endl
+            << "                              "
+               "wavefronts, and symbolize the --core-file"
+            << std::endl
+            << "                              "
+               "offline with rocm-debug-agent-symbolize."
+            << std::endl;
+  std::cerr << "  --active-lanes[=matrix]     "
+               "Only print the lanes of the vector registers"
+            << std::endl
+            << "                              "
+               "that are set in the wavefront's exec mask, as a"
+            << std::endl
+            << "                              "
+               "matrix of the lanes by the registers if matrix."
+            << std::endl;
+  std::cerr << "  --code-object-memory-limit=SIZE"
+            << std::endl
+            << "                              "
+               "Limit the memory used by the ELF files, symbol"
+            << std::endl
+            << "                              "
+               "tables and debug information of the code"
+            << std::endl
+            << "                              "
+               "objects to SIZE bytes, evicting the least"
+            << std::endl
+            << "                              "
+               "recently used ones."
+            << std::endl;
+  std::cerr << "  --pc-sampling=FILE          "
+               "Periodically sample the pc of all wavefronts,"
+            << std::endl
+            << "                              "
+               "and save a per-kernel, per-source-line"
+            << std::endl
+            << "                              "
+               "histogram in folded-stack format in FILE."
+            << std::endl;
+  std::cerr << "  --pc-sampling-interval=USEC "
+               "Time between two pc samples. The default is"
+            << std::endl
+            << "                              "
+               "10000 microseconds."
+            << std::endl;
+  std::cerr << "  --stats[=FILE]              "
+               "Print the time spent in each stage of a dump,"
+            << std::endl
+            << "                              "
+               "and in each debugger API call, at the end of"
+            << std::endl
+            << "                              "
+               "each dump, or append it to FILE."
+            << std::endl;
+  std::cerr << "  --persistent-session[=startup]"
+            << std::endl
+            << "                              "
+               "Keep the debugger API session attached from the"
+            << std::endl
+            << "                              "
+               "first dump, or from the first queue creation,"
+            << std::endl
+            << "                              "
+               "until the agent is unloaded."
+            << std::endl;
+  std::cerr << "  --track-allocations[=DEPTH] "
+               "Record the device memory allocations, and the"
+            << std::endl
+            << "                              "
+               "DEPTH innermost frames of their backtraces"
+            << std::endl
+            << "                              "
+               "(default 16, at most 32), to report which"
+            << std::endl
+            << "                              "
+               "allocation a memory fault is in."
+            << std::endl;
+  std::cerr << "  --control-socket[=PATH]     "
+               "Serve on-demand dumps, and option changes, on a"
+            << std::endl
+            << "                              "
+               "Unix domain socket at PATH, by default"
+            << std::endl
+            << "                              "
+               "/tmp/rocm-debug-agent-%p.sock. See"
+            << std::endl
+            << "                              "
+               "rocm-debug-agent-control."
+            << std::endl;
   std::cerr << "  -h, --help                  "
                "Display a usage message and abort the process."
             << std::endl;
@@ -849,28 +1022,51 @@ OnLoad (void *table, uint64_t runtime_version, uint64_t failed_tool_count,
 
   set_log_level (log_level_t::warning);
 
-  std::istringstream args_stream;
+  /* Split the options in place in a copy of the environment variable.  */
+  constexpr const char *separators = " \t\n\v\f\r";
+  std::string args_buffer;
+  std::vector<char *> args = { const_cast<char *> ("rocm-debug-agent") };
   if (const char *env = ::getenv ("ROCM_DEBUG_AGENT_OPTIONS"))
-    args_stream.str (env);
-
-  std::vector<char *> args = { strdup ("rocm-debug-agent") };
-  std::transform (
-      std::istream_iterator<std::string> (args_stream),
-      std::istream_iterator<std::string> (), std::back_inserter (args),
-      [] (const std::string &str) { return strdup (str.c_str ()); });
+    {
+      args_buffer = env;
+      char *save_ptr;
+      for (char *arg = strtok_r (args_buffer.data (), separators, &save_ptr);
+           arg; arg = strtok_r (nullptr, separators, &save_ptr))
+        args.emplace_back (arg);
+    }
+  args.emplace_back (nullptr);
 
-  char *const *argv = const_cast<char *const *> (args.data ());
-  int argc = args.size ();
+  char *const *argv = args.data ();
+  int argc = args.size () - 1;
 
   static struct option options[]
       = { { "all", no_argument, nullptr, 'a' },
           { "disable-linux-signals", no_argument, nullptr, 'd' },
           { "log-level", required_argument, nullptr, 'l' },
+          { "log-timestamps", no_argument, nullptr, 'L' },
           { "output", required_argument, nullptr, 'o' },
           { "save-code-objects", optional_argument, nullptr, 's' },
+          { "output-buffer-size", required_argument, nullptr, 'B' },
+          { "async-output", optional_argument, nullptr, 'Y' },
+          { "compress-output", optional_argument, nullptr, 'Z' },
+          { "dump-time-budget", required_argument, nullptr, 'T' },
+          { "dump-size-budget", required_argument, nullptr, 'S' },
+          { "core-file", required_argument, nullptr, 'C' },
+          { "core-memory-window", required_argument, nullptr, 'W' },
+          { "raw-dump", no_argument, nullptr, 'X' },
+          { "active-lanes", optional_argument, nullptr, 'V' },
+          { "code-object-memory-limit", required_argument, nullptr, 'K' },
+          { "pc-sampling", required_argument, nullptr, 'P' },
+          { "pc-sampling-interval", required_argument, nullptr, 'I' },
+          { "stats", optional_argument, nullptr, 'A' },
+          { "persistent-session", optional_argument, nullptr, 'R' },
+          { "track-allocations", optional_argument, nullptr, 'M' },
+          { "control-socket", optional_argument, nullptr, 'U' },
           { "help", no_argument, nullptr, 'h' },
           { 0 } };
 
+  /* The application may have parsed its own options already, start over.  */
+  optind = 0;
   while (int c = getopt_long (argc, argv, ":as::o:dl:h", options, nullptr))
     {
       if (c == -1)
@@ -894,6 +1090,10 @@ OnLoad (void *table, uint64_t runtime_version, uint64_t failed_tool_count,
           disable_sigquit = true;
           break;
 
+        case 'L': /* --log-timestamps  */
+          log_timestamps = true;
+          break;
+
         case 'l': /* -l or --log-level  */
           if (!argument)
             print_usage ();
@@ -923,11 +1123,11 @@ OnLoad (void *table, uint64_t runtime_version, uint64_t failed_tool_count,
                   print_usage ();
                 }
 
-              g_code_objects_dir = *argument;
+              g_dump_options.code_objects_dir = *argument;
             }
           else
             {
-              g_code_objects_dir = ".";
+              g_dump_options.code_objects_dir = ".";
             }
           break;
 
@@ -935,12 +1135,192 @@ OnLoad (void *table, uint64_t runtime_version, uint64_t failed_tool_count,
           if (!argument)
             print_usage ();
 
-          agent_out.open (*argument);
-          if (!agent_out.is_open ())
+          g_output_options.path_template = *argument;
+          break;
+
+        case 'B': /* --output-buffer-size  */
+          {
+            std::optional<size_t> size;
+            if (!argument || !(size = parse_size (*argument)))
+              print_usage ();
+
+            g_output_options.buffer_size = *size;
+            break;
+          }
+
+        case 'Y': /* --async-output  */
+          if (argument)
             {
-              std::cerr << "could not open `" << *argument << "'" << std::endl;
-              abort ();
+              if (!(g_output_options.ring_size = parse_size (*argument))
+                  || !*g_output_options.ring_size)
+                print_usage ();
             }
+          else
+            {
+              g_output_options.ring_size = 16 << 20;
+            }
+          break;
+
+        case 'Z': /* --compress-output  */
+          {
+            int level{ 1 };
+            if (argument)
+              {
+                try
+                  {
+                    level = std::stoi (*argument);
+                  }
+                catch (...)
+                  {
+                    print_usage ();
+                  }
+
+                if (level < 1 || level > 9)
+                  print_usage ();
+              }
+
+            g_output_options.compression_level = level;
+            break;
+          }
+
+        case 'T': /* --dump-time-budget  */
+          {
+            if (!argument)
+              print_usage ();
+
+            double seconds{ 0 };
+            try
+              {
+                seconds = std::stod (*argument);
+              }
+            catch (...)
+              {
+                print_usage ();
+              }
+
+            if (seconds <= 0)
+              print_usage ();
+
+            g_dump_options.time_budget = std::chrono::duration_cast<
+                std::chrono::steady_clock::duration> (
+                std::chrono::duration<double> (seconds));
+            break;
+          }
+
+        case 'S': /* --dump-size-budget  */
+          if (!argument
+              || !(g_dump_options.size_budget = parse_size (*argument))
+              || !*g_dump_options.size_budget)
+            print_usage ();
+          break;
+
+        case 'C': /* --core-file  */
+          if (!argument)
+            print_usage ();
+
+          g_dump_options.core_file = *argument;
+          break;
+
+        case 'W': /* --core-memory-window  */
+          {
+            std::optional<size_t> size;
+            if (!argument || !(size = parse_size (*argument)))
+              print_usage ();
+
+            g_dump_options.core_memory_window = *size;
+            break;
+          }
+
+        case 'X': /* --raw-dump  */
+          g_dump_options.raw = true;
+          break;
+
+        case 'V': /* --active-lanes  */
+          if (!argument)
+            g_dump_options.vector_lanes = vector_lanes_t::active;
+          else if (*argument == "matrix")
+            g_dump_options.vector_lanes = vector_lanes_t::matrix;
+          else
+            print_usage ();
+          break;
+
+        case 'K': /* --code-object-memory-limit  */
+          {
+            std::optional<size_t> size;
+            if (!argument || !(size = parse_size (*argument)))
+              print_usage ();
+
+            set_code_object_memory_limit (*size);
+            break;
+          }
+
+        case 'P': /* --pc-sampling  */
+          if (!argument)
+            print_usage ();
+
+          g_pc_sampling_output = *argument;
+          break;
+
+        case 'I': /* --pc-sampling-interval  */
+          {
+            if (!argument)
+              print_usage ();
+
+            unsigned long interval{ 0 };
+            try
+              {
+                interval = std::stoul (*argument, nullptr, 0);
+              }
+            catch (...)
+              {
+                print_usage ();
+              }
+
+            if (!interval)
+              print_usage ();
+
+            g_pc_sampling_interval = std::chrono::microseconds (interval);
+            break;
+          }
+
+        case 'A': /* --stats  */
+          stats_enabled = true;
+          g_stats_file = argument;
+          break;
+
+        case 'R': /* --persistent-session  */
+          if (!argument)
+            g_persistent_session = persistent_session_t::first_dump;
+          else if (argument == "startup")
+            g_persistent_session = persistent_session_t::startup;
+          else
+            print_usage ();
+          break;
+
+        case 'M': /* --track-allocations  */
+          {
+            unsigned long depth{ 16 };
+            try
+              {
+                if (argument)
+                  depth = std::stoul (*argument, nullptr, 0);
+              }
+            catch (...)
+              {
+                print_usage ();
+              }
+
+            if (depth > allocation_t::max_backtrace_depth)
+              print_usage ();
+
+            g_track_allocations = true;
+            allocation_tracker.set_backtrace_depth (depth);
+            break;
+          }
+
+        case 'U': /* --control-socket  */
+          g_control_socket_path
+              = argument.value_or ("/tmp/rocm-debug-agent-%p.sock");
           break;
 
         case '?': /* Unrecognized option  */
@@ -949,16 +1329,17 @@ OnLoad (void *table, uint64_t runtime_version, uint64_t failed_tool_count,
           print_usage ();
         }
     }
-  std::for_each (args.begin (), args.end (), [] (char *str) { free (str); });
 
-  if (!agent_out.is_open ())
+  /* A raw dump is symbolized from its core file.  */
+  if (g_dump_options.raw && !g_dump_options.core_file)
     {
-      agent_out.copyfmt (std::cerr);
-      agent_out.clear (std::cerr.rdstate ());
-      agent_out.basic_ios<char>::rdbuf (std::cerr.rdbuf ());
+      std::cerr << "error: --raw-dump requires --core-file" << std::endl;
+      print_usage ();
     }
 
-  if (!disable_sigquit)
+  open_agent_out (g_output_options);
+
+  if (!disable_sigquit && g_dump_service.emplace ().initialize ())
     {
       struct sigaction sig_action;
 
@@ -966,8 +1347,7 @@ OnLoad (void *table, uint64_t runtime_version, uint64_t failed_tool_count,
       sigemptyset (&sig_action.sa_mask);
 
       sig_action.sa_sigaction = [] (int signal, siginfo_t *, void *) {
-        agent_out << std::endl;
-        print_wavefronts (true);
+        g_dump_service->request_dump ();
       };
 
       /* Install a SIGQUIT (Ctrl-\) handler.  */
@@ -984,9 +1364,46 @@ OnLoad (void *table, uint64_t runtime_version, uint64_t failed_tool_count,
   original_hsa_queue_destroy_fn = core_table->hsa_queue_destroy_fn;
   core_table->hsa_queue_destroy_fn = &queue_destroy;
 
+  /* Intercept the device memory allocation functions.  */
+  if (g_track_allocations)
+    {
+      AmdExtTable *amd_ext_table
+          = reinterpret_cast<HsaApiTable *> (table)->amd_ext_;
+
+      original_hsa_amd_memory_pool_allocate_fn
+          = amd_ext_table->hsa_amd_memory_pool_allocate_fn;
+      amd_ext_table->hsa_amd_memory_pool_allocate_fn = &memory_pool_allocate;
+
+      original_hsa_amd_memory_pool_free_fn
+          = amd_ext_table->hsa_amd_memory_pool_free_fn;
+      amd_ext_table->hsa_amd_memory_pool_free_fn = &memory_pool_free;
+
+      original_hsa_memory_allocate_fn = core_table->hsa_memory_allocate_fn;
+      core_table->hsa_memory_allocate_fn = &memory_allocate;
+
+      original_hsa_memory_free_fn = core_table->hsa_memory_free_fn;
+      core_table->hsa_memory_free_fn = &memory_free;
+    }
+
   /* Install a system handler to report memory faults.  */
   return hsa_amd_register_system_event_handler (handle_system_event, table)
          == HSA_STATUS_SUCCESS;
 }
 
-extern "C" void __attribute__ ((visibility ("default"))) OnUnload () {}
+extern "C" void __attribute__ ((visibility ("default"))) OnUnload ()
+{
+  stop_pc_sampling ();
+  stop_control_socket ();
+
+  /* The SIGQUIT handler remains installed, and still queues requests.  */
+  if (g_dump_service)
+    g_dump_service->stop ();
+
+  if (g_session_held)
+    {
+      std::scoped_lock lock (dbgapi_lock);
+      detach_process ();
+    }
+
+  drain_agent_out ();
+}
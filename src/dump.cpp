@@ -0,0 +1,1347 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "dump.h"
+#include "code_object.h"
+#include "core_file.h"
+#include "debug.h"
+#include "logging.h"
+#include "queue_registry.h"
+#include "session.h"
+#include "stats.h"
+#include "stop_reason.h"
+
+#include <amd-dbgapi.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace amd::debug_agent
+{
+
+namespace
+{
+
+std::string
+hex_string (const uint8_t *value, size_t size)
+{
+  std::string value_string;
+  value_string.reserve (2 * size);
+
+  for (size_t pos = size; pos > 0; --pos)
+    {
+      static constexpr char hex_digits[] = "0123456789abcdef";
+      value_string.push_back (hex_digits[value[pos - 1] >> 4]);
+      value_string.push_back (hex_digits[value[pos - 1] & 0xF]);
+    }
+
+  return value_string;
+}
+
+std::string
+hex_string (const std::vector<uint8_t> &value)
+{
+  return hex_string (value.data (), value.size ());
+}
+
+std::string
+register_value_string (const std::string &register_type,
+                       const std::vector<uint8_t> &register_value)
+{
+  /* handle vector types..  */
+  if (size_t pos = register_type.find_last_of ('['); pos != std::string::npos)
+    {
+      const std::string element_type = register_type.substr (0, pos);
+      const size_t element_count = std::stoi (register_type.substr (pos + 1));
+      const size_t element_size = register_value.size () / element_count;
+
+      agent_assert ((register_value.size () % element_size) == 0);
+
+      std::stringstream ss;
+      for (size_t i = 0; i < element_count; ++i)
+        {
+          if (i != 0)
+            ss << " ";
+          ss << "[" << i << "] ";
+
+          std::vector<uint8_t> element_value (
+              &register_value[element_size * i],
+              &register_value[element_size * (i + 1)]);
+
+          ss << register_value_string (element_type, element_value);
+        }
+      return ss.str ();
+    }
+
+  return hex_string (register_value);
+}
+
+/* Return the number of elements of `register_type` if it is a vector type,
+   such as "int32_t[64]", or else 0.  */
+size_t
+vector_element_count (const std::string &register_type)
+{
+  if (size_t pos = register_type.find_last_of ('['); pos != std::string::npos)
+    return std::stoul (register_type.substr (pos + 1));
+
+  return 0;
+}
+
+/* Copy the elements of the lanes set in `exec` from `value`, one element of
+   `element_size` bytes per lane, to `lanes`, in lane order.  The set bits
+   are visited directly, so the cost is proportional to the number of active
+   lanes.  */
+template <size_t element_size>
+void
+compact_lanes (const uint8_t *value, uint64_t exec, uint8_t *lanes)
+{
+  for (; exec; exec &= exec - 1, lanes += element_size)
+    memcpy (lanes, value + __builtin_ctzll (exec) * element_size,
+            element_size);
+}
+
+void
+compact_lanes (const uint8_t *value, size_t element_size, uint64_t exec,
+               uint8_t *lanes)
+{
+  switch (element_size)
+    {
+    case 4:
+      compact_lanes<4> (value, exec, lanes);
+      break;
+    case 8:
+      compact_lanes<8> (value, exec, lanes);
+      break;
+    default:
+      for (; exec; exec &= exec - 1, lanes += element_size)
+        memcpy (lanes, value + __builtin_ctzll (exec) * element_size,
+                element_size);
+    }
+}
+
+/* Print the per-lane registers `names` as a matrix of the lanes set in
+   `exec` by the registers, 8 registers per block.  `values` holds the
+   compacted lanes of each register in turn, `element_size` bytes per
+   lane.  */
+void
+print_lane_matrix (std::ostream &out, const std::vector<std::string> &names,
+                   const std::vector<uint8_t> &values, size_t element_size,
+                   uint64_t exec)
+{
+  constexpr size_t registers_per_block = 8;
+  const size_t active_lane_count = __builtin_popcountll (exec);
+  const int width = 2 * element_size + 2;
+
+  for (size_t first = 0; first < names.size (); first += registers_per_block)
+    {
+      const size_t last
+          = std::min (first + registers_per_block, names.size ());
+
+      out << '\n' << std::right << std::setfill (' ') << std::setw (8)
+          << "lane";
+      for (size_t i = first; i < last; ++i)
+        out << std::setw (width) << names[i];
+
+      size_t row = 0;
+      for (uint64_t mask = exec; mask; mask &= mask - 1, ++row)
+        {
+          out << '\n' << std::dec << std::setw (8) << __builtin_ctzll (mask);
+          for (size_t i = first; i < last; ++i)
+            out << "  "
+                << hex_string (
+                       &values[(i * active_lane_count + row) * element_size],
+                       element_size);
+        }
+    }
+}
+
+/* Return true once the budget of the dump is exhausted.  Checked while a
+   wave is printed, so that a single wave with many registers or a large
+   local memory does not overrun the budget.  */
+using budget_check_t = std::function<bool ()>;
+
+/* Print the registers of `wave_id`.  Return false if they were truncated
+   because the budget was exhausted.  */
+bool
+print_registers (std::ostream &out, amd_dbgapi_process_id_t process_id,
+                 amd_dbgapi_wave_id_t wave_id,
+                 amd_dbgapi_architecture_id_t architecture_id,
+                 vector_lanes_t vector_lanes,
+                 const budget_check_t &budget_exhausted)
+{
+  static stat_site_t timer_site ("print_registers");
+  scoped_timer_t timer (timer_site);
+
+  /* The lanes of the vector registers to print, all of them if the wave's
+     execution mask is not known.  */
+  uint64_t exec{ 0 };
+  size_t lane_count{ 0 };
+  if (vector_lanes != vector_lanes_t::all
+      && (DBGAPI_TIMED (amd_dbgapi_wave_get_info (
+              process_id, wave_id, AMD_DBGAPI_WAVE_INFO_EXEC_MASK,
+              sizeof (exec), &exec))
+              != AMD_DBGAPI_STATUS_SUCCESS
+          || DBGAPI_TIMED (amd_dbgapi_wave_get_info (
+                 process_id, wave_id, AMD_DBGAPI_WAVE_INFO_LANE_COUNT,
+                 sizeof (lane_count), &lane_count))
+                 != AMD_DBGAPI_STATUS_SUCCESS
+          || lane_count > 64))
+    vector_lanes = vector_lanes_t::all;
+
+  const size_t active_lane_count = __builtin_popcountll (exec);
+
+  size_t class_count;
+  amd_dbgapi_register_class_id_t *register_class_ids;
+  DBGAPI_CHECK (amd_dbgapi_architecture_register_class_list (
+      architecture_id, &class_count, &register_class_ids));
+
+  size_t register_count;
+  amd_dbgapi_register_id_t *register_ids;
+  DBGAPI_CHECK (amd_dbgapi_wave_register_list (
+      process_id, wave_id, &register_count, &register_ids));
+
+  bool complete{ true };
+  for (size_t i = 0; i < class_count && complete; ++i)
+    {
+      amd_dbgapi_register_class_id_t register_class_id = register_class_ids[i];
+
+      char *class_name_;
+      DBGAPI_CHECK (amd_dbgapi_architecture_register_class_get_info (
+          architecture_id, register_class_id,
+          AMD_DBGAPI_REGISTER_CLASS_INFO_NAME, sizeof (class_name_),
+          &class_name_));
+      std::string class_name (class_name_);
+      free (class_name_);
+
+      if (class_name == "general" || class_name == "all")
+        continue;
+
+      out << '\n' << class_name << " registers:";
+
+      /* The per-lane registers of this class, printed as a matrix once all
+         of them are read.  The per-lane registers with another element size
+         than the matrix's are printed after it.  */
+      std::vector<std::string> matrix_names;
+      std::vector<uint8_t> matrix_values;
+      size_t matrix_element_size{ 0 };
+      std::ostringstream after_matrix;
+      bool lanes_elided{ false };
+
+      size_t last_register_size = 0;
+      for (size_t j = 0, column = 0; j < register_count; ++j)
+        {
+          if (budget_exhausted ())
+            {
+              complete = false;
+              break;
+            }
+
+          amd_dbgapi_register_id_t register_id = register_ids[j];
+
+          amd_dbgapi_register_class_state_t state;
+          DBGAPI_CHECK (amd_dbgapi_register_is_in_register_class (
+              architecture_id, register_id, register_class_id, &state));
+
+          if (state != AMD_DBGAPI_REGISTER_CLASS_STATE_MEMBER)
+            continue;
+
+          char *register_name_;
+          DBGAPI_CHECK (amd_dbgapi_wave_register_get_info (
+              process_id, wave_id, register_id, AMD_DBGAPI_REGISTER_INFO_NAME,
+              sizeof (register_name_), &register_name_));
+          std::string register_name (register_name_);
+          free (register_name_);
+
+          char *register_type_;
+          DBGAPI_CHECK (amd_dbgapi_wave_register_get_info (
+              process_id, wave_id, register_id, AMD_DBGAPI_REGISTER_INFO_TYPE,
+              sizeof (register_type_), &register_type_));
+          std::string register_type (register_type_);
+          free (register_type_);
+
+          size_t register_size;
+          DBGAPI_CHECK (amd_dbgapi_wave_register_get_info (
+              process_id, wave_id, register_id, AMD_DBGAPI_REGISTER_INFO_SIZE,
+              sizeof (register_size), &register_size));
+
+          std::vector<uint8_t> buffer (register_size);
+          DBGAPI_CHECK (
+              amd_dbgapi_read_register (process_id, wave_id, register_id, 0,
+                                        register_size, buffer.data ()));
+          timer.add_bytes (register_size);
+
+          /* Only print the active lanes of the per-lane registers.  */
+          if (const size_t element_count
+              = vector_lanes != vector_lanes_t::all
+                    ? vector_element_count (register_type)
+                    : 0;
+              element_count && element_count == lane_count
+              && register_size % element_count == 0)
+            {
+              const size_t element_size = register_size / element_count;
+
+              if (!active_lane_count)
+                {
+                  lanes_elided = true;
+                  continue;
+                }
+
+              if (vector_lanes == vector_lanes_t::matrix
+                  && (matrix_names.empty ()
+                      || element_size == matrix_element_size))
+                {
+                  matrix_names.emplace_back (std::move (register_name));
+                  matrix_values.resize (matrix_values.size ()
+                                        + active_lane_count * element_size);
+                  compact_lanes (buffer.data (), element_size, exec,
+                                 &matrix_values[matrix_values.size ()
+                                                - active_lane_count
+                                                      * element_size]);
+                  matrix_element_size = element_size;
+                  continue;
+                }
+
+              std::vector<uint8_t> lanes (active_lane_count * element_size);
+              compact_lanes (buffer.data (), element_size, exec,
+                             lanes.data ());
+
+              std::ostream &lanes_out
+                  = vector_lanes == vector_lanes_t::matrix ? after_matrix
+                                                           : out;
+              lanes_out << '\n'
+                        << std::right << std::setfill (' ') << std::setw (16)
+                        << (register_name + ": ");
+
+              size_t lane = 0;
+              for (uint64_t mask = exec; mask; mask &= mask - 1, ++lane)
+                lanes_out << (lane ? " [" : "[") << std::dec
+                          << __builtin_ctzll (mask) << "] "
+                          << hex_string (&lanes[lane * element_size],
+                                         element_size);
+
+              last_register_size = 0;
+              continue;
+            }
+
+          const size_t num_register_per_line = 16 / register_size;
+
+          if (register_size > sizeof (uint64_t) /* Registers larger than a
+                                                   uint64_t are printed each
+                                                   on a separate line.  */
+              || register_size != last_register_size
+              || (column++ % num_register_per_line) == 0)
+            {
+              out << '\n';
+              column = 1;
+            }
+
+          last_register_size = register_size;
+
+          out << std::right << std::setfill (' ') << std::setw (16)
+              << (register_name + ": ")
+              << register_value_string (register_type, buffer);
+        }
+
+      if (!matrix_names.empty ())
+        print_lane_matrix (out, matrix_names, matrix_values,
+                           matrix_element_size, exec);
+      out << after_matrix.str ();
+
+      if (lanes_elided)
+        out << "\n    no active lanes (exec: " << hex_string (
+                   reinterpret_cast<const uint8_t *> (&exec), sizeof (exec))
+            << ")";
+
+      out << '\n';
+    }
+
+  free (register_ids);
+  free (register_class_ids);
+  return complete;
+}
+
+/* Print the local memory of `wave_id`.  Return false if it was truncated
+   because the budget was exhausted.  */
+bool
+print_local_memory (std::ostream &out, amd_dbgapi_process_id_t process_id,
+                    amd_dbgapi_wave_id_t wave_id,
+                    amd_dbgapi_architecture_id_t architecture_id,
+                    const budget_check_t &budget_exhausted)
+{
+  static stat_site_t timer_site ("print_local_memory");
+  scoped_timer_t timer (timer_site);
+
+  amd_dbgapi_address_space_id_t local_address_space_id;
+  DBGAPI_CHECK (amd_dbgapi_dwarf_address_space_to_address_space (
+      architecture_id, 0x3 /* DW_ASPACE_AMDGPU_local */,
+      &local_address_space_id));
+
+  std::vector<uint32_t> buffer (1024);
+  amd_dbgapi_segment_address_t base_address{ 0 };
+  bool complete{ true };
+
+  while (true)
+    {
+      if (budget_exhausted ())
+        {
+          complete = false;
+          break;
+        }
+
+      size_t requested_size = buffer.size () * sizeof (buffer[0]);
+      size_t size = requested_size;
+      if (DBGAPI_TIMED (amd_dbgapi_read_memory (
+              process_id, wave_id, 0, local_address_space_id, base_address,
+              &size, buffer.data ()))
+          != AMD_DBGAPI_STATUS_SUCCESS)
+        break;
+      timer.add_bytes (size);
+
+      agent_assert ((size % sizeof (buffer[0])) == 0);
+      buffer.resize (size / sizeof (buffer[0]));
+
+      if (!base_address)
+        out << "\nLocal memory content:";
+
+      for (size_t i = 0, column = 0; i < buffer.size (); ++i)
+        {
+          if ((column++ % 8) == 0)
+            {
+              out << '\n'
+                  << "    0x" << std::setfill ('0') << std::setw (4)
+                  << (base_address + i * sizeof (buffer[0])) << ":";
+              column = 1;
+            }
+
+          out << " " << std::hex << std::setfill ('0') << std::setw (8)
+              << buffer[i];
+        }
+
+      base_address += size;
+
+      if (size != requested_size)
+        break;
+    }
+
+  if (base_address)
+    out << '\n';
+
+  return complete;
+}
+
+/* Stop reasons that indicate the wave caused, or was a victim of, a fatal
+   error.  These waves are printed before any other wave.  */
+constexpr std::underlying_type_t<amd_dbgapi_wave_stop_reason_t>
+    fatal_stop_reasons
+    = AMD_DBGAPI_WAVE_STOP_REASON_MEMORY_VIOLATION
+      | AMD_DBGAPI_WAVE_STOP_REASON_ASSERT_TRAP
+      | AMD_DBGAPI_WAVE_STOP_REASON_ILLEGAL_INSTRUCTION
+      | AMD_DBGAPI_WAVE_STOP_REASON_ECC_ERROR
+      | AMD_DBGAPI_WAVE_STOP_REASON_FATAL_HALT
+      | AMD_DBGAPI_WAVE_STOP_REASON_XNACK_ERROR
+      | AMD_DBGAPI_WAVE_STOP_REASON_INT_DIVIDE_BY_0
+      | AMD_DBGAPI_WAVE_STOP_REASON_FP_INPUT_DENORMAL
+      | AMD_DBGAPI_WAVE_STOP_REASON_FP_DIVIDE_BY_0
+      | AMD_DBGAPI_WAVE_STOP_REASON_FP_OVERFLOW
+      | AMD_DBGAPI_WAVE_STOP_REASON_FP_UNDERFLOW
+      | AMD_DBGAPI_WAVE_STOP_REASON_FP_INEXACT
+      | AMD_DBGAPI_WAVE_STOP_REASON_FP_INVALID_OPERATION;
+
+struct wave_info_t
+{
+  amd_dbgapi_wave_id_t wave_id;
+  amd_dbgapi_global_address_t pc{ 0 };
+  std::underlying_type_t<amd_dbgapi_wave_stop_reason_t> stop_reason{
+    AMD_DBGAPI_WAVE_STOP_REASON_NONE
+  };
+  amd_dbgapi_agent_id_t agent_id{};
+  amd_dbgapi_queue_id_t queue_id{};
+  amd_dbgapi_dispatch_id_t dispatch_id{};
+  std::array<uint32_t, 3> workgroup_coord{};
+};
+
+/* Return the order in which a wave is printed: first the waves that stopped
+   because of a fatal error, then the waves that stopped for any other reason,
+   and last the waves that were only halted to be printed.  */
+int
+wave_priority (const wave_info_t &wave)
+{
+  if (wave.stop_reason & fatal_stop_reasons)
+    return 0;
+  if (wave.stop_reason != AMD_DBGAPI_WAVE_STOP_REASON_NONE)
+    return 1;
+  return 2;
+}
+
+/* Summary of the waves in one level (agent, queue, dispatch, or workgroup) of
+   the dump hierarchy.  */
+struct wave_group_t
+{
+  /* The highest priority (lowest value) of the waves in this group.  */
+  int priority{ std::numeric_limits<int>::max () };
+  size_t wave_count{ 0 };
+  /* Number of waves for each state, "running" or the stop reason.  */
+  std::map<std::string, size_t> state_counts;
+
+  void
+  add (const wave_info_t &wave)
+  {
+    priority = std::min (priority, wave_priority (wave));
+    ++wave_count;
+    ++state_counts[wave.stop_reason == AMD_DBGAPI_WAVE_STOP_REASON_NONE
+                       ? "running"
+                       : stop_reason_string (wave.stop_reason)];
+  }
+};
+
+std::ostream &
+operator<< (std::ostream &os, const wave_group_t &group)
+{
+  os << std::dec << group.wave_count << " wavefront"
+     << (group.wave_count == 1 ? "" : "s") << " (";
+
+  for (auto it = group.state_counts.begin (); it != group.state_counts.end ();
+       ++it)
+    os << (it == group.state_counts.begin () ? "" : ", ") << it->first
+       << ": " << it->second;
+
+  return os << ")";
+}
+
+/* Information shared by all the waves of a dispatch, resolved once when the
+   first wave of the dispatch is printed.  */
+struct dispatch_info_t
+{
+  std::optional<amd_dbgapi_architecture_id_t> architecture_id;
+  code_object_t *code_object{ nullptr };
+  std::string kernel_name;
+};
+
+using code_object_map_t
+    = std::map<amd_dbgapi_global_address_t, code_object_t *>;
+
+/* The code objects loaded in the process.  They are kept between dumps as
+   long as the debugger API session they were listed in remains attached,
+   so that their symbols and debug information are only loaded once.
+   Protected by dbgapi_lock.  */
+struct code_object_cache_t
+{
+  std::size_t session_id{ 0 };
+  std::unordered_map<decltype (amd_dbgapi_code_object_id_t::handle),
+                     std::unique_ptr<code_object_t>>
+      code_objects;
+  code_object_map_t code_object_map;
+};
+
+code_object_cache_t code_object_cache;
+
+/* Update code_object_cache with the code objects currently loaded in
+   `process_id`.  New code objects are saved in `code_objects_dir`.  */
+void
+update_code_objects (amd_dbgapi_process_id_t process_id,
+                     const std::optional<std::string> &code_objects_dir)
+{
+  if (code_object_cache.session_id != session_id ())
+    code_object_cache = { session_id (), {}, {} };
+
+  /* The debugger API tracks the changes to the list per process, and the pc
+     sampler consumes them, so they cannot tell whether this cache is up to
+     date.  Always get the list, the code objects already opened are
+     reused.  */
+  amd_dbgapi_code_object_id_t *code_object_ids;
+  size_t code_object_count;
+  DBGAPI_CHECK (amd_dbgapi_code_object_list (process_id, &code_object_count,
+                                             &code_object_ids, nullptr));
+
+  auto &code_objects = code_object_cache.code_objects;
+  decltype (code_object_cache.code_objects) loaded_code_objects;
+  code_object_cache.code_object_map.clear ();
+
+  for (size_t i = 0; i < code_object_count; ++i)
+    {
+      const auto handle = code_object_ids[i].handle;
+      std::unique_ptr<code_object_t> code_object;
+
+      if (auto it = code_objects.find (handle); it != code_objects.end ())
+        {
+          code_object = std::move (it->second);
+        }
+      else
+        {
+          code_object = std::make_unique<code_object_t> (
+              process_id, code_object_ids[i]);
+
+          code_object->open ();
+          if (!code_object->is_open ())
+            {
+              agent_warning ("could not open code_object_%ld", handle);
+              continue;
+            }
+
+          if (code_objects_dir && !code_object->save (*code_objects_dir))
+            agent_warning ("could not save code object to %s",
+                           code_objects_dir->c_str ());
+        }
+
+      code_object_cache.code_object_map.emplace (code_object->load_address (),
+                                                 code_object.get ());
+      loaded_code_objects.emplace (handle, std::move (code_object));
+    }
+  free (code_object_ids);
+
+  /* Drop the code objects that were unloaded.  */
+  code_objects = std::move (loaded_code_objects);
+}
+
+/* Return the code object that contains `pc`, or nullptr.  */
+code_object_t *
+find_code_object (const code_object_map_t &code_object_map,
+                  amd_dbgapi_global_address_t pc)
+{
+  if (auto it = code_object_map.upper_bound (pc);
+      it != code_object_map.begin ())
+    if (auto &&[load_address, code_object] = *std::prev (it);
+        (pc - load_address) <= code_object->mem_size ())
+      return code_object;
+
+  return nullptr;
+}
+
+/* Return the architecture, code object and kernel name of `dispatch_id`.
+   The kernel name is only looked up if `symbolize` is set.  */
+dispatch_info_t
+get_dispatch_info (amd_dbgapi_process_id_t process_id,
+                   amd_dbgapi_dispatch_id_t dispatch_id,
+                   const code_object_map_t &code_object_map, bool symbolize)
+{
+  dispatch_info_t info;
+
+  if (amd_dbgapi_architecture_id_t architecture_id;
+      DBGAPI_TIMED (amd_dbgapi_dispatch_get_info (
+          process_id, dispatch_id, AMD_DBGAPI_DISPATCH_INFO_ARCHITECTURE,
+          sizeof (architecture_id), &architecture_id))
+      == AMD_DBGAPI_STATUS_SUCCESS)
+    info.architecture_id.emplace (architecture_id);
+
+  amd_dbgapi_global_address_t kernel_entry;
+  if (DBGAPI_TIMED (amd_dbgapi_dispatch_get_info (
+          process_id, dispatch_id,
+          AMD_DBGAPI_DISPATCH_INFO_KERNEL_CODE_ENTRY_ADDRESS,
+          sizeof (kernel_entry), &kernel_entry))
+      != AMD_DBGAPI_STATUS_SUCCESS)
+    return info;
+
+  info.code_object = find_code_object (code_object_map, kernel_entry);
+  if (info.code_object && symbolize)
+    if (auto symbol = info.code_object->find_symbol (kernel_entry))
+      info.kernel_name = symbol->m_name;
+
+  return info;
+}
+
+/* Match the waves with the filter of a dump.  The kernel name of each
+   dispatch is only looked up once.  */
+class wave_matcher_t
+{
+public:
+  wave_matcher_t (amd_dbgapi_process_id_t process_id,
+                  const wave_filter_t &filter,
+                  const code_object_map_t &code_object_map)
+    : m_process_id (process_id), m_filter (filter),
+      m_code_object_map (code_object_map)
+  {
+  }
+
+  bool
+  operator() (amd_dbgapi_wave_id_t wave_id)
+  {
+    if (m_filter.wave_id && wave_id.handle != *m_filter.wave_id)
+      return false;
+
+    if (amd_dbgapi_queue_id_t queue_id;
+        m_filter.queue_id
+        && (DBGAPI_TIMED (amd_dbgapi_wave_get_info (
+                    m_process_id, wave_id, AMD_DBGAPI_WAVE_INFO_QUEUE,
+                    sizeof (queue_id), &queue_id))
+                != AMD_DBGAPI_STATUS_SUCCESS
+            || queue_id.handle != *m_filter.queue_id))
+      return false;
+
+    if (!m_filter.dispatch_id && !m_filter.kernel)
+      return true;
+
+    amd_dbgapi_dispatch_id_t dispatch_id;
+    if (DBGAPI_TIMED (amd_dbgapi_wave_get_info (
+            m_process_id, wave_id, AMD_DBGAPI_WAVE_INFO_DISPATCH,
+            sizeof (dispatch_id), &dispatch_id))
+        != AMD_DBGAPI_STATUS_SUCCESS)
+      return false;
+
+    if (m_filter.dispatch_id && dispatch_id.handle != *m_filter.dispatch_id)
+      return false;
+
+    if (!m_filter.kernel)
+      return true;
+
+    auto [it, inserted] = m_kernel_matches.try_emplace (dispatch_id.handle);
+    if (inserted)
+      it->second = get_dispatch_info (m_process_id, dispatch_id,
+                                      m_code_object_map, true)
+                       .kernel_name.find (*m_filter.kernel)
+                   != std::string::npos;
+
+    return it->second;
+  }
+
+private:
+  const amd_dbgapi_process_id_t m_process_id;
+  const wave_filter_t &m_filter;
+  const code_object_map_t &m_code_object_map;
+  std::unordered_map<decltype (amd_dbgapi_dispatch_id_t::handle), bool>
+      m_kernel_matches;
+};
+
+std::string
+architecture_name (amd_dbgapi_architecture_id_t architecture_id)
+{
+  char *name;
+  if (DBGAPI_TIMED (amd_dbgapi_architecture_get_info (
+          architecture_id, AMD_DBGAPI_ARCHITECTURE_INFO_NAME, sizeof (name),
+          &name))
+      != AMD_DBGAPI_STATUS_SUCCESS)
+    return "unknown";
+
+  std::string str (name);
+  free (name);
+  return str;
+}
+
+void
+print_agent_header (std::ostream &out, amd_dbgapi_process_id_t process_id,
+                    amd_dbgapi_agent_id_t agent_id, const wave_group_t &group)
+{
+  out << "agent_" << std::dec << agent_id.handle;
+
+  char *name;
+  if (DBGAPI_TIMED (amd_dbgapi_agent_get_info (
+          process_id, agent_id, AMD_DBGAPI_AGENT_INFO_NAME, sizeof (name),
+          &name))
+      == AMD_DBGAPI_STATUS_SUCCESS)
+    {
+      out << " (" << name;
+      free (name);
+
+      if (amd_dbgapi_architecture_id_t architecture_id;
+          DBGAPI_TIMED (amd_dbgapi_agent_get_info (
+              process_id, agent_id, AMD_DBGAPI_AGENT_INFO_ARCHITECTURE,
+              sizeof (architecture_id), &architecture_id))
+          == AMD_DBGAPI_STATUS_SUCCESS)
+        out << ", " << architecture_name (architecture_id);
+
+      out << ")";
+    }
+
+  out << ": " << group << '\n';
+}
+
+/* Print the state of `wave`.  The instructions around its pc are
+   disassembled unless `options.raw` is set, then only the offset of the pc
+   in its code object is printed.  The registers and local memory of a large
+   wave are truncated once `budget_exhausted` returns true.  */
+void
+print_wavefront (std::ostream &out, amd_dbgapi_process_id_t process_id,
+                 const wave_info_t &wave, const dispatch_info_t &dispatch,
+                 const code_object_map_t &code_object_map,
+                 const dump_options_t &options,
+                 const budget_check_t &budget_exhausted)
+{
+  const amd_dbgapi_wave_id_t wave_id = wave.wave_id;
+  const amd_dbgapi_global_address_t pc = wave.pc;
+
+  out << "--------------------------------------------------------\n";
+
+  out << "wave_" << std::dec << wave_id.handle << ": pc=0x" << std::hex << pc;
+
+  out << " (" << wave_status_string (wave.stop_reason) << ")\n";
+
+  /* All the waves of a dispatch share the same architecture.  */
+  amd_dbgapi_architecture_id_t architecture_id;
+  if (dispatch.architecture_id)
+    architecture_id = *dispatch.architecture_id;
+  else
+    DBGAPI_CHECK (amd_dbgapi_wave_get_info (
+        process_id, wave_id, AMD_DBGAPI_WAVE_INFO_ARCHITECTURE,
+        sizeof (architecture_id), &architecture_id));
+
+  if (!print_registers (out, process_id, wave_id, architecture_id,
+                        options.vector_lanes, budget_exhausted)
+      || !print_local_memory (out, process_id, wave_id, architecture_id,
+                              budget_exhausted))
+    {
+      out << "\nDump budget exhausted, wave_" << std::dec << wave_id.handle
+          << " truncated\n";
+      return;
+    }
+
+  /* Find the code object that contains this pc, and disassemble
+     instructions around `pc`.  The wave is most likely still executing the
+     dispatch's kernel, so try its code object first.  */
+  code_object_t *code_object_found{ dispatch.code_object };
+  if (!code_object_found
+      || pc < code_object_found->load_address ()
+      || (pc - code_object_found->load_address ())
+             > code_object_found->mem_size ())
+    code_object_found = find_code_object (code_object_map, pc);
+
+  if (code_object_found && options.raw)
+    {
+      out << "\npc offset: 0x" << std::hex
+          << (pc - code_object_found->load_address ()) << " in "
+          << code_object_found->uri () << '\n';
+    }
+  else if (code_object_found)
+    {
+      code_object_found->disassemble (out, architecture_id, pc);
+    }
+  else
+    {
+      /* TODO: Add disassembly even if we did not find a code object  */
+    }
+}
+
+/* Print one line per wave in `waves`, from the information already queried
+   to order them, and the symbol that contains its pc.  The symbols are only
+   looked up in the symbol tables, unless `raw` is set, then the offset of
+   the pc in its code object is printed instead.  */
+void
+print_summary (std::ostream &out, const std::vector<wave_info_t> &waves,
+               const code_object_map_t &code_object_map, bool raw)
+{
+  static stat_site_t timer_site ("print_summary");
+  scoped_timer_t timer (timer_site);
+
+  out << "Wavefronts:\n"
+      << std::left << std::setfill (' ') << "    " << std::setw (12)
+      << "wave" << std::setw (14) << "dispatch" << std::setw (18) << "pc"
+      << std::setw (20) << "status"
+      << "location\n";
+
+  /* Most waves of a dump share a few pcs.  */
+  std::unordered_map<amd_dbgapi_global_address_t, std::string> locations;
+
+  for (auto &&wave : waves)
+    {
+      auto [it, inserted] = locations.try_emplace (wave.pc);
+      if (inserted)
+        {
+          std::ostringstream location;
+          if (code_object_t *code_object
+              = find_code_object (code_object_map, wave.pc);
+              !code_object)
+            location << "??";
+          else if (raw)
+            location << "[0x" << std::hex << code_object->load_address ()
+                     << "]+0x" << (wave.pc - code_object->load_address ());
+          else if (auto symbol = code_object->find_symbol (wave.pc))
+            location << symbol->m_name << "+" << std::dec
+                     << (wave.pc - symbol->m_value);
+          else
+            location << "<" << code_object->uri () << ">+0x" << std::hex
+                     << (wave.pc - code_object->load_address ());
+          it->second = location.str ();
+        }
+
+      out << "    " << std::dec << std::setw (12)
+          << ("wave_" + std::to_string (wave.wave_id.handle))
+          << std::setw (14)
+          << (wave.dispatch_id.handle
+                  ? "dispatch_" + std::to_string (wave.dispatch_id.handle)
+                  : "-")
+          << "0x" << std::hex << std::setw (16) << wave.pc << std::setw (20)
+          << (wave.stop_reason == AMD_DBGAPI_WAVE_STOP_REASON_NONE
+                  ? "running"
+                  : stop_reason_string (wave.stop_reason))
+          << it->second << '\n';
+    }
+
+  out << std::right << '\n';
+}
+
+using workgroup_key_t
+    = std::tuple<decltype (amd_dbgapi_dispatch_id_t::handle), uint32_t,
+                 uint32_t, uint32_t>;
+
+workgroup_key_t
+workgroup_key (const wave_info_t &wave)
+{
+  return workgroup_key_t{ wave.dispatch_id.handle, wave.workgroup_coord[0],
+                          wave.workgroup_coord[1], wave.workgroup_coord[2] };
+}
+
+/* The waves of a dump, grouped and ordered, and what they are printed
+   with.  */
+struct dump_state_t
+{
+  amd_dbgapi_process_id_t process_id;
+  const dump_options_t &options;
+  const code_object_map_t &code_object_map;
+  std::chrono::steady_clock::time_point start;
+  size_t start_bytes;
+
+  /* The summary of each level of the hierarchy.  */
+  std::unordered_map<decltype (amd_dbgapi_agent_id_t::handle), wave_group_t>
+      agent_groups;
+  std::unordered_map<decltype (amd_dbgapi_queue_id_t::handle), wave_group_t>
+      queue_groups;
+  std::unordered_map<decltype (amd_dbgapi_dispatch_id_t::handle),
+                     wave_group_t>
+      dispatch_groups;
+  std::map<workgroup_key_t, wave_group_t> workgroup_groups;
+
+  /* The queues created by the application, by the address of their
+     packets.  */
+  std::unordered_map<uint64_t, queue_info_t> queue_infos;
+
+  bool
+  budget_exhausted () const
+  {
+    /* The output cannot be written, such as to a control socket client that
+       stopped reading it, stop the dump.  */
+    if (!agent_out)
+      return true;
+
+    if (options.time_budget
+        && (std::chrono::steady_clock::now () - start)
+               >= *options.time_budget)
+      return true;
+
+    if (options.size_budget
+        && (agent_out_bytes () - start_bytes) >= *options.size_budget)
+      return true;
+
+    return false;
+  }
+
+  /* Print the sorted `waves` until the budget is exhausted, and return the
+     number of waves printed.  */
+  size_t print_waves (const std::vector<wave_info_t> &waves);
+};
+
+size_t
+dump_state_t::print_waves (const std::vector<wave_info_t> &waves)
+{
+  std::ostream &out = agent_out;
+  const budget_check_t wave_budget_exhausted
+      = [this] () { return budget_exhausted (); };
+
+  /* Kernel name, code object, and architecture are only resolved once per
+     dispatch.  */
+  std::unordered_map<decltype (amd_dbgapi_dispatch_id_t::handle),
+                     dispatch_info_t>
+      dispatch_infos;
+
+  size_t printed_count{ 0 };
+  for (; printed_count < waves.size () && !budget_exhausted ();
+       ++printed_count)
+    {
+      const wave_info_t *wave = &waves[printed_count];
+      const wave_info_t *prev_wave
+          = printed_count ? &waves[printed_count - 1] : nullptr;
+
+      if (prev_wave)
+        out << '\n';
+
+      const bool new_agent
+          = !prev_wave || prev_wave->agent_id.handle != wave->agent_id.handle;
+      const bool new_queue
+          = new_agent || prev_wave->queue_id.handle != wave->queue_id.handle;
+      const bool new_dispatch
+          = new_queue
+            || prev_wave->dispatch_id.handle != wave->dispatch_id.handle;
+      const bool new_workgroup
+          = new_dispatch
+            || workgroup_key (*prev_wave) != workgroup_key (*wave);
+
+      if (new_agent)
+        print_agent_header (out, process_id, wave->agent_id,
+                            agent_groups.at (wave->agent_id.handle));
+
+      if (new_queue)
+        {
+          out << "  queue_" << std::dec << wave->queue_id.handle;
+
+          if (amd_dbgapi_global_address_t address;
+              !queue_infos.empty ()
+              && DBGAPI_TIMED (amd_dbgapi_queue_get_info (
+                     process_id, wave->queue_id, AMD_DBGAPI_QUEUE_INFO_ADDRESS,
+                     sizeof (address), &address))
+                     == AMD_DBGAPI_STATUS_SUCCESS)
+            if (auto it = queue_infos.find (address);
+                it != queue_infos.end ())
+              out << " " << it->second;
+
+          out << ": " << queue_groups.at (wave->queue_id.handle) << '\n';
+        }
+
+      auto dispatch_it = dispatch_infos.find (wave->dispatch_id.handle);
+      if (dispatch_it == dispatch_infos.end ())
+        dispatch_it
+            = dispatch_infos
+                  .emplace (wave->dispatch_id.handle,
+                            wave->dispatch_id.handle
+                                ? get_dispatch_info (process_id,
+                                                     wave->dispatch_id,
+                                                     code_object_map,
+                                                     !options.raw)
+                                : dispatch_info_t{})
+                  .first;
+      const dispatch_info_t &dispatch = dispatch_it->second;
+
+      if (new_dispatch)
+        {
+          if (wave->dispatch_id.handle)
+            out << "    dispatch_" << std::dec << wave->dispatch_id.handle;
+          else
+            out << "    unknown dispatch";
+
+          if (!dispatch.kernel_name.empty ())
+            out << " (" << dispatch.kernel_name << ")";
+
+          out << ": " << dispatch_groups.at (wave->dispatch_id.handle)
+              << '\n';
+        }
+
+      if (new_workgroup && wave->dispatch_id.handle)
+        out << "      workgroup (" << std::dec << wave->workgroup_coord[0]
+            << ", " << wave->workgroup_coord[1] << ", "
+            << wave->workgroup_coord[2]
+            << "): " << workgroup_groups.at (workgroup_key (*wave)) << '\n';
+
+      if (new_agent || new_queue || new_dispatch || new_workgroup)
+        out << '\n';
+
+      print_wavefront (out, process_id, *wave, dispatch, code_object_map,
+                       options, wave_budget_exhausted);
+    }
+
+  return printed_count;
+}
+
+/* Print the state of the sorted `waves` after their summary, and write the
+   core file.  */
+void
+print_details (dump_state_t &state, const std::vector<wave_info_t> &waves)
+{
+  const dump_options_t &options = state.options;
+  const code_object_map_t &code_object_map = state.code_object_map;
+
+  for (auto &&info : queue_registry.queues ())
+    state.queue_infos.emplace (info.address, info);
+
+  if (size_t printed_count = state.print_waves (waves);
+      printed_count < waves.size ())
+    {
+      agent_out << '\n'
+                << "Dump budget exhausted, " << std::dec
+                << (waves.size () - printed_count)
+                << " wavefront(s) not printed:\n";
+
+      for (size_t i = printed_count; i < waves.size (); ++i)
+        agent_out << "    wave_" << std::dec << waves[i].wave_id.handle
+                  << ": pc=0x" << std::hex << waves[i].pc << " ("
+                  << wave_status_string (waves[i].stop_reason) << ")"
+                  << '\n';
+    }
+
+  /* Identify the code objects the pcs are relative to, so that the dump can
+     be matched with the code objects saved in the core file.  */
+  if (options.raw)
+    {
+      agent_out << "\nCode objects:\n";
+      for (auto &&[load_address, code_object] : code_object_map)
+        agent_out << "    [0x" << std::hex << load_address << "-0x"
+                  << (load_address + code_object->mem_size ())
+                  << "] hash=0x" << std::setfill ('0') << std::setw (16)
+                  << code_object->content_hash () << std::setfill (' ')
+                  << " " << code_object->uri () << '\n';
+    }
+
+  if (state.options.core_file)
+    {
+      /* Numbered separately from the dumps, which may not all write one.  */
+      static size_t core_file_count{ 0 };
+      const std::string path
+          = expand_path_template (*options.core_file, core_file_count++);
+
+      std::vector<amd_dbgapi_wave_id_t> wave_ids;
+      wave_ids.reserve (waves.size ());
+      for (auto &&wave : waves)
+        wave_ids.emplace_back (wave.wave_id);
+
+      std::vector<code_object_t *> code_objects;
+      for (auto &&[load_address, code_object] : code_object_map)
+        code_objects.emplace_back (code_object);
+
+      if (write_core_file (path, state.process_id, wave_ids, code_objects,
+                           { options.core_memory_window, options.raw }))
+        agent_out << "\nGPU core file written to " << path << '\n';
+      else
+        agent_warning ("could not write the GPU core file %s", path.c_str ());
+    }
+}
+
+} /* namespace */
+
+void
+dump_wavefronts (bool all_wavefronts, const dump_options_t &options)
+{
+  static stat_site_t timer_site ("dump");
+  scoped_timer_t timer (timer_site);
+
+  agent_out_lock_t out_lock;
+  const auto dump_start = std::chrono::steady_clock::now ();
+
+  /* Other agent threads, such as the pc sampler, may be using the debugger
+     API.  Wait for them to yield it.  */
+  std::scoped_lock session_lock (dbgapi_lock);
+  amd_dbgapi_process_id_t process_id = attach_process ();
+
+  update_code_objects (process_id, options.code_objects_dir);
+  const code_object_map_t &code_object_map
+      = code_object_cache.code_object_map;
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_progress (
+      process_id, AMD_DBGAPI_PROGRESS_NO_FORWARD));
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_wave_creation (
+      process_id, AMD_DBGAPI_WAVE_CREATION_STOP));
+
+  wave_matcher_t matches (process_id, options.filter, code_object_map);
+
+  if (all_wavefronts && options.filter.empty ())
+    stop_all_wavefronts (process_id);
+  else if (all_wavefronts)
+    stop_wavefronts (process_id, std::ref (matches));
+
+  amd_dbgapi_wave_id_t *wave_ids;
+  size_t wave_count;
+  DBGAPI_CHECK (
+      amd_dbgapi_wave_list (process_id, &wave_count, &wave_ids, nullptr));
+
+  /* Only query what is needed to order the waves, the expensive parts of the
+     dump are deferred until the waves are printed.  */
+  std::vector<wave_info_t> waves;
+  waves.reserve (wave_count);
+
+  /* The waves only stopped for the dump, resumed once it is printed.  The
+     ones that do not match the filter are not printed.  */
+  std::vector<amd_dbgapi_wave_id_t> halted_waves;
+
+  for (size_t i = 0; i < wave_count; ++i)
+    {
+      wave_info_t wave{ wave_ids[i] };
+
+      amd_dbgapi_wave_state_t state;
+      DBGAPI_CHECK (amd_dbgapi_wave_get_info (process_id, wave.wave_id,
+                                              AMD_DBGAPI_WAVE_INFO_STATE,
+                                              sizeof (state), &state));
+
+      if (state != AMD_DBGAPI_WAVE_STATE_STOP)
+        continue;
+
+      DBGAPI_CHECK (amd_dbgapi_wave_get_info (
+          process_id, wave.wave_id, AMD_DBGAPI_WAVE_INFO_STOP_REASON,
+          sizeof (wave.stop_reason), &wave.stop_reason));
+
+      if (!options.filter.empty () && !matches (wave.wave_id))
+        {
+          if (wave.stop_reason == AMD_DBGAPI_WAVE_STOP_REASON_NONE)
+            halted_waves.emplace_back (wave.wave_id);
+          continue;
+        }
+
+      DBGAPI_CHECK (amd_dbgapi_wave_get_info (
+          process_id, wave.wave_id, AMD_DBGAPI_WAVE_INFO_PC, sizeof (wave.pc),
+          &wave.pc));
+
+      DBGAPI_CHECK (amd_dbgapi_wave_get_info (
+          process_id, wave.wave_id, AMD_DBGAPI_WAVE_INFO_AGENT,
+          sizeof (wave.agent_id), &wave.agent_id));
+
+      DBGAPI_CHECK (amd_dbgapi_wave_get_info (
+          process_id, wave.wave_id, AMD_DBGAPI_WAVE_INFO_QUEUE,
+          sizeof (wave.queue_id), &wave.queue_id));
+
+      /* Not all queue types provide dispatch and workgroup information,
+         waves without it are grouped together.  */
+      if (amd_dbgapi_wave_get_info (
+              process_id, wave.wave_id, AMD_DBGAPI_WAVE_INFO_DISPATCH,
+              sizeof (wave.dispatch_id), &wave.dispatch_id)
+          != AMD_DBGAPI_STATUS_SUCCESS)
+        wave.dispatch_id = {};
+
+      if (amd_dbgapi_wave_get_info (
+              process_id, wave.wave_id, AMD_DBGAPI_WAVE_INFO_WORK_GROUP_COORD,
+              sizeof (wave.workgroup_coord), wave.workgroup_coord.data ())
+          != AMD_DBGAPI_STATUS_SUCCESS)
+        wave.workgroup_coord = {};
+
+      waves.emplace_back (wave);
+    }
+
+  free (wave_ids);
+
+  /* Organize the waves in an agent, queue, dispatch, workgroup hierarchy.
+     Each level is ordered by the highest priority of the waves it contains so
+     that the waves that caused the dump are still printed first.  */
+  dump_state_t state{ process_id, options, code_object_map, dump_start, 0 };
+
+  for (auto &&wave : waves)
+    {
+      state.agent_groups[wave.agent_id.handle].add (wave);
+      state.queue_groups[wave.queue_id.handle].add (wave);
+      state.dispatch_groups[wave.dispatch_id.handle].add (wave);
+      state.workgroup_groups[workgroup_key (wave)].add (wave);
+    }
+
+  {
+    auto sort_key = [&] (const wave_info_t &wave) {
+      return std::make_tuple (
+          state.agent_groups[wave.agent_id.handle].priority,
+          wave.agent_id.handle,
+          state.queue_groups[wave.queue_id.handle].priority,
+          wave.queue_id.handle,
+          state.dispatch_groups[wave.dispatch_id.handle].priority,
+          wave.dispatch_id.handle,
+          state.workgroup_groups[workgroup_key (wave)].priority,
+          workgroup_key (wave), wave_priority (wave));
+    };
+
+    std::vector<std::pair<decltype (sort_key (waves[0])), wave_info_t>>
+        sorted_waves;
+    sorted_waves.reserve (waves.size ());
+    for (auto &&wave : waves)
+      sorted_waves.emplace_back (sort_key (wave), wave);
+
+    std::stable_sort (sorted_waves.begin (), sorted_waves.end (),
+                      [] (const auto &lhs, const auto &rhs) {
+                        return lhs.first < rhs.first;
+                      });
+
+    std::transform (sorted_waves.begin (), sorted_waves.end (),
+                    waves.begin (),
+                    [] (const auto &value) { return value.second; });
+  }
+
+  /* List all the waves first, and write the list out now: the details of
+     a large dump may take seconds to print, and are limited by the budget.
+     The summary counts against the size budget.  */
+  state.start_bytes = agent_out_bytes ();
+  print_summary (agent_out, waves, code_object_map, options.raw);
+  agent_out.flush ();
+
+  if (!options.summary_only)
+    print_details (state, waves);
+
+  for (auto &&wave : waves)
+    if (wave.stop_reason == AMD_DBGAPI_WAVE_STOP_REASON_NONE)
+      halted_waves.emplace_back (wave.wave_id);
+
+  /* Resume the waves that were only stopped to be printed.  */
+  for (auto &&wave_id : halted_waves)
+    {
+      /* FIXME: What if the wave was single-stepping?  */
+      DBGAPI_CHECK (amd_dbgapi_wave_resume (process_id, wave_id,
+                                            AMD_DBGAPI_RESUME_MODE_NORMAL));
+    }
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_wave_creation (
+      process_id, AMD_DBGAPI_WAVE_CREATION_NORMAL));
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_progress (process_id,
+                                                 AMD_DBGAPI_PROGRESS_NORMAL));
+
+  detach_process ();
+
+  /* Release the code objects if the session was finalized, their ids are
+     not valid in the next session.  */
+  if (!session_id ())
+    code_object_cache = {};
+}
+
+std::vector<std::string>
+kernel_object_names (const std::vector<uint64_t> &kernel_objects,
+                     const dump_options_t &options)
+{
+  std::vector<std::string> names (kernel_objects.size ());
+
+  /* The symbols are only looked up offline.  */
+  if (options.raw)
+    return names;
+
+  std::scoped_lock session_lock (dbgapi_lock);
+  amd_dbgapi_process_id_t process_id = attach_process ();
+
+  update_code_objects (process_id, options.code_objects_dir);
+
+  for (size_t i = 0; i < kernel_objects.size (); ++i)
+    if (code_object_t *code_object = find_code_object (
+            code_object_cache.code_object_map, kernel_objects[i]))
+      if (auto name = code_object->find_kernel_descriptor (kernel_objects[i]))
+        names[i] = std::move (*name);
+
+  detach_process ();
+
+  if (!session_id ())
+    code_object_cache = {};
+
+  return names;
+}
+
+} /* namespace amd::debug_agent */
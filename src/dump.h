@@ -0,0 +1,117 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_DUMP_H
+#define _ROCM_DEBUG_AGENT_DUMP_H 1
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace amd::debug_agent
+{
+
+/* How the lanes of the vector registers are printed.  */
+enum class vector_lanes_t
+{
+  /* All the lanes, whether active or not.  */
+  all,
+  /* Only the lanes set in the wave's execution mask.  */
+  active,
+  /* Only the active lanes, as a matrix of the lanes by the registers.  */
+  matrix
+};
+
+/* Which waves a dump stops and prints: the waves matching all the fields
+   that are set, all the waves if none is.  The ids are the handles printed
+   in the dump, as in wave_<id>.  */
+struct wave_filter_t
+{
+  std::optional<uint64_t> wave_id;
+  std::optional<uint64_t> queue_id;
+  std::optional<uint64_t> dispatch_id;
+  /* A part of the name of the wave's kernel.  */
+  std::optional<std::string> kernel;
+
+  bool
+  empty () const
+  {
+    return !wave_id && !queue_id && !dispatch_id && !kernel;
+  }
+};
+
+struct dump_options_t
+{
+  /* Save the code objects loaded in the process to this directory.  */
+  std::optional<std::string> code_objects_dir;
+  /* Stop printing wavefronts once the dump took this long, or printed this
+     many bytes.  The remaining wavefronts are summarized on one line each.  */
+  std::optional<std::chrono::steady_clock::duration> time_budget;
+  std::optional<size_t> size_budget;
+  /* Also save the state of the waves in a GPU core file, named after this
+     template as agent_out's file, %n being the number of the core file.  */
+  std::optional<std::string> core_file;
+  /* Save this many bytes of global memory at each kernel argument that is
+     an address in the core file.  */
+  size_t core_memory_window{ 0 };
+  /* Only print the pc, registers and local memory of the waves, and the
+     identity of the code objects, and embed all the code objects in the core
+     file.  The symbols, disassembly, and source lines are looked up offline
+     by rocm-debug-agent-symbolize.  */
+  bool raw{ false };
+  vector_lanes_t vector_lanes{ vector_lanes_t::all };
+  wave_filter_t filter;
+  /* Only print the list of the waves, not their state, and do not write a
+     core file.  */
+  bool summary_only{ false };
+};
+
+/* Print the state of the stopped wavefronts to agent_out, grouped by agent,
+   queue, dispatch and workgroup, the waves stopped by an exception first.  If
+   `all_wavefronts` is set, the running wavefronts are stopped and printed
+   too.  Only the waves matching `options.filter` are stopped and printed.
+   Attaches to the process if needed, dbgapi_lock must not be held.  */
+void dump_wavefronts (bool all_wavefronts, const dump_options_t &options);
+
+/* Return the names of the kernels whose descriptors are at
+   `kernel_objects`, or an empty string for the ones not found in the loaded
+   code objects.  All the names are empty if `options.raw` is set.  New code
+   objects are saved as by dump_wavefronts.  Attaches to the process if
+   needed, dbgapi_lock must not be held.  */
+std::vector<std::string>
+kernel_object_names (const std::vector<uint64_t> &kernel_objects,
+                     const dump_options_t &options);
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_DUMP_H */
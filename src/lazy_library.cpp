@@ -0,0 +1,366 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* The debugger API, libelf and libdw are only needed once a dump starts,
+   most processes never fault.  The agent is not linked with them: each
+   function it calls is defined here, and forwards to the library's
+   function, loading the library the first time one of its functions is
+   called.  */
+
+#include "debug.h"
+#include "logging.h"
+#include "stats.h"
+
+#include <amd-dbgapi.h>
+#include <elfutils/libdw.h>
+#include <gelf.h>
+#include <libelf.h>
+
+#include <dlfcn.h>
+
+#include <mutex>
+
+namespace amd::debug_agent
+{
+namespace
+{
+
+class lazy_library_t
+{
+public:
+  constexpr lazy_library_t (const char *soname) : m_soname (soname) {}
+
+  /* Return the address of the function NAME, the library is loaded on the
+     first call.  */
+  void *
+  symbol (const char *name)
+  {
+    std::call_once (m_loaded, [this] () {
+      static stat_site_t timer_site ("load_library");
+      scoped_timer_t timer (timer_site);
+
+      if (!(m_handle = dlopen (m_soname, RTLD_NOW | RTLD_LOCAL)))
+        agent_error ("cannot load %s: %s", m_soname, dlerror ());
+
+      agent_log (log_level_t::info, "loaded %s", m_soname);
+    });
+
+    void *address = dlsym (m_handle, name);
+    if (!address)
+      agent_error ("cannot find %s in %s", name, m_soname);
+
+    return address;
+  }
+
+private:
+  const char *const m_soname;
+  std::once_flag m_loaded;
+  void *m_handle{ nullptr };
+};
+
+lazy_library_t dbgapi_library ("libamd_dbgapi.so.0");
+lazy_library_t elf_library ("libelf.so.1");
+lazy_library_t dw_library ("libdw.so.1");
+
+} /* namespace */
+} /* namespace amd::debug_agent */
+
+/* Define NAME, with the given RETURN_TYPE and PARAMETERS, to call the
+   function of the same name in LIBRARY with ARGUMENTS.  */
+#define LAZY_FUNCTION(library, return_type, name, parameters, arguments)    \
+  return_type name parameters                                               \
+  {                                                                         \
+    static auto *const function = reinterpret_cast<decltype (&name)> (      \
+        amd::debug_agent::library.symbol (#name));                          \
+    return function arguments;                                              \
+  }
+
+/* The debugger API.  */
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_initialize,
+               (amd_dbgapi_callbacks_t * callbacks), (callbacks))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_finalize, (),
+               ())
+
+LAZY_FUNCTION (dbgapi_library, void, amd_dbgapi_set_log_level,
+               (amd_dbgapi_log_level_t level), (level))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_process_attach,
+               (amd_dbgapi_client_process_id_t client_process_id,
+                amd_dbgapi_process_id_t *process_id),
+               (client_process_id, process_id))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_process_detach,
+               (amd_dbgapi_process_id_t process_id), (process_id))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_process_set_progress,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_progress_t progress),
+               (process_id, progress))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_process_set_wave_creation,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_creation_t creation),
+               (process_id, creation))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_next_pending_event,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_event_id_t *event_id,
+                amd_dbgapi_event_kind_t *kind),
+               (process_id, event_id, kind))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_event_get_info,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_event_id_t event_id, amd_dbgapi_event_info_t query,
+                size_t value_size, void *value),
+               (process_id, event_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_event_processed,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_event_id_t event_id),
+               (process_id, event_id))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_code_object_list,
+               (amd_dbgapi_process_id_t process_id, size_t *code_object_count,
+                amd_dbgapi_code_object_id_t **code_objects,
+                amd_dbgapi_changed_t *changed),
+               (process_id, code_object_count, code_objects, changed))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_code_object_get_info,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_code_object_id_t code_object_id,
+                amd_dbgapi_code_object_info_t query, size_t value_size,
+                void *value),
+               (process_id, code_object_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_agent_get_info,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_agent_id_t agent_id, amd_dbgapi_agent_info_t query,
+                size_t value_size, void *value),
+               (process_id, agent_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_queue_get_info,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_queue_id_t queue_id, amd_dbgapi_queue_info_t query,
+                size_t value_size, void *value),
+               (process_id, queue_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_dispatch_get_info,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_dispatch_id_t dispatch_id,
+                amd_dbgapi_dispatch_info_t query, size_t value_size,
+                void *value),
+               (process_id, dispatch_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_wave_list,
+               (amd_dbgapi_process_id_t process_id, size_t *wave_count,
+                amd_dbgapi_wave_id_t **waves, amd_dbgapi_changed_t *changed),
+               (process_id, wave_count, waves, changed))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_wave_get_info,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_id_t wave_id, amd_dbgapi_wave_info_t query,
+                size_t value_size, void *value),
+               (process_id, wave_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_wave_stop,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_id_t wave_id),
+               (process_id, wave_id))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_wave_resume,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_id_t wave_id,
+                amd_dbgapi_resume_mode_t resume_mode),
+               (process_id, wave_id, resume_mode))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_architecture_get_info,
+               (amd_dbgapi_architecture_id_t architecture_id,
+                amd_dbgapi_architecture_info_t query, size_t value_size,
+                void *value),
+               (architecture_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_architecture_register_class_list,
+               (amd_dbgapi_architecture_id_t architecture_id,
+                size_t *register_class_count,
+                amd_dbgapi_register_class_id_t **register_classes),
+               (architecture_id, register_class_count, register_classes))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_architecture_register_class_get_info,
+               (amd_dbgapi_architecture_id_t architecture_id,
+                amd_dbgapi_register_class_id_t register_class_id,
+                amd_dbgapi_register_class_info_t query, size_t value_size,
+                void *value),
+               (architecture_id, register_class_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_wave_register_list,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_id_t wave_id, size_t *register_count,
+                amd_dbgapi_register_id_t **registers),
+               (process_id, wave_id, register_count, registers))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_wave_register_get_info,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_id_t wave_id,
+                amd_dbgapi_register_id_t register_id,
+                amd_dbgapi_register_info_t query, size_t value_size,
+                void *value),
+               (process_id, wave_id, register_id, query, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_register_is_in_register_class,
+               (amd_dbgapi_architecture_id_t architecture_id,
+                amd_dbgapi_register_id_t register_id,
+                amd_dbgapi_register_class_id_t register_class_id,
+                amd_dbgapi_register_class_state_t *register_class_state),
+               (architecture_id, register_id, register_class_id,
+                register_class_state))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_read_register,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_id_t wave_id,
+                amd_dbgapi_register_id_t register_id,
+                amd_dbgapi_size_t offset, amd_dbgapi_size_t value_size,
+                void *value),
+               (process_id, wave_id, register_id, offset, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_dwarf_address_space_to_address_space,
+               (amd_dbgapi_architecture_id_t architecture_id,
+                uint64_t dwarf_address_space,
+                amd_dbgapi_address_space_id_t *address_space_id),
+               (architecture_id, dwarf_address_space, address_space_id))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t, amd_dbgapi_read_memory,
+               (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_wave_id_t wave_id, amd_dbgapi_lane_id_t lane_id,
+                amd_dbgapi_address_space_id_t address_space_id,
+                amd_dbgapi_segment_address_t segment_address,
+                amd_dbgapi_size_t *value_size, void *value),
+               (process_id, wave_id, lane_id, address_space_id,
+                segment_address, value_size, value))
+
+LAZY_FUNCTION (dbgapi_library, amd_dbgapi_status_t,
+               amd_dbgapi_disassemble_instruction,
+               (amd_dbgapi_architecture_id_t architecture_id,
+                amd_dbgapi_global_address_t address, amd_dbgapi_size_t *size,
+                const void *memory, char **instruction_text,
+                amd_dbgapi_symbolizer_id_t symbolizer_id,
+                amd_dbgapi_status_t (*symbolizer) (
+                    amd_dbgapi_symbolizer_id_t symbolizer_id,
+                    amd_dbgapi_global_address_t address, char **symbol_text)),
+               (architecture_id, address, size, memory, instruction_text,
+                symbolizer_id, symbolizer))
+
+/* libelf.  */
+
+LAZY_FUNCTION (elf_library, Elf *, elf_memory, (char *image, size_t size),
+               (image, size))
+
+LAZY_FUNCTION (elf_library, int, elf_end, (Elf * elf), (elf))
+
+LAZY_FUNCTION (elf_library, int, elf_getphdrnum, (Elf * elf, size_t *dst),
+               (elf, dst))
+
+LAZY_FUNCTION (elf_library, Elf_Scn *, elf_nextscn, (Elf * elf, Elf_Scn *scn),
+               (elf, scn))
+
+LAZY_FUNCTION (elf_library, Elf_Data *, elf_getdata,
+               (Elf_Scn * scn, Elf_Data *data), (scn, data))
+
+LAZY_FUNCTION (elf_library, char *, elf_strptr,
+               (Elf * elf, size_t index, size_t offset), (elf, index, offset))
+
+LAZY_FUNCTION (elf_library, size_t, gelf_fsize,
+               (Elf * elf, Elf_Type type, size_t count, unsigned int version),
+               (elf, type, count, version))
+
+LAZY_FUNCTION (elf_library, GElf_Phdr *, gelf_getphdr,
+               (Elf * elf, int ndx, GElf_Phdr *dst), (elf, ndx, dst))
+
+LAZY_FUNCTION (elf_library, GElf_Shdr *, gelf_getshdr,
+               (Elf_Scn * scn, GElf_Shdr *dst), (scn, dst))
+
+LAZY_FUNCTION (elf_library, GElf_Sym *, gelf_getsym,
+               (Elf_Data * data, int ndx, GElf_Sym *dst), (data, ndx, dst))
+
+/* libdw.  */
+
+LAZY_FUNCTION (dw_library, Dwarf *, dwarf_begin_elf,
+               (Elf * elf, Dwarf_Cmd cmd, Elf_Scn *scngrp),
+               (elf, cmd, scngrp))
+
+LAZY_FUNCTION (dw_library, int, dwarf_end, (Dwarf * dwarf), (dwarf))
+
+LAZY_FUNCTION (dw_library, int, dwarf_nextcu,
+               (Dwarf * dwarf, Dwarf_Off off, Dwarf_Off *next_off,
+                size_t *header_sizep, Dwarf_Off *abbrev_offsetp,
+                uint8_t *address_sizep, uint8_t *offset_sizep),
+               (dwarf, off, next_off, header_sizep, abbrev_offsetp,
+                address_sizep, offset_sizep))
+
+LAZY_FUNCTION (dw_library, Dwarf_Die *, dwarf_offdie,
+               (Dwarf * dbg, Dwarf_Off offset, Dwarf_Die *result),
+               (dbg, offset, result))
+
+LAZY_FUNCTION (dw_library, ptrdiff_t, dwarf_ranges,
+               (Dwarf_Die * die, ptrdiff_t offset, Dwarf_Addr *basep,
+                Dwarf_Addr *startp, Dwarf_Addr *endp),
+               (die, offset, basep, startp, endp))
+
+LAZY_FUNCTION (dw_library, int, dwarf_getsrclines,
+               (Dwarf_Die * cudie, Dwarf_Lines **lines, size_t *nlines),
+               (cudie, lines, nlines))
+
+LAZY_FUNCTION (dw_library, Dwarf_Line *, dwarf_onesrcline,
+               (Dwarf_Lines * lines, size_t idx), (lines, idx))
+
+LAZY_FUNCTION (dw_library, int, dwarf_lineaddr,
+               (Dwarf_Line * line, Dwarf_Addr *addrp), (line, addrp))
+
+LAZY_FUNCTION (dw_library, int, dwarf_lineno, (Dwarf_Line * line, int *linep),
+               (line, linep))
+
+LAZY_FUNCTION (dw_library, const char *, dwarf_linesrc,
+               (Dwarf_Line * line, Dwarf_Word *mtime, Dwarf_Word *length),
+               (line, mtime, length))
@@ -29,68 +29,1043 @@
    DEALINGS WITH THE SOFTWARE.  */
 
 #include "logging.h"
+#include "stats.h"
 
-#include <amd-dbgapi.h>
 #include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace amd::debug_agent
 {
 
 log_level_t log_level = log_level_t::warning;
+bool log_timestamps{ false };
 
-std::ofstream agent_out;
+/* Not connected to a stream buffer, and therefore discarding its output,
+   until open_agent_out is called.  */
+std::ostream agent_out (nullptr);
 
-namespace detail
+namespace
+{
+
+/* Return the rank of this process in an MPI job, as set by the common MPI
+   launchers, or "0" if it is not part of a job.  */
+std::string
+mpi_rank ()
+{
+  for (const char *variable :
+       { "OMPI_COMM_WORLD_RANK", "PMIX_RANK", "PMI_RANK",
+         "MV2_COMM_WORLD_RANK", "SLURM_PROCID" })
+    if (const char *value = getenv (variable); value && *value)
+      return value;
+
+  return "0";
+}
+
+} /* namespace */
+
+std::string
+expand_path_template (const std::string &path_template, std::size_t sequence)
+{
+  std::string path;
+
+  for (size_t i = 0; i < path_template.size (); ++i)
+    {
+      if (path_template[i] != '%' || i + 1 == path_template.size ())
+        {
+          path += path_template[i];
+          continue;
+        }
+
+      switch (path_template[++i])
+        {
+        case 'p':
+          path += std::to_string (getpid ());
+          break;
+
+        case 'h':
+          {
+            char host_name[256] = {};
+            if (gethostname (host_name, sizeof (host_name) - 1) == 0)
+              path += host_name;
+            break;
+          }
+
+        case 't':
+          {
+            time_t now = time (nullptr);
+            struct tm tm;
+            char buffer[32];
+            if (localtime_r (&now, &tm)
+                && strftime (buffer, sizeof (buffer), "%Y%m%dT%H%M%S", &tm))
+              path += buffer;
+            break;
+          }
+
+        case 'r':
+          path += mpi_rank ();
+          break;
+
+        case 'n':
+          path += std::to_string (sequence);
+          break;
+
+        case '%':
+          path += '%';
+          break;
+
+        default:
+          path += '%';
+          path += path_template[i];
+        }
+    }
+
+  return path;
+}
+
+namespace
+{
+
+/* Return true if PATH_TEMPLATE contains a %n sequence.  */
+bool
+has_sequence_number (const std::string &path_template)
+{
+  for (size_t i = 0; i + 1 < path_template.size (); ++i)
+    if (path_template[i] == '%' && path_template[++i] == 'n')
+      return true;
+
+  return false;
+}
+
+/* Write the first SIZE1 bytes at DATA1 followed by the first SIZE2 bytes at
+   DATA2 to FD, retrying after short writes and interruptions.  If SOCKET is
+   set, FD is a connected socket, and a peer that went away fails the write
+   instead of raising SIGPIPE.  */
+bool
+write_fd (int fd, const char *data1, std::size_t size1, const char *data2,
+          std::size_t size2, bool socket = false)
+{
+  static stat_site_t timer_site ("output");
+  scoped_timer_t timer (timer_site);
+
+  struct iovec iov[2] = { { const_cast<char *> (data1), size1 },
+                          { const_cast<char *> (data2), size2 } };
+  struct iovec *next = iov;
+  int count = 2;
+
+  while (count)
+    {
+      struct msghdr message = {};
+      message.msg_iov = next;
+      message.msg_iovlen = count;
+
+      ssize_t written = socket ? ::sendmsg (fd, &message, MSG_NOSIGNAL)
+                               : ::writev (fd, next, count);
+      if (written == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+
+      timer.add_bytes (written);
+
+      /* Skip over the chunks that were completely written.  */
+      while (count && static_cast<std::size_t> (written) >= next->iov_len)
+        {
+          written -= next->iov_len;
+          ++next;
+          --count;
+        }
+
+      if (count)
+        {
+          next->iov_base = static_cast<char *> (next->iov_base) + written;
+          next->iov_len -= written;
+        }
+    }
+
+  return true;
+}
+
+/* Compress blocks of output into gzip members.  gzip and zcat decompress a
+   file made of several members as if it was a single stream, and the
+   complete members of a truncated file can still be decompressed.  */
+class gzip_writer_t
+{
+public:
+  gzip_writer_t () = default;
+
+  ~gzip_writer_t ()
+  {
+    if (m_initialized)
+      deflateEnd (&m_stream);
+  }
+
+  gzip_writer_t (const gzip_writer_t &) = delete;
+  gzip_writer_t &operator= (const gzip_writer_t &) = delete;
+
+  /* Return false if the compressor cannot be initialized.  */
+  bool
+  initialize (int level)
+  {
+    m_initialized = deflateInit2 (&m_stream, level, Z_DEFLATED,
+                                  15 + 16 /* gzip */, 8, Z_DEFAULT_STRATEGY)
+                    == Z_OK;
+    return m_initialized;
+  }
+
+  /* Write the first SIZE1 bytes at DATA1 followed by the first SIZE2 bytes
+     at DATA2 to FD, as a single gzip member.  */
+  bool
+  write (int fd, const char *data1, std::size_t size1, const char *data2,
+         std::size_t size2)
+  {
+    {
+      static stat_site_t timer_site ("compress");
+      scoped_timer_t timer (timer_site);
+      timer.add_bytes (size1 + size2);
+
+      deflateReset (&m_stream);
+
+      /* Size the output buffer so that both chunks are compressed in a
+         single call to deflate.  */
+      m_output.resize (deflateBound (&m_stream, size1 + size2));
+      m_stream.next_out = reinterpret_cast<Bytef *> (m_output.data ());
+      m_stream.avail_out = m_output.size ();
+
+      m_stream.next_in
+          = reinterpret_cast<Bytef *> (const_cast<char *> (data1));
+      m_stream.avail_in = size1;
+      deflate (&m_stream, Z_NO_FLUSH);
+
+      m_stream.next_in
+          = reinterpret_cast<Bytef *> (const_cast<char *> (data2));
+      m_stream.avail_in = size2;
+      if (deflate (&m_stream, Z_FINISH) != Z_STREAM_END)
+        return false;
+    }
+
+    return write_fd (fd, m_output.data (), m_stream.total_out, nullptr, 0);
+  }
+
+private:
+  z_stream m_stream{};
+  bool m_initialized{ false };
+  std::vector<char> m_output;
+};
+
+/* Write the chunks to FD, compressed if GZIP is not null.  */
+bool
+write_output (int fd, gzip_writer_t *gzip, const char *data1,
+              std::size_t size1, const char *data2, std::size_t size2)
+{
+  return gzip ? gzip->write (fd, data1, size1, data2, size2)
+              : write_fd (fd, data1, size1, data2, size2);
+}
+
+/* A thread writing to a file descriptor the bytes pushed in a single-producer,
+   single-consumer ring buffer.  The bytes are exchanged through the head and
+   tail positions only; the mutex and condition variables are only used to
+   sleep when the ring is empty (writer) or full (producer).  */
+class ring_writer_t
+{
+public:
+  ring_writer_t (int fd, gzip_writer_t *gzip, std::size_t capacity)
+    : m_fd (fd), m_gzip (gzip), m_ring (std::max<std::size_t> (capacity, 1))
+  {
+    m_thread = std::thread ([this] () { run (); });
+  }
+
+  /* Wait for all the bytes pushed so far to be written, then stop the
+     thread.  */
+  ~ring_writer_t ()
+  {
+    {
+      std::scoped_lock lock (m_mutex);
+      m_stop_requested = true;
+    }
+    m_data_cv.notify_one ();
+    m_thread.join ();
+  }
+
+  /* Copy SIZE bytes at DATA into the ring, waiting for the writer thread to
+     make room when the ring is full.  Return false if an earlier write
+     failed.  */
+  bool
+  push (const char *data, std::size_t size)
+  {
+    const std::size_t capacity = m_ring.size ();
+    const std::size_t head = m_head.load (std::memory_order_relaxed);
+    std::size_t pushed = 0;
+
+    while (pushed < size)
+      {
+        std::size_t tail = m_tail.load (std::memory_order_acquire);
+        std::size_t room = capacity - (head + pushed - tail);
+
+        if (!room)
+          {
+            /* Back pressure: the ring is full.  */
+            static stat_site_t timer_site ("output_wait");
+            scoped_timer_t timer (timer_site);
+            std::unique_lock lock (m_mutex);
+            m_space_cv.wait (lock, [&] () {
+              return m_tail.load (std::memory_order_relaxed) != tail;
+            });
+            continue;
+          }
+
+        std::size_t length = std::min (room, size - pushed);
+        std::size_t offset = (head + pushed) % capacity;
+        std::size_t first = std::min (length, capacity - offset);
+
+        std::memcpy (&m_ring[offset], data + pushed, first);
+        std::memcpy (&m_ring[0], data + pushed + first, length - first);
+        pushed += length;
+
+        m_head.store (head + pushed, std::memory_order_release);
+
+        /* Taking the mutex orders the store to m_head with the writer's check
+           of the ring being empty before it goes to sleep.  */
+        {
+          std::scoped_lock lock (m_mutex);
+        }
+        m_data_cv.notify_one ();
+      }
+
+    return !m_failed.load (std::memory_order_relaxed);
+  }
+
+private:
+  void
+  run ()
+  {
+    /* Signals are handled by the application threads, a SIGQUIT dump must not
+       be started from this thread as it would wait for itself to make room
+       in the ring.  */
+    sigset_t signal_set;
+    sigemptyset (&signal_set);
+    sigaddset (&signal_set, SIGQUIT);
+    pthread_sigmask (SIG_BLOCK, &signal_set, nullptr);
+
+    const std::size_t capacity = m_ring.size ();
+
+    while (true)
+      {
+        const std::size_t tail = m_tail.load (std::memory_order_relaxed);
+        std::size_t head = m_head.load (std::memory_order_acquire);
+
+        if (head == tail)
+          {
+            std::unique_lock lock (m_mutex);
+            m_data_cv.wait (lock, [&] () {
+              return m_head.load (std::memory_order_relaxed) != tail
+                     || m_stop_requested;
+            });
+
+            if (m_head.load (std::memory_order_relaxed) == tail)
+              return;
+
+            continue;
+          }
+
+        std::size_t offset = tail % capacity;
+        std::size_t first = std::min (head - tail, capacity - offset);
+
+        /* Keep the bytes of a failed write from blocking the producer, they
+           are discarded.  */
+        if (!write_output (m_fd, m_gzip, &m_ring[offset], first, &m_ring[0],
+                           head - tail - first))
+          m_failed.store (true, std::memory_order_relaxed);
+
+        m_tail.store (head, std::memory_order_release);
+
+        {
+          std::scoped_lock lock (m_mutex);
+        }
+        m_space_cv.notify_one ();
+      }
+  }
+
+  const int m_fd;
+  /* Compress the output if not null.  Only used by this thread while the
+     ring writer exists.  */
+  gzip_writer_t *const m_gzip;
+  std::vector<char> m_ring;
+
+  /* The number of bytes ever pushed, and ever written.  The bytes in the ring
+     are at positions [m_tail, m_head) modulo the ring's capacity.  */
+  std::atomic<std::size_t> m_head{ 0 };
+  std::atomic<std::size_t> m_tail{ 0 };
+  std::atomic<bool> m_failed{ false };
+
+  std::mutex m_mutex;
+  std::condition_variable m_data_cv;
+  std::condition_variable m_space_cv;
+  bool m_stop_requested{ false };
+
+  std::thread m_thread;
+};
+
+/* A stream buffer writing to a file descriptor.  The characters are
+   accumulated in a buffer and written with a single system call when the
+   buffer is full or when the stream is flushed, so that a dump does not make
+   a write system call per line.  Writes larger than the buffer are combined
+   with the pending characters with writev, without being copied.
+
+   If a ring writer is started, the buffer is handed over to the writer
+   thread instead of being written, so that producing the output overlaps
+   with writing, and compressing, it.
+
+   The buffer, the file, and the ring writer, are only created when the
+   first characters are written, so that a process that never prints
+   anything does not create a file or pay for the buffer.  */
+class output_streambuf_t : public std::streambuf
 {
+public:
+  explicit output_streambuf_t (const agent_out_options_t &options)
+    : m_path_template (options.path_template),
+      /* pbump takes an int.  */
+      m_buffer_size (std::min<std::size_t> (options.buffer_size, INT_MAX)),
+      m_ring_size (options.ring_size)
+  {
+    if (options.compression_level)
+      {
+        m_gzip = std::make_unique<gzip_writer_t> ();
+
+        /* Write the output uncompressed rather than not at all.  */
+        if (!m_gzip->initialize (*options.compression_level))
+          m_gzip.reset ();
+      }
+  }
+
+  /* Write to the connected socket SOCKET_FD, which is not closed.  */
+  explicit output_streambuf_t (int socket_fd)
+    : m_fd (socket_fd), m_socket (true), m_buffer_size (64 * 1024)
+  {
+  }
+
+  ~output_streambuf_t ()
+  {
+    drain ();
+    close_file ();
+  }
+
+  /* Write the buffered characters and stop the writer thread, if any, once
+     it has written everything.  Later output is written synchronously.  */
+  void
+  drain ()
+  {
+    sync ();
+    m_writer.reset ();
+    m_ring_size.reset ();
+  }
+
+  /* Close the current file if the path template depends on the dump
+     sequence number, the next characters will be written to a new file.  */
+  void
+  next_dump ()
+  {
+    ++m_sequence;
+
+    if (!m_path_template || !has_sequence_number (*m_path_template))
+      return;
+
+    sync ();
+    m_writer.reset ();
+    close_file ();
+  }
+
+  std::size_t count () const { return m_written + (pptr () - pbase ()); }
+
+protected:
+  int_type
+  overflow (int_type c) override
+  {
+    allocate_buffer ();
+
+    if (!flush_put_area ())
+      return traits_type::eof ();
+
+    if (traits_type::eq_int_type (c, traits_type::eof ()))
+      return traits_type::not_eof (c);
+
+    char_type ch = traits_type::to_char_type (c);
+
+    /* Unbuffered.  */
+    if (pbase () == epptr ())
+      return write_chunks (nullptr, 0, &ch, 1) ? c : traits_type::eof ();
+
+    *pptr () = ch;
+    pbump (1);
+    return c;
+  }
+
+  std::streamsize
+  xsputn (const char_type *s, std::streamsize n) override
+  {
+    allocate_buffer ();
+
+    if (n <= epptr () - pptr ())
+      {
+        std::memcpy (pptr (), s, n);
+        pbump (n);
+        return n;
+      }
+
+    /* The characters would not fit in the buffer's remaining space.  If they
+       fit in an empty buffer, write the pending characters first, otherwise
+       write both at once.  */
+    if (static_cast<std::size_t> (n) < m_buffer_size)
+      {
+        if (!flush_put_area ())
+          return 0;
+
+        std::memcpy (pptr (), s, n);
+        pbump (n);
+        return n;
+      }
+
+    bool success = write_chunks (pbase (), pptr () - pbase (), s, n);
+    reset_put_area ();
+    return success ? n : 0;
+  }
+
+  int
+  sync () override
+  {
+    return flush_put_area () ? 0 : -1;
+  }
+
+private:
+  void
+  allocate_buffer ()
+  {
+    if (m_buffer || !m_buffer_size)
+      return;
+
+    m_buffer.reset (new char_type[m_buffer_size]);
+    reset_put_area ();
+  }
+
+  void
+  reset_put_area ()
+  {
+    setp (m_buffer.get (), m_buffer.get () + (m_buffer ? m_buffer_size : 0));
+  }
+
+  bool
+  flush_put_area ()
+  {
+    if (pptr () == pbase ())
+      return true;
+
+    bool success = write_chunks (pbase (), pptr () - pbase (), nullptr, 0);
+    reset_put_area ();
+    return success;
+  }
+
+  void
+  open_file ()
+  {
+    m_fd = STDERR_FILENO;
+
+    if (m_path_template)
+      {
+        std::string path = expand_path_template (*m_path_template, m_sequence);
+        int fd = ::open (path.c_str (),
+                         O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+        /* Do not lose the output, write it to stderr instead.  */
+        if (fd == -1)
+          fprintf (stderr,
+                   "rocm-debug-agent: warning: could not open `%s': %s\n",
+                   path.c_str (), strerror (errno));
+        else
+          m_fd = fd;
+      }
+
+    if (m_ring_size)
+      m_writer = std::make_unique<ring_writer_t> (m_fd, m_gzip.get (),
+                                                  *m_ring_size);
+  }
+
+  void
+  close_file ()
+  {
+    if (m_fd != -1 && m_fd != STDERR_FILENO && !m_socket)
+      ::close (m_fd);
+    m_fd = -1;
+  }
+
+  bool
+  write_chunks (const char *data1, std::size_t size1, const char *data2,
+                std::size_t size2)
+  {
+    if (m_fd == -1)
+      open_file ();
+
+    /* Once a write to a socket failed, such as when its send timeout
+       expired, the output is discarded rather than waiting for the timeout
+       again.  */
+    bool success
+        = m_socket   ? !m_socket_failed
+                         && write_fd (m_fd, data1, size1, data2, size2, true)
+          : m_writer ? m_writer->push (data1, size1)
+                           && m_writer->push (data2, size2)
+                     : write_output (m_fd, m_gzip.get (), data1, size1, data2,
+                                     size2);
+    m_written += size1 + size2;
+    m_socket_failed = m_socket && !success;
+    return success;
+  }
+
+  const std::optional<std::string> m_path_template;
+  /* The number of the current dump, for the %n sequence.  */
+  std::size_t m_sequence{ 0 };
+  /* The file descriptor, or -1 if the file is not opened yet.  */
+  int m_fd{ -1 };
+  /* Set if m_fd is a socket the output is redirected to.  */
+  const bool m_socket{ false };
+  /* Set once a write to the socket failed.  */
+  bool m_socket_failed{ false };
+
+  const std::size_t m_buffer_size;
+  std::unique_ptr<char_type[]> m_buffer;
+  std::optional<std::size_t> m_ring_size;
+  std::unique_ptr<gzip_writer_t> m_gzip;
+  /* Declared after m_gzip, so that it is destroyed first.  */
+  std::unique_ptr<ring_writer_t> m_writer;
+  /* The number of bytes written to m_fd, or handed over to m_writer.  */
+  std::size_t m_written{ 0 };
+};
+
+/* Intentionally leaked, agent_out may still be written to by static
+   destructors at exit.  */
+output_streambuf_t *agent_out_buffer{ nullptr };
+
+/* The buffer of the file while agent_out is redirected to a socket.  */
+output_streambuf_t *saved_agent_out_buffer{ nullptr };
 
+/* Held by the thread writing to agent_out, see agent_out_lock_t.  */
+std::recursive_mutex agent_out_mutex;
+/* The number of agent_out_lock_t held by this thread.  */
+thread_local std::size_t agent_out_lock_depth{ 0 };
+
+/* The log lines of the threads that could not take agent_out_mutex, written
+   by its holder when it releases it.  */
+std::mutex pending_lines_lock;
+std::string pending_lines;
+
+/* Write the queued log lines to agent_out, and return true if there were
+   any.  agent_out_mutex must be held.  */
+bool
+write_pending_lines ()
+{
+  std::string lines;
+  {
+    std::scoped_lock lock (pending_lines_lock);
+    lines.swap (pending_lines);
+  }
+
+  agent_out.write (lines.data (), lines.size ());
+  return !lines.empty ();
+}
+
+/* Write the queued log lines, flushed so that they are not delayed until
+   the next dump, and release agent_out_mutex.  A line queued while this
+   thread still held the mutex is found when checking again after releasing
+   it: the thread that queued it failed to take the mutex, and left it to be
+   written by its holder.  */
 void
-log (log_level_t level, const char *format, ...)
+release_agent_out ()
 {
-  va_list va;
+  while (true)
+    {
+      if (write_pending_lines ())
+        agent_out.flush ();
+      agent_out_mutex.unlock ();
 
-  agent_out << "rocm-debug-agent: ";
+      {
+        std::scoped_lock lock (pending_lines_lock);
+        if (pending_lines.empty ())
+          return;
+      }
 
-  if (level == log_level_t::error)
-    agent_out << "error: ";
-  else if (level == log_level_t::warning)
-    agent_out << "warning: ";
+      /* Another thread took the mutex, it writes the lines instead.  */
+      if (!agent_out_mutex.try_lock ())
+        return;
+    }
+}
 
-  va_start (va, format);
-  size_t size = vsnprintf (NULL, 0, format, va);
-  va_end (va);
+/* Write the log LINES to agent_out if no other thread is writing to it,
+   or else queue them.  */
+void
+write_log_lines (const char *lines, std::size_t size, bool flush)
+{
+  if (agent_out_lock_depth)
+    {
+      agent_out.write (lines, size);
+      if (flush)
+        agent_out.flush ();
+      return;
+    }
+
+  if (agent_out_mutex.try_lock ())
+    {
+      write_pending_lines ();
+      agent_out.write (lines, size);
+      if (flush)
+        agent_out.flush ();
+    }
+  else
+    {
+      {
+        std::scoped_lock lock (pending_lines_lock);
+        pending_lines.append (lines, size);
+      }
+
+      /* The holder may have released the mutex before the lines were
+         queued, without seeing them.  */
+      if (!agent_out_mutex.try_lock ())
+        return;
+    }
+
+  release_agent_out ();
+}
+
+/* Protects the rate limiter.  */
+std::mutex log_lock;
+
+} /* namespace */
+
+agent_out_lock_t::agent_out_lock_t ()
+{
+  agent_out_mutex.lock ();
+  ++agent_out_lock_depth;
+}
+
+agent_out_lock_t::~agent_out_lock_t ()
+{
+  if (--agent_out_lock_depth)
+    agent_out_mutex.unlock ();
+  else
+    release_agent_out ();
+}
+
+void
+open_agent_out (const agent_out_options_t &options)
+{
+  auto *old_buffer = agent_out_buffer;
+  agent_out_buffer = new output_streambuf_t (options);
+
+  /* Also clears the stream's error state.  */
+  agent_out.rdbuf (agent_out_buffer);
+
+  delete old_buffer;
+}
+
+void
+redirect_agent_out (int socket_fd)
+{
+  agent_out.flush ();
+
+  saved_agent_out_buffer = agent_out_buffer;
+  agent_out_buffer = new output_streambuf_t (socket_fd);
+  agent_out.rdbuf (agent_out_buffer);
+}
+
+void
+restore_agent_out ()
+{
+  auto *socket_buffer = agent_out_buffer;
+
+  agent_out.flush ();
+  agent_out_buffer = saved_agent_out_buffer;
+  agent_out.rdbuf (agent_out_buffer);
+  saved_agent_out_buffer = nullptr;
+
+  delete socket_buffer;
+}
+
+void
+next_agent_out_dump ()
+{
+  if (agent_out_buffer)
+    agent_out_buffer->next_dump ();
+}
+
+void
+drain_agent_out ()
+{
+  /* The process is about to abort, write the queued log lines, such as the
+     error that caused it, even if another thread is writing to agent_out.  */
+  if (agent_out_mutex.try_lock ())
+    {
+      write_pending_lines ();
+      agent_out_mutex.unlock ();
+    }
+  else
+    {
+      std::scoped_lock lock (pending_lines_lock);
+      write_fd (STDERR_FILENO, pending_lines.data (), pending_lines.size (),
+                nullptr, 0);
+      pending_lines.clear ();
+    }
 
+  if (agent_out_buffer)
+    agent_out_buffer->drain ();
+}
+
+std::size_t
+agent_out_bytes ()
+{
+  return agent_out_buffer ? agent_out_buffer->count () : 0;
+}
+
+namespace
+{
+
+/* The messages printed from a call site are limited to log_burst per
+   log_window, the others are counted and reported once the window ends.  */
+constexpr std::size_t log_burst = 100;
+constexpr std::chrono::steady_clock::duration log_window
+    = std::chrono::seconds (1);
+
+struct log_rate_t
+{
+  /* The call site's format string, or nullptr if this entry is unused.  */
+  const void *site{ nullptr };
+  std::chrono::steady_clock::time_point window_start;
+  std::size_t count{ 0 };
+  std::size_t suppressed{ 0 };
+};
+
+/* Indexed by a hash of the call site.  Call sites hashing to the same entry
+   evict each other, which only resets their counts.  */
+std::array<log_rate_t, 64> log_rates;
+
+/* Format the prefix of a message from SOURCE with the given LEVEL in the
+   SIZE bytes at BUFFER, and return its length.  */
+std::size_t
+format_prefix (char *buffer, std::size_t size, const char *source,
+               log_level_t level)
+{
+  const char *level_str = level == log_level_t::error     ? "error: "
+                          : level == log_level_t::warning ? "warning: "
+                                                          : "";
+  int length;
+
+  if (log_timestamps)
+    {
+      struct timespec now;
+      struct tm tm;
+      clock_gettime (CLOCK_REALTIME, &now);
+      localtime_r (&now.tv_sec, &tm);
+
+      length = snprintf (buffer, size, "[%02d:%02d:%02d.%06ld %d] %s: %s",
+                         tm.tm_hour, tm.tm_min, tm.tm_sec,
+                         now.tv_nsec / 1000, gettid (), source, level_str);
+    }
+  else
+    {
+      length = snprintf (buffer, size, "%s: %s", source, level_str);
+    }
+
+  return std::min<std::size_t> (std::max (length, 0), size - 1);
+}
+
+/* A line formatted in a thread-local buffer, or on the heap if it does not
+   fit.  */
+class log_line_t
+{
+public:
+  log_line_t (const char *source, log_level_t level)
+      : m_flush (level <= log_level_t::warning)
+  {
+    m_size = format_prefix (data (), capacity (), source, level);
+  }
+
+  void
+  append (const char *format, ...)
+#if defined(__GNUC__)
+      __attribute__ ((format (printf, 2, 3)))
+#endif /* defined (__GNUC__) */
+  {
+    va_list va;
+    va_start (va, format);
+    vappend (format, va);
+    va_end (va);
+  }
+
+  /* Append the formatted message.  Only formats it again if it does not fit
+     in the remaining space.  */
+  void
+  vappend (const char *format, va_list va)
+  {
+    va_list copy;
+    va_copy (copy, va);
+
+    std::size_t available = capacity () - m_size;
+    int length = vsnprintf (data () + m_size, available, format, va);
+    if (length < 0)
+      {
+        va_end (copy);
+        return;
+      }
+
+    if (static_cast<std::size_t> (length) >= available)
+      {
+        /* Keep room for the newline.  */
+        grow (m_size + length + 2);
+        vsnprintf (data () + m_size, capacity () - m_size, format, copy);
+      }
+    m_size += length;
+
+    va_end (copy);
+  }
+
+  /* Terminate the line, and write it to agent_out.  */
+  void
+  emit (const void *site)
+  {
+    if (m_size == capacity ())
+      grow (m_size + 1);
+    data ()[m_size++] = '\n';
+
+    const auto now = std::chrono::steady_clock::now ();
+    char message[128];
+    std::size_t length{ 0 };
+    {
+      std::scoped_lock lock (log_lock);
+
+      log_rate_t &rate
+          = log_rates[std::hash<const void *>{}(site) % log_rates.size ()];
+
+      if (rate.site != site || now - rate.window_start >= log_window)
+        {
+          if (rate.site == site && rate.suppressed)
+            {
+              length = format_prefix (message, sizeof (message),
+                                      "rocm-debug-agent", log_level_t::info);
+              length += snprintf (message + length,
+                                  sizeof (message) - length,
+                                  "%zu similar messages suppressed\n",
+                                  rate.suppressed);
+            }
+
+          rate = { site, now, 0, 0 };
+        }
+
+      if (++rate.count > log_burst)
+        {
+          ++rate.suppressed;
+          m_size = 0;
+        }
+    }
+
+    if (length)
+      write_log_lines (message, length, false);
+
+    /* A single write, so that the lines of concurrent threads are not
+       interleaved.  Only the warnings and errors are flushed, the other
+       messages are written with the next output.  */
+    if (m_size)
+      write_log_lines (data (), m_size, m_flush);
+  }
+
+private:
+  char *data () { return m_heap ? m_heap.get () : s_buffer; }
+
+  std::size_t
+  capacity () const
+  {
+    return m_heap ? m_heap_capacity : sizeof (s_buffer);
+  }
+
+  void
+  grow (std::size_t capacity)
+  {
+    std::unique_ptr<char[]> heap (new char[capacity]);
+    std::memcpy (heap.get (), data (), m_size);
+    m_heap = std::move (heap);
+    m_heap_capacity = capacity;
+  }
+
+  /* Shared by all the lines of a thread, the logging functions are not
+     re-entrant.  */
+  static thread_local char s_buffer[512];
+
+  /* Set if the line is flushed once written.  */
+  const bool m_flush;
+  std::unique_ptr<char[]> m_heap;
+  std::size_t m_heap_capacity{ 0 };
+  std::size_t m_size{ 0 };
+};
+
+thread_local char log_line_t::s_buffer[512];
+
+} /* namespace */
+
+namespace detail
+{
+
+void
+log (log_level_t level, const char *format, ...)
+{
+  log_line_t line ("rocm-debug-agent", level);
+
+  va_list va;
   va_start (va, format);
-  std::string str (size, '\0');
-  vsprintf (&str[0], format, va);
+  line.vappend (format, va);
   va_end (va);
 
-  agent_out << str << std::endl;
+  line.emit (format);
 }
 
 } /* namespace detail */
 
+void
+log_dbgapi_message (const char *message)
+{
+  static const char site{};
+
+  log_line_t line ("rocm-dbgapi", log_level_t::info);
+  line.append ("%s", message);
+  line.emit (&site);
+}
+
 void
 set_log_level (log_level_t level)
 {
+  /* The debugger API's log level is set by attach_process, so that the
+     library is not loaded just to configure it.  */
   log_level = level;
-  switch (level)
-    {
-    case log_level_t::none:
-      amd_dbgapi_set_log_level (AMD_DBGAPI_LOG_LEVEL_NONE);
-      break;
-    case log_level_t::info:
-      amd_dbgapi_set_log_level (AMD_DBGAPI_LOG_LEVEL_INFO);
-      break;
-    case log_level_t::warning:
-      amd_dbgapi_set_log_level (AMD_DBGAPI_LOG_LEVEL_WARNING);
-      break;
-    case log_level_t::error:
-      amd_dbgapi_set_log_level (AMD_DBGAPI_LOG_LEVEL_FATAL_ERROR);
-      break;
-    }
 }
 
 } /* namespace amd::debug_agent */
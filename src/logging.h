@@ -31,7 +31,10 @@
 #ifndef _ROCM_DEBUG_AGENT_LOGGING_H
 #define _ROCM_DEBUG_AGENT_LOGGING_H 1
 
-#include <fstream>
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
 
 namespace amd::debug_agent
 {
@@ -50,13 +53,97 @@ enum class log_level_t
 
 extern log_level_t log_level;
 
-extern std::ofstream agent_out;
+/* Prefix the log messages with the time and the id of the thread.  */
+extern bool log_timestamps;
+
+extern std::ostream agent_out;
+
+struct agent_out_options_t
+{
+  /* The path of the output file, see open_agent_out.  The output is written
+     to stderr if not specified.  */
+  std::optional<std::string> path_template;
+  /* The output is accumulated in a buffer of this size, and is only written
+     when the buffer is full or when agent_out is flushed.  */
+  std::size_t buffer_size{ 1 << 20 };
+  /* If specified, the output is written by a separate thread, which is
+     handed the output through a ring buffer of this size.  */
+  std::optional<std::size_t> ring_size;
+  /* If specified, the output is compressed with this gzip level.  */
+  std::optional<int> compression_level;
+};
+
+/* Direct agent_out to the file named after OPTIONS.path_template, or to
+   stderr.  The file is created when the first output is written, and the
+   following sequences are replaced in its name:
+     %p  the process id
+     %h  the host name
+     %t  the creation time, formatted as YYYYMMDDTHHMMSS
+     %r  the MPI rank, or 0 if not running in an MPI job
+     %n  the dump sequence number (see next_agent_out_dump)
+     %%  a single %
+   If the file cannot be created, the output is written to stderr.
+
+   When compressed, each block of output written to the file is a complete
+   gzip member, so the blocks of a truncated file can still be
+   decompressed.  */
+void open_agent_out (const agent_out_options_t &options);
+
+/* Return PATH_TEMPLATE with its % sequences replaced as in the name of the
+   agent_out file, %n being replaced by SEQUENCE.  An unknown sequence is kept
+   as is.  */
+std::string expand_path_template (const std::string &path_template,
+                                  std::size_t sequence);
+
+/* Increment the dump sequence number, starting from 0 for the output printed
+   before the first dump.  If the path template contains %n, the following
+   output is written to a new file.  */
+void next_agent_out_dump ();
+
+/* Write all the output, and wait for the writer thread to complete and
+   exit.  The output written to agent_out afterwards is written directly.
+   Must be called before aborting the process.  */
+void drain_agent_out ();
+
+/* Make the calling thread the only writer of agent_out while it exists.
+   The log messages of the other threads are queued meanwhile, and written
+   when the thread's outermost agent_out_lock_t is destroyed, so that they do
+   not end up in the middle of a dump.  A thread may take it again while
+   holding it.  */
+class agent_out_lock_t
+{
+public:
+  agent_out_lock_t ();
+  ~agent_out_lock_t ();
+
+  agent_out_lock_t (const agent_out_lock_t &) = delete;
+  agent_out_lock_t &operator= (const agent_out_lock_t &) = delete;
+};
+
+/* Write agent_out to the connected socket SOCKET_FD instead of its file,
+   until restore_agent_out is called.  SOCKET_FD is not closed.  Once a write
+   fails, because the peer went away or its send timeout expired, agent_out
+   is in a failed state and the output is discarded, instead of raising
+   SIGPIPE or blocking.  Must be
+   called with an agent_out_lock_t held until restore_agent_out returns, so
+   only the messages logged by the calling thread are redirected.  */
+void redirect_agent_out (int socket_fd);
+
+/* Write the output redirected by redirect_agent_out to its socket, and
+   write agent_out to its file again.  */
+void restore_agent_out ();
+
+/* Return the number of bytes written to agent_out since it was opened,
+   including the bytes still in its buffer.  */
+std::size_t agent_out_bytes ();
 
 namespace detail
 {
 
 /* A macro instead of a variadic template so that the __VAR_ARGS__ are not
-   evaluated unless the log level indicated they are needed.  */
+   evaluated unless the log level indicated they are needed.  The message is
+   formatted in a thread-local buffer and written as a single line.  The
+   messages from one call site are rate limited.  */
 extern void log (log_level_t level, const char *format, ...)
 #if defined(__GNUC__)
     __attribute__ ((format (printf, 2, 3)))
@@ -75,6 +162,9 @@ extern void log (log_level_t level, const char *format, ...)
 
 void set_log_level (log_level_t level);
 
+/* Print a message reported by the debugger API library.  */
+void log_dbgapi_message (const char *message);
+
 } /* namespace amd::debug_agent */
 
 #endif /* _ROCM_DEBUG_AGENT_LOGGING_H */
@@ -0,0 +1,472 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "pc_sampler.h"
+#include "code_object.h"
+#include "debug.h"
+#include "logging.h"
+#include "session.h"
+
+#include <amd-dbgapi.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace amd::debug_agent
+{
+
+namespace
+{
+
+struct pc_sample_t
+{
+  amd_dbgapi_global_address_t pc;
+  /* The entry address of the kernel of the wave's dispatch, 0 if it is not
+     known.  */
+  amd_dbgapi_global_address_t kernel_entry;
+};
+
+class pc_sampler_t
+{
+public:
+  pc_sampler_t (std::chrono::microseconds interval, std::string output_path)
+      : m_interval (interval), m_output_path (std::move (output_path))
+  {
+  }
+
+  void start ();
+  void stop ();
+
+private:
+  void run ();
+  void sample (amd_dbgapi_process_id_t process_id);
+  amd_dbgapi_global_address_t
+  kernel_entry (amd_dbgapi_process_id_t process_id,
+                amd_dbgapi_dispatch_id_t dispatch_id);
+  void update_code_objects (amd_dbgapi_process_id_t process_id);
+  code_object_t *find_code_object (amd_dbgapi_global_address_t address) const;
+  void fold_interval_samples ();
+  const std::string &frame (const pc_sample_t &sample);
+  void write_histogram () const;
+
+  const std::chrono::microseconds m_interval;
+  const std::string m_output_path;
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stop_requested{ false };
+
+  /* All the fields below are only accessed by the sampling thread while it
+     is running, and by stop once the thread is joined, so they do not need
+     to be protected.  */
+
+  /* Samples recorded during the current interval.  The buffer is reused
+     from one interval to the next so that recording a sample while the
+     waves are halted never allocates.  */
+  std::vector<pc_sample_t> m_interval_samples;
+
+  /* The kernel entry address of the dispatches sampled during the current
+     interval, reused like m_interval_samples.  */
+  std::vector<std::pair<decltype (amd_dbgapi_dispatch_id_t::handle),
+                        amd_dbgapi_global_address_t>>
+      m_interval_kernels;
+
+  /* The loaded code objects, indexed by handle, and by load address.  The
+     samples of an interval are folded before the code objects are updated
+     at the start of the next one, so unloaded code objects are released.  */
+  std::unordered_map<decltype (amd_dbgapi_code_object_id_t::handle),
+                     std::unique_ptr<code_object_t>>
+      m_code_objects;
+  std::map<amd_dbgapi_global_address_t, code_object_t *> m_code_object_map;
+
+  /* Folded-stack frame for each kernel entry address and pc sampled since
+     the code objects were last updated.  */
+  std::map<std::pair<amd_dbgapi_global_address_t, amd_dbgapi_global_address_t>,
+           std::string>
+      m_frame_cache;
+
+  /* Number of samples for each folded-stack frame.  */
+  std::map<std::string, uint64_t> m_histogram;
+
+  uint64_t m_sample_count{ 0 };
+  uint64_t m_interval_count{ 0 };
+  std::chrono::steady_clock::duration m_halted_time{};
+  std::chrono::steady_clock::time_point m_start_time;
+};
+
+void
+pc_sampler_t::start ()
+{
+  m_start_time = std::chrono::steady_clock::now ();
+
+  {
+    std::scoped_lock lock (dbgapi_lock);
+    attach_process ();
+  }
+
+  m_thread = std::thread ([this] () { run (); });
+}
+
+void
+pc_sampler_t::stop ()
+{
+  {
+    std::scoped_lock lock (m_mutex);
+    m_stop_requested = true;
+  }
+  m_cv.notify_one ();
+  m_thread.join ();
+
+  {
+    std::scoped_lock lock (dbgapi_lock);
+    detach_process ();
+  }
+
+  write_histogram ();
+
+  const auto elapsed = std::chrono::steady_clock::now () - m_start_time;
+  const auto halted_us
+      = std::chrono::duration_cast<std::chrono::microseconds> (m_halted_time)
+            .count ();
+
+  agent_out_lock_t out_lock;
+  agent_out << "PC sampling: " << std::dec << m_sample_count
+            << " samples in " << m_interval_count << " intervals, "
+            << (m_interval_count ? halted_us / m_interval_count : 0)
+            << "us average pause, " << std::fixed << std::setprecision (2)
+            << (elapsed.count () ? 100.0 * m_halted_time.count ()
+                                       / elapsed.count ()
+                                 : 0.0)
+            << "% of the wall time spent with the waves halted" << std::endl;
+}
+
+void
+pc_sampler_t::run ()
+{
+  /* Signals are handled by the application threads, a SIGQUIT dump must not
+     be started from this thread while it holds the debugger API lock.  */
+  sigset_t signal_set;
+  sigemptyset (&signal_set);
+  sigaddset (&signal_set, SIGQUIT);
+  pthread_sigmask (SIG_BLOCK, &signal_set, nullptr);
+
+  std::unique_lock lock (m_mutex);
+  while (!m_cv.wait_for (lock, m_interval, [this] () {
+    return m_stop_requested;
+  }))
+    {
+      lock.unlock ();
+
+      const auto interval_start = std::chrono::steady_clock::now ();
+      {
+        std::scoped_lock session_lock (dbgapi_lock);
+        sample (attach_process ());
+        detach_process ();
+      }
+      m_halted_time += std::chrono::steady_clock::now () - interval_start;
+      ++m_interval_count;
+
+      /* Symbolize the samples after the waves are resumed, without holding
+         dbgapi_lock so that a fault dump is not delayed.  The symbol and
+         line lookups make no debugger API call: the ELF files read from the
+         process's memory are never released by the code object memory
+         limit, and the others are read again from their file.  */
+      fold_interval_samples ();
+
+      lock.lock ();
+    }
+}
+
+void
+pc_sampler_t::sample (amd_dbgapi_process_id_t process_id)
+{
+  update_code_objects (process_id);
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_progress (
+      process_id, AMD_DBGAPI_PROGRESS_NO_FORWARD));
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_wave_creation (
+      process_id, AMD_DBGAPI_WAVE_CREATION_STOP));
+
+  stop_all_wavefronts (process_id);
+
+  amd_dbgapi_wave_id_t *wave_ids;
+  size_t wave_count;
+  DBGAPI_CHECK (
+      amd_dbgapi_wave_list (process_id, &wave_count, &wave_ids, nullptr));
+
+  for (size_t i = 0; i < wave_count; ++i)
+    {
+      amd_dbgapi_wave_id_t wave_id = wave_ids[i];
+
+      std::underlying_type_t<amd_dbgapi_wave_stop_reason_t> stop_reason;
+      DBGAPI_CHECK (amd_dbgapi_wave_get_info (
+          process_id, wave_id, AMD_DBGAPI_WAVE_INFO_STOP_REASON,
+          sizeof (stop_reason), &stop_reason));
+
+      /* Waves stopped for another reason than the sampler halting them are
+         not executing, sampling them would skew the histogram.  */
+      if (stop_reason != AMD_DBGAPI_WAVE_STOP_REASON_NONE)
+        continue;
+
+      pc_sample_t sample{};
+      DBGAPI_CHECK (amd_dbgapi_wave_get_info (process_id, wave_id,
+                                              AMD_DBGAPI_WAVE_INFO_PC,
+                                              sizeof (sample.pc), &sample.pc));
+
+      if (amd_dbgapi_dispatch_id_t dispatch_id;
+          amd_dbgapi_wave_get_info (process_id, wave_id,
+                                    AMD_DBGAPI_WAVE_INFO_DISPATCH,
+                                    sizeof (dispatch_id), &dispatch_id)
+          == AMD_DBGAPI_STATUS_SUCCESS)
+        sample.kernel_entry = kernel_entry (process_id, dispatch_id);
+
+      m_interval_samples.emplace_back (sample);
+
+      DBGAPI_CHECK (amd_dbgapi_wave_resume (process_id, wave_id,
+                                            AMD_DBGAPI_RESUME_MODE_NORMAL));
+    }
+
+  free (wave_ids);
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_wave_creation (
+      process_id, AMD_DBGAPI_WAVE_CREATION_NORMAL));
+
+  DBGAPI_CHECK (amd_dbgapi_process_set_progress (process_id,
+                                                 AMD_DBGAPI_PROGRESS_NORMAL));
+}
+
+/* Return the entry address of the kernel of `dispatch_id`, only queried
+   once per interval for all the waves of a dispatch.  */
+amd_dbgapi_global_address_t
+pc_sampler_t::kernel_entry (amd_dbgapi_process_id_t process_id,
+                            amd_dbgapi_dispatch_id_t dispatch_id)
+{
+  /* Few dispatches run at once, and the waves of a dispatch are usually
+     listed together, so search from the most recent one.  */
+  for (auto it = m_interval_kernels.rbegin ();
+       it != m_interval_kernels.rend (); ++it)
+    if (it->first == dispatch_id.handle)
+      return it->second;
+
+  amd_dbgapi_global_address_t address;
+  if (amd_dbgapi_dispatch_get_info (
+          process_id, dispatch_id,
+          AMD_DBGAPI_DISPATCH_INFO_KERNEL_CODE_ENTRY_ADDRESS, sizeof (address),
+          &address)
+      != AMD_DBGAPI_STATUS_SUCCESS)
+    address = 0;
+
+  m_interval_kernels.emplace_back (dispatch_id.handle, address);
+  return address;
+}
+
+void
+pc_sampler_t::update_code_objects (amd_dbgapi_process_id_t process_id)
+{
+  amd_dbgapi_code_object_id_t *code_object_ids{ nullptr };
+  size_t code_object_count{ 0 };
+  amd_dbgapi_changed_t changed{ AMD_DBGAPI_CHANGED_YES };
+
+  /* The dumps do not use the debugger API's change tracking, so it can be
+     relied on once the code objects were listed.  */
+  DBGAPI_CHECK (amd_dbgapi_code_object_list (
+      process_id, &code_object_count, &code_object_ids,
+      m_code_objects.empty () ? nullptr : &changed));
+
+  if (changed == AMD_DBGAPI_CHANGED_NO)
+    return;
+
+  m_code_object_map.clear ();
+  m_frame_cache.clear ();
+
+  /* Only keep the code objects that are still loaded.  */
+  decltype (m_code_objects) loaded_code_objects;
+
+  for (size_t i = 0; i < code_object_count; ++i)
+    {
+      auto it = m_code_objects.find (code_object_ids[i].handle);
+      if (it != m_code_objects.end ())
+        {
+          it = loaded_code_objects
+                   .emplace (it->first, std::move (it->second))
+                   .first;
+        }
+      else
+        {
+          auto code_object = std::make_unique<code_object_t> (
+              process_id, code_object_ids[i]);
+
+          code_object->open ();
+          if (!code_object->is_open ())
+            {
+              agent_warning ("could not open code_object_%ld",
+                             code_object_ids[i].handle);
+              continue;
+            }
+
+          it = loaded_code_objects
+                   .emplace (code_object_ids[i].handle,
+                             std::move (code_object))
+                   .first;
+        }
+
+      m_code_object_map.emplace (it->second->load_address (),
+                                 it->second.get ());
+    }
+
+  m_code_objects = std::move (loaded_code_objects);
+  free (code_object_ids);
+}
+
+code_object_t *
+pc_sampler_t::find_code_object (amd_dbgapi_global_address_t address) const
+{
+  if (auto it = m_code_object_map.upper_bound (address);
+      it != m_code_object_map.begin ())
+    if (auto [load_address, candidate] = *std::prev (it);
+        (address - load_address) <= candidate->mem_size ())
+      return candidate;
+
+  return nullptr;
+}
+
+/* Return the folded-stack frame of `sample`: its kernel, the function
+   that contains its pc if it is not the kernel, and its source line.  */
+const std::string &
+pc_sampler_t::frame (const pc_sample_t &sample)
+{
+  const amd_dbgapi_global_address_t pc = sample.pc;
+  if (auto it = m_frame_cache.find ({ sample.kernel_entry, pc });
+      it != m_frame_cache.end ())
+    return it->second;
+
+  std::stringstream ss;
+
+  code_object_t *kernel_code_object
+      = sample.kernel_entry ? find_code_object (sample.kernel_entry) : nullptr;
+  auto kernel = kernel_code_object
+                    ? kernel_code_object->find_symbol (sample.kernel_entry)
+                    : std::optional<code_object_t::symbol_info_t>{};
+
+  code_object_t *code_object = find_code_object (pc);
+  auto symbol = code_object ? code_object->find_symbol (pc)
+                            : std::optional<code_object_t::symbol_info_t>{};
+
+  if (kernel)
+    ss << kernel->m_name << ";";
+  else
+    ss << "[unknown kernel];";
+
+  if (!symbol)
+    ss << "[unknown];";
+  else if (!kernel || symbol->m_name != kernel->m_name)
+    ss << symbol->m_name << ";";
+
+  if (auto line = code_object ? code_object->find_line (pc) : std::nullopt)
+    ss << line->first << ":" << std::dec << line->second;
+  else if (symbol)
+    ss << "+0x" << std::hex << (pc - symbol->m_value);
+  else
+    ss << "0x" << std::hex << pc;
+
+  return m_frame_cache.try_emplace ({ sample.kernel_entry, pc }, ss.str ())
+      .first->second;
+}
+
+void
+pc_sampler_t::fold_interval_samples ()
+{
+  for (auto &&sample : m_interval_samples)
+    ++m_histogram[frame (sample)];
+
+  m_sample_count += m_interval_samples.size ();
+  m_interval_samples.clear ();
+  m_interval_kernels.clear ();
+}
+
+void
+pc_sampler_t::write_histogram () const
+{
+  std::ofstream file (m_output_path);
+  if (!file)
+    {
+      agent_warning ("could not open `%s'", m_output_path.c_str ());
+      return;
+    }
+
+  for (auto &&[frame, count] : m_histogram)
+    file << frame << " " << count << "\n";
+
+  if (!file.good ())
+    agent_warning ("could not write the pc samples to `%s'",
+                   m_output_path.c_str ());
+}
+
+std::unique_ptr<pc_sampler_t> pc_sampler;
+
+} /* namespace */
+
+void
+start_pc_sampling (std::chrono::microseconds interval,
+                   const std::string &output_path)
+{
+  agent_assert (!pc_sampler && "pc sampling is already started");
+
+  pc_sampler = std::make_unique<pc_sampler_t> (interval, output_path);
+  pc_sampler->start ();
+}
+
+void
+stop_pc_sampling ()
+{
+  if (!pc_sampler)
+    return;
+
+  pc_sampler->stop ();
+  pc_sampler.reset ();
+}
+
+} /* namespace amd::debug_agent */
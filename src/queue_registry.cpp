@@ -0,0 +1,257 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "queue_registry.h"
+
+#include <cstdint>
+#include <iomanip>
+#include <utility>
+
+namespace amd::debug_agent
+{
+
+namespace
+{
+
+/* Number of records allocated at once.  */
+constexpr std::size_t slab_size = 64;
+
+/* Records freed by threads which already cached enough of them, or which
+   exited.  */
+std::mutex pool_lock;
+callback_and_data_t *pool_records{ nullptr };
+
+struct thread_cache_t
+{
+  ~thread_cache_t ()
+  {
+    while (records)
+      release (slab_size);
+  }
+
+  /* Move COUNT records, or all of them if fewer, to the shared pool.  */
+  void
+  release (std::size_t count)
+  {
+    callback_and_data_t *first = records, *last = records;
+    std::size_t released = 1;
+    for (; released < count && last->next; ++released)
+      last = last->next;
+
+    records = last->next;
+    record_count -= released;
+
+    std::scoped_lock lock (pool_lock);
+    last->next = pool_records;
+    pool_records = first;
+  }
+
+  callback_and_data_t *records{ nullptr };
+  std::size_t record_count{ 0 };
+};
+
+thread_local thread_cache_t thread_cache;
+
+} /* namespace */
+
+/* Never destroyed, so that the error callbacks remain valid while the runtime
+   shuts down.  */
+queue_callback_registry_t &queue_registry = *new queue_callback_registry_t;
+
+std::ostream &
+operator<< (std::ostream &os, const queue_info_t &info)
+{
+  const std::ios_base::fmtflags flags = os.flags ();
+  const char fill = os.fill ();
+
+  os << std::dec << "hsa_queue_" << info.id << " (";
+
+  switch (info.type)
+    {
+    case HSA_QUEUE_TYPE_MULTI:
+      os << "multi";
+      break;
+    case HSA_QUEUE_TYPE_SINGLE:
+      os << "single";
+      break;
+    default:
+      os << "type " << info.type;
+      break;
+    }
+
+  struct tm tm;
+  localtime_r (&info.creation_time.tv_sec, &tm);
+
+  os << ", " << info.size << " packets, private_segment_size="
+     << info.private_segment_size
+     << ", group_segment_size=" << info.group_segment_size
+     << ", created at " << std::right << std::setfill ('0') << std::setw (2)
+     << tm.tm_hour << ':' << std::setw (2) << tm.tm_min << ':'
+     << std::setw (2) << tm.tm_sec << '.' << std::setw (6)
+     << info.creation_time.tv_nsec / 1000 << " by thread "
+     << info.creation_tid << ")";
+
+  os.fill (fill);
+  os.flags (flags);
+  return os;
+}
+
+callback_and_data_t *
+queue_callback_registry_t::allocate (
+    void (*callback) (hsa_status_t, hsa_queue_t *, void *), void *data)
+{
+  thread_cache_t &cache = thread_cache;
+
+  if (!cache.records)
+    {
+      std::size_t count{ 0 };
+      {
+        std::scoped_lock lock (pool_lock);
+        cache.records = std::exchange (pool_records, nullptr);
+      }
+
+      if (cache.records)
+        for (callback_and_data_t *record = cache.records; record;
+             record = record->next)
+          ++count;
+      else
+        {
+          /* The slabs are never freed, the runtime may invoke a queue's
+             error callback until the process exits.  */
+          callback_and_data_t *slab = new callback_and_data_t[slab_size];
+          for (std::size_t i = 0; i + 1 < slab_size; ++i)
+            slab[i].next = &slab[i + 1];
+          cache.records = slab;
+          count = slab_size;
+        }
+
+      cache.record_count = count;
+    }
+
+  callback_and_data_t *record = cache.records;
+  cache.records = record->next;
+  --cache.record_count;
+
+  *record = { callback, data, {}, nullptr, nullptr };
+  return record;
+}
+
+void
+queue_callback_registry_t::deallocate (callback_and_data_t *record)
+{
+  thread_cache_t &cache = thread_cache;
+
+  record->next = cache.records;
+  cache.records = record;
+
+  /* Do not let a thread destroying the queues created by others hoard the
+     records.  */
+  if (++cache.record_count > 2 * slab_size)
+    cache.release (slab_size);
+}
+
+queue_callback_registry_t::shard_t &
+queue_callback_registry_t::queue_shard (const hsa_queue_t *queue)
+{
+  /* The low bits of a queue address are always 0, multiply by the golden
+     ratio to mix the others into the high bits.  */
+  uint64_t hash
+      = (reinterpret_cast<uintptr_t> (queue) >> 6) * 0x9e3779b97f4a7c15ull;
+  return m_shards[(hash >> 32) % shard_count];
+}
+
+void
+queue_callback_registry_t::insert (hsa_queue_t *queue,
+                                   callback_and_data_t *record)
+{
+  shard_t &shard = queue_shard (queue);
+  std::scoped_lock lock (shard.lock);
+
+  record->queue = queue;
+  record->next = shard.records;
+  shard.records = record;
+}
+
+void
+queue_callback_registry_t::erase (hsa_queue_t *queue)
+{
+  callback_and_data_t *record{ nullptr };
+
+  {
+    shard_t &shard = queue_shard (queue);
+    std::scoped_lock lock (shard.lock);
+
+    for (callback_and_data_t **link = &shard.records; *link;
+         link = &(*link)->next)
+      if ((*link)->queue == queue)
+        {
+          record = *link;
+          *link = record->next;
+          break;
+        }
+  }
+
+  if (record)
+    deallocate (record);
+}
+
+std::vector<queue_info_t>
+queue_callback_registry_t::queues ()
+{
+  std::vector<queue_info_t> infos;
+
+  for (shard_t &shard : m_shards)
+    {
+      std::scoped_lock lock (shard.lock);
+      for (callback_and_data_t *record = shard.records; record;
+           record = record->next)
+        infos.emplace_back (record->info);
+    }
+
+  return infos;
+}
+
+std::size_t
+queue_callback_registry_t::size ()
+{
+  std::size_t count{ 0 };
+
+  for (shard_t &shard : m_shards)
+    {
+      std::scoped_lock lock (shard.lock);
+      for (callback_and_data_t *record = shard.records; record;
+           record = record->next)
+        ++count;
+    }
+
+  return count;
+}
+
+} /* namespace amd::debug_agent */
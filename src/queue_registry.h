@@ -0,0 +1,134 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_QUEUE_REGISTRY_H
+#define _ROCM_DEBUG_AGENT_QUEUE_REGISTRY_H 1
+
+#include <hsa/hsa.h>
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace amd::debug_agent
+{
+
+/* How a queue was created, recorded when it is created so that it can be
+   printed without querying the runtime or the debugger API.  */
+struct queue_info_t
+{
+  hsa_agent_t agent;
+  uint32_t size;
+  hsa_queue_type32_t type;
+  uint32_t private_segment_size;
+  uint32_t group_segment_size;
+  /* The runtime's id of the queue, and the address of its packets, which
+     the debugger API reports as the queue address.  */
+  uint64_t id;
+  uint64_t address;
+  struct timespec creation_time;
+  pid_t creation_tid;
+};
+
+/* Print "hsa_queue_ID (TYPE, SIZE packets, ...)".  */
+std::ostream &operator<< (std::ostream &os, const queue_info_t &info);
+
+/* The error callback and data an application passed to hsa_queue_create.
+   The agent registers its own callback, with a pointer to this record as
+   its data, and forwards the errors to the original callback.  */
+struct callback_and_data_t
+{
+  void (*callback) (hsa_status_t error_code, hsa_queue_t *source, void *data);
+  void *data;
+  queue_info_t info{};
+
+  /* The queue this record is registered for.  */
+  hsa_queue_t *queue{ nullptr };
+  /* The next record in the same shard, or in the same free list.  */
+  callback_and_data_t *next{ nullptr };
+};
+
+/* The callback records of all the queues, safe to use from concurrent
+   threads.  The records are indexed by queue in shards with their own lock,
+   so that threads creating and destroying different queues rarely contend.
+   Records are allocated from slabs, which are never freed, and recycled
+   through a per-thread cache, so that creating a queue neither allocates
+   memory nor takes another lock once the registry is warm.  */
+class queue_callback_registry_t
+{
+public:
+  /* Return a record for CALLBACK and DATA, which must be either inserted
+     or deallocated.  */
+  static callback_and_data_t *
+  allocate (void (*callback) (hsa_status_t, hsa_queue_t *, void *),
+            void *data);
+
+  /* Free RECORD, which was not inserted.  */
+  static void deallocate (callback_and_data_t *record);
+
+  /* Register RECORD, with its info filled in, for QUEUE.  */
+  void insert (hsa_queue_t *queue, callback_and_data_t *record);
+
+  /* Unregister and free the record registered for QUEUE, if any.  */
+  void erase (hsa_queue_t *queue);
+
+  /* Return the information recorded for all the registered queues.  */
+  std::vector<queue_info_t> queues ();
+
+  /* Return the number of records inserted.  */
+  std::size_t size ();
+
+private:
+  static constexpr std::size_t shard_count = 64;
+
+  struct alignas (64) shard_t
+  {
+    std::mutex lock;
+    /* The records registered for the queues hashing to this shard.  */
+    callback_and_data_t *records{ nullptr };
+  };
+
+  shard_t &queue_shard (const hsa_queue_t *queue);
+
+  std::array<shard_t, shard_count> m_shards;
+};
+
+/* The queues created by the application.  */
+extern queue_callback_registry_t &queue_registry;
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_QUEUE_REGISTRY_H */
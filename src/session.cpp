@@ -0,0 +1,342 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "session.h"
+#include "debug.h"
+#include "logging.h"
+#include "stats.h"
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+
+using namespace std::string_literals;
+
+namespace amd::debug_agent
+{
+
+std::mutex dbgapi_lock;
+
+namespace
+{
+
+amd_dbgapi_callbacks_t dbgapi_callbacks = {
+  /* allocate_memory.  */
+  .allocate_memory = malloc,
+
+  /* deallocate_memory.  */
+  .deallocate_memory = free,
+
+  /* get_os_pid.  */
+  .get_os_pid =
+      [] (amd_dbgapi_client_process_id_t client_process_id, pid_t *pid) {
+        *pid = getpid ();
+        return AMD_DBGAPI_STATUS_SUCCESS;
+      },
+
+  /* enable_notify_shared_library callback.  */
+  .enable_notify_shared_library =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          const char *library_name, amd_dbgapi_shared_library_id_t library_id,
+          amd_dbgapi_shared_library_state_t *library_state) {
+        /* If the debug agent is loaded, then the ROCR is already loaded.   */
+        *library_state = (library_name == "libhsa-runtime64.so.1"s)
+                             ? AMD_DBGAPI_SHARED_LIBRARY_STATE_LOADED
+                             : AMD_DBGAPI_SHARED_LIBRARY_STATE_UNLOADED;
+        return AMD_DBGAPI_STATUS_SUCCESS;
+      },
+
+  /* disable_notify_shared_library callback.  */
+  .disable_notify_shared_library =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_shared_library_id_t library_id) {
+        return AMD_DBGAPI_STATUS_SUCCESS;
+      },
+
+  /* get_symbol_address callback.  */
+  .get_symbol_address =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_shared_library_id_t library_id, const char *symbol_name,
+          amd_dbgapi_global_address_t *address) {
+        *address = reinterpret_cast<amd_dbgapi_global_address_t> (
+            dlsym (RTLD_DEFAULT, symbol_name));
+        return AMD_DBGAPI_STATUS_SUCCESS;
+      },
+
+  /* set_breakpoint callback.  */
+  .insert_breakpoint =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_shared_library_id_t shared_library_id,
+          amd_dbgapi_global_address_t address,
+          amd_dbgapi_breakpoint_id_t breakpoint_id) {
+        return AMD_DBGAPI_STATUS_SUCCESS;
+      },
+
+  /* remove_breakpoint callback.  */
+  .remove_breakpoint =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_breakpoint_id_t breakpoint_id) {
+        return AMD_DBGAPI_STATUS_SUCCESS;
+      },
+
+  /* log_message callback.  */
+  .log_message =
+      [] (amd_dbgapi_log_level_t level, const char *message) {
+        log_dbgapi_message (message);
+      }
+};
+
+/* Return the debugger API log level matching the agent's.  */
+amd_dbgapi_log_level_t
+dbgapi_log_level ()
+{
+  switch (log_level)
+    {
+    case log_level_t::none:
+      return AMD_DBGAPI_LOG_LEVEL_NONE;
+    case log_level_t::info:
+      return AMD_DBGAPI_LOG_LEVEL_INFO;
+    case log_level_t::warning:
+      return AMD_DBGAPI_LOG_LEVEL_WARNING;
+    case log_level_t::error:
+      break;
+    }
+  return AMD_DBGAPI_LOG_LEVEL_FATAL_ERROR;
+}
+
+amd_dbgapi_process_id_t session_process_id;
+size_t session_refcount{ 0 };
+size_t session_count{ 0 };
+
+} /* namespace */
+
+amd_dbgapi_process_id_t
+attach_process ()
+{
+  /* Also apply a log level changed since the session was attached.  */
+  amd_dbgapi_set_log_level (dbgapi_log_level ());
+
+  if (session_refcount++)
+    return session_process_id;
+
+  static stat_site_t timer_site ("process_attach");
+  scoped_timer_t timer (timer_site);
+  ++session_count;
+
+  DBGAPI_CHECK (amd_dbgapi_initialize (&dbgapi_callbacks));
+
+  DBGAPI_CHECK (amd_dbgapi_process_attach (
+      reinterpret_cast<amd_dbgapi_client_process_id_t> (&session_process_id),
+      &session_process_id));
+
+  /* Check the runtime state.  */
+  while (true)
+    {
+      amd_dbgapi_event_id_t event_id;
+      amd_dbgapi_event_kind_t event_kind;
+
+      DBGAPI_CHECK (amd_dbgapi_next_pending_event (session_process_id,
+                                                   &event_id, &event_kind));
+
+      if (event_kind == AMD_DBGAPI_EVENT_KIND_RUNTIME)
+        {
+          amd_dbgapi_runtime_state_t runtime_state;
+
+          DBGAPI_CHECK (amd_dbgapi_event_get_info (
+              session_process_id, event_id,
+              AMD_DBGAPI_EVENT_INFO_RUNTIME_STATE, sizeof (runtime_state),
+              &runtime_state));
+
+          switch (runtime_state)
+            {
+            case AMD_DBGAPI_RUNTIME_STATE_LOADED_SUCCESS:
+              break;
+
+            case AMD_DBGAPI_RUNTIME_STATE_UNLOADED:
+              agent_error ("invalid runtime state %d", runtime_state);
+
+            case AMD_DBGAPI_RUNTIME_STATE_LOADED_ERROR_RESTRICTION:
+              agent_error ("unable to enable GPU debugging due to a "
+                           "restriction error");
+              break;
+            }
+        }
+
+      /* No more events.  */
+      if (event_kind == AMD_DBGAPI_EVENT_KIND_NONE)
+        break;
+    }
+
+  return session_process_id;
+}
+
+void
+detach_process ()
+{
+  agent_assert (session_refcount && "process is not attached");
+
+  if (--session_refcount)
+    return;
+
+  static stat_site_t timer_site ("process_detach");
+  scoped_timer_t timer (timer_site);
+
+  DBGAPI_CHECK (amd_dbgapi_process_detach (session_process_id));
+  DBGAPI_CHECK (amd_dbgapi_finalize ());
+}
+
+size_t
+session_id ()
+{
+  return session_refcount ? session_count : 0;
+}
+
+void
+stop_wavefronts (amd_dbgapi_process_id_t process_id,
+                 const std::function<bool (amd_dbgapi_wave_id_t)> &filter)
+{
+  using wave_handle_type_t = decltype (amd_dbgapi_wave_id_t::handle);
+  std::unordered_set<wave_handle_type_t> already_stopped;
+  std::unordered_set<wave_handle_type_t> waiting_to_stop;
+  /* The waves that do not match the filter, only checked once.  */
+  std::unordered_set<wave_handle_type_t> ignored;
+  static stat_site_t timer_site ("stop_wavefronts");
+  scoped_timer_t timer (timer_site);
+
+  agent_log (log_level_t::info, "stopping wavefronts");
+  for (size_t iter = 0;; ++iter)
+    {
+      agent_log (log_level_t::info, "iteration %zu:", iter);
+
+      while (true)
+        {
+          amd_dbgapi_event_id_t event_id;
+          amd_dbgapi_event_kind_t kind;
+
+          DBGAPI_CHECK (
+              amd_dbgapi_next_pending_event (process_id, &event_id, &kind));
+
+          if (event_id.handle == AMD_DBGAPI_EVENT_NONE.handle)
+            break;
+
+          if (kind == AMD_DBGAPI_EVENT_KIND_WAVE_STOP)
+            {
+              amd_dbgapi_wave_id_t wave_id;
+              DBGAPI_CHECK (amd_dbgapi_event_get_info (
+                  process_id, event_id, AMD_DBGAPI_EVENT_INFO_WAVE,
+                  sizeof (wave_id), &wave_id));
+
+              waiting_to_stop.erase (wave_id.handle);
+              already_stopped.emplace (wave_id.handle);
+
+              agent_log (log_level_t::info, "wave_%ld is stopped",
+                         wave_id.handle);
+            }
+        }
+
+      amd_dbgapi_wave_id_t *wave_ids;
+      size_t wave_count;
+      DBGAPI_CHECK (
+          amd_dbgapi_wave_list (process_id, &wave_count, &wave_ids, nullptr));
+
+      /* Stop all waves that are still running.  */
+      for (size_t i = 0; i < wave_count; ++i)
+        {
+          amd_dbgapi_wave_id_t wave_id = wave_ids[i];
+
+          if (already_stopped.find (wave_id.handle) != already_stopped.end ()
+              || ignored.find (wave_id.handle) != ignored.end ())
+            continue;
+
+          /* Already requested to stop.  */
+          if (waiting_to_stop.find (wave_id.handle) != waiting_to_stop.end ())
+            {
+              agent_log (log_level_t::info, "wave_%ld is still stopping",
+                         wave_id.handle);
+              continue;
+            }
+
+          if (!filter (wave_id))
+            {
+              ignored.emplace (wave_id.handle);
+              continue;
+            }
+
+          /* The session may have been held since an earlier call, which
+             already consumed the stop events of the waves stopped by an
+             exception.  Those waves are still stopped.  */
+          amd_dbgapi_wave_state_t state;
+          DBGAPI_CHECK (amd_dbgapi_wave_get_info (process_id, wave_id,
+                                                  AMD_DBGAPI_WAVE_INFO_STATE,
+                                                  sizeof (state), &state));
+
+          if (state == AMD_DBGAPI_WAVE_STATE_STOP)
+            {
+              already_stopped.emplace (wave_id.handle);
+              continue;
+            }
+
+          agent_log (log_level_t::info,
+                     "wave_%ld is running, sending stop request",
+                     wave_id.handle);
+
+          /* FIXME: The wave could be single-stepping, how are we going to
+             restore the state?  A wave that stopped on its own since its
+             state was queried is waited for like the others, its stop event
+             is pending.  */
+          if (amd_dbgapi_status_t status
+              = DBGAPI_TIMED (amd_dbgapi_wave_stop (process_id, wave_id));
+              status != AMD_DBGAPI_STATUS_SUCCESS
+              && status != AMD_DBGAPI_STATUS_ERROR_WAVE_STOPPED)
+            agent_error ("amd_dbgapi_wave_stop failed (rc=%d)", status);
+
+          waiting_to_stop.emplace (wave_id.handle);
+        }
+
+      free (wave_ids);
+
+      if (!waiting_to_stop.size ())
+        break;
+    }
+
+  agent_log (log_level_t::info, "wavefronts are stopped");
+}
+
+void
+stop_all_wavefronts (amd_dbgapi_process_id_t process_id)
+{
+  stop_wavefronts (process_id, [] (amd_dbgapi_wave_id_t) { return true; });
+}
+
+} /* namespace amd::debug_agent */
@@ -0,0 +1,77 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_SESSION_H
+#define _ROCM_DEBUG_AGENT_SESSION_H 1
+
+#include <amd-dbgapi.h>
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+namespace amd::debug_agent
+{
+
+/* The debugger API is not thread-safe, all calls to it must be made while
+   holding this lock.  */
+extern std::mutex dbgapi_lock;
+
+/* Return the debugger API process for this process.  The debugger API is
+   loaded, initialized and attached on the first call, later calls reuse the
+   same session.  Each call applies the current log level to the debugger
+   API.  Each call must be balanced by a call to detach_process.  dbgapi_lock
+   must be held.  */
+amd_dbgapi_process_id_t attach_process ();
+
+/* Release a reference to the session returned by attach_process, the process
+   is detached and the debugger API finalized when the last reference is
+   released.  dbgapi_lock must be held.  */
+void detach_process ();
+
+/* Return an identifier of the current session, different for each
+   attach_process call that attaches the process, or 0 if the process is not
+   attached.  dbgapi_lock must be held.  */
+std::size_t session_id ();
+
+/* Stop the waves of `process_id` for which `filter` returns true, and wait
+   for them to report that they are stopped.  The other waves keep running.
+   dbgapi_lock must be held.  */
+void stop_wavefronts (
+    amd_dbgapi_process_id_t process_id,
+    const std::function<bool (amd_dbgapi_wave_id_t)> &filter);
+
+/* Stop all the waves of `process_id` and wait for them to report that they
+   are stopped.  dbgapi_lock must be held.  */
+void stop_all_wavefronts (amd_dbgapi_process_id_t process_id);
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_SESSION_H */
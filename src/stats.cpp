@@ -0,0 +1,185 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#include "stats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace amd::debug_agent
+{
+
+bool stats_enabled{ false };
+
+namespace
+{
+
+std::mutex stats_lock;
+
+/* Counters indexed by the address of the name passed by the call site, which
+   is a string literal.  */
+std::unordered_map<const char *, std::unique_ptr<stat_counter_t>> counters;
+
+size_t
+bucket_index (uint64_t ns)
+{
+  if (ns < stat_counter_t::linear_buckets)
+    return ns;
+
+  /* 63 - clz is the index of the most significant bit, which is >= 4.  */
+  size_t msb = 63 - __builtin_clzll (ns);
+  size_t sub_bucket = (ns >> (msb - 3)) & 7;
+  return std::min (stat_counter_t::linear_buckets + (msb - 4) * 8
+                       + sub_bucket,
+                   stat_counter_t::bucket_count - 1);
+}
+
+uint64_t
+bucket_value (size_t index)
+{
+  if (index < stat_counter_t::linear_buckets)
+    return index;
+
+  size_t msb = (index - stat_counter_t::linear_buckets) / 8 + 4;
+  size_t sub_bucket = (index - stat_counter_t::linear_buckets) % 8;
+  return (uint64_t{ 8 } | sub_bucket) << (msb - 3);
+}
+
+} /* namespace */
+
+/* The counters of all call sites with the same name, merged.  */
+class stat_summary_t
+{
+public:
+  void
+  merge (stat_counter_t &counter, bool reset)
+  {
+    auto take = [reset] (std::atomic<uint64_t> &value) {
+      return reset ? value.exchange (0, std::memory_order_relaxed)
+                   : value.load (std::memory_order_relaxed);
+    };
+
+    m_count += take (counter.m_count);
+    m_total_ns += take (counter.m_total_ns);
+    m_bytes += take (counter.m_bytes);
+    for (size_t i = 0; i < stat_counter_t::bucket_count; ++i)
+      m_buckets[i] += take (counter.m_buckets[i]);
+  }
+
+  uint64_t
+  percentile (double fraction) const
+  {
+    uint64_t rank = fraction * m_count;
+    uint64_t seen{ 0 };
+    for (size_t i = 0; i < stat_counter_t::bucket_count; ++i)
+      if ((seen += m_buckets[i]) > rank)
+        return bucket_value (i);
+    return 0;
+  }
+
+  uint64_t m_count{ 0 };
+  uint64_t m_total_ns{ 0 };
+  uint64_t m_bytes{ 0 };
+  std::array<uint64_t, stat_counter_t::bucket_count> m_buckets{};
+};
+
+void
+stat_counter_t::record (std::chrono::nanoseconds duration, size_t bytes)
+{
+  uint64_t ns = duration.count ();
+
+  m_count.fetch_add (1, std::memory_order_relaxed);
+  m_total_ns.fetch_add (ns, std::memory_order_relaxed);
+  m_bytes.fetch_add (bytes, std::memory_order_relaxed);
+  m_buckets[bucket_index (ns)].fetch_add (1, std::memory_order_relaxed);
+}
+
+stat_counter_t &
+stat_counter (const char *name)
+{
+  std::scoped_lock lock (stats_lock);
+
+  auto &counter = counters[name];
+  if (!counter)
+    {
+      /* Debugger API calls are recorded as "function (arguments)", only keep
+         the function name.  */
+      std::string str (name);
+      counter = std::make_unique<stat_counter_t> (
+          str.substr (0, str.find_first_of (" (")));
+    }
+
+  return *counter;
+}
+
+void
+print_stats (std::ostream &os, bool reset)
+{
+  std::map<std::string, stat_summary_t> summaries;
+  {
+    std::scoped_lock lock (stats_lock);
+    for (auto &&[name, counter] : counters)
+      summaries[counter->name ()].merge (*counter, reset);
+  }
+
+  auto us = [] (uint64_t ns) { return ns / 1000.0; };
+  const std::ios_base::fmtflags flags = os.flags ();
+  const std::streamsize precision = os.precision ();
+  const char fill = os.fill ();
+
+  os << "\nAgent statistics:\n"
+     << std::left << std::setfill (' ') << std::setw (48) << "  stage"
+     << std::right << std::setw (10) << "calls" << std::setw (14)
+     << "total (us)" << std::setw (12) << "p50 (us)" << std::setw (12)
+     << "p99 (us)" << std::setw (14) << "bytes" << '\n';
+
+  for (auto &&[name, summary] : summaries)
+    {
+      if (!summary.m_count)
+        continue;
+
+      os << std::left << std::setw (48) << ("  " + name) << std::right
+         << std::dec << std::fixed << std::setprecision (1) << std::setw (10)
+         << summary.m_count << std::setw (14) << us (summary.m_total_ns)
+         << std::setw (12) << us (summary.percentile (0.50)) << std::setw (12)
+         << us (summary.percentile (0.99)) << std::setw (14)
+         << summary.m_bytes << '\n';
+    }
+
+  os.flags (flags);
+  os.precision (precision);
+  os.fill (fill);
+}
+
+} /* namespace amd::debug_agent */
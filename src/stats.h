@@ -0,0 +1,144 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_STATS_H
+#define _ROCM_DEBUG_AGENT_STATS_H 1
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace amd::debug_agent
+{
+
+/* Set when the agent's self-profiling is enabled.  When clear, timers are a
+   single test of this flag.  */
+extern bool stats_enabled;
+
+/* Call count, latency distribution, and bytes transferred for one pipeline
+   stage or debugger API call kind.  */
+class stat_counter_t
+{
+public:
+  /* Latencies are recorded in a log-linear histogram: values below
+     `linear_buckets` ns have their own bucket, larger values are split in 8
+     sub-buckets per power of 2, which bounds the error to 12.5%.  */
+  static constexpr size_t linear_buckets = 16;
+  static constexpr size_t bucket_count = linear_buckets + 60 * 8;
+
+  explicit stat_counter_t (std::string name) : m_name (std::move (name)) {}
+
+  const std::string &name () const { return m_name; }
+
+  void record (std::chrono::nanoseconds duration, size_t bytes);
+
+private:
+  friend class stat_summary_t;
+
+  const std::string m_name;
+  std::atomic<uint64_t> m_count{ 0 };
+  std::atomic<uint64_t> m_total_ns{ 0 };
+  std::atomic<uint64_t> m_bytes{ 0 };
+  std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+};
+
+/* Return the counter for `name`.  Debugger API call sites pass the text of
+   the call, only the function name is kept.  */
+stat_counter_t &stat_counter (const char *name);
+
+/* A call site of a timer, which only looks up its counter the first time
+   it is timed.  Declared as a function-local static, which is constant
+   initialized, so it costs no guard.  */
+class stat_site_t
+{
+public:
+  constexpr explicit stat_site_t (const char *name) : m_name (name) {}
+
+  stat_counter_t &
+  counter ()
+  {
+    /* Threads racing to look up the counter all find the same one.  */
+    stat_counter_t *counter = m_counter.load (std::memory_order_acquire);
+    if (!counter)
+      {
+        counter = &stat_counter (m_name);
+        m_counter.store (counter, std::memory_order_release);
+      }
+    return *counter;
+  }
+
+private:
+  const char *const m_name;
+  std::atomic<stat_counter_t *> m_counter{ nullptr };
+};
+
+/* Measure the time from construction to destruction of this object, and
+   record it in the counter of `site`.  */
+class scoped_timer_t
+{
+public:
+  explicit scoped_timer_t (stat_site_t &site)
+  {
+    if (stats_enabled)
+      {
+        m_counter = &site.counter ();
+        m_start = std::chrono::steady_clock::now ();
+      }
+  }
+
+  ~scoped_timer_t ()
+  {
+    if (m_counter)
+      m_counter->record (std::chrono::steady_clock::now () - m_start,
+                         m_bytes);
+  }
+
+  scoped_timer_t (const scoped_timer_t &) = delete;
+  scoped_timer_t &operator= (const scoped_timer_t &) = delete;
+
+  void add_bytes (size_t bytes) { m_bytes += bytes; }
+
+private:
+  stat_counter_t *m_counter{ nullptr };
+  std::chrono::steady_clock::time_point m_start;
+  size_t m_bytes{ 0 };
+};
+
+/* Print a table of all the counters to `os`, and reset them if `reset` is
+   set.  */
+void print_stats (std::ostream &os, bool reset = true);
+
+} /* namespace amd::debug_agent */
+
+#endif /* _ROCM_DEBUG_AGENT_STATS_H */
@@ -0,0 +1,166 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Checks that allocation_tracker_t::find finds a fault anywhere in a large
+   allocation, whichever shard the faulting page hashes to, and the freed
+   allocations until they are evicted from the freed rings.  */
+
+#include "allocation_tracker.h"
+#include "unit_test.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace amd::debug_agent;
+
+namespace
+{
+
+constexpr uint64_t page_size = 4096;
+constexpr uint64_t base_address = 0x7f0000000000;
+
+void *
+as_pointer (uint64_t address)
+{
+  return reinterpret_cast<void *> (address);
+}
+
+void
+test_large_allocation ()
+{
+  auto tracker = std::make_unique<allocation_tracker_t> ();
+
+  /* The allocation is recorded in the shard of its first page, and most of
+     its pages hash to another shard.  */
+  constexpr std::size_t size = 64 * 1024 * 1024;
+  tracker->allocated (as_pointer (base_address), size, 1);
+
+  for (uint64_t offset = 0; offset < size; offset += 97 * page_size)
+    {
+      const std::vector<allocation_t> found
+          = tracker->find (base_address + offset, page_size);
+      CHECK_EQUAL (found.size (), 1u);
+      if (found.size () == 1)
+        {
+          CHECK_EQUAL (found[0].address, base_address);
+          CHECK_EQUAL (found[0].size, size);
+          CHECK (!found[0].freed);
+        }
+    }
+
+  CHECK_EQUAL (tracker->find (base_address + size - page_size, page_size)
+                   .size (),
+               1u);
+  CHECK (tracker->find (base_address + size, page_size).empty ());
+  CHECK (tracker->find (base_address - page_size, page_size).empty ());
+}
+
+void
+test_adjacent_allocations ()
+{
+  auto tracker = std::make_unique<allocation_tracker_t> ();
+
+  tracker->allocated (as_pointer (base_address + page_size), page_size, 2);
+  tracker->allocated (as_pointer (base_address), page_size, 1);
+
+  /* A range over both returns them by address.  */
+  const std::vector<allocation_t> found
+      = tracker->find (base_address, 2 * page_size);
+  CHECK_EQUAL (found.size (), 2u);
+  if (found.size () == 2)
+    {
+      CHECK_EQUAL (found[0].pool, 1u);
+      CHECK_EQUAL (found[1].pool, 2u);
+    }
+}
+
+void
+test_use_after_free ()
+{
+  auto tracker = std::make_unique<allocation_tracker_t> ();
+
+  tracker->allocated (as_pointer (base_address), 4 * page_size, 1);
+  tracker->freed (as_pointer (base_address));
+
+  /* The faulting page was freed.  */
+  std::vector<allocation_t> found
+      = tracker->find (base_address + 2 * page_size, page_size);
+  CHECK_EQUAL (found.size (), 1u);
+  if (found.size () == 1)
+    {
+      CHECK (found[0].freed);
+      CHECK_EQUAL (found[0].pool, 1u);
+    }
+
+  /* A live allocation at the same address hides the freed one.  */
+  tracker->allocated (as_pointer (base_address), page_size, 2);
+  found = tracker->find (base_address, page_size);
+  CHECK_EQUAL (found.size (), 1u);
+  if (found.size () == 1)
+    {
+      CHECK (!found[0].freed);
+      CHECK_EQUAL (found[0].pool, 2u);
+    }
+  tracker->freed (as_pointer (base_address));
+
+  /* Free many more pages than all the rings hold, spread over the shards,
+     which evicts both freed allocations.  Their nodes are reused by the
+     later allocations.  */
+  constexpr uint64_t other_address = base_address + (1ull << 32);
+  constexpr std::size_t other_count = 64 * 1024;
+  for (std::size_t i = 0; i < other_count; ++i)
+    {
+      tracker->allocated (as_pointer (other_address + i * page_size),
+                          page_size, 3);
+      tracker->freed (as_pointer (other_address + i * page_size));
+    }
+
+  CHECK (tracker->find (base_address, page_size).empty ());
+
+  /* The most recently freed allocations are still remembered.  */
+  found = tracker->find (other_address + (other_count - 1) * page_size,
+                         page_size);
+  CHECK_EQUAL (found.size (), 1u);
+  if (found.size () == 1)
+    CHECK (found[0].freed);
+}
+
+} /* namespace */
+
+int
+main ()
+{
+  test_large_allocation ();
+  test_adjacent_allocations ();
+  test_use_after_free ();
+
+  return unit_test::test_status ();
+}
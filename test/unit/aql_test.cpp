@@ -0,0 +1,239 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Checks the copy of the pending AQL packets from a queue's ring buffer,
+   across the end of the ring, and how each packet type is printed.  */
+
+#include "aql.h"
+#include "unit_test.h"
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace amd::debug_agent;
+
+namespace
+{
+
+/* The number of packets in the synthetic ring, a power of 2.  */
+constexpr uint32_t ring_size = 8;
+
+uint16_t
+packet_header (hsa_packet_type_t type, bool barrier = false)
+{
+  return (type << HSA_PACKET_HEADER_TYPE)
+         | (barrier ? 1 << HSA_PACKET_HEADER_BARRIER : 0);
+}
+
+/* A ring holding a packet of each type, where the packets 14 to 18 wrap
+   around from the last 2 slots to the first 3.  The other slots hold stale
+   invalid packets.  */
+std::vector<hsa_kernel_dispatch_packet_t>
+make_ring ()
+{
+  std::vector<hsa_kernel_dispatch_packet_t> ring (ring_size);
+  for (auto &&slot : ring)
+    {
+      std::memset (&slot, 0xcd, sizeof (slot));
+      slot.header = packet_header (HSA_PACKET_TYPE_INVALID);
+    }
+
+  hsa_barrier_and_packet_t barrier_and{};
+  barrier_and.header = packet_header (HSA_PACKET_TYPE_BARRIER_AND);
+  barrier_and.dep_signal[0].handle = 0x10;
+  barrier_and.dep_signal[2].handle = 0x20;
+  barrier_and.completion_signal.handle = 0x30;
+  std::memcpy (&ring[14 % ring_size], &barrier_and, sizeof (barrier_and));
+
+  hsa_barrier_or_packet_t barrier_or{};
+  barrier_or.header = packet_header (HSA_PACKET_TYPE_BARRIER_OR);
+  std::memcpy (&ring[15 % ring_size], &barrier_or, sizeof (barrier_or));
+
+  hsa_kernel_dispatch_packet_t dispatch{};
+  dispatch.header = packet_header (HSA_PACKET_TYPE_KERNEL_DISPATCH, true);
+  dispatch.workgroup_size_x = 64;
+  dispatch.workgroup_size_y = 1;
+  dispatch.workgroup_size_z = 1;
+  dispatch.grid_size_x = 256;
+  dispatch.grid_size_y = 1;
+  dispatch.grid_size_z = 1;
+  dispatch.group_segment_size = 512;
+  dispatch.kernel_object = 0x7f00deadbeef;
+  dispatch.kernarg_address = reinterpret_cast<void *> (0x7f0000002000);
+  dispatch.completion_signal.handle = 0x1234;
+  ring[16 % ring_size] = dispatch;
+
+  hsa_agent_dispatch_packet_t agent_dispatch{};
+  agent_dispatch.header = packet_header (HSA_PACKET_TYPE_AGENT_DISPATCH);
+  agent_dispatch.type = 3;
+  agent_dispatch.arg[0] = 0x1;
+  agent_dispatch.arg[1] = 0x2;
+  agent_dispatch.arg[2] = 0x3;
+  agent_dispatch.arg[3] = 0xff;
+  agent_dispatch.return_address = reinterpret_cast<void *> (0x7f0000003000);
+  agent_dispatch.completion_signal.handle = 0x40;
+  std::memcpy (&ring[17 % ring_size], &agent_dispatch,
+               sizeof (agent_dispatch));
+
+  hsa_amd_barrier_value_packet_t barrier_value{};
+  barrier_value.header.header
+      = packet_header (HSA_PACKET_TYPE_VENDOR_SPECIFIC);
+  barrier_value.header.AmdFormat = HSA_AMD_PACKET_TYPE_BARRIER_VALUE;
+  barrier_value.signal.handle = 0x50;
+  barrier_value.cond = HSA_SIGNAL_CONDITION_LT;
+  barrier_value.value = 0x7;
+  barrier_value.mask = 0xff;
+  barrier_value.completion_signal.handle = 0x60;
+  std::memcpy (&ring[18 % ring_size], &barrier_value, sizeof (barrier_value));
+
+  return ring;
+}
+
+std::string
+packet_string (const aql_packet_t &packet, const std::string &kernel_name)
+{
+  std::ostringstream os;
+  print_aql_packet (os, packet, kernel_name);
+  return os.str ();
+}
+
+void
+test_read_wrapped ()
+{
+  const auto ring = make_ring ();
+
+  const std::vector<aql_packet_t> packets
+      = read_aql_packets (ring.data (), ring_size, 14, 19, 33);
+
+  CHECK_EQUAL (packets.size (), 5u);
+  for (std::size_t i = 0; i < packets.size (); ++i)
+    {
+      CHECK_EQUAL (packets[i].index, 14 + i);
+      CHECK (std::memcmp (&packets[i].kernel_dispatch,
+                          &ring[(14 + i) % ring_size], sizeof (ring[0]))
+             == 0);
+    }
+
+  CHECK_EQUAL (packets[0].type (), HSA_PACKET_TYPE_BARRIER_AND);
+  CHECK_EQUAL (packets[1].type (), HSA_PACKET_TYPE_BARRIER_OR);
+  CHECK_EQUAL (packets[2].type (), HSA_PACKET_TYPE_KERNEL_DISPATCH);
+  CHECK_EQUAL (packets[3].type (), HSA_PACKET_TYPE_AGENT_DISPATCH);
+  CHECK_EQUAL (packets[4].type (), HSA_PACKET_TYPE_VENDOR_SPECIFIC);
+}
+
+void
+test_read_bounds ()
+{
+  const auto ring = make_ring ();
+
+  /* At most `max_count` packets.  */
+  std::vector<aql_packet_t> packets
+      = read_aql_packets (ring.data (), ring_size, 14, 19, 3);
+  CHECK_EQUAL (packets.size (), 3u);
+  CHECK_EQUAL (packets.back ().index, 16u);
+
+  /* A backlog larger than the ring only has the ring's packets, each slot
+     read once.  */
+  packets = read_aql_packets (ring.data (), ring_size, 14, 100, 33);
+  CHECK_EQUAL (packets.size (), ring_size);
+  CHECK_EQUAL (packets.back ().index, 21u);
+
+  CHECK (read_aql_packets (ring.data (), ring_size, 19, 19, 33).empty ());
+  CHECK (read_aql_packets (ring.data (), ring_size, 20, 19, 33).empty ());
+  CHECK (read_aql_packets (nullptr, ring_size, 14, 19, 33).empty ());
+  CHECK (read_aql_packets (ring.data (), 0, 14, 19, 33).empty ());
+}
+
+void
+test_print ()
+{
+  const auto ring = make_ring ();
+  const std::vector<aql_packet_t> packets
+      = read_aql_packets (ring.data (), ring_size, 14, 19, 33);
+  if (packets.size () != 5)
+    return;
+
+  CHECK_EQUAL (packet_string (packets[0], {}),
+               "  packet 14: barrier_and\n"
+               "    dep_signal=[0x10, 0x20], completion_signal=0x30\n");
+  CHECK_EQUAL (packet_string (packets[1], {}),
+               "  packet 15: barrier_or\n"
+               "    dep_signal=[], completion_signal=0x0\n");
+  CHECK_EQUAL (packet_string (packets[2], "my_kernel(int*)"),
+               "  packet 16: kernel_dispatch (my_kernel(int*)), barrier\n"
+               "    kernel_object=0x7f00deadbeef, grid=(256, 1, 1), "
+               "workgroup=(64, 1, 1), private_segment_size=0, "
+               "group_segment_size=512, kernarg_address=0x7f0000002000, "
+               "completion_signal=0x1234\n");
+  CHECK_EQUAL (packet_string (packets[3], {}),
+               "  packet 17: agent_dispatch, type=3\n"
+               "    arg=[0x1, 0x2, 0x3, 0xff], "
+               "return_address=0x7f0000003000, completion_signal=0x40\n");
+  CHECK_EQUAL (packet_string (packets[4], {}),
+               "  packet 18: barrier_value\n"
+               "    signal=0x50, condition=LT, value=0x7, mask=0xff, "
+               "completion_signal=0x60\n");
+
+  /* A stale slot, read past the end of the backlog.  */
+  aql_packet_t packet = packets[0];
+  packet.index = 19;
+  packet.header = packet_header (HSA_PACKET_TYPE_INVALID);
+  CHECK_EQUAL (packet_string (packet, {}), "  packet 19: invalid\n");
+
+  packet.header = packet_header (HSA_PACKET_TYPE_VENDOR_SPECIFIC);
+  packet.barrier_value.header.AmdFormat = 9;
+  CHECK_EQUAL (packet_string (packet, {}),
+               "  packet 19: vendor_specific, format=9\n");
+
+  packet.header = 7 << HSA_PACKET_HEADER_TYPE;
+  CHECK_EQUAL (packet_string (packet, {}), "  packet 19: unknown type 7\n");
+
+  /* The stream's format is restored.  */
+  std::ostringstream os;
+  os << std::hex;
+  const std::ios_base::fmtflags flags = os.flags ();
+  print_aql_packet (os, packets[2]);
+  CHECK_EQUAL (os.flags (), flags);
+}
+
+} /* namespace */
+
+int
+main ()
+{
+  test_read_wrapped ();
+  test_read_bounds ();
+  test_print ();
+
+  return unit_test::test_status ();
+}
@@ -0,0 +1,145 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Checks the replacement of the % sequences in the output path templates.  */
+
+#include "logging.h"
+#include "unit_test.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+using namespace amd::debug_agent;
+
+namespace
+{
+
+/* The environment variables holding the MPI rank, in order of precedence.  */
+const char *const rank_variables[]
+    = { "OMPI_COMM_WORLD_RANK", "PMIX_RANK", "PMI_RANK",
+        "MV2_COMM_WORLD_RANK", "SLURM_PROCID" };
+
+void
+test_process ()
+{
+  CHECK_EQUAL (expand_path_template ("out-%p.log", 0),
+               "out-" + std::to_string (getpid ()) + ".log");
+
+  char host_name[256] = {};
+  CHECK (gethostname (host_name, sizeof (host_name) - 1) == 0);
+  CHECK_EQUAL (expand_path_template ("%h:%p", 0),
+               std::string (host_name) + ":" + std::to_string (getpid ()));
+}
+
+void
+test_time ()
+{
+  const time_t before = time (nullptr);
+  const std::string path = expand_path_template ("%t", 0);
+  const time_t after = time (nullptr);
+
+  /* YYYYMMDDTHHMMSS, in local time.  */
+  CHECK_EQUAL (path.size (), 15u);
+  if (path.size () != 15)
+    return;
+  for (size_t i = 0; i < path.size (); ++i)
+    CHECK (i == 8 ? path[i] == 'T' : isdigit (path[i]));
+
+  struct tm tm = {};
+  CHECK (strptime (path.c_str (), "%Y%m%dT%H%M%S", &tm));
+  tm.tm_isdst = -1;
+  const time_t expanded = mktime (&tm);
+  CHECK (before <= expanded && expanded <= after);
+}
+
+void
+test_rank ()
+{
+  for (const char *variable : rank_variables)
+    unsetenv (variable);
+
+  CHECK_EQUAL (expand_path_template ("rank%r", 0), "rank0");
+
+  setenv ("SLURM_PROCID", "7", 1);
+  CHECK_EQUAL (expand_path_template ("rank%r", 0), "rank7");
+
+  /* The launcher specific variables take precedence.  */
+  setenv ("PMI_RANK", "5", 1);
+  CHECK_EQUAL (expand_path_template ("rank%r", 0), "rank5");
+
+  /* An empty variable is ignored.  */
+  setenv ("OMPI_COMM_WORLD_RANK", "", 1);
+  CHECK_EQUAL (expand_path_template ("rank%r", 0), "rank5");
+
+  setenv ("OMPI_COMM_WORLD_RANK", "3", 1);
+  CHECK_EQUAL (expand_path_template ("rank%r", 0), "rank3");
+
+  for (const char *variable : rank_variables)
+    unsetenv (variable);
+}
+
+void
+test_sequence ()
+{
+  CHECK_EQUAL (expand_path_template ("dump-%n.txt", 0), "dump-0.txt");
+  CHECK_EQUAL (expand_path_template ("dump-%n.txt", 42), "dump-42.txt");
+  CHECK_EQUAL (expand_path_template ("%n%n", 7), "77");
+}
+
+void
+test_literal ()
+{
+  CHECK_EQUAL (expand_path_template ("", 1), "");
+  CHECK_EQUAL (expand_path_template ("/tmp/out.log", 1), "/tmp/out.log");
+  CHECK_EQUAL (expand_path_template ("100%%", 1), "100%");
+  CHECK_EQUAL (expand_path_template ("%%n", 1), "%n");
+
+  /* Unknown and trailing sequences are kept as is.  */
+  CHECK_EQUAL (expand_path_template ("a%xb", 1), "a%xb");
+  CHECK_EQUAL (expand_path_template ("a%", 1), "a%");
+}
+
+} /* namespace */
+
+int
+main ()
+{
+  test_process ();
+  test_time ();
+  test_rank ();
+  test_sequence ();
+  test_literal ();
+
+  return unit_test::test_status ();
+}
@@ -0,0 +1,192 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Checks the registration of the queue callback records, and the recycling
+   of the records of the destroyed queues, within a thread and across
+   threads.  */
+
+#include "queue_registry.h"
+#include "unit_test.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace amd::debug_agent;
+
+namespace
+{
+
+void
+application_callback (hsa_status_t, hsa_queue_t *, void *)
+{
+}
+
+/* Register a record for each queue of `queues`, its info id being the
+   queue's index, and return the records.  */
+std::vector<callback_and_data_t *>
+insert_queues (queue_callback_registry_t &registry,
+               std::vector<hsa_queue_t> &queues)
+{
+  std::vector<callback_and_data_t *> records;
+  for (size_t i = 0; i < queues.size (); ++i)
+    {
+      callback_and_data_t *record = queue_callback_registry_t::allocate (
+          application_callback, &queues[i]);
+      record->info.id = i;
+      registry.insert (&queues[i], record);
+      records.emplace_back (record);
+    }
+  return records;
+}
+
+std::set<uint64_t>
+registered_ids (queue_callback_registry_t &registry)
+{
+  std::set<uint64_t> ids;
+  for (auto &&info : registry.queues ())
+    ids.emplace (info.id);
+  return ids;
+}
+
+void
+test_insert_erase ()
+{
+  auto registry = std::make_unique<queue_callback_registry_t> ();
+
+  /* More queues than shards, so that some shards hold several records.  */
+  std::vector<hsa_queue_t> queues (200);
+  insert_queues (*registry, queues);
+
+  CHECK_EQUAL (registry->size (), queues.size ());
+  CHECK_EQUAL (registered_ids (*registry).size (), queues.size ());
+
+  /* Erase every other queue, which unlinks records from the head, the
+     middle, and the tail of the shards' lists.  */
+  for (size_t i = 0; i < queues.size (); i += 2)
+    registry->erase (&queues[i]);
+
+  CHECK_EQUAL (registry->size (), queues.size () / 2);
+  const std::set<uint64_t> ids = registered_ids (*registry);
+  CHECK_EQUAL (ids.size (), queues.size () / 2);
+  CHECK (std::all_of (ids.begin (), ids.end (),
+                      [] (uint64_t id) { return id % 2 == 1; }));
+
+  /* Erasing a queue that is not registered, or not anymore, does
+     nothing.  */
+  hsa_queue_t unknown_queue{};
+  registry->erase (&unknown_queue);
+  registry->erase (&queues[0]);
+  CHECK_EQUAL (registry->size (), queues.size () / 2);
+
+  for (size_t i = 1; i < queues.size (); i += 2)
+    registry->erase (&queues[i]);
+  CHECK_EQUAL (registry->size (), 0u);
+  CHECK (registry->queues ().empty ());
+}
+
+void
+test_recycle ()
+{
+  auto registry = std::make_unique<queue_callback_registry_t> ();
+
+  hsa_queue_t queue{};
+  int data;
+  callback_and_data_t *record
+      = queue_callback_registry_t::allocate (application_callback, &data);
+  record->info.id = 42;
+  registry->insert (&queue, record);
+  registry->erase (&queue);
+
+  /* The record of the destroyed queue is reused first, and reset.  */
+  callback_and_data_t *recycled
+      = queue_callback_registry_t::allocate (nullptr, nullptr);
+  CHECK_EQUAL (recycled, record);
+  CHECK (!recycled->callback);
+  CHECK (!recycled->data);
+  CHECK_EQUAL (recycled->info.id, 0u);
+  CHECK (!recycled->queue);
+  CHECK (!recycled->next);
+
+  /* Likewise for a record that was never inserted.  */
+  queue_callback_registry_t::deallocate (recycled);
+  CHECK_EQUAL (queue_callback_registry_t::allocate (application_callback,
+                                                    &data),
+               record);
+  CHECK_EQUAL (record->callback, &application_callback);
+  CHECK_EQUAL (record->data, static_cast<void *> (&data));
+  queue_callback_registry_t::deallocate (record);
+}
+
+void
+test_recycle_across_threads ()
+{
+  auto registry = std::make_unique<queue_callback_registry_t> ();
+
+  /* The queues are created by a thread which exits, and destroyed by this
+     one, which keeps a bounded number of their records and returns the
+     others to the shared pool, like the records left in the exited thread's
+     cache.  */
+  std::vector<hsa_queue_t> queues (300);
+  std::vector<callback_and_data_t *> records;
+  std::thread ([&] () { records = insert_queues (*registry, queues); })
+      .join ();
+
+  for (auto &&queue : queues)
+    registry->erase (&queue);
+  CHECK_EQUAL (registry->size (), 0u);
+
+  /* A new thread takes its records from the pool rather than from a new
+     slab.  */
+  callback_and_data_t *record{ nullptr };
+  std::thread ([&] () {
+    record = queue_callback_registry_t::allocate (application_callback,
+                                                  nullptr);
+    queue_callback_registry_t::deallocate (record);
+  }).join ();
+
+  std::sort (records.begin (), records.end ());
+  CHECK (std::binary_search (records.begin (), records.end (), record));
+}
+
+} /* namespace */
+
+int
+main ()
+{
+  test_insert_erase ();
+  test_recycle ();
+  test_recycle_across_threads ();
+
+  return unit_test::test_status ();
+}
@@ -0,0 +1,169 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Checks the call counts, totals and percentiles printed by print_stats
+   for known latency distributions.  */
+
+#include "stats.h"
+#include "unit_test.h"
+
+#include <chrono>
+#include <optional>
+#include <sstream>
+#include <string>
+
+using namespace amd::debug_agent;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+/* A row of the statistics table.  */
+struct stat_row_t
+{
+  uint64_t calls;
+  double total_us;
+  double p50_us;
+  double p99_us;
+  uint64_t bytes;
+};
+
+/* Return the row of the counter `name` printed by print_stats.  */
+std::optional<stat_row_t>
+find_row (bool reset, const std::string &name)
+{
+  std::ostringstream os;
+  print_stats (os, reset);
+
+  std::istringstream table (os.str ());
+  for (std::string line; std::getline (table, line);)
+    {
+      std::istringstream fields (line);
+      std::string row_name;
+      stat_row_t row;
+      if (fields >> row_name >> row.calls >> row.total_us >> row.p50_us
+                 >> row.p99_us >> row.bytes
+          && row_name == name)
+        return row;
+    }
+
+  return std::nullopt;
+}
+
+void
+test_exact_buckets ()
+{
+  /* 2^16 and 2^24 ns are the lower bounds of their buckets.  */
+  stat_counter_t &counter = stat_counter ("exact");
+  for (int i = 0; i < 99; ++i)
+    counter.record (65536ns, 10);
+  counter.record (16777216ns, 1000);
+
+  const std::optional<stat_row_t> row = find_row (false, "exact");
+  CHECK (row);
+  if (!row)
+    return;
+
+  CHECK_EQUAL (row->calls, 100u);
+  CHECK_EQUAL (row->total_us, 23265.3);
+  CHECK_EQUAL (row->p50_us, 65.5);
+  CHECK_EQUAL (row->p99_us, 16777.2);
+  CHECK_EQUAL (row->bytes, 1990u);
+}
+
+void
+test_error_bound ()
+{
+  /* 1 to 1000 us.  A percentile is the lower bound of the bucket it falls
+     in, at most 12.5% below the exact value.  */
+  stat_counter_t &counter = stat_counter ("uniform");
+  for (int i = 1; i <= 1000; ++i)
+    counter.record (std::chrono::microseconds (i), 0);
+
+  const std::optional<stat_row_t> row = find_row (false, "uniform");
+  CHECK (row);
+  if (!row)
+    return;
+
+  CHECK (row->p50_us <= 501 && row->p50_us >= 501 * 0.875);
+  CHECK (row->p99_us <= 991 && row->p99_us >= 991 * 0.875);
+}
+
+void
+test_small_values ()
+{
+  /* Below 16 ns, each value has its own bucket.  */
+  stat_counter_t &counter = stat_counter ("small");
+  for (int i = 0; i < 10; ++i)
+    counter.record (3ns, 0);
+  counter.record (std::chrono::milliseconds (5), 0);
+
+  const std::optional<stat_row_t> row = find_row (false, "small");
+  CHECK (row);
+  if (!row)
+    return;
+
+  CHECK_EQUAL (row->p50_us, 0.0);
+  /* 5 ms is in the bucket from 4.72 to 5.24 ms.  */
+  CHECK_EQUAL (row->p99_us, 4718.6);
+}
+
+void
+test_merge_and_reset ()
+{
+  /* The debugger API call sites are merged under the function name.  */
+  stat_counter ("amd_dbgapi_test_call (process_id, wave_id)").record (1us, 4);
+  stat_counter ("amd_dbgapi_test_call (process_id)").record (1us, 4);
+
+  std::optional<stat_row_t> row = find_row (true, "amd_dbgapi_test_call");
+  CHECK (row);
+  if (row)
+    {
+      CHECK_EQUAL (row->calls, 2u);
+      CHECK_EQUAL (row->bytes, 8u);
+    }
+
+  /* Reset, the counters without calls are not printed.  */
+  CHECK (!find_row (false, "amd_dbgapi_test_call"));
+  CHECK (!find_row (false, "exact"));
+}
+
+} /* namespace */
+
+int
+main ()
+{
+  test_exact_buckets ();
+  test_error_bound ();
+  test_small_values ();
+  test_merge_and_reset ();
+
+  return unit_test::test_status ();
+}
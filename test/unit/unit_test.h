@@ -0,0 +1,85 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+#ifndef _ROCM_DEBUG_AGENT_UNIT_TEST_H
+#define _ROCM_DEBUG_AGENT_UNIT_TEST_H 1
+
+#include <iostream>
+
+namespace amd::debug_agent::unit_test
+{
+
+/* The number of failed checks, the test exits with a failure status if it is
+   not 0.  */
+inline int failure_count{ 0 };
+
+template <typename Actual, typename Expected>
+void
+check_equal (const Actual &actual, const Expected &expected,
+             const char *actual_expr, const char *file, int line)
+{
+  if (actual == expected)
+    return;
+
+  ++failure_count;
+  std::cerr << file << ':' << line << ": check failed: " << actual_expr
+            << "\n  expected: " << expected << "\n  actual:   " << actual
+            << '\n';
+}
+
+/* Return the exit status of the test.  */
+inline int
+test_status ()
+{
+  if (failure_count)
+    std::cerr << failure_count << " check(s) failed\n";
+  return failure_count ? 1 : 0;
+}
+
+} /* namespace amd::debug_agent::unit_test */
+
+/* Report a failed check with its location, and keep going, so that one run
+   reports all the failures.  */
+#define CHECK(expr)                                                           \
+  do                                                                          \
+    if (!(expr))                                                              \
+      {                                                                       \
+        ++amd::debug_agent::unit_test::failure_count;                         \
+        std::cerr << __FILE__ << ':' << __LINE__                              \
+                  << ": check failed: " #expr "\n";                           \
+      }                                                                       \
+  while (false)
+
+/* Likewise, and print both values if they differ.  */
+#define CHECK_EQUAL(actual, expected)                                         \
+  amd::debug_agent::unit_test::check_equal ((actual), (expected), #actual,    \
+                                            __FILE__, __LINE__)
+
+#endif /* _ROCM_DEBUG_AGENT_UNIT_TEST_H */
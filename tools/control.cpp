@@ -0,0 +1,169 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Client of the agent's --control-socket.  Sends one command to the agent of
+   a process, and copies the reply to stdout.  */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+namespace
+{
+
+void
+print_usage ()
+{
+  std::cerr
+      << "Usage: rocm-debug-agent-control PID|SOCKET COMMAND..." << std::endl
+      << std::endl
+      << "Send COMMAND to the debug agent of the process PID, which was"
+      << std::endl
+      << "started with --control-socket, or to the agent listening on"
+      << std::endl
+      << "SOCKET, and print the reply. Run the `help' command for the list"
+      << std::endl
+      << "of the commands." << std::endl
+      << std::endl
+      << "  -h, --help         Display a usage message and exit"
+      << std::endl;
+}
+
+/* Write the SIZE bytes at DATA to FD, retrying after short writes.  */
+bool
+write_all (int fd, const char *data, std::size_t size)
+{
+  while (size)
+    {
+      ssize_t written = ::write (fd, data, size);
+      if (written == -1 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        return false;
+      data += written;
+      size -= written;
+    }
+  return true;
+}
+
+} /* namespace */
+
+int
+main (int argc, char **argv)
+{
+  static const struct option long_options[]
+      = { { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+
+  int c;
+  while ((c = getopt_long (argc, argv, "+h", long_options, nullptr)) != -1)
+    switch (c)
+      {
+      case 'h':
+        print_usage ();
+        return EXIT_SUCCESS;
+      default:
+        print_usage ();
+        return EXIT_FAILURE;
+      }
+
+  if (optind + 2 > argc)
+    {
+      print_usage ();
+      return EXIT_FAILURE;
+    }
+
+  /* A pid is the default path of the agent's socket.  */
+  std::string path = argv[optind++];
+  if (path.find_first_not_of ("0123456789") == std::string::npos)
+    path = "/tmp/rocm-debug-agent-" + path + ".sock";
+
+  std::string command;
+  for (; optind < argc; ++optind)
+    command += std::string (command.empty () ? "" : " ") + argv[optind];
+  command += '\n';
+
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.size () >= sizeof (address.sun_path))
+    {
+      std::cerr << "error: socket path `" << path << "' is too long"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  path.copy (address.sun_path, path.size ());
+
+  int fd = ::socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1
+      || ::connect (fd, reinterpret_cast<struct sockaddr *> (&address),
+                    sizeof (address))
+             == -1)
+    {
+      std::cerr << "error: could not connect to `" << path
+                << "': " << strerror (errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (!write_all (fd, command.data (), command.size ()))
+    {
+      std::cerr << "error: could not send the command: " << strerror (errno)
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  ::shutdown (fd, SHUT_WR);
+
+  /* The agent closes the connection once the command completed.  */
+  char buffer[64 * 1024];
+  while (true)
+    {
+      ssize_t length = ::read (fd, buffer, sizeof (buffer));
+      if (length == -1 && errno == EINTR)
+        continue;
+      if (length == -1)
+        {
+          std::cerr << "error: could not read the reply: " << strerror (errno)
+                    << std::endl;
+          return EXIT_FAILURE;
+        }
+      if (length == 0)
+        break;
+      if (!write_all (STDOUT_FILENO, buffer, length))
+        return EXIT_FAILURE;
+    }
+
+  ::close (fd);
+  return EXIT_SUCCESS;
+}
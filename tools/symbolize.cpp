@@ -0,0 +1,800 @@
+/* The University of Illinois/NCSA
+   Open Source License (NCSA)
+
+   Copyright (c) 2020, Advanced Micro Devices, Inc. All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal with the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+    - Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimers.
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimers in
+      the documentation and/or other materials provided with the distribution.
+    - Neither the names of Advanced Micro Devices, Inc,
+      nor the names of its contributors may be used to endorse or promote
+      products derived from this Software without specific prior written
+      permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+   OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+   ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS WITH THE SOFTWARE.  */
+
+/* Offline symbolizer for the GPU core files written with --raw-dump.  The
+   waves are printed as by the agent, with the symbols, source lines, and
+   disassembly looked up in the code objects saved in the core file.  The
+   pcs of all the waves are sorted by code object, and each code object is
+   opened once and symbolizes all its distinct pcs in a single pass, before
+   it is released and the next one is opened.  */
+
+#include "code_object.h"
+#include "core_file.h"
+#include "debug.h"
+#include "logging.h"
+#include "stop_reason.h"
+
+#include <amd-dbgapi.h>
+#include <ctype.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <libelf.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+using namespace amd::debug_agent;
+
+namespace
+{
+
+/* The mask of the EF_AMDGPU_MACH_* value in the e_flags of a code object.  */
+constexpr uint32_t ef_amdgpu_mach = 0x0ff;
+
+amd_dbgapi_callbacks_t dbgapi_callbacks = {
+  .allocate_memory = malloc,
+  .deallocate_memory = free,
+
+  /* No process is attached, only the architectures are used.  */
+  .get_os_pid =
+      [] (amd_dbgapi_client_process_id_t client_process_id, pid_t *pid) {
+        return AMD_DBGAPI_STATUS_ERROR;
+      },
+  .enable_notify_shared_library =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          const char *library_name, amd_dbgapi_shared_library_id_t library_id,
+          amd_dbgapi_shared_library_state_t *library_state) {
+        return AMD_DBGAPI_STATUS_ERROR;
+      },
+  .disable_notify_shared_library =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_shared_library_id_t library_id) {
+        return AMD_DBGAPI_STATUS_ERROR;
+      },
+  .get_symbol_address =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_shared_library_id_t library_id, const char *symbol_name,
+          amd_dbgapi_global_address_t *address) {
+        return AMD_DBGAPI_STATUS_ERROR;
+      },
+  .insert_breakpoint =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_shared_library_id_t shared_library_id,
+          amd_dbgapi_global_address_t address,
+          amd_dbgapi_breakpoint_id_t breakpoint_id) {
+        return AMD_DBGAPI_STATUS_ERROR;
+      },
+  .remove_breakpoint =
+      [] (amd_dbgapi_client_process_id_t client_process_id,
+          amd_dbgapi_breakpoint_id_t breakpoint_id) {
+        return AMD_DBGAPI_STATUS_ERROR;
+      },
+
+  .log_message =
+      [] (amd_dbgapi_log_level_t level, const char *message) {
+        log_dbgapi_message (message);
+      }
+};
+
+struct agent_t
+{
+  std::string name;
+  std::string architecture;
+};
+
+struct dispatch_t
+{
+  core_dispatch_note_t note;
+  std::string kernel_name;
+};
+
+struct wave_t
+{
+  core_wave_note_t note;
+  /* The registers that follow the note, in core_file_t::m_notes.  */
+  const char *registers;
+};
+
+struct code_object_info_t
+{
+  core_code_object_note_t note;
+  std::string uri;
+};
+
+/* The summary of the waves of an agent, queue, dispatch or workgroup, as
+   printed by the agent.  */
+struct wave_group_t
+{
+  size_t wave_count{ 0 };
+  std::map<std::string, size_t> state_counts;
+
+  void
+  add (const core_wave_note_t &wave)
+  {
+    ++wave_count;
+    ++state_counts[wave.stop_reason == AMD_DBGAPI_WAVE_STOP_REASON_NONE
+                       ? "running"
+                       : stop_reason_string (wave.stop_reason)];
+  }
+};
+
+std::ostream &
+operator<< (std::ostream &os, const wave_group_t &group)
+{
+  os << std::dec << group.wave_count << " wavefront"
+     << (group.wave_count == 1 ? "" : "s") << " (";
+
+  for (auto it = group.state_counts.begin (); it != group.state_counts.end ();
+       ++it)
+    os << (it == group.state_counts.begin () ? "" : ", ") << it->first
+       << ": " << it->second;
+
+  return os << ")";
+}
+
+using workgroup_key_t = std::tuple<uint64_t, uint32_t, uint32_t, uint32_t>;
+
+workgroup_key_t
+workgroup_key (const core_wave_note_t &wave)
+{
+  return { wave.dispatch_id, wave.work_group_coord[0],
+           wave.work_group_coord[1], wave.work_group_coord[2] };
+}
+
+/* Escape the characters of `path` that are not allowed in the path of a
+   code object URI.  */
+std::string
+uri_escape (const std::string &path)
+{
+  std::ostringstream ss;
+  for (unsigned char c : path)
+    if (c == '%' || c == '#' || c == '?' || c == '&' || !isprint (c))
+      ss << '%' << std::hex << std::setw (2) << std::setfill ('0')
+         << static_cast<unsigned> (c);
+    else
+      ss << c;
+  return ss.str ();
+}
+
+class core_file_t
+{
+public:
+  explicit core_file_t (std::string path) : m_path (std::move (path)) {}
+  ~core_file_t ()
+  {
+    if (m_fd != -1)
+      ::close (m_fd);
+  }
+
+  /* Read the program headers and the notes, return false if the file is not
+     a GPU core file.  */
+  bool load ();
+
+  /* Look up the kernel names, symbols, source lines and disassembly of all
+     the pcs.  */
+  void symbolize ();
+
+  /* Print the waves, in the order they were dumped.  */
+  void print (std::ostream &out) const;
+
+private:
+  bool read (void *buffer, std::size_t size, uint64_t offset) const;
+  bool parse_note (uint32_t type, const char *desc, std::size_t size);
+
+  /* Return the index of the code object that contains `pc`.  */
+  std::optional<size_t> find_code_object (uint64_t pc) const;
+
+  void print_registers (std::ostream &out, const wave_t &wave) const;
+  void print_local_memory (std::ostream &out, const wave_t &wave) const;
+
+  const std::string m_path;
+  int m_fd{ -1 };
+
+  std::vector<Elf64_Phdr> m_program_headers;
+  std::vector<char> m_notes;
+  std::string m_register_names;
+
+  std::map<uint64_t, agent_t> m_agents;
+  std::unordered_map<uint64_t, dispatch_t> m_dispatches;
+  std::vector<wave_t> m_waves;
+  std::vector<code_object_info_t> m_code_objects;
+  std::map<uint64_t, size_t> m_code_object_map;
+
+  /* The symbolized text printed after the registers of the waves at each
+     pc.  */
+  std::unordered_map<uint64_t, std::string> m_pc_texts;
+};
+
+bool
+core_file_t::read (void *buffer, std::size_t size, uint64_t offset) const
+{
+  return ::pread (m_fd, buffer, size, offset) == static_cast<ssize_t> (size);
+}
+
+bool
+core_file_t::load ()
+{
+  m_fd = ::open (m_path.c_str (), O_RDONLY | O_CLOEXEC);
+  if (m_fd == -1)
+    {
+      std::cerr << "error: could not open `" << m_path << "': "
+                << strerror (errno) << std::endl;
+      return false;
+    }
+
+  Elf64_Ehdr ehdr;
+  if (!read (&ehdr, sizeof (ehdr), 0) || memcmp (ehdr.e_ident, ELFMAG, SELFMAG)
+      || ehdr.e_ident[EI_CLASS] != ELFCLASS64 || ehdr.e_type != ET_CORE
+      || ehdr.e_machine != EM_AMDGPU)
+    {
+      std::cerr << "error: `" << m_path << "' is not a GPU core file"
+                << std::endl;
+      return false;
+    }
+
+  std::size_t phnum = ehdr.e_phnum;
+  if (phnum == PN_XNUM)
+    {
+      Elf64_Shdr shdr;
+      if (!read (&shdr, sizeof (shdr), ehdr.e_shoff))
+        return false;
+      phnum = shdr.sh_info;
+    }
+
+  m_program_headers.resize (phnum);
+  if (!read (m_program_headers.data (), phnum * sizeof (Elf64_Phdr),
+             ehdr.e_phoff))
+    {
+      std::cerr << "error: `" << m_path << "' is truncated" << std::endl;
+      return false;
+    }
+
+  /* Read all the notes first, the waves reference their registers in
+     m_notes.  */
+  for (auto &&phdr : m_program_headers)
+    if (phdr.p_type == PT_NOTE)
+      {
+        const std::size_t offset = m_notes.size ();
+        m_notes.resize (offset + phdr.p_filesz);
+        if (!read (&m_notes[offset], phdr.p_filesz, phdr.p_offset))
+          return false;
+      }
+
+  std::size_t offset = 0;
+  while (offset + sizeof (Elf64_Nhdr) <= m_notes.size ())
+    {
+      Elf64_Nhdr nhdr;
+      memcpy (&nhdr, &m_notes[offset], sizeof (nhdr));
+
+      const std::size_t name_offset = offset + sizeof (nhdr);
+      const std::size_t desc_offset
+          = name_offset + (nhdr.n_namesz + 3) / 4 * 4;
+      offset = desc_offset + (nhdr.n_descsz + 3) / 4 * 4;
+
+      if (offset > m_notes.size ())
+        {
+          std::cerr << "error: `" << m_path << "' has a truncated note"
+                    << std::endl;
+          return false;
+        }
+
+      if (nhdr.n_namesz != sizeof ("AMDGPU")
+          || memcmp (&m_notes[name_offset], "AMDGPU", sizeof ("AMDGPU")))
+        continue;
+
+      if (!parse_note (nhdr.n_type, &m_notes[desc_offset], nhdr.n_descsz))
+        {
+          std::cerr << "error: `" << m_path << "' has an invalid note"
+                    << std::endl;
+          return false;
+        }
+    }
+
+  return true;
+}
+
+bool
+core_file_t::parse_note (uint32_t type, const char *desc, std::size_t size)
+{
+  /* Return the NUL-terminated string at `*pos`, and advance `pos` past
+     it.  */
+  const char *end = desc + size;
+  auto next_string = [end] (const char *&pos) -> std::optional<std::string> {
+    const char *nul = std::find (pos, end, '\0');
+    if (nul == end)
+      return {};
+    std::string str (pos, nul);
+    pos = nul + 1;
+    return str;
+  };
+
+  switch (type)
+    {
+    case core_nt_amdgpu_process:
+      {
+        core_process_note_t note;
+        if (size < sizeof (note))
+          return false;
+        memcpy (&note, desc, sizeof (note));
+
+        if (note.version != core_format_version)
+          {
+            std::cerr << "error: unsupported core file version "
+                      << note.version << std::endl;
+            return false;
+          }
+
+        m_waves.reserve (note.wave_count);
+        return true;
+      }
+
+    case core_nt_amdgpu_agent:
+      {
+        core_agent_note_t note;
+        if (size < sizeof (note))
+          return false;
+        memcpy (&note, desc, sizeof (note));
+
+        const char *pos = desc + sizeof (note);
+        auto name = next_string (pos);
+        auto architecture = next_string (pos);
+        if (!name || !architecture)
+          return false;
+
+        m_agents[note.agent_id] = { *name, *architecture };
+        return true;
+      }
+
+    case core_nt_amdgpu_dispatch:
+      {
+        dispatch_t dispatch;
+        if (size < sizeof (dispatch.note))
+          return false;
+        memcpy (&dispatch.note, desc, sizeof (dispatch.note));
+
+        const char *pos = desc + sizeof (dispatch.note);
+        auto kernel_name = next_string (pos);
+        if (!kernel_name)
+          return false;
+
+        dispatch.kernel_name = std::move (*kernel_name);
+        m_dispatches.emplace (dispatch.note.dispatch_id, std::move (dispatch));
+        return true;
+      }
+
+    case core_nt_amdgpu_wave:
+      {
+        wave_t wave;
+        if (size < sizeof (wave.note))
+          return false;
+        memcpy (&wave.note, desc, sizeof (wave.note));
+        wave.registers = desc + sizeof (wave.note);
+
+        /* Check that the registers are all in the note.  */
+        const char *pos = wave.registers;
+        for (uint32_t i = 0; i < wave.note.register_count; ++i)
+          {
+            core_register_t reg;
+            if (end - pos < static_cast<ptrdiff_t> (sizeof (reg)))
+              return false;
+            memcpy (&reg, pos, sizeof (reg));
+            pos += sizeof (reg) + (reg.size + 3) / 4 * 4;
+            if (pos > end)
+              return false;
+          }
+
+        m_waves.emplace_back (wave);
+        return true;
+      }
+
+    case core_nt_amdgpu_code_object:
+      {
+        code_object_info_t code_object;
+        if (size < sizeof (code_object.note))
+          return false;
+        memcpy (&code_object.note, desc, sizeof (code_object.note));
+
+        const char *pos = desc + sizeof (code_object.note);
+        auto uri = next_string (pos);
+        if (!uri)
+          return false;
+
+        code_object.uri = std::move (*uri);
+        m_code_object_map.emplace (code_object.note.load_address,
+                                   m_code_objects.size ());
+        m_code_objects.emplace_back (std::move (code_object));
+        return true;
+      }
+
+    case core_nt_amdgpu_register_names:
+      m_register_names.assign (desc, size);
+      return true;
+
+    default:
+      /* Ignore the notes added by later versions.  */
+      return true;
+    }
+}
+
+std::optional<size_t>
+core_file_t::find_code_object (uint64_t pc) const
+{
+  if (auto it = m_code_object_map.upper_bound (pc);
+      it != m_code_object_map.begin ())
+    if (auto &&[load_address, index] = *std::prev (it);
+        pc - load_address <= m_code_objects[index].note.mem_size)
+      return index;
+
+  return {};
+}
+
+void
+core_file_t::symbolize ()
+{
+  /* The distinct pcs of each code object, and the dispatches whose kernel
+     name is to be looked up in it.  */
+  std::vector<std::vector<uint64_t>> pcs (m_code_objects.size ());
+  std::vector<std::vector<dispatch_t *>> dispatches (m_code_objects.size ());
+
+  for (auto &&wave : m_waves)
+    if (auto index = find_code_object (wave.note.pc))
+      pcs[*index].emplace_back (wave.note.pc);
+
+  for (auto &&[dispatch_id, dispatch] : m_dispatches)
+    if (auto index
+        = find_code_object (dispatch.note.kernel_code_entry_address);
+        index && dispatch.kernel_name.empty ())
+      dispatches[*index].emplace_back (&dispatch);
+
+  for (size_t i = 0; i < m_code_objects.size (); ++i)
+    {
+      if (pcs[i].empty () && dispatches[i].empty ())
+        continue;
+
+      const code_object_info_t &info = m_code_objects[i];
+
+      /* The code objects embedded in the core file are read from the segment
+         that contains them.  */
+      std::string uri = info.uri;
+      if (info.note.segment >= 0
+          && static_cast<size_t> (info.note.segment)
+                 < m_program_headers.size ())
+        {
+          const Elf64_Phdr &phdr = m_program_headers[info.note.segment];
+          std::ostringstream ss;
+          ss << "file://" << uri_escape (m_path) << "#offset=" << std::dec
+             << phdr.p_offset << "&size=" << phdr.p_filesz;
+          uri = ss.str ();
+        }
+
+      code_object_t code_object (uri, info.note.load_address);
+      code_object.open ();
+      if (!code_object.is_open ())
+        {
+          agent_warning ("could not open code object `%s'", uri.c_str ());
+          continue;
+        }
+
+      if (code_object.content_hash () != info.note.content_hash)
+        agent_warning ("code object `%s' changed since the core file was "
+                       "written",
+                       uri.c_str ());
+
+      for (dispatch_t *dispatch : dispatches[i])
+        if (auto symbol = code_object.find_symbol (
+                dispatch->note.kernel_code_entry_address))
+          dispatch->kernel_name = symbol->m_name;
+
+      if (pcs[i].empty ())
+        continue;
+
+      Elf64_Ehdr ehdr;
+      amd_dbgapi_architecture_id_t architecture_id;
+      if (code_object.read (&ehdr, sizeof (ehdr), 0) != sizeof (ehdr)
+          || amd_dbgapi_get_architecture (ehdr.e_flags & ef_amdgpu_mach,
+                                          &architecture_id)
+                 != AMD_DBGAPI_STATUS_SUCCESS)
+        {
+          agent_warning ("unknown architecture for code object `%s'",
+                         uri.c_str ());
+          continue;
+        }
+
+      /* Visit the pcs in address order, so that the symbol map, line number
+         table and source files are walked forward once.  */
+      std::sort (pcs[i].begin (), pcs[i].end ());
+      pcs[i].erase (std::unique (pcs[i].begin (), pcs[i].end ()),
+                    pcs[i].end ());
+
+      for (uint64_t pc : pcs[i])
+        {
+          std::ostringstream ss;
+          code_object.disassemble (ss, architecture_id, pc);
+          m_pc_texts.emplace (pc, ss.str ());
+        }
+    }
+}
+
+void
+core_file_t::print_registers (std::ostream &out, const wave_t &wave) const
+{
+  out << "\nregisters:";
+
+  const char *pos = wave.registers;
+  size_t last_register_size = 0;
+  for (uint32_t i = 0, column = 0; i < wave.note.register_count; ++i)
+    {
+      core_register_t reg;
+      memcpy (&reg, pos, sizeof (reg));
+      const uint8_t *value
+          = reinterpret_cast<const uint8_t *> (pos + sizeof (reg));
+      pos += sizeof (reg) + (reg.size + 3) / 4 * 4;
+
+      std::string name;
+      if (reg.name_offset < m_register_names.size ())
+        name = m_register_names.c_str () + reg.name_offset;
+
+      /* Registers larger than a uint64_t are printed each on a separate
+         line, one element per lane.  */
+      const size_t per_line = reg.size ? 16 / reg.size : 0;
+      if (!per_line || reg.size != last_register_size
+          || (column++ % per_line) == 0)
+        {
+          out << '\n';
+          column = 1;
+        }
+      last_register_size = reg.size;
+
+      out << std::right << std::setfill (' ') << std::setw (16)
+          << (name + ": ");
+
+      const size_t element_size
+          = per_line || !wave.note.lane_count
+                    || reg.size % wave.note.lane_count
+                ? reg.size
+                : reg.size / wave.note.lane_count;
+
+      for (size_t element = 0; element < reg.size / element_size; ++element)
+        {
+          if (element_size != reg.size)
+            out << (element ? " [" : "[") << std::dec << element << "] ";
+
+          for (size_t byte = element_size; byte > 0; --byte)
+            out << std::hex << std::setw (2) << std::setfill ('0')
+                << static_cast<unsigned> (
+                       value[element * element_size + byte - 1]);
+        }
+    }
+
+  out << '\n';
+}
+
+void
+core_file_t::print_local_memory (std::ostream &out, const wave_t &wave) const
+{
+  if (wave.note.lds_segment < 0
+      || static_cast<size_t> (wave.note.lds_segment)
+             >= m_program_headers.size ())
+    return;
+
+  const Elf64_Phdr &phdr = m_program_headers[wave.note.lds_segment];
+  std::vector<uint32_t> buffer (phdr.p_filesz / sizeof (uint32_t));
+  if (buffer.empty ()
+      || !read (buffer.data (), buffer.size () * sizeof (uint32_t),
+                phdr.p_offset))
+    return;
+
+  out << "\nLocal memory content:";
+  for (size_t i = 0; i < buffer.size (); ++i)
+    {
+      if ((i % 8) == 0)
+        out << '\n'
+            << "    0x" << std::hex << std::setfill ('0') << std::setw (4)
+            << (i * sizeof (uint32_t)) << ":";
+
+      out << " " << std::hex << std::setfill ('0') << std::setw (8)
+          << buffer[i];
+    }
+  out << '\n';
+}
+
+void
+core_file_t::print (std::ostream &out) const
+{
+  std::unordered_map<uint64_t, wave_group_t> agent_groups, queue_groups,
+      dispatch_groups;
+  std::map<workgroup_key_t, wave_group_t> workgroup_groups;
+
+  for (auto &&wave : m_waves)
+    {
+      agent_groups[wave.note.agent_id].add (wave.note);
+      queue_groups[wave.note.queue_id].add (wave.note);
+      dispatch_groups[wave.note.dispatch_id].add (wave.note);
+      workgroup_groups[workgroup_key (wave.note)].add (wave.note);
+    }
+
+  const core_wave_note_t *prev_wave{ nullptr };
+  for (auto &&wave : m_waves)
+    {
+      const core_wave_note_t &note = wave.note;
+
+      if (prev_wave)
+        out << '\n';
+
+      const bool new_agent
+          = !prev_wave || prev_wave->agent_id != note.agent_id;
+      const bool new_queue = new_agent || prev_wave->queue_id != note.queue_id;
+      const bool new_dispatch
+          = new_queue || prev_wave->dispatch_id != note.dispatch_id;
+      const bool new_workgroup
+          = new_dispatch || workgroup_key (*prev_wave) != workgroup_key (note);
+
+      if (new_agent)
+        {
+          out << "agent_" << std::dec << note.agent_id;
+          if (auto it = m_agents.find (note.agent_id); it != m_agents.end ())
+            out << " (" << it->second.name << ", " << it->second.architecture
+                << ")";
+          out << ": " << agent_groups.at (note.agent_id) << '\n';
+        }
+
+      if (new_queue)
+        out << "  queue_" << std::dec << note.queue_id << ": "
+            << queue_groups.at (note.queue_id) << '\n';
+
+      if (new_dispatch)
+        {
+          if (note.dispatch_id)
+            out << "    dispatch_" << std::dec << note.dispatch_id;
+          else
+            out << "    unknown dispatch";
+
+          if (auto it = m_dispatches.find (note.dispatch_id);
+              it != m_dispatches.end () && !it->second.kernel_name.empty ())
+            out << " (" << it->second.kernel_name << ")";
+
+          out << ": " << dispatch_groups.at (note.dispatch_id) << '\n';
+        }
+
+      if (new_workgroup && note.dispatch_id)
+        out << "      workgroup (" << std::dec << note.work_group_coord[0]
+            << ", " << note.work_group_coord[1] << ", "
+            << note.work_group_coord[2]
+            << "): " << workgroup_groups.at (workgroup_key (note)) << '\n';
+
+      if (new_agent || new_queue || new_dispatch || new_workgroup)
+        out << '\n';
+
+      out << "--------------------------------------------------------\n";
+      out << "wave_" << std::dec << note.wave_id << ": pc=0x" << std::hex
+          << note.pc << " (" << wave_status_string (note.stop_reason)
+          << ")\n";
+
+      print_registers (out, wave);
+      print_local_memory (out, wave);
+
+      if (auto it = m_pc_texts.find (note.pc); it != m_pc_texts.end ())
+        out << it->second;
+
+      prev_wave = &note;
+    }
+}
+
+void
+print_usage ()
+{
+  std::cerr
+      << "Usage: rocm-debug-agent-symbolize [options] CORE-FILE" << std::endl
+      << std::endl
+      << "Print the wavefronts saved in a GPU core file written with"
+      << std::endl
+      << "--raw-dump, with their kernel names, source lines, and disassembly."
+      << std::endl
+      << std::endl
+      << "  -o, --output=FILE  Write the output to FILE (default stdout)"
+      << std::endl
+      << "  -h, --help         Display a usage message and exit"
+      << std::endl;
+}
+
+} /* namespace */
+
+int
+main (int argc, char **argv)
+{
+  agent_out_options_t output_options;
+  output_options.path_template = "/dev/stdout";
+
+  static const struct option long_options[]
+      = { { "output", required_argument, 0, 'o' },
+          { "help", no_argument, 0, 'h' },
+          { 0, 0, 0, 0 } };
+
+  int c;
+  while ((c = getopt_long (argc, argv, "o:h", long_options, nullptr)) != -1)
+    switch (c)
+      {
+      case 'o':
+        output_options.path_template = optarg;
+        break;
+      case 'h':
+        print_usage ();
+        return EXIT_SUCCESS;
+      default:
+        print_usage ();
+        return EXIT_FAILURE;
+      }
+
+  if (optind + 1 != argc)
+    {
+      print_usage ();
+      return EXIT_FAILURE;
+    }
+
+  if (elf_version (EV_CURRENT) == EV_NONE)
+    {
+      std::cerr << "libelf initialization failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  core_file_t core_file (argv[optind]);
+  if (!core_file.load ())
+    return EXIT_FAILURE;
+
+  open_agent_out (output_options);
+
+  if (amd_dbgapi_initialize (&dbgapi_callbacks) != AMD_DBGAPI_STATUS_SUCCESS)
+    {
+      std::cerr << "error: could not initialize the debugger API" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  core_file.symbolize ();
+  core_file.print (agent_out);
+
+  amd_dbgapi_finalize ();
+  drain_agent_out ();
+
+  return EXIT_SUCCESS;
+}